@@ -3,6 +3,8 @@
 /* flags we export */
 int ceph_arch_intel_sse42 = 0;
 int ceph_arch_intel_sse2 = 0;
+int ceph_arch_intel_ssse3 = 0;
+int ceph_arch_intel_avx2 = 0;
 
 #ifdef __x86_64__
 
@@ -11,30 +13,66 @@ static void do_cpuid(unsigned int *eax, unsigned int *ebx, unsigned int *ecx,
                      unsigned int *edx)
 {
         int id = *eax;
+        int sub = *ecx;
 
         asm("movl %4, %%eax;"
+            "movl %5, %%ecx;"
             "cpuid;"
             "movl %%eax, %0;"
             "movl %%ebx, %1;"
             "movl %%ecx, %2;"
             "movl %%edx, %3;"
                 : "=r" (*eax), "=r" (*ebx), "=r" (*ecx), "=r" (*edx)
-                : "r" (id)
+                : "r" (id), "r" (sub)
                 : "eax", "ebx", "ecx", "edx");
 }
 
+/* extended control register 0: the register state the os saves */
+static unsigned int do_xgetbv0(void)
+{
+        unsigned int eax, edx;
+
+        /* xgetbv, spelled out for assemblers which do not know it */
+        asm(".byte 0x0f, 0x01, 0xd0"
+                : "=a" (eax), "=d" (edx)
+                : "c" (0));
+        return eax;
+}
+
 int ceph_arch_intel_probe(void)
 {
 	/* i know how to check this on x86_64... */
-	unsigned int eax = 1, ebx, ecx, edx;
+	unsigned int max, eax = 0, ebx, ecx = 0, edx;
+	do_cpuid(&eax, &ebx, &ecx, &edx);
+	max = eax;
+
+	eax = 1;
+	ecx = 0;
 	do_cpuid(&eax, &ebx, &ecx, &edx);
 	if ((ecx & (1 << 20)) != 0) {
 		ceph_arch_intel_sse42 = 1;
 	}
+	if ((ecx & (1 << 9)) != 0) {
+		ceph_arch_intel_ssse3 = 1;
+	}
 	if ((edx & (1 << 26)) != 0) {
 	        ceph_arch_intel_sse2 = 1;
 	}
 
+	/*
+	 * avx2 is only usable if the os saves the ymm registers on
+	 * context switch (osxsave, then sse and avx state in xcr0).
+	 */
+	if (max >= 7 && (ecx & (1 << 27)) != 0 &&
+	    (do_xgetbv0() & 0x6) == 0x6) {
+		eax = 7;
+		ecx = 0;
+		do_cpuid(&eax, &ebx, &ecx, &edx);
+		if ((ebx & (1 << 5)) != 0) {
+			ceph_arch_intel_avx2 = 1;
+		}
+	}
+
 	return 0;
 }
 
@@ -365,6 +365,8 @@ int main(int argc, const char **argv)
   boost::scoped_ptr<Throttle> client_msg_throttler(
     new Throttle(g_ceph_context, "osd_client_messages",
 		 g_conf->osd_client_message_cap));
+  client_byte_throttler->set_fair_share(g_conf->osd_client_message_fair_share);
+  client_msg_throttler->set_fair_share(g_conf->osd_client_message_fair_share);
 
   uint64_t supported =
     CEPH_FEATURE_UID | 
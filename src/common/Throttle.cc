@@ -2,11 +2,16 @@
 // vim: ts=8 sw=2 smarttab
 
 #include <errno.h>
+#include <algorithm>
 
 #include "common/Throttle.h"
 #include "common/dout.h"
 #include "common/ceph_context.h"
 #include "common/perf_counters.h"
+#include "common/admin_socket.h"
+#include "common/Formatter.h"
+#include "common/cmdparse.h"
+#include "common/errno.h"
 
 #define dout_subsys ceph_subsys_throttle
 
@@ -29,11 +34,32 @@ enum {
   l_throttle_last,
 };
 
+class ThrottleAdminHook : public AdminSocketHook {
+  CephContext *cct;
+  Throttle *throttle;
+public:
+  ThrottleAdminHook(CephContext *cct, Throttle *t) : cct(cct), throttle(t) {}
+  bool call(std::string command, cmdmap_t& cmdmap, std::string format,
+	    bufferlist& out) {
+    int64_t n = 10;
+    cmd_getval(cct, cmdmap, "count", n);
+    Formatter *f = new_formatter(format);
+    throttle->dump_consumers(f, n > 0 ? n : 0);
+    ostringstream ss;
+    f->flush(ss);
+    out.append(ss.str());
+    delete f;
+    return true;
+  }
+};
+
 Throttle::Throttle(CephContext *cct, std::string n, int64_t m, bool _use_perf)
   : cct(cct), name(n), logger(NULL),
 		max(m),
     lock("Throttle::lock"),
-    use_perf(_use_perf)
+    use_perf(_use_perf),
+    fair(false),
+    asok_hook(NULL)
 {
   assert(m >= 0);
 
@@ -60,11 +86,18 @@ Throttle::Throttle(CephContext *cct, std::string n, int64_t m, bool _use_perf)
 
 Throttle::~Throttle()
 {
+  set_fair_share(false);
+
   while (!cond.empty()) {
     Cond *cv = cond.front();
     delete cv;
     cond.pop_front();
   }
+  while (!over_cond.empty()) {
+    Cond *cv = over_cond.front();
+    delete cv;
+    over_cond.pop_front();
+  }
 
   if (!use_perf)
     return;
@@ -76,20 +109,37 @@ Throttle::~Throttle()
 void Throttle::_reset_max(int64_t m)
 {
   assert(lock.is_locked());
-  if (!cond.empty())
-    cond.front()->SignalOne();
+  _signal_next();
   if (logger)
     logger->set(l_throttle_max, m);
   max.set((size_t)m);
 }
 
-bool Throttle::_wait(int64_t c)
+void Throttle::_signal_next()
+{
+  assert(lock.is_locked());
+  if (!cond.empty())
+    cond.front()->SignalOne();
+  else if (!over_cond.empty())
+    over_cond.front()->SignalOne();
+}
+
+bool Throttle::_wait(int64_t c, Consumer *who)
 {
   utime_t start;
   bool waited = false;
-  if (_should_wait(c) || !cond.empty()) { // always wait behind other waiters.
+  bool over = _over_share(who, c);
+  if (over) {
+    ldout(cct, 10) << "_wait " << who->name << " holds " << who->count
+		   << ", over its share" << dendl;
+    who->over_share++;
+  }
+  list<Cond*>& q = over ? over_cond : cond;
+  if (_should_wait(c) || !cond.empty() || !q.empty()) { // always wait behind other waiters.
     Cond *cv = new Cond;
-    cond.push_back(cv);
+    q.push_back(cv);
+    if (who)
+      who->waiting++;
     do {
       if (!waited) {
 	ldout(cct, 2) << "_wait waiting..." << dendl;
@@ -97,21 +147,24 @@ bool Throttle::_wait(int64_t c)
       }
       waited = true;
       cv->Wait(lock);
-    } while (_should_wait(c) || cv != cond.front());
+    } while (_should_wait(c) || cv != q.front() || (over && !cond.empty()));
 
     if (waited) {
       ldout(cct, 3) << "_wait finished waiting" << dendl;
       utime_t dur = ceph_clock_now(cct) - start;
       if (logger)
         logger->tinc(l_throttle_wait, dur);
+      if (who)
+	who->wait += dur;
     }
 
     delete cv;
-    cond.pop_front();
+    q.pop_front();
+    if (who)
+      who->waiting--;
 
     // wake up the next guy
-    if (!cond.empty())
-      cond.front()->SignalOne();
+    _signal_next();
   }
   return waited;
 }
@@ -127,13 +180,18 @@ bool Throttle::wait(int64_t m)
   return _wait(0);
 }
 
-int64_t Throttle::take(int64_t c)
+int64_t Throttle::take(int64_t c, const void *who)
 {
   assert(c >= 0);
   ldout(cct, 10) << "take " << c << dendl;
   {
     Mutex::Locker l(lock);
     count.add(c);
+    if (fair && who) {
+      map<const void*, Consumer>::iterator p = consumers.find(who);
+      if (p != consumers.end())
+	p->second.count += c;
+    }
   }
   if (logger) {
     logger->inc(l_throttle_take);
@@ -144,6 +202,16 @@ int64_t Throttle::take(int64_t c)
 }
 
 bool Throttle::get(int64_t c, int64_t m)
+{
+  return _get(c, m, NULL, string());
+}
+
+bool Throttle::get(int64_t c, const void *who, const std::string& who_name)
+{
+  return _get(c, 0, who, who_name);
+}
+
+bool Throttle::_get(int64_t c, int64_t m, const void *who, const std::string& who_name)
 {
   assert(c >= 0);
   ldout(cct, 10) << "get " << c << " (" << count.read() << " -> " << (count.read() + c) << ")" << dendl;
@@ -154,8 +222,18 @@ bool Throttle::get(int64_t c, int64_t m)
       assert(m > 0);
       _reset_max(m);
     }
-    waited = _wait(c);
+    Consumer *con = NULL;
+    if (fair && who) {
+      con = &consumers[who];
+      if (con->name != who_name)
+	con->name = who_name;
+      con->get++;
+      con->get_sum += c;
+    }
+    waited = _wait(c, con);
     count.add(c);
+    if (con)
+      con->count += c;
   }
   if (logger) {
     logger->inc(l_throttle_get);
@@ -191,16 +269,17 @@ bool Throttle::get_or_fail(int64_t c)
   }
 }
 
-int64_t Throttle::put(int64_t c)
+int64_t Throttle::put(int64_t c, const void *who)
 {
   assert(c >= 0);
   ldout(cct, 10) << "put " << c << " (" << count.read() << " -> " << (count.read()-c) << ")" << dendl;
   Mutex::Locker l(lock);
   if (c) {
-    if (!cond.empty())
-      cond.front()->SignalOne();
+    _signal_next();
     assert(((int64_t)count.read()) >= c); //if count goes negative, we failed somewhere!
     count.sub(c);
+    if (fair && who)
+      _put_consumer(who, c);
     if (logger) {
       logger->inc(l_throttle_put);
       logger->inc(l_throttle_put_sum, c);
@@ -210,6 +289,99 @@ int64_t Throttle::put(int64_t c)
   return count.read();
 }
 
+void Throttle::_put_consumer(const void *who, int64_t c)
+{
+  map<const void*, Consumer>::iterator p = consumers.find(who);
+  if (p == consumers.end())
+    return;  // got before fair sharing was turned on
+  p->second.count -= MIN(c, p->second.count);
+  if (p->second.count == 0 && p->second.waiting == 0)
+    consumers.erase(p);
+}
+
+void Throttle::set_fair_share(bool on)
+{
+  {
+    Mutex::Locker l(lock);
+    if (on == fair)
+      return;
+    fair = on;
+    if (!on) {
+      // anyone waiting for a share waits in line again
+      consumers.clear();
+      while (!over_cond.empty()) {
+	cond.push_back(over_cond.front());
+	over_cond.pop_front();
+      }
+      _signal_next();
+    }
+  }
+
+  // not under our lock: the admin socket calls dump_consumers() with
+  // its own lock held
+  AdminSocket *admin_socket = cct->get_admin_socket();
+  string command = "dump_throttle_consumers " + name;
+  if (on) {
+    asok_hook = new ThrottleAdminHook(cct, this);
+    int r = admin_socket->register_command(
+      command, command + " name=count,type=CephInt,req=false", asok_hook,
+      "show the consumers holding the most of throttle " + name);
+    if (r < 0) {
+      // another throttle by this name got there first
+      ldout(cct, 10) << "set_fair_share can't register " << command << ": "
+		     << cpp_strerror(r) << dendl;
+      delete asok_hook;
+      asok_hook = NULL;
+    }
+  } else if (asok_hook) {
+    admin_socket->unregister_command(command);
+    delete asok_hook;
+    asok_hook = NULL;
+  }
+}
+
+struct ConsumerHolds {
+  bool operator()(const pair<int64_t, const void*>& a,
+		  const pair<int64_t, const void*>& b) const {
+    return a.first > b.first;
+  }
+};
+
+void Throttle::dump_consumers(Formatter *f, unsigned n)
+{
+  Mutex::Locker l(lock);
+  vector<pair<int64_t, const void*> > held;
+  for (map<const void*, Consumer>::iterator p = consumers.begin();
+       p != consumers.end();
+       ++p)
+    held.push_back(make_pair(p->second.count, p->first));
+  n = MIN(n, held.size());
+  partial_sort(held.begin(), held.begin() + n, held.end(), ConsumerHolds());
+
+  f->open_object_section("throttle");
+  f->dump_string("name", name);
+  f->dump_int("max", max.read());
+  f->dump_int("val", count.read());
+  f->dump_int("consumers", consumers.size());
+  if (!consumers.empty())
+    f->dump_int("share", max.read() / consumers.size());
+  f->open_array_section("top");
+  for (unsigned i = 0; i < n; ++i) {
+    Consumer& c = consumers[held[i].second];
+    f->open_object_section("consumer");
+    f->dump_string("name", c.name);
+    f->dump_int("val", c.count);
+    f->dump_int("waiting", c.waiting);
+    f->dump_unsigned("get", c.get);
+    f->dump_unsigned("get_sum", c.get_sum);
+    f->dump_unsigned("over_share", c.over_share);
+    f->dump_float("wait", (double)c.wait);
+    f->close_section();
+  }
+  f->close_section();
+  f->close_section();
+}
+
 SimpleThrottle::SimpleThrottle(uint64_t max, bool ignore_enoent)
   : m_lock("SimpleThrottle"),
     m_max(max),
@@ -7,10 +7,13 @@
 #include "Mutex.h"
 #include "Cond.h"
 #include <list>
+#include <map>
 #include "include/atomic.h"
 
 class CephContext;
 class PerfCounters;
+namespace ceph { class Formatter; }
+class ThrottleAdminHook;
 
 class Throttle {
   CephContext *cct;
@@ -20,7 +23,30 @@ class Throttle {
   Mutex lock;
   list<Cond*> cond;
   bool use_perf;
-  
+
+  /*
+   * Fair sharing.  Callers that pass a consumer to get() are
+   * accounted separately.  A consumer that already holds some of the
+   * budget and would go over max / (number of consumers holding or
+   * waiting) waits in over_cond, behind every waiter in cond, so a
+   * consumer that has filled the throttle gets no more of it while
+   * others are waiting.  If nobody else wants it, it may still use
+   * the whole budget.
+   */
+  struct Consumer {
+    std::string name;
+    int64_t count;     ///< currently held
+    int waiting;       ///< threads waiting in get()
+    uint64_t get, get_sum, over_share;
+    utime_t wait;      ///< total time spent waiting
+
+    Consumer() : count(0), waiting(0), get(0), get_sum(0), over_share(0) {}
+  };
+  bool fair;
+  std::map<const void*, Consumer> consumers;
+  list<Cond*> over_cond;
+  ThrottleAdminHook *asok_hook;
+
 public:
   Throttle(CephContext *cct, std::string n, int64_t m = 0, bool _use_perf = true);
   ~Throttle();
@@ -35,8 +61,16 @@ private:
       ((c <= m && cur + c > m) || // normally stay under max
        (c >= m && cur > m));     // except for large c
   }
+  bool _over_share(Consumer *who, int64_t c) {
+    int64_t m = max.read();
+    return who && m && who->count > 0 &&
+      who->count + c > m / (int64_t)consumers.size();
+  }
+  void _signal_next();
+  void _put_consumer(const void *who, int64_t c);
 
-  bool _wait(int64_t c);
+  bool _wait(int64_t c, Consumer *who = NULL);
+  bool _get(int64_t c, int64_t m, const void *who, const std::string& who_name);
 
 public:
   int64_t get_current() {
@@ -47,15 +81,31 @@ public:
 
   bool wait(int64_t m = 0);
 
-  int64_t take(int64_t c = 1);
+  int64_t take(int64_t c = 1, const void *who = NULL);
   bool get(int64_t c = 1, int64_t m = 0);
+  /**
+   * get on behalf of a consumer (see set_fair_share())
+   *
+   * @param who opaque key; pass the same one to put() and take()
+   * @param who_name how to show who in dump_consumers()
+   */
+  bool get(int64_t c, const void *who, const std::string& who_name);
 
   /**
    * Returns true if it successfully got the requested amount,
    * or false if it would block.
    */
   bool get_or_fail(int64_t c = 1);
-  int64_t put(int64_t c = 1);
+  int64_t put(int64_t c = 1, const void *who = NULL);
+
+  /**
+   * Share the budget fairly between the consumers passed to get().
+   * This also registers the admin socket command
+   * "dump_throttle_consumers <name>".
+   */
+  void set_fair_share(bool on);
+  /// dump the n consumers holding the most
+  void dump_consumers(ceph::Formatter *f, unsigned n);
 };
 
 
@@ -14,6 +14,7 @@
 #include "common/Formatter.h"
 #include <iostream>
 #include <vector>
+#include <algorithm>
 #include "common/debug.h"
 #include "common/config.h"
 #include "msg/Message.h"
@@ -30,6 +31,7 @@ static ostream& _prefix(std::ostream* _dout)
 
 void OpHistory::on_shutdown()
 {
+  Mutex::Locker history_lock(ops_history_lock);
   arrived.clear();
   duration.clear();
   shutdown = true;
@@ -37,6 +39,7 @@ void OpHistory::on_shutdown()
 
 void OpHistory::insert(utime_t now, TrackedOpRef op)
 {
+  Mutex::Locker history_lock(ops_history_lock);
   if (shutdown)
     return;
   duration.insert(make_pair(op->get_duration(), op));
@@ -65,6 +68,7 @@ void OpHistory::cleanup(utime_t now)
 
 void OpHistory::dump_ops(utime_t now, Formatter *f)
 {
+  Mutex::Locker history_lock(ops_history_lock);
   cleanup(now);
   f->open_object_section("OpHistory");
   f->dump_int("num to keep", history_size);
@@ -84,76 +88,145 @@ void OpHistory::dump_ops(utime_t now, Formatter *f)
   f->close_section();
 }
 
+OpTracker::OpTracker(CephContext *cct_, uint32_t num_shards)
+  : num_optracker_shards(num_shards ? num_shards : 1),
+    complaint_time(0), log_threshold(0), slow_detail_only(false),
+    cct(cct_)
+{
+  for (uint32_t i = 0; i < num_optracker_shards; i++) {
+    char lock_name[32];
+    snprintf(lock_name, sizeof(lock_name), "OpTracker::ShardedLock%u", i);
+    sharded_in_flight_list.push_back(new ShardedTrackingData(lock_name));
+  }
+}
+
+OpTracker::~OpTracker()
+{
+  while (!sharded_in_flight_list.empty()) {
+    assert(sharded_in_flight_list.back()->ops_in_flight_sharded.empty());
+    delete sharded_in_flight_list.back();
+    sharded_in_flight_list.pop_back();
+  }
+}
+
+bool OpTracker::keep_detail(const TrackedOp *op, utime_t now) const
+{
+  return !slow_detail_only || now - op->get_arrived() >= complaint_time;
+}
+
 void OpTracker::dump_historic_ops(Formatter *f)
 {
-  Mutex::Locker locker(ops_in_flight_lock);
   utime_t now = ceph_clock_now(cct);
   history.dump_ops(now, f);
 }
 
 void OpTracker::dump_ops_in_flight(Formatter *f)
 {
-  Mutex::Locker locker(ops_in_flight_lock);
   f->open_object_section("ops_in_flight"); // overall dump
-  f->dump_int("num_ops", ops_in_flight.size());
+  uint64_t total_ops_in_flight = 0;
   f->open_array_section("ops"); // list of TrackedOps
   utime_t now = ceph_clock_now(cct);
-  for (xlist<TrackedOp*>::iterator p = ops_in_flight.begin(); !p.end(); ++p) {
-    f->open_object_section("op");
-    (*p)->dump(now, f);
-    f->close_section(); // this TrackedOp
+  for (uint32_t i = 0; i < num_optracker_shards; i++) {
+    ShardedTrackingData *sdata = sharded_in_flight_list[i];
+    Mutex::Locker locker(sdata->ops_in_flight_lock_sharded);
+    for (xlist<TrackedOp*>::iterator p = sdata->ops_in_flight_sharded.begin();
+	 !p.end(); ++p) {
+      f->open_object_section("op");
+      (*p)->dump(now, f);
+      f->close_section(); // this TrackedOp
+      total_ops_in_flight++;
+    }
   }
   f->close_section(); // list of TrackedOps
+  f->dump_int("num_ops", total_ops_in_flight);
   f->close_section(); // overall dump
 }
 
+int OpTracker::get_num_ops_in_flight()
+{
+  int total = 0;
+  for (uint32_t i = 0; i < num_optracker_shards; i++) {
+    ShardedTrackingData *sdata = sharded_in_flight_list[i];
+    Mutex::Locker locker(sdata->ops_in_flight_lock_sharded);
+    total += sdata->ops_in_flight_sharded.size();
+  }
+  return total;
+}
+
 void OpTracker::register_inflight_op(xlist<TrackedOp*>::item *i)
 {
-  Mutex::Locker locker(ops_in_flight_lock);
-  ops_in_flight.push_back(i);
-  ops_in_flight.back()->seq = seq++;
+  uint64_t current_seq = seq.inc();
+  ShardedTrackingData *sdata = get_shard(current_seq);
+  Mutex::Locker locker(sdata->ops_in_flight_lock_sharded);
+  sdata->ops_in_flight_sharded.push_back(i);
+  sdata->ops_in_flight_sharded.back()->seq = current_seq;
 }
 
 void OpTracker::unregister_inflight_op(TrackedOp *i)
 {
-  Mutex::Locker locker(ops_in_flight_lock);
-  assert(i->xitem.get_list() == &ops_in_flight);
-  utime_t now = ceph_clock_now(cct);
-  i->xitem.remove_myself();
+  ShardedTrackingData *sdata = get_shard(i->seq);
+  {
+    Mutex::Locker locker(sdata->ops_in_flight_lock_sharded);
+    assert(i->xitem.get_list() == &sdata->ops_in_flight_sharded);
+    i->xitem.remove_myself();
+  }
   i->request->clear_data();
-  history.insert(now, TrackedOpRef(i));
+  utime_t now = ceph_clock_now(cct);
+  if (keep_detail(i, now))
+    history.insert(now, TrackedOpRef(i));
+  else
+    delete i;
 }
 
 bool OpTracker::check_ops_in_flight(std::vector<string> &warning_vector)
 {
-  Mutex::Locker locker(ops_in_flight_lock);
-  if (!ops_in_flight.size())
-    return false;
-
   utime_t now = ceph_clock_now(cct);
   utime_t too_old = now;
   too_old -= complaint_time;
 
-  utime_t oldest_secs = now - ops_in_flight.front()->get_arrived();
+  // hold every shard while we look: warn_interval_multiplier is only
+  // touched here, and the ops must not go away under us
+  for (uint32_t i = 0; i < num_optracker_shards; i++)
+    sharded_in_flight_list[i]->ops_in_flight_lock_sharded.Lock();
+
+  // each shard's list is in arrival order; merge their slow heads
+  vector<pair<utime_t, TrackedOp*> > slow_ops;
+  uint64_t total_ops_in_flight = 0;
+  for (uint32_t i = 0; i < num_optracker_shards; i++) {
+    ShardedTrackingData *sdata = sharded_in_flight_list[i];
+    total_ops_in_flight += sdata->ops_in_flight_sharded.size();
+    for (xlist<TrackedOp*>::iterator p = sdata->ops_in_flight_sharded.begin();
+	 !p.end() && (*p)->get_arrived() < too_old;
+	 ++p)
+      slow_ops.push_back(make_pair((*p)->get_arrived(), *p));
+  }
+  sort(slow_ops.begin(), slow_ops.end());
 
-  dout(10) << "ops_in_flight.size: " << ops_in_flight.size()
+  double oldest_secs = slow_ops.empty() ? 0 : (double)(now - slow_ops[0].first);
+  dout(10) << "ops_in_flight.size: " << total_ops_in_flight
+           << "; slow: " << slow_ops.size()
            << "; oldest is " << oldest_secs
            << " seconds old" << dendl;
 
-  if (oldest_secs < complaint_time)
+  if (slow_ops.empty()) {
+    for (uint32_t i = 0; i < num_optracker_shards; i++)
+      sharded_in_flight_list[i]->ops_in_flight_lock_sharded.Unlock();
     return false;
+  }
 
-  xlist<TrackedOp*>::iterator i = ops_in_flight.begin();
   warning_vector.reserve(log_threshold + 1);
 
   int slow = 0;     // total slow
   int warned = 0;   // total logged
-  while (!i.end() && (*i)->get_arrived() < too_old) {
+  for (vector<pair<utime_t, TrackedOp*> >::iterator i = slow_ops.begin();
+       i != slow_ops.end();
+       ++i) {
+    TrackedOp *op = i->second;
     slow++;
 
     // exponential backoff of warning intervals
-    if (((*i)->get_arrived() +
-	 (complaint_time * (*i)->warn_interval_multiplier)) < now) {
+    if ((op->get_arrived() +
+	 (complaint_time * op->warn_interval_multiplier)) < now) {
       // will warn
       if (warning_vector.empty())
 	warning_vector.push_back("");
@@ -161,18 +234,19 @@ bool OpTracker::check_ops_in_flight(std::vector<string> &warning_vector)
       if (warned > log_threshold)
         break;
 
-      utime_t age = now - (*i)->get_arrived();
+      utime_t age = now - op->get_arrived();
       stringstream ss;
-      ss << "slow request " << age << " seconds old, received at " << (*i)->get_arrived()
-	 << ": " << *((*i)->request) << " currently "
-	 << ((*i)->current.size() ? (*i)->current : (*i)->state_string());
+      ss << "slow request " << age << " seconds old, received at " << op->get_arrived()
+	 << ": " << *(op->request) << " currently "
+	 << (op->current.size() ? op->current : op->state_string());
       warning_vector.push_back(ss.str());
 
       // only those that have been shown will backoff
-      (*i)->warn_interval_multiplier *= 2;
+      op->warn_interval_multiplier *= 2;
     }
-    ++i;
   }
+  for (uint32_t i = 0; i < num_optracker_shards; i++)
+    sharded_in_flight_list[i]->ops_in_flight_lock_sharded.Unlock();
 
   // only summarize if we warn about any.  if everything has backed
   // off, we will stay silent.
@@ -188,43 +262,25 @@ bool OpTracker::check_ops_in_flight(std::vector<string> &warning_vector)
 
 void OpTracker::get_age_ms_histogram(pow2_hist_t *h)
 {
-  Mutex::Locker locker(ops_in_flight_lock);
-
   h->clear();
 
   utime_t now = ceph_clock_now(NULL);
-  unsigned bin = 30;
-  uint32_t lb = 1 << (bin-1);  // lower bound for this bin
-  int count = 0;
-  for (xlist<TrackedOp*>::iterator i = ops_in_flight.begin(); !i.end(); ++i) {
-    utime_t age = now - (*i)->get_arrived();
-    uint32_t ms = (long)(age * 1000.0);
-    if (ms >= lb) {
-      count++;
-      continue;
+  for (uint32_t i = 0; i < num_optracker_shards; i++) {
+    ShardedTrackingData *sdata = sharded_in_flight_list[i];
+    Mutex::Locker locker(sdata->ops_in_flight_lock_sharded);
+    for (xlist<TrackedOp*>::iterator p = sdata->ops_in_flight_sharded.begin();
+	 !p.end(); ++p) {
+      utime_t age = now - (*p)->get_arrived();
+      uint32_t ms = (long)(age * 1000.0);
+      if (ms >= (1u << 29))
+	ms = (1u << 29);  // everything older lands in the top bin
+      h->add((int32_t)ms);
     }
-    if (count)
-      h->set(bin, count);
-    while (lb > ms) {
-      bin--;
-      lb >>= 1;
-    }
-    count = 1;
   }
-  if (count)
-    h->set(bin, count);
-}
-
-void OpTracker::mark_event(TrackedOp *op, const string &dest)
-{
-  utime_t now = ceph_clock_now(cct);
-  return _mark_event(op, dest, now);
 }
 
-void OpTracker::_mark_event(TrackedOp *op, const string &evt,
-			    utime_t time)
+void OpTracker::mark_event(TrackedOp *op, const char *evt, utime_t time)
 {
-  Mutex::Locker locker(ops_in_flight_lock);
   dout(5) << //"reqid: " << op->get_reqid() <<
 	     ", seq: " << op->seq
 	  << ", time: " << time << ", event: " << evt
@@ -232,22 +288,122 @@ void OpTracker::_mark_event(TrackedOp *op, const string &evt,
 }
 
 void OpTracker::RemoveOnDelete::operator()(TrackedOp *op) {
-  op->mark_event("done");
+  op->mark_event(TrackedOp::EVENT_DONE);
   tracker->unregister_inflight_op(op);
   // Do not delete op, unregister_inflight_op took control
 }
 
+const char *TrackedOp::get_event_name(event_t e)
+{
+  switch (e) {
+  case EVENT_NONE: return "none";
+  case EVENT_HEADER_READ: return "header_read";
+  case EVENT_THROTTLED: return "throttled";
+  case EVENT_ALL_READ: return "all_read";
+  case EVENT_DISPATCHED: return "dispatched";
+  case EVENT_FAST_DISPATCH: return "fast_dispatch";
+  case EVENT_WAITING_FOR_OSDMAP: return "waiting_for_osdmap";
+  case EVENT_QUEUED_FOR_PG: return "queued_for_pg";
+  case EVENT_REACHED_PG: return "reached_pg";
+  case EVENT_STARTED: return "started";
+  case EVENT_COMMIT_QUEUED_FOR_JOURNAL_WRITE: return "commit_queued_for_journal_write";
+  case EVENT_WRITE_THREAD_IN_JOURNAL_BUFFER: return "write_thread_in_journal_buffer";
+  case EVENT_JOURNALED_COMPLETION_QUEUED: return "journaled_completion_queued";
+  case EVENT_OP_COMMIT: return "op_commit";
+  case EVENT_OP_APPLIED: return "op_applied";
+  case EVENT_SUB_OP_COMMIT_REC: return "sub_op_commit_rec";
+  case EVENT_SUB_OP_APPLIED_REC: return "sub_op_applied_rec";
+  case EVENT_SUB_OP_APPLIED: return "sub_op_applied";
+  case EVENT_COMMITTED: return "committed";
+  case EVENT_COMMIT_SENT: return "commit_sent";
+  case EVENT_DONE: return "done";
+  default: return "???";
+  }
+}
+
+void TrackedOp::stamp_event(event_t e, utime_t now)
+{
+  if (now == utime_t())
+    return;  // a stage the message skipped, e.g. no throttler
+  unsigned slot = num_stamps.inc() - 1;
+  if (slot < MAX_STAMPS) {
+    stamps[slot].stamp = now;
+    stamps[slot].event.set(e);
+  }
+}
+
+void TrackedOp::mark_event(event_t event)
+{
+  utime_t now = ceph_clock_now(g_ceph_context);
+  stamp_event(event, now);
+  tracker->mark_event(this, get_event_name(event), now);
+  _event_marked();
+}
+
 void TrackedOp::mark_event(const string &event)
 {
   utime_t now = ceph_clock_now(g_ceph_context);
-  {
+  if (tracker->keep_detail(this, now)) {
     Mutex::Locker l(lock);
     events.push_back(make_pair(now, event));
   }
-  tracker->mark_event(this, event);
+  tracker->mark_event(this, event.c_str(), now);
   _event_marked();
 }
 
+TrackedOp::event_t TrackedOp::get_last_stamp(utime_t *when) const
+{
+  event_t last = EVENT_NONE;
+  unsigned n = num_stamps.read();
+  if (n > MAX_STAMPS)
+    n = MAX_STAMPS;
+  for (unsigned i = 0; i < n; ++i) {
+    event_t e = (event_t)stamps[i].event.read();
+    if (e != EVENT_NONE &&
+	(last == EVENT_NONE || stamps[i].stamp >= *when)) {
+      last = e;
+      *when = stamps[i].stamp;
+    }
+  }
+  return last;
+}
+
+void TrackedOp::get_events(list<pair<utime_t, string> > *out) const
+{
+  unsigned n = num_stamps.read();
+  if (n > MAX_STAMPS)
+    n = MAX_STAMPS;
+  for (unsigned i = 0; i < n; ++i) {
+    event_t e = (event_t)stamps[i].event.read();
+    if (e != EVENT_NONE)
+      out->push_back(make_pair(stamps[i].stamp, string(get_event_name(e))));
+  }
+  {
+    Mutex::Locker l(lock);
+    out->insert(out->end(), events.begin(), events.end());
+  }
+  out->sort();
+}
+
+double TrackedOp::get_duration() const
+{
+  utime_t last;
+  if (get_last_stamp(&last) == EVENT_NONE)
+    last = get_arrived();
+  {
+    Mutex::Locker l(lock);
+    if (!events.empty() && events.rbegin()->first > last)
+      last = events.rbegin()->first;
+  }
+  return last - get_arrived();
+}
+
+const char *TrackedOp::state_string() const
+{
+  utime_t when;
+  return get_event_name(get_last_stamp(&when));
+}
+
 void TrackedOp::dump(utime_t now, Formatter *f) const
 {
   Message *m = request;
@@ -19,6 +19,7 @@
 #include "common/Mutex.h"
 #include "include/histogram.h"
 #include "include/xlist.h"
+#include "include/atomic.h"
 #include "msg/Message.h"
 #include <tr1/memory>
 
@@ -29,13 +30,14 @@ class OpTracker;
 class OpHistory {
   set<pair<utime_t, TrackedOpRef> > arrived;
   set<pair<double, TrackedOpRef> > duration;
+  Mutex ops_history_lock;
   void cleanup(utime_t now);
   bool shutdown;
   uint32_t history_size;
   uint32_t history_duration;
 
 public:
-  OpHistory() : shutdown(false),
+  OpHistory() : ops_history_lock("OpHistory::Lock"), shutdown(false),
   history_size(0), history_duration(0) {}
   ~OpHistory() {
     assert(arrived.empty());
@@ -59,17 +61,36 @@ class OpTracker {
   };
   friend class RemoveOnDelete;
   friend class OpHistory;
-  uint64_t seq;
-  Mutex ops_in_flight_lock;
-  xlist<TrackedOp *> ops_in_flight;
+  friend class TrackedOp;
+
+  /**
+   * the ops in flight are spread over shards by their seq, each with
+   * its own lock, so that registering and unregistering ops from many
+   * threads does not serialize on a single mutex.  each shard's list
+   * is in arrival order; walkers merge them.
+   */
+  struct ShardedTrackingData {
+    Mutex ops_in_flight_lock_sharded;
+    xlist<TrackedOp *> ops_in_flight_sharded;
+    ShardedTrackingData(string lock_name)
+      : ops_in_flight_lock_sharded(lock_name.c_str()) {}
+  };
+  vector<ShardedTrackingData*> sharded_in_flight_list;
+  uint32_t num_optracker_shards;
+  atomic_t seq;
   OpHistory history;
   float complaint_time;
   int log_threshold;
+  /// keep string events and history only for ops older than complaint_time
+  bool slow_detail_only;
+
+  ShardedTrackingData *get_shard(uint64_t seq) {
+    return sharded_in_flight_list[seq % num_optracker_shards];
+  }
 
 public:
   CephContext *cct;
-  OpTracker(CephContext *cct_) : seq(0), ops_in_flight_lock("OpTracker mutex"),
-      complaint_time(0), log_threshold(0), cct(cct_) {}
+  OpTracker(CephContext *cct_, uint32_t num_shards = 1);
   void set_complaint_and_threshold(float time, int threshold) {
     complaint_time = time;
     log_threshold = threshold;
@@ -77,8 +98,14 @@ public:
   void set_history_size_and_duration(uint32_t new_size, uint32_t new_duration) {
     history.set_size_and_duration(new_size, new_duration);
   }
+  void set_slow_detail_only(bool v) {
+    slow_detail_only = v;
+  }
+  /// true if op should keep the detail (string events) of what it goes through
+  bool keep_detail(const TrackedOp *op, utime_t now) const;
   void dump_ops_in_flight(Formatter *f);
   void dump_historic_ops(Formatter *f);
+  int get_num_ops_in_flight();
   void register_inflight_op(xlist<TrackedOp*>::item *i);
   void unregister_inflight_op(TrackedOp *i);
 
@@ -93,16 +120,12 @@ public:
    * @return True if there are any Ops to warn on, false otherwise.
    */
   bool check_ops_in_flight(std::vector<string> &warning_strings);
-  void mark_event(TrackedOp *op, const string &evt);
-  void _mark_event(TrackedOp *op, const string &evt, utime_t now);
+  void mark_event(TrackedOp *op, const char *evt, utime_t now);
 
   void on_shutdown() {
-    Mutex::Locker l(ops_in_flight_lock);
     history.on_shutdown();
   }
-  ~OpTracker() {
-    assert(ops_in_flight.empty());
-  }
+  ~OpTracker();
 
   template <typename T>
   typename T::Ref create_request(Message *ref)
@@ -110,10 +133,10 @@ public:
     typename T::Ref retval(new T(ref, this),
 			   RemoveOnDelete(this));
     
-    _mark_event(retval.get(), "header_read", ref->get_recv_stamp());
-    _mark_event(retval.get(), "throttled", ref->get_throttle_stamp());
-    _mark_event(retval.get(), "all_read", ref->get_recv_complete_stamp());
-    _mark_event(retval.get(), "dispatched", ref->get_dispatch_stamp());
+    retval->stamp_event(T::EVENT_HEADER_READ, ref->get_recv_stamp());
+    retval->stamp_event(T::EVENT_THROTTLED, ref->get_throttle_stamp());
+    retval->stamp_event(T::EVENT_ALL_READ, ref->get_recv_complete_stamp());
+    retval->stamp_event(T::EVENT_DISPATCHED, ref->get_dispatch_stamp());
     
     retval->init_from_message();
     
@@ -122,16 +145,60 @@ public:
 };
 
 class TrackedOp {
+public:
+  /**
+   * the fixed events ops go through.  they are stamped into a
+   * preallocated array without taking any lock; free form events
+   * (mark_event(const string&)) still go to a list under the op lock,
+   * and may be limited to slow ops (see OpTracker::keep_detail()).
+   */
+  enum event_t {
+    EVENT_NONE = 0,
+    EVENT_HEADER_READ,
+    EVENT_THROTTLED,
+    EVENT_ALL_READ,
+    EVENT_DISPATCHED,
+    EVENT_FAST_DISPATCH,
+    EVENT_WAITING_FOR_OSDMAP,
+    EVENT_QUEUED_FOR_PG,
+    EVENT_REACHED_PG,
+    EVENT_STARTED,
+    EVENT_COMMIT_QUEUED_FOR_JOURNAL_WRITE,
+    EVENT_WRITE_THREAD_IN_JOURNAL_BUFFER,
+    EVENT_JOURNALED_COMPLETION_QUEUED,
+    EVENT_OP_COMMIT,
+    EVENT_OP_APPLIED,
+    EVENT_SUB_OP_COMMIT_REC,
+    EVENT_SUB_OP_APPLIED_REC,
+    EVENT_SUB_OP_APPLIED,
+    EVENT_COMMITTED,
+    EVENT_COMMIT_SENT,
+    EVENT_DONE,
+    EVENT_MAX
+  };
+  static const char *get_event_name(event_t e);
+
+  /// room for this many fixed events per op; any more are counted only
+  static const unsigned MAX_STAMPS = 24;
+
 private:
   friend class OpHistory;
   friend class OpTracker;
   xlist<TrackedOp*>::item xitem;
+
+  struct event_stamp_t {
+    utime_t stamp;
+    atomic_t event;  ///< set last; EVENT_NONE while the slot is being filled
+  };
+  event_stamp_t stamps[MAX_STAMPS];
+  atomic_t num_stamps;  ///< slots taken, may exceed MAX_STAMPS
+
 protected:
   Message *request; /// the logical request we are tracking
   OpTracker *tracker; /// the tracker we are associated with
 
   list<pair<utime_t, string> > events; /// list of events and their times
-  Mutex lock; /// to protect the events list
+  mutable Mutex lock; /// to protect the events list
   string current; /// the current state the event is in
   uint64_t seq; /// a unique value set by the OpTracker
 
@@ -154,24 +221,26 @@ protected:
   /// if you want something else to happen when events are marked, implement
   virtual void _event_marked() {}
 
+  /// record e at time now
+  void stamp_event(event_t e, utime_t now);
+  /// all the events so far, fixed and free form, in time order
+  void get_events(list<pair<utime_t, string> > *out) const;
+  /// the last fixed event and its time, EVENT_NONE if none yet
+  event_t get_last_stamp(utime_t *when) const;
+
 public:
   virtual ~TrackedOp() { assert(request); request->put(); }
 
   utime_t get_arrived() const {
     return request->get_recv_stamp();
   }
-  // This function maybe needs some work; assumes last event is completion time
-  double get_duration() const {
-    return events.size() ?
-      (events.rbegin()->first - get_arrived()) :
-      0.0;
-  }
+  /// time from arrival to the last event (completion, once done)
+  double get_duration() const;
   Message *get_req() const { return request; }
 
+  void mark_event(event_t event);
   void mark_event(const string &event);
-  virtual const char *state_string() const {
-    return events.rbegin()->second.c_str();
-  }
+  virtual const char *state_string() const;
   void dump(utime_t now, Formatter *f) const;
 };
 
@@ -252,6 +252,208 @@ static uint32_t simple_spinlock_t buffer_debug_lock = SIMPLE_SPINLOCK_INITIALIZE
   };
 #endif
 
+  /*
+   * Pool of page-aligned buffers, in power-of-two classes of pages.
+   *
+   * A freed buffer is kept while the free buffers of the pool, thread
+   * caches included, stay under max_bytes, else it goes back to the
+   * allocator.  It is kept in the freeing thread's cache if that thread
+   * allocates from the pool too and its cache has room for the class,
+   * else on the class' shared free list.  Allocation looks in the same
+   * places in the same order.  Message buffers are typically allocated
+   * by a reader thread and freed by a worker, so the shared lists are
+   * what carry buffers between the two; the thread caches absorb the
+   * churn of buffers that are allocated and freed on one thread
+   * (encoding, the journal).
+   */
+  class buffer_pool_t;
+  static buffer_pool_t& get_buffer_pool();
+
+  class buffer_pool_t {
+  public:
+    static const unsigned NUM_CLASSES = 11;  // 1 page .. 1024 pages
+
+  private:
+    struct pool_class_t {
+      Spinlock lock;
+      std::vector<char*> free;
+      atomic_t in_use, cached, hits, misses;
+    } classes[NUM_CLASSES];
+
+    atomic_t max_bytes, thread_bytes;
+    atomic_t cached_bytes;  // free bytes, shared lists and thread caches
+
+    struct thread_cache_t {
+      std::vector<char*> free[NUM_CLASSES];
+      bool allocates;  ///< the thread allocates from the pool
+      thread_cache_t() : allocates(false) {}
+    };
+    pthread_key_t cache_key;
+
+    static void put_thread_cache(void *p) {
+      thread_cache_t *tc = static_cast<thread_cache_t*>(p);
+      buffer_pool_t &pool = get_buffer_pool();
+      for (unsigned i = 0; i < NUM_CLASSES; ++i)
+	for (unsigned j = 0; j < tc->free[i].size(); ++j)
+	  pool.put_shared(i, tc->free[i][j]);
+      delete tc;
+    }
+
+    thread_cache_t *get_thread_cache() {
+      thread_cache_t *tc =
+	static_cast<thread_cache_t*>(pthread_getspecific(cache_key));
+      if (!tc) {
+	tc = new thread_cache_t;
+	pthread_setspecific(cache_key, tc);
+      }
+      return tc;
+    }
+
+    /// how many free buffers of class cls one thread may keep
+    unsigned thread_limit(unsigned cls) const {
+      return thread_bytes.read() / NUM_CLASSES / get_size(cls);
+    }
+
+    /// p is already counted in cached_bytes
+    void put_shared(unsigned cls, char *p) {
+      pool_class_t &c = classes[cls];
+      Spinlock::Locker l(c.lock);
+      c.free.push_back(p);
+    }
+
+  public:
+    buffer_pool_t() : max_bytes(64 << 20), thread_bytes(1 << 20) {
+      pthread_key_create(&cache_key, put_thread_cache);
+    }
+
+    static unsigned get_size(unsigned cls) {
+      return CEPH_PAGE_SIZE << cls;
+    }
+
+    /// class for a buffer of len bytes, or -1 if we don't pool it
+    int get_class(unsigned len) const {
+      if (!len || !max_bytes.read())
+	return -1;
+      for (unsigned cls = 0; cls < NUM_CLASSES; ++cls)
+	if (len <= get_size(cls))
+	  return cls;
+      return -1;
+    }
+
+    char *alloc(unsigned cls) {
+      pool_class_t &c = classes[cls];
+      char *p = NULL;
+      thread_cache_t *tc = get_thread_cache();
+      tc->allocates = true;
+      if (!tc->free[cls].empty()) {
+	p = tc->free[cls].back();
+	tc->free[cls].pop_back();
+      } else {
+	Spinlock::Locker l(c.lock);
+	if (!c.free.empty()) {
+	  p = c.free.back();
+	  c.free.pop_back();
+	}
+      }
+      if (p) {
+	cached_bytes.sub(get_size(cls));
+	c.cached.dec();
+	c.hits.inc();
+      } else {
+	int r = ::posix_memalign((void**)(void*)&p, CEPH_PAGE_SIZE,
+				 get_size(cls));
+	if (r || !p)
+	  throw buffer::bad_alloc();
+	c.misses.inc();
+      }
+      c.in_use.inc();
+      return p;
+    }
+
+    void free(unsigned cls, char *p) {
+      pool_class_t &c = classes[cls];
+      c.in_use.dec();
+      unsigned size = get_size(cls);
+      if (cached_bytes.read() + size > max_bytes.read()) {
+	::free(p);
+	return;
+      }
+      cached_bytes.add(size);
+      c.cached.inc();
+      // a thread which only frees would keep buffers nobody else can use
+      thread_cache_t *tc = get_thread_cache();
+      if (tc->allocates && tc->free[cls].size() < thread_limit(cls)) {
+	tc->free[cls].push_back(p);
+	return;
+      }
+      put_shared(cls, p);
+    }
+
+    void set_limits(uint64_t max, uint64_t thread) {
+      max_bytes.set(max);
+      thread_bytes.set(thread);
+      // trim the shared lists; the thread caches are drained as their
+      // threads allocate or exit
+      for (unsigned cls = 0; cls < NUM_CLASSES; ++cls) {
+	pool_class_t &c = classes[cls];
+	Spinlock::Locker l(c.lock);
+	while (!c.free.empty() && cached_bytes.read() > max) {
+	  ::free(c.free.back());
+	  c.free.pop_back();
+	  c.cached.dec();
+	  cached_bytes.sub(get_size(cls));
+	}
+      }
+    }
+
+    void get_stat(unsigned cls, buffer::pool_stat_t *s) {
+      pool_class_t &c = classes[cls];
+      s->size = get_size(cls);
+      s->in_use = c.in_use.read();
+      s->cached = c.cached.read();
+      s->hits = c.hits.read();
+      s->misses = c.misses.read();
+    }
+  };
+
+  // never destroyed: buffers may be freed by static destructors
+  static buffer_pool_t& get_buffer_pool() {
+    static buffer_pool_t *pool = new buffer_pool_t;
+    return *pool;
+  }
+
+  unsigned buffer::get_pool_classes() {
+    return buffer_pool_t::NUM_CLASSES;
+  }
+  unsigned buffer::get_pool_max_size() {
+    return buffer_pool_t::get_size(buffer_pool_t::NUM_CLASSES - 1);
+  }
+  void buffer::get_pool_stat(unsigned cls, pool_stat_t *s) {
+    assert(cls < buffer_pool_t::NUM_CLASSES);
+    get_buffer_pool().get_stat(cls, s);
+  }
+  void buffer::set_pool_limits(uint64_t max_bytes, uint64_t thread_bytes) {
+    get_buffer_pool().set_limits(max_bytes, thread_bytes);
+  }
+
+  class buffer::raw_pooled : public buffer::raw {
+    unsigned cls;
+  public:
+    raw_pooled(unsigned l, unsigned c) : raw(l), cls(c) {
+      data = get_buffer_pool().alloc(cls);
+      inc_total_alloc(len);
+      bdout << "raw_pooled " << this << " alloc " << (void *)data << " " << l << " " << buffer::get_total_alloc() << bendl;
+    }
+    ~raw_pooled() {
+      get_buffer_pool().free(cls, data);
+      dec_total_alloc(len);
+      bdout << "raw_pooled " << this << " free " << (void *)data << " " << buffer::get_total_alloc() << bendl;
+    }
+    raw* clone_empty() {
+      return new raw_pooled(len, cls);
+    }
+  };
+
 #ifdef __CYGWIN__
   class buffer::raw_hack_aligned : public buffer::raw {
     char *realdata;
@@ -519,6 +721,9 @@ static uint32_t simple_spinlock_t buffer_debug_lock = SIMPLE_SPINLOCK_INITIALIZE
   buffer::raw* buffer::create_page_aligned(unsigned len) {
 #ifndef __CYGWIN__
     //return new raw_mmap_pages(len);
+    int cls = get_buffer_pool().get_class(len);
+    if (cls >= 0)
+      return new raw_pooled(len, cls);
     return new raw_posix_aligned(len);
 #else
     return new raw_hack_aligned(len);
@@ -1273,6 +1478,41 @@ void buffer::list::rebuild_page_aligned()
       _buffers.push_back(*p);
   }
 
+  buffer::list::contiguous_appender::contiguous_appender(list& bl,
+							  unsigned len)
+    : pbl(&bl)
+  {
+    if (pbl->append_buffer.unused_tail_length() < len) {
+      unsigned alen = CEPH_PAGE_SIZE * (((len-1) / CEPH_PAGE_SIZE) + 1);
+      pbl->append_buffer = create_page_aligned(alen);
+      pbl->append_buffer.set_length(0);   // unused, so far.
+    }
+    start = pos = pbl->append_buffer.c_str() + pbl->append_buffer.length();
+    limit = start + len;
+  }
+
+  void buffer::list::contiguous_appender::append(const list& bl)
+  {
+    assert(pos + bl.length() <= limit);
+    for (std::list<ptr>::const_iterator p = bl.buffers().begin();
+	 p != bl.buffers().end();
+	 ++p) {
+      memcpy(pos, p->c_str(), p->length());
+      pos += p->length();
+    }
+  }
+
+  void buffer::list::contiguous_appender::flush()
+  {
+    unsigned used = pos - start;
+    if (!used)
+      return;
+    ptr& ab = pbl->append_buffer;
+    ab.set_length(ab.length() + used);
+    pbl->append(ab, ab.length() - used, used);
+    start = pos;
+  }
+
   void buffer::list::append(std::istream& in)
   {
     while (!in.eof()) {
@@ -1670,7 +1910,7 @@ __u32 buffer::list::crc32c(__u32 crc) const
 	   * http://crcutil.googlecode.com/files/crc-doc.1.0.pdf
 	   * note, u for our crc32c implementation is 0
 	   */
-	  crc = ccrc.second ^ ceph_crc32c(ccrc.first ^ crc, NULL, it->length());
+	  crc = ccrc.second ^ ceph_crc32c_zeros(ccrc.first ^ crc, it->length());
 	  if (buffer_track_crc)
 	    buffer_cached_crc_adjusted.inc();
 	}
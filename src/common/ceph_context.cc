@@ -153,6 +153,31 @@ public:
 };
 
 
+/**
+ * observe buffer pool config changes
+ *
+ * Like the log, ceph::buffer sits below the config subsystem; the
+ * pool limits are process-wide.
+ */
+class BufferPoolObs : public md_config_obs_t {
+public:
+  const char** get_tracked_conf_keys() const {
+    static const char *KEYS[] = {
+      "buffer_pool_max_bytes",
+      "buffer_pool_thread_cache_bytes",
+      NULL
+    };
+    return KEYS;
+  }
+
+  void handle_conf_change(const md_config_t *conf,
+                          const std::set <std::string> &changed) {
+    buffer::set_pool_limits(conf->buffer_pool_max_bytes,
+			    conf->buffer_pool_thread_cache_bytes);
+  }
+};
+
+
 // perfcounter hooks
 
 class CephContextHook : public AdminSocketHook {
@@ -255,6 +280,7 @@ CephContext::CephContext(uint32_t module_type_)
     _module_type(module_type_),
     _service_thread(NULL),
     _log_obs(NULL),
+    _buffer_pool_obs(NULL),
     _admin_socket(NULL),
     _perf_counters_collection(NULL),
     _perf_counters_conf_obs(NULL),
@@ -270,6 +296,9 @@ CephContext::CephContext(uint32_t module_type_)
   _log_obs = new LogObs(_log);
   _conf->add_observer(_log_obs);
 
+  _buffer_pool_obs = new BufferPoolObs;
+  _conf->add_observer(_buffer_pool_obs);
+
   _perf_counters_collection = new PerfCountersCollection(this);
   _admin_socket = new AdminSocket(this);
   _heartbeat_map = new HeartbeatMap(this);
@@ -327,6 +356,10 @@ CephContext::~CephContext()
   delete _log_obs;
   _log_obs = NULL;
 
+  _conf->remove_observer(_buffer_pool_obs);
+  delete _buffer_pool_obs;
+  _buffer_pool_obs = NULL;
+
   _log->stop();
   delete _log;
   _log = NULL;
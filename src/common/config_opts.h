@@ -102,9 +102,16 @@ OPTION(heartbeat_interval, OPT_INT, 5)
 OPTION(heartbeat_file, OPT_STR, "")
 OPTION(heartbeat_inject_failure, OPT_INT, 0)    // force an unhealthy heartbeat for N seconds
 OPTION(perf, OPT_BOOL, true)       // enable internal perf counters
+OPTION(buffer_pool_max_bytes, OPT_U64, 64 << 20)  // free page-aligned buffers kept for reuse (0 = no pool)
+OPTION(buffer_pool_thread_cache_bytes, OPT_U64, 1 << 20)  // of which each allocating thread may keep this much to itself
 
 OPTION(ms_tcp_nodelay, OPT_BOOL, true)
 OPTION(ms_tcp_rcvbuf, OPT_INT, 0)
+OPTION(ms_tcp_coalesce_bytes, OPT_U32, 512)     // copy payload segments smaller than this into one iovec
+OPTION(ms_tcp_batch_bytes, OPT_U64, 256 << 10)  // max bytes of queued messages to gather into one sendmsg
+OPTION(ms_tcp_prefetch_max_size, OPT_INT, 4096) // read ahead up to this much for reads smaller than it; 0 disables
+OPTION(ms_tcp_frag_bytes, OPT_U32, 64 << 10)  // send message data in fragments of this size so higher priority messages can cut in; 0 disables
+OPTION(ms_unix_socket_dir, OPT_STR, "")  // if set, also listen on a unix socket here and use it for same-host peers
 OPTION(ms_initial_backoff, OPT_DOUBLE, .2)
 OPTION(ms_max_backoff, OPT_DOUBLE, 15.0)
 OPTION(ms_nocrc, OPT_BOOL, false)
@@ -112,11 +119,13 @@ OPTION(ms_die_on_bad_msg, OPT_BOOL, false)
 OPTION(ms_die_on_unhandled_msg, OPT_BOOL, false)
 OPTION(ms_die_on_old_message, OPT_BOOL, false)     // assert if we get a dup incoming message and shouldn't have (may be triggered by pre-541cd3c64be0dfa04e8a2df39422e0eb9541a428 code)
 OPTION(ms_dispatch_throttle_bytes, OPT_U64, 100 << 20)
+OPTION(ms_dispatch_throttle_fair_share, OPT_BOOL, true)  // share the dispatch throttle fairly between connections
 OPTION(ms_bind_ipv6, OPT_BOOL, false)
 OPTION(ms_bind_port_min, OPT_INT, 6800)
 OPTION(ms_bind_port_max, OPT_INT, 7300)
 OPTION(ms_rwthread_stack_bytes, OPT_U64, 1024 << 10)
 OPTION(ms_tcp_read_timeout, OPT_U64, 900)
+OPTION(ms_tcp_connect_timeout, OPT_U64, 10)  // give up on a connect after this many seconds; 0 waits for the kernel
 OPTION(ms_pq_max_tokens_per_priority, OPT_U64, 4194304)
 OPTION(ms_pq_min_cost, OPT_U64, 65536)
 OPTION(ms_inject_socket_failures, OPT_U64, 0)
@@ -390,6 +399,7 @@ OPTION(osd_max_write_size, OPT_INT, 90)
 OPTION(osd_max_pgls, OPT_U64, 1024) // max number of pgls entries to return
 OPTION(osd_client_message_size_cap, OPT_U64, 500*1024L*1024L) // client data allowed in-memory (in bytes)
 OPTION(osd_client_message_cap, OPT_U64, 100)              // num client messages allowed in-memory
+OPTION(osd_client_message_fair_share, OPT_BOOL, true)     // share the two caps above fairly between client connections
 OPTION(osd_pg_bits, OPT_INT, 6)  // bits per osd
 OPTION(osd_pgp_bits, OPT_INT, 6)  // bits per osd
 OPTION(osd_crush_chooseleaf_type, OPT_INT, 1) // 1 = host
@@ -409,18 +419,48 @@ OPTION(osd_pool_default_erasure_code_properties,
        "erasure-code-k=4 "
        "erasure-code-m=2 "
        ) // default properties of osd pool create
+OPTION(osd_pool_erasure_code_stripe_width, OPT_U32, 4096) // default for the erasure-code-stripe-width=XXX property of osd pool create
 OPTION(osd_pool_default_flags, OPT_INT, 0)   // default flags for new pools
 OPTION(osd_pool_default_flag_hashpspool, OPT_BOOL, true)   // use new pg hashing to prevent pool/pg overlap
 OPTION(osd_hit_set_min_size, OPT_INT, 1000)  // min target size for a HitSet
 OPTION(osd_hit_set_namespace, OPT_STR, ".ceph-internal") // rados namespace for hit_set tracking
+
+OPTION(osd_agent_max_ops, OPT_INT, 4)  // max concurrent tiering agent flushes per osd
+OPTION(osd_agent_max_low_ops, OPT_INT, 1)  // ... while the osd is busy with client ops
+OPTION(osd_agent_busy_ops, OPT_INT, 16)  // ops in flight at which the osd counts as busy
+OPTION(osd_agent_min_evict_effort, OPT_FLOAT, .1)
+OPTION(osd_agent_quantize_effort, OPT_FLOAT, .1)
+OPTION(osd_agent_delay_time, OPT_FLOAT, 5.0)  // seconds to wait after a pass found nothing to do
+OPTION(osd_agent_hist_halflife, OPT_INT, 1000)  // agent work rounds between temperature histogram decays
 OPTION(osd_map_dedup, OPT_BOOL, true)
 OPTION(osd_map_cache_size, OPT_INT, 500)
 OPTION(osd_map_message_max, OPT_INT, 100)  // max maps per MOSDMap message
 OPTION(osd_map_share_max_epochs, OPT_INT, 100)  // cap on # of inc maps we send to peers, clients
 OPTION(osd_op_threads, OPT_INT, 2)    // 0 == no threading
+OPTION(osd_fast_dispatch, OPT_BOOL, true)  // route client and replica ops from the messenger reader threads
 OPTION(osd_peering_wq_batch_size, OPT_U64, 20)
 OPTION(osd_op_pq_max_tokens_per_priority, OPT_U64, 4194304)
 OPTION(osd_op_pq_min_cost, OPT_U64, 65536)
+
+/**
+ * osd_op_queue selects the OpWQ scheduler: "prioritized" (token buckets
+ * per message priority) or "mclock" (reservation/weight/limit per op
+ * class).  The mclock reservations and limits are in units of
+ * osd_op_pq_min_cost per second; a limit of 0 means unlimited.
+ */
+OPTION(osd_op_queue, OPT_STR, "prioritized")
+OPTION(osd_op_queue_mclock_client_op_res, OPT_DOUBLE, 1000.0)
+OPTION(osd_op_queue_mclock_client_op_wgt, OPT_DOUBLE, 500.0)
+OPTION(osd_op_queue_mclock_client_op_lim, OPT_DOUBLE, 0.0)
+OPTION(osd_op_queue_mclock_recovery_res, OPT_DOUBLE, 100.0)
+OPTION(osd_op_queue_mclock_recovery_wgt, OPT_DOUBLE, 10.0)
+OPTION(osd_op_queue_mclock_recovery_lim, OPT_DOUBLE, 0.0)
+OPTION(osd_op_queue_mclock_backfill_res, OPT_DOUBLE, 50.0)
+OPTION(osd_op_queue_mclock_backfill_wgt, OPT_DOUBLE, 5.0)
+OPTION(osd_op_queue_mclock_backfill_lim, OPT_DOUBLE, 0.0)
+OPTION(osd_op_queue_mclock_scrub_res, OPT_DOUBLE, 0.0)
+OPTION(osd_op_queue_mclock_scrub_wgt, OPT_DOUBLE, 1.0)
+OPTION(osd_op_queue_mclock_scrub_lim, OPT_DOUBLE, 0.0)
 OPTION(osd_disk_threads, OPT_INT, 1)
 OPTION(osd_recovery_threads, OPT_INT, 1)
 OPTION(osd_recover_clone_overlap, OPT_BOOL, true)   // preserve clone_overlap during recovery/migration
@@ -434,6 +474,9 @@ OPTION(osd_backfill_scan_max, OPT_INT, 512)
 OPTION(osd_op_thread_timeout, OPT_INT, 15)
 OPTION(osd_recovery_thread_timeout, OPT_INT, 30)
 OPTION(osd_snap_trim_thread_timeout, OPT_INT, 60*60*1)
+OPTION(osd_snap_trim_batch_objects, OPT_INT, 16)  // clones trimmed per snap trim transaction
+OPTION(osd_snap_trim_max_objects_per_sec, OPT_INT, 0)  // per osd; 0 for no limit
+OPTION(osd_snap_trim_max_bytes_per_sec, OPT_U64, 0)  // clone bytes released per osd; 0 for no limit
 OPTION(osd_scrub_thread_timeout, OPT_INT, 60)
 OPTION(osd_scrub_finalize_thread_timeout, OPT_INT, 60*10)
 OPTION(osd_remove_thread_timeout, OPT_INT, 60*60)
@@ -461,6 +504,7 @@ OPTION(osd_recovery_delay_start, OPT_FLOAT, 0)
 OPTION(osd_recovery_max_active, OPT_INT, 15)
 OPTION(osd_recovery_max_single_start, OPT_INT, 5)
 OPTION(osd_recovery_max_chunk, OPT_U64, 8<<20)  // max size of push chunk
+OPTION(osd_recovery_delta, OPT_BOOL, true)  // push only the extents logged since the peer's version
 OPTION(osd_copyfrom_max_chunk, OPT_U64, 8<<20)   // max size of a COPYFROM chunk
 OPTION(osd_push_per_object_cost, OPT_U64, 1000)  // push cost per object
 OPTION(osd_max_push_cost, OPT_U64, 8<<20)  // max size of push message
@@ -504,6 +548,8 @@ OPTION(osd_debug_verify_stray_on_activate, OPT_BOOL, false)
 OPTION(osd_debug_skip_full_check_in_backfill_reservation, OPT_BOOL, false)
 OPTION(osd_op_history_size, OPT_U32, 20)    // Max number of completed ops to track
 OPTION(osd_op_history_duration, OPT_U32, 600) // Oldest completed op to track
+OPTION(osd_num_op_tracker_shard, OPT_U32, 32) // ops in flight are tracked in this many lists, each with its own lock
+OPTION(osd_op_tracker_slow_detail_only, OPT_BOOL, false) // keep free form events and history only for ops older than osd_op_complaint_time
 OPTION(osd_target_transaction_size, OPT_INT, 30)     // to adjust various transactions that batch smaller items
 OPTION(osd_failsafe_full_ratio, OPT_FLOAT, .97) // what % full makes an OSD "full" (failsafe)
 OPTION(osd_failsafe_nearfull_ratio, OPT_FLOAT, .90) // what % full makes an OSD near full (failsafe)
@@ -585,6 +631,7 @@ OPTION(filestore_max_inline_xattrs_other, OPT_U32, 2)
 
 OPTION(filestore_sloppy_crc, OPT_BOOL, false)         // track sloppy crcs
 OPTION(filestore_sloppy_crc_block_size, OPT_INT, 65536)
+OPTION(filestore_strict_crc, OPT_BOOL, false)         // crc every block, EIO on mismatch
 
 OPTION(filestore_max_sync_interval, OPT_DOUBLE, 5)    // seconds
 OPTION(filestore_min_sync_interval, OPT_DOUBLE, .01)  // seconds
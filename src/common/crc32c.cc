@@ -39,3 +39,55 @@ ceph_crc32c_func_t ceph_choose_crc32(void)
  */
 ceph_crc32c_func_t ceph_crc32c_func = ceph_choose_crc32();
 
+
+/*
+ * Appending a zero bit to the crc register is linear over GF(2), so
+ * appending n zero bytes is a 32x32 bit matrix.  We keep the matrices
+ * for 2^k bytes and apply the ones for the bits set in the length.
+ * Each matrix is stored as its 32 columns: column i is the image of
+ * bit i.
+ */
+#define CRC32C_POLY_REFLECTED 0x82f63b78u
+
+static uint32_t crc32c_apply(const uint32_t *mat, uint32_t crc)
+{
+  uint32_t r = 0;
+  for (int i = 0; crc; ++i, crc >>= 1)
+    if (crc & 1)
+      r ^= mat[i];
+  return r;
+}
+
+struct crc32c_zeros_table_t {
+  uint32_t op[32][32];  // op[k] appends 2^k zero bytes
+
+  crc32c_zeros_table_t() {
+    // one zero bit
+    uint32_t bit[32];
+    bit[0] = CRC32C_POLY_REFLECTED;
+    for (int i = 1; i < 32; ++i)
+      bit[i] = 1u << (i - 1);
+    // one zero byte: bit applied 8 times
+    for (int i = 0; i < 32; ++i) {
+      uint32_t v = 1u << i;
+      for (int j = 0; j < 8; ++j)
+	v = crc32c_apply(bit, v);
+      op[0][i] = v;
+    }
+    // and square our way up
+    for (int k = 1; k < 32; ++k)
+      for (int i = 0; i < 32; ++i)
+	op[k][i] = crc32c_apply(op[k-1], op[k-1][i]);
+  }
+};
+
+static crc32c_zeros_table_t crc32c_zeros_table;
+
+uint32_t ceph_crc32c_zeros(uint32_t crc, unsigned length)
+{
+  for (int k = 0; length; ++k, length >>= 1)
+    if (length & 1)
+      crc = crc32c_apply(crc32c_zeros_table.op[k], crc);
+  return crc;
+}
+
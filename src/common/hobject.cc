@@ -104,15 +104,21 @@ string hobject_t::to_str() const
 
 void hobject_t::encode(bufferlist& bl) const
 {
-  ENCODE_START(4, 3, bl);
-  ::encode(key, bl);
-  ::encode(oid, bl);
-  ::encode(snap, bl);
-  ::encode(hash, bl);
-  ::encode(max, bl);
-  ::encode(nspace, bl);
-  ::encode(pool, bl);
-  ENCODE_FINISH(bl);
+  encode_bounded(*this, bl);
+}
+
+void hobject_t::encode(bufferlist::contiguous_appender& p,
+		       uint64_t features) const
+{
+  BOUNDED_ENCODE_START(4, 3, p);
+  ::encode(key, p);
+  ::encode(oid, p);
+  ::encode(snap, p);
+  ::encode(hash, p);
+  ::encode(max, p);
+  ::encode(nspace, p);
+  ::encode(pool, p);
+  BOUNDED_ENCODE_FINISH(p);
 }
 
 void hobject_t::decode(bufferlist::iterator& bl)
@@ -238,7 +244,7 @@ void ghobject_t::decode(bufferlist::iterator& bl)
 void ghobject_t::dump(Formatter *f) const
 {
   hobj.dump(f);
-  if (generation != NO_GEN) {
+  if (generation != NO_GEN || shard_id != NO_SHARD) {
     f->dump_int("generation", generation);
     f->dump_int("shard_id", shard_id);
   }
@@ -274,7 +280,9 @@ ostream& operator<<(ostream& out, const ghobject_t& o)
   out << o.hobj;
   if (o.generation != ghobject_t::NO_GEN) {
     assert(o.shard_id != ghobject_t::NO_SHARD);
-    out << "/" << o.generation << "/" << o.shard_id;
+    out << "/" << o.generation << "/" << (unsigned)o.shard_id;
+  } else if (o.shard_id != ghobject_t::NO_SHARD) {
+    out << "/s" << (unsigned)o.shard_id;
   }
   return out;
 }
@@ -183,6 +183,17 @@ public:
     return nspace;
   }
 
+  void bound_encode(size_t& p, uint64_t features=0) const {
+    p += BOUNDED_ENCODE_HEADER_LEN;
+    ::bound_encode(key, p);
+    ::bound_encode(oid, p);
+    ::bound_encode(snap, p);
+    ::bound_encode(hash, p);
+    ::bound_encode(max, p);
+    ::bound_encode(nspace, p);
+    ::bound_encode(pool, p);
+  }
+  void encode(bufferlist::contiguous_appender& p, uint64_t features=0) const;
   void encode(bufferlist& bl) const;
   void decode(bufferlist::iterator& bl);
   void decode(json_spirit::Value& v);
@@ -197,6 +208,7 @@ public:
   friend struct ghobject_t;
 };
 WRITE_CLASS_ENCODER(hobject_t)
+WRITE_CLASS_BOUNDED_ENCODER(hobject_t)
 
 namespace __gnu_cxx {
   template<> struct hash<hobject_t> {
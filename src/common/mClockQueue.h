@@ -0,0 +1,488 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#ifndef CEPH_MCLOCK_QUEUE_H
+#define CEPH_MCLOCK_QUEUE_H
+
+#include "common/Formatter.h"
+#include "common/Clock.h"
+
+#include <map>
+#include <utility>
+#include <list>
+#include <limits>
+
+/**
+ * Manages queue for strict priority items and items scheduled by class
+ * with a reservation, weight and limit (mClock, Gulati et al., OSDI '10)
+ *
+ * Every class has
+ *  - a reservation: cost units per second it is guaranteed while busy,
+ *  - a weight: its share of whatever is left over, and
+ *  - a limit: cost units per second beyond which it only runs when no
+ *    other class is eligible (0 for no limit).
+ *
+ * An item with cost c counts as max(c, min_cost) / min_cost cost units.
+ *
+ * On dequeue, strict items are returned first, highest priority first.
+ * Otherwise we serve the class whose head is furthest behind on its
+ * reservation, if any is; then, among the classes below their limit,
+ * the class with the smallest weight tag.  If every class is over its
+ * limit we still pick by weight tag, so the queue is work conserving.
+ *
+ * Tags are computed lazily for the head of each class so that, within a
+ * class, we can schedule round robin based on the class of type K used to
+ * enqueue items (e.g. entity_inst_t to provide fairness between clients)
+ * just like PrioritizedQueue.
+ */
+template <typename T, typename K>
+class mClockQueue {
+  struct Item {
+    unsigned cost;
+    double arrival;
+    T item;
+    Item(unsigned c, double a, T i) : cost(c), arrival(a), item(i) {}
+  };
+
+  template <class F>
+  static unsigned filter_list(
+    list<Item> *l, F f,
+    list<T> *out) {
+    unsigned ret = 0;
+    if (out) {
+      for (typename list<Item>::reverse_iterator i = l->rbegin();
+	   i != l->rend();
+	   ++i) {
+	if (f(i->item)) {
+	  out->push_front(i->item);
+	}
+      }
+    }
+    for (typename list<Item>::iterator i = l->begin();
+	 i != l->end();
+      ) {
+      if (f(i->item)) {
+	l->erase(i++);
+	++ret;
+      } else {
+	++i;
+      }
+    }
+    return ret;
+  }
+
+  struct ClassQueue {
+    double reservation, weight, limit;
+    /// tags of the last item dequeued from this class
+    double r_tag, p_tag, l_tag;
+    uint64_t num_reserved, num_weighted, num_over_limit;
+  private:
+    map<K, list<Item> > q;
+    int64_t size;
+    typename map<K, list<Item> >::iterator cur;
+  public:
+    ClassQueue(const ClassQueue &other)
+      : reservation(other.reservation),
+	weight(other.weight),
+	limit(other.limit),
+	r_tag(other.r_tag),
+	p_tag(other.p_tag),
+	l_tag(other.l_tag),
+	num_reserved(other.num_reserved),
+	num_weighted(other.num_weighted),
+	num_over_limit(other.num_over_limit),
+	q(other.q),
+	size(other.size),
+	cur(q.begin()) {}
+    ClassQueue()
+      : reservation(0), weight(1), limit(0),
+	r_tag(0), p_tag(0), l_tag(0),
+	num_reserved(0), num_weighted(0), num_over_limit(0),
+	size(0), cur(q.begin()) {}
+
+    void enqueue(K cl, const Item &item) {
+      q[cl].push_back(item);
+      if (cur == q.end())
+	cur = q.begin();
+      size++;
+    }
+    void enqueue_front(K cl, const Item &item) {
+      q[cl].push_front(item);
+      if (cur == q.end())
+	cur = q.begin();
+      size++;
+    }
+    const Item &front() const {
+      assert(!(q.empty()));
+      assert(cur != q.end());
+      return cur->second.front();
+    }
+    void pop_front() {
+      assert(!(q.empty()));
+      assert(cur != q.end());
+      cur->second.pop_front();
+      if (cur->second.empty())
+	q.erase(cur++);
+      else
+	++cur;
+      if (cur == q.end())
+	cur = q.begin();
+      size--;
+    }
+    unsigned length() const {
+      assert(size >= 0);
+      return (unsigned)size;
+    }
+    bool empty() const {
+      return q.empty();
+    }
+    template <class F>
+    void remove_by_filter(F f, list<T> *out) {
+      for (typename map<K, list<Item> >::iterator i = q.begin();
+	   i != q.end();
+	   ) {
+	size -= filter_list(&(i->second), f, out);
+	if (i->second.empty()) {
+	  if (cur == i)
+	    ++cur;
+	  q.erase(i++);
+	} else {
+	  ++i;
+	}
+      }
+      if (cur == q.end())
+	cur = q.begin();
+    }
+    void remove_by_class(K k, list<T> *out) {
+      typename map<K, list<Item> >::iterator i = q.find(k);
+      if (i == q.end())
+	return;
+      size -= i->second.size();
+      if (i == cur) {
+	++cur;
+	if (cur == q.end())
+	  cur = q.begin();
+      }
+      if (out) {
+	for (typename list<Item>::reverse_iterator j =
+	       i->second.rbegin();
+	     j != i->second.rend();
+	     ++j) {
+	  out->push_front(j->item);
+	}
+      }
+      q.erase(i);
+    }
+
+    void dump(Formatter *f) const {
+      f->dump_float("reservation", reservation);
+      f->dump_float("weight", weight);
+      f->dump_float("limit", limit);
+      f->dump_float("r_tag", r_tag);
+      f->dump_float("p_tag", p_tag);
+      f->dump_float("l_tag", l_tag);
+      f->dump_unsigned("num_reserved", num_reserved);
+      f->dump_unsigned("num_weighted", num_weighted);
+      f->dump_unsigned("num_over_limit", num_over_limit);
+      f->dump_int("size", size);
+      f->dump_int("num_keys", q.size());
+    }
+  };
+
+  int64_t min_cost;
+  map<unsigned, list<pair<K, T> > > high_queue;
+  map<unsigned, ClassQueue> queue;
+
+  double units(unsigned cost) const {
+    if (cost < min_cost)
+      cost = min_cost;
+    return (double)cost / (double)min_cost;
+  }
+
+  /// tag advanced by cost at rate, or infinity for a zero rate
+  static double next_tag(double prev, double cost_units, double rate,
+			 double arrival) {
+    if (rate <= 0)
+      return std::numeric_limits<double>::infinity();
+    double t = prev + cost_units / rate;
+    return t > arrival ? t : arrival;
+  }
+
+  double head_r_tag(const ClassQueue &c) const {
+    const Item &i = c.front();
+    return next_tag(c.r_tag, units(i.cost), c.reservation, i.arrival);
+  }
+  double head_p_tag(const ClassQueue &c) const {
+    const Item &i = c.front();
+    return next_tag(c.p_tag, units(i.cost), c.weight, i.arrival);
+  }
+  double head_l_tag(const ClassQueue &c) const {
+    if (c.limit <= 0)
+      return 0;  // unlimited
+    const Item &i = c.front();
+    return next_tag(c.l_tag, units(i.cost), c.limit, i.arrival);
+  }
+
+  T pop(typename map<unsigned, ClassQueue>::iterator i, bool reserved) {
+    ClassQueue &c = i->second;
+    const Item &head = c.front();
+    double r = head_r_tag(c);
+    if (reserved) {
+      c.r_tag = r;
+    } else if (c.reservation > 0) {
+      // mClock: an item served out of the weight phase does not count
+      // against the reservation of the items queued behind it.
+      c.r_tag = r - units(head.cost) / c.reservation;
+    }
+    c.p_tag = head_p_tag(c);
+    if (c.limit > 0)
+      c.l_tag = head_l_tag(c);
+    T ret = head.item;
+    c.pop_front();
+    return ret;
+  }
+
+public:
+  mClockQueue(unsigned min_c)
+    : min_cost(min_c ? min_c : 1)
+  {}
+
+  /**
+   * set scheduling parameters for a class
+   *
+   * @param klass class id as passed to enqueue
+   * @param reservation guaranteed cost units per second (0 for none)
+   * @param weight proportional share of the spare capacity
+   * @param limit maximum cost units per second (0 for unlimited)
+   */
+  void set_class(unsigned klass, double reservation, double weight,
+		 double limit) {
+    ClassQueue &c = queue[klass];
+    c.reservation = reservation;
+    c.weight = weight;
+    c.limit = limit;
+  }
+
+  unsigned length() const {
+    unsigned total = 0;
+    for (typename map<unsigned, ClassQueue>::const_iterator i = queue.begin();
+	 i != queue.end();
+	 ++i) {
+      total += i->second.length();
+    }
+    for (typename map<unsigned, list<pair<K, T> > >::const_iterator i =
+	   high_queue.begin();
+	 i != high_queue.end();
+	 ++i) {
+      assert(i->second.size());
+      total += i->second.size();
+    }
+    return total;
+  }
+
+  template <class F>
+  void remove_by_filter(F f, list<T> *removed = 0) {
+    for (typename map<unsigned, ClassQueue>::iterator i = queue.begin();
+	 i != queue.end();
+	 ++i) {
+      i->second.remove_by_filter(f, removed);
+    }
+    for (typename map<unsigned, list<pair<K, T> > >::iterator i =
+	   high_queue.begin();
+	 i != high_queue.end();
+	 ) {
+      if (removed) {
+	for (typename list<pair<K, T> >::reverse_iterator j =
+	       i->second.rbegin();
+	     j != i->second.rend();
+	     ++j) {
+	  if (f(j->second))
+	    removed->push_front(j->second);
+	}
+      }
+      for (typename list<pair<K, T> >::iterator j = i->second.begin();
+	   j != i->second.end();
+	) {
+	if (f(j->second))
+	  i->second.erase(j++);
+	else
+	  ++j;
+      }
+      if (i->second.empty()) {
+	high_queue.erase(i++);
+      } else {
+	++i;
+      }
+    }
+  }
+
+  void remove_by_class(K k, list<T> *out = 0) {
+    for (typename map<unsigned, ClassQueue>::iterator i = queue.begin();
+	 i != queue.end();
+	 ++i) {
+      i->second.remove_by_class(k, out);
+    }
+    for (typename map<unsigned, list<pair<K, T> > >::iterator i =
+	   high_queue.begin();
+	 i != high_queue.end();
+	 ) {
+      for (typename list<pair<K, T> >::reverse_iterator j =
+	     i->second.rbegin();
+	   j != i->second.rend();
+	   ++j) {
+	if (out && j->first == k)
+	  out->push_front(j->second);
+      }
+      for (typename list<pair<K, T> >::iterator j = i->second.begin();
+	   j != i->second.end();
+	) {
+	if (j->first == k)
+	  i->second.erase(j++);
+	else
+	  ++j;
+      }
+      if (i->second.empty()) {
+	high_queue.erase(i++);
+      } else {
+	++i;
+      }
+    }
+  }
+
+  void enqueue_strict(K cl, unsigned priority, T item) {
+    high_queue[priority].push_back(make_pair(cl, item));
+  }
+
+  void enqueue_strict_front(K cl, unsigned priority, T item) {
+    high_queue[priority].push_front(make_pair(cl, item));
+  }
+
+  void enqueue(K cl, unsigned klass, unsigned cost, T item,
+	       utime_t now = utime_t()) {
+    if (now == utime_t())
+      now = ceph_clock_now(NULL);
+    queue[klass].enqueue(cl, Item(cost, (double)now, item));
+  }
+
+  void enqueue_front(K cl, unsigned klass, unsigned cost, T item,
+		     utime_t now = utime_t()) {
+    if (now == utime_t())
+      now = ceph_clock_now(NULL);
+    queue[klass].enqueue_front(cl, Item(cost, (double)now, item));
+  }
+
+  bool empty() const {
+    if (!high_queue.empty())
+      return false;
+    for (typename map<unsigned, ClassQueue>::const_iterator i = queue.begin();
+	 i != queue.end();
+	 ++i) {
+      if (!i->second.empty())
+	return false;
+    }
+    return true;
+  }
+
+  T dequeue(utime_t t = utime_t()) {
+    assert(!empty());
+
+    if (!(high_queue.empty())) {
+      T ret = high_queue.rbegin()->second.front().second;
+      high_queue.rbegin()->second.pop_front();
+      if (high_queue.rbegin()->second.empty())
+	high_queue.erase(high_queue.rbegin()->first);
+      return ret;
+    }
+
+    if (t == utime_t())
+      t = ceph_clock_now(NULL);
+    double now = (double)t;
+
+    // constraint-based phase: serve the class furthest behind on its
+    // reservation
+    typename map<unsigned, ClassQueue>::iterator best = queue.end();
+    double best_tag = 0;
+    for (typename map<unsigned, ClassQueue>::iterator i = queue.begin();
+	 i != queue.end();
+	 ++i) {
+      if (i->second.empty())
+	continue;
+      double r = head_r_tag(i->second);
+      if (r <= now && (best == queue.end() || r < best_tag)) {
+	best = i;
+	best_tag = r;
+      }
+    }
+    if (best != queue.end()) {
+      best->second.num_reserved++;
+      return pop(best, true);
+    }
+
+    // weight-based phase: among the classes under their limit, serve
+    // the one with the smallest proportional share tag
+    typename map<unsigned, ClassQueue>::iterator over = queue.end();
+    double over_tag = 0;
+    for (typename map<unsigned, ClassQueue>::iterator i = queue.begin();
+	 i != queue.end();
+	 ++i) {
+      if (i->second.empty())
+	continue;
+      double p = head_p_tag(i->second);
+      if (head_l_tag(i->second) <= now) {
+	if (best == queue.end() || p < best_tag) {
+	  best = i;
+	  best_tag = p;
+	}
+      } else if (over == queue.end() || p < over_tag) {
+	over = i;
+	over_tag = p;
+      }
+    }
+    if (best != queue.end()) {
+      best->second.num_weighted++;
+      return pop(best, false);
+    }
+
+    // everybody is over their limit; rather than idle the thread, serve
+    // by weight anyway
+    assert(over != queue.end());
+    over->second.num_over_limit++;
+    return pop(over, false);
+  }
+
+  void dump(Formatter *f) const {
+    f->dump_int("min_cost", min_cost);
+    f->open_array_section("high_queues");
+    for (typename map<unsigned, list<pair<K, T> > >::const_iterator p =
+	   high_queue.begin();
+	 p != high_queue.end();
+	 ++p) {
+      f->open_object_section("subqueue");
+      f->dump_int("priority", p->first);
+      f->dump_int("size", p->second.size());
+      f->close_section();
+    }
+    f->close_section();
+    f->open_array_section("queues");
+    for (typename map<unsigned, ClassQueue>::const_iterator p = queue.begin();
+	 p != queue.end();
+	 ++p) {
+      f->open_object_section("class");
+      f->dump_int("class", p->first);
+      p->second.dump(f);
+      f->close_section();
+    }
+    f->close_section();
+  }
+};
+
+#endif
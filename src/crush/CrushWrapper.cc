@@ -24,6 +24,21 @@ bool CrushWrapper::has_v2_rules() const
   return false;
 }
 
+bool CrushWrapper::ruleset_uses_firstn(int ruleset) const
+{
+  for (unsigned i=0; i<crush->max_rules; i++) {
+    crush_rule *r = crush->rules[i];
+    if (!r || r->mask.ruleset != ruleset)
+      continue;
+    for (unsigned j=0; j<r->len; j++) {
+      if (r->steps[j].op == CRUSH_RULE_CHOOSE_FIRSTN ||
+	  r->steps[j].op == CRUSH_RULE_CHOOSELEAF_FIRSTN)
+	return true;
+    }
+  }
+  return false;
+}
+
 void CrushWrapper::find_takes(set<int>& roots) const
 {
   for (unsigned i=0; i<crush->max_rules; i++) {
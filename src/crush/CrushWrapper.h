@@ -185,6 +185,13 @@ public:
   }
   bool has_v2_rules() const;
 
+  /**
+   * True if a rule of the ruleset chooses with firstn.  firstn shifts
+   * the items after a failed one down, which erasure coded pools cannot
+   * follow: each position holds a different shard.
+   */
+  bool ruleset_uses_firstn(int ruleset) const;
+
 
   // bucket types
   int get_num_type_names() const {
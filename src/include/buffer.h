@@ -113,6 +113,35 @@ public:
   /// enable/disable tracking of buffer::ptr::c_str() calls
   static void track_c_str(bool b);
 
+  /*
+   * page-aligned buffer pool
+   *
+   * create_page_aligned() carves buffers out of power-of-two size
+   * classes from one page up to get_pool_max_size().  Freed buffers
+   * are kept in a small per-thread cache and then a shared per-class
+   * free list instead of going back to the allocator.
+   */
+  struct pool_stat_t {
+    unsigned size;      ///< buffer size of this class
+    uint64_t in_use;    ///< buffers handed out
+    uint64_t cached;    ///< free buffers kept for reuse
+    uint64_t hits;      ///< allocations served from a cache
+    uint64_t misses;    ///< allocations that went to the allocator
+  };
+  /// number of pool size classes
+  static unsigned get_pool_classes();
+  /// largest buffer the pool serves
+  static unsigned get_pool_max_size();
+  static void get_pool_stat(unsigned cls, pool_stat_t *s);
+  /**
+   * bound the memory kept in the pool
+   *
+   * @param max_bytes free bytes kept in all, thread caches included;
+   *        0 disables the pool
+   * @param thread_bytes free bytes kept by each thread that allocates
+   */
+  static void set_pool_limits(uint64_t max_bytes, uint64_t thread_bytes);
+
 private:
  
   /* hack for memory utilization debugging. */
@@ -127,6 +156,7 @@ private:
   class raw_static;
   class raw_mmap_pages;
   class raw_posix_aligned;
+  class raw_pooled;
   class raw_hack_aligned;
   class raw_char;
   class raw_pipe;
@@ -414,7 +444,50 @@ public:
     void append(const list& bl);
     void append(std::istream& in);
     void append_zero(unsigned len);
-    
+
+    /**
+     * write directly into reserved space at the end of a list
+     *
+     * Reserves room for up to len bytes in a single buffer and hands
+     * out a raw pointer into it; whatever has been written by the time
+     * the appender is destroyed is added to the list as one segment.
+     * Nothing else may be appended to the list while an appender is
+     * live.  See encode_bounded() in encoding.h.
+     */
+    class contiguous_appender {
+      list *pbl;
+      char *start;
+      char *pos;
+      char *limit;
+
+      // not copyable
+      contiguous_appender(const contiguous_appender& other);
+      contiguous_appender& operator=(const contiguous_appender& other);
+
+    public:
+      contiguous_appender(list& bl, unsigned len);
+      ~contiguous_appender() {
+	flush();
+      }
+
+      char *get_pos() {
+	return pos;
+      }
+      /// skip over bytes that will be filled in later via get_pos()
+      void advance(unsigned len) {
+	assert(pos + len <= limit);
+	pos += len;
+      }
+      void append(const char *p, unsigned len) {
+	assert(pos + len <= limit);
+	memcpy(pos, p, len);
+	pos += len;
+      }
+      void append(const list& bl);
+      /// add what has been written so far to the list
+      void flush();
+    };
+
     /*
      * get a char
      */
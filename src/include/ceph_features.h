@@ -43,6 +43,9 @@
 #define CEPH_FEATURE_CRUSH_V2      (1ULL<<36)  /* new indep; SET_* steps */
 #define CEPH_FEATURE_EXPORT_PEER   (1ULL<<37)
 #define CEPH_FEATURE_OSD_ERASURE_CODES (1ULL<<38)
+#define CEPH_FEATURE_OSD_DELTA_RECOVERY (1ULL<<39)
+#define CEPH_FEATURE_OSD_NOTIFY_BATCH (1ULL<<40)
+#define CEPH_FEATURE_MSG_FRAG      (1ULL<<41)
 
 /*
  * The introduction of CEPH_FEATURE_OSD_SNAPMAPPER caused the feature
@@ -109,6 +112,9 @@ static inline unsigned long long ceph_sanitize_features(unsigned long long f) {
 	 CEPH_FEATURE_CRUSH_V2 |	    \
 	 CEPH_FEATURE_EXPORT_PEER |	    \
          CEPH_FEATURE_OSD_ERASURE_CODES |   \
+	 CEPH_FEATURE_OSD_DELTA_RECOVERY |  \
+	 CEPH_FEATURE_OSD_NOTIFY_BATCH |    \
+	 CEPH_FEATURE_MSG_FRAG |	    \
 	 0ULL)
 
 #define CEPH_FEATURES_SUPPORTED_DEFAULT  CEPH_FEATURES_ALL
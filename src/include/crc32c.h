@@ -14,6 +14,17 @@ extern ceph_crc32c_func_t ceph_crc32c_func;
 
 extern ceph_crc32c_func_t ceph_choose_crc32(void);
 
+/**
+ * calculate crc32c of length zero bytes
+ *
+ * Equivalent to ceph_crc32c(crc, NULL, length), but takes time
+ * logarithmic in length instead of walking it.
+ *
+ * @param crc initial value
+ * @param length number of zero bytes
+ */
+extern uint32_t ceph_crc32c_zeros(uint32_t crc, unsigned length);
+
 /**
  * calculate crc32c
  *
@@ -26,7 +37,26 @@ extern ceph_crc32c_func_t ceph_choose_crc32(void);
  */
 static inline uint32_t ceph_crc32c(uint32_t crc, unsigned char const *data, unsigned length)
 {
+	if (!data && length > 16)
+		return ceph_crc32c_zeros(crc, length);
 	return ceph_crc32c_func(crc, data, length);
 }
 
+/**
+ * combine the crc32c of two adjacent buffers
+ *
+ * Our crc32c has no pre- or post-conditioning, so the crc of A
+ * followed by B from initial value v is crc_a = crc32c(v, A) shifted
+ * over len_b zero bytes, xor crc32c(0, B).
+ *
+ * @param crc_a crc32c of the first buffer, from any initial value
+ * @param crc_b crc32c of the second buffer from initial value 0
+ * @param len_b length of the second buffer
+ */
+static inline uint32_t ceph_crc32c_combine(uint32_t crc_a, uint32_t crc_b,
+					   unsigned len_b)
+{
+	return ceph_crc32c_zeros(crc_a, len_b) ^ crc_b;
+}
+
 #endif
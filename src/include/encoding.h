@@ -57,9 +57,19 @@ inline void decode_raw(T& t, bufferlist::iterator &p)
   p.copy(sizeof(t), (char*)&t);
 }
 
+template<class T>
+inline void encode_raw(const T& t, bufferlist::contiguous_appender& p)
+{
+  p.append((char*)&t, sizeof(t));
+}
+
 #define WRITE_RAW_ENCODER(type)						\
   inline void encode(const type &v, bufferlist& bl, uint64_t features=0) { encode_raw(v, bl); } \
-  inline void decode(type &v, bufferlist::iterator& p) { __ASSERT_FUNCTION decode_raw(v, p); }
+  inline void decode(type &v, bufferlist::iterator& p) { __ASSERT_FUNCTION decode_raw(v, p); } \
+  inline void bound_encode(const type &v, size_t& p, uint64_t features=0) { \
+    p += sizeof(type); }						\
+  inline void encode(const type &v, bufferlist::contiguous_appender& p, \
+		     uint64_t features=0) { encode_raw(v, p); }
 
 WRITE_RAW_ENCODER(__u8)
 WRITE_RAW_ENCODER(__s8)
@@ -81,6 +91,14 @@ inline void decode(bool &v, bufferlist::iterator& p) {
   decode_raw(vv, p);
   v = vv;
 }
+inline void bound_encode(const bool &v, size_t& p, uint64_t features=0) {
+  p += sizeof(__u8);
+}
+inline void encode(const bool &v, bufferlist::contiguous_appender& p,
+		   uint64_t features=0) {
+  __u8 vv = v;
+  encode_raw(vv, p);
+}
 
 
 // -----------------------------------
@@ -96,6 +114,15 @@ inline void decode(bool &v, bufferlist::iterator& p) {
     ceph_##etype e;							\
     decode_raw(e, p);							\
     v = e;								\
+  }									\
+  inline void bound_encode(type v, size_t& p, uint64_t features=0) {	\
+    p += sizeof(ceph_##etype);						\
+  }									\
+  inline void encode(type v, bufferlist::contiguous_appender& p,	\
+		     uint64_t features=0) {				\
+    ceph_##etype e;							\
+    e = v;								\
+    encode_raw(e, p);							\
   }
 
 WRITE_INTTYPE_ENCODER(uint64_t, le64)
@@ -158,6 +185,39 @@ WRITE_INTTYPE_ENCODER(int16_t, le16)
     ENCODE_DUMP_PRE(); c.encode(bl, features); ENCODE_DUMP_POST(cl); }	\
   inline void decode(cl &c, bufferlist::iterator &p) { c.decode(p); }
 
+/*
+ * bounded encoding
+ *
+ * Encoding field by field into a bufferlist costs a call into
+ * buffer::list per field, and ENCODE_START/FINISH walk the list twice
+ * with iterators.  A type that can cheaply put an upper bound on its
+ * encoded size can instead implement
+ *
+ *   void bound_encode(size_t& p, uint64_t features=0) const;
+ *   void encode(bufferlist::contiguous_appender& p, uint64_t features=0) const;
+ *
+ * where bound_encode adds the bound to p, declare itself with
+ * WRITE_CLASS_BOUNDED_ENCODER, and implement encode(bufferlist&) with
+ * encode_bounded(), which reserves the bound in one buffer and writes
+ * every field through a raw pointer.  The bytes produced are the same
+ * as the bufferlist encoders'; use BOUNDED_ENCODE_START/FINISH in place
+ * of ENCODE_START/FINISH.
+ */
+#define WRITE_CLASS_BOUNDED_ENCODER(cl)					\
+  inline void bound_encode(const cl &c, size_t& p, uint64_t features=0) { \
+    c.bound_encode(p, features); }					\
+  inline void encode(const cl &c, bufferlist::contiguous_appender& p,	\
+		     uint64_t features=0) { c.encode(p, features); }
+
+template<class T>
+inline void encode_bounded(const T& o, bufferlist& bl, uint64_t features=0)
+{
+  size_t len = 0;
+  o.bound_encode(len, features);
+  bufferlist::contiguous_appender p(bl, len);
+  o.encode(p, features);
+}
+
 
 // string
 inline void encode(const std::string& s, bufferlist& bl, uint64_t features=0)
@@ -185,6 +245,19 @@ inline void decode_nohead(int len, std::string& s, bufferlist::iterator& p)
 }
 
 // const char* (encode only, string compatible)
+inline void bound_encode(const std::string& s, size_t& p,
+			 uint64_t features=0)
+{
+  p += sizeof(__u32) + s.length();
+}
+inline void encode(const std::string& s, bufferlist::contiguous_appender& p,
+		   uint64_t features=0)
+{
+  __u32 len = s.length();
+  encode(len, p);
+  p.append(s.data(), len);
+}
+
 inline void encode(const char *s, bufferlist& bl) 
 {
   __u32 len = strlen(s);
@@ -243,6 +316,17 @@ inline void encode(const bufferlist& s, bufferlist& bl)
   encode(len, bl);
   bl.append(s);
 }
+inline void bound_encode(const bufferlist& s, size_t& p, uint64_t features=0)
+{
+  p += sizeof(__u32) + s.length();
+}
+inline void encode(const bufferlist& s, bufferlist::contiguous_appender& p,
+		   uint64_t features=0)
+{
+  __u32 len = s.length();
+  encode(len, p);
+  p.append(s);
+}
 inline void encode_destructively(bufferlist& s, bufferlist& bl) 
 {
   __u32 len = s.length();
@@ -464,6 +548,23 @@ inline void decode(std::vector<T>& v, bufferlist::iterator& p)
   for (__u32 i=0; i<n; i++) 
     decode(v[i], p);
 }
+template<class T>
+inline void bound_encode(const std::vector<T>& v, size_t& p,
+			 uint64_t features=0)
+{
+  p += sizeof(__u32);
+  for (typename std::vector<T>::const_iterator i = v.begin(); i != v.end(); ++i)
+    bound_encode(*i, p, features);
+}
+template<class T>
+inline void encode(const std::vector<T>& v, bufferlist::contiguous_appender& p,
+		   uint64_t features=0)
+{
+  __u32 n = v.size();
+  encode(n, p);
+  for (typename std::vector<T>::const_iterator i = v.begin(); i != v.end(); ++i)
+    encode(*i, p, features);
+}
 
 template<class T>
 inline void encode_nohead(const std::vector<T>& v, bufferlist& bl)
@@ -550,6 +651,27 @@ inline void encode(const std::map<T,U>& m, bufferlist& bl, uint64_t features)
   }
 }
 template<class T, class U>
+inline void bound_encode(const std::map<T,U>& m, size_t& p,
+			 uint64_t features=0)
+{
+  p += sizeof(__u32);
+  for (typename std::map<T,U>::const_iterator i = m.begin(); i != m.end(); ++i) {
+    bound_encode(i->first, p, features);
+    bound_encode(i->second, p, features);
+  }
+}
+template<class T, class U>
+inline void encode(const std::map<T,U>& m, bufferlist::contiguous_appender& p,
+		   uint64_t features=0)
+{
+  __u32 n = m.size();
+  encode(n, p);
+  for (typename std::map<T,U>::const_iterator i = m.begin(); i != m.end(); ++i) {
+    encode(i->first, p, features);
+    encode(i->second, p, features);
+  }
+}
+template<class T, class U>
 inline void decode(std::map<T,U>& m, bufferlist::iterator& p)
 {
   __u32 n;
@@ -734,6 +856,48 @@ inline void decode(std::deque<T>& ls, bufferlist::iterator& p)
 
 #define ENCODE_FINISH(bl) ENCODE_FINISH_NEW_COMPAT(bl, 0)
 
+/// bytes BOUNDED_ENCODE_START adds: struct_v, struct_compat, struct_len
+#define BOUNDED_ENCODE_HEADER_LEN (2 * sizeof(__u8) + sizeof(ceph_le32))
+
+/**
+ * start encoding block through a contiguous_appender
+ *
+ * Same wire format as ENCODE_START; the length slot is filled in
+ * through a raw pointer by BOUNDED_ENCODE_FINISH.
+ *
+ * @param v current (code) version of the encoding
+ * @param compat oldest code version that can decode it
+ * @param p bufferlist::contiguous_appender to encode to
+ */
+#define BOUNDED_ENCODE_START(v, compat, p)		     \
+  __u8 struct_v = v, struct_compat = compat;		     \
+  ::encode(struct_v, p);				     \
+  ::encode(struct_compat, p);				     \
+  char *struct_compat_pos = p.get_pos() - 1;		     \
+  char *struct_len_pos = p.get_pos();			     \
+  p.advance(sizeof(ceph_le32));				     \
+  do {
+
+/**
+ * finish encoding block through a contiguous_appender
+ *
+ * @param p bufferlist::contiguous_appender we were encoding to
+ * @param new_struct_compat struct-compat value to use
+ */
+#define BOUNDED_ENCODE_FINISH_NEW_COMPAT(p, new_struct_compat)		\
+  } while (false);							\
+  {									\
+    ceph_le32 struct_len;						\
+    struct_len = p.get_pos() - struct_len_pos - sizeof(struct_len);	\
+    memcpy(struct_len_pos, &struct_len, sizeof(struct_len));		\
+  }									\
+  if (new_struct_compat) {						\
+    struct_compat = new_struct_compat;					\
+    *struct_compat_pos = struct_compat;					\
+  }
+
+#define BOUNDED_ENCODE_FINISH(p) BOUNDED_ENCODE_FINISH_NEW_COMPAT(p, 0)
+
 #define DECODE_ERR_VERSION(func, v)			\
   "" #func " unknown encoding version > " #v
 
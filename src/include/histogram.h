@@ -66,6 +66,50 @@ public:
     return 1 << h.size();
   }
 
+  /// bin a value falls into
+  static int calc_bits_of(int t) {
+    int b = 0;
+    while (t > 0) {
+      t = t >> 1;
+      b++;
+    }
+    return b;
+  }
+
+  /// count one more value
+  void add(int32_t v) {
+    int bin = calc_bits_of(v);
+    _expand_to(bin + 1);
+    h[bin]++;
+  }
+
+  /// fraction (in millionths) of the values in lower bins, and in
+  /// lower bins or the same bin, than v
+  void get_position_micro(int32_t v, uint64_t *lower, uint64_t *upper) const {
+    unsigned bin = calc_bits_of(v);
+    uint64_t lower_sum = 0, upper_sum = 0, total = 0;
+    for (unsigned p = 0; p < h.size(); ++p) {
+      if (p < bin)
+	lower_sum += h[p];
+      if (p <= bin)
+	upper_sum += h[p];
+      total += h[p];
+    }
+    if (total > 0) {
+      *lower = lower_sum * 1000000 / total;
+      *upper = upper_sum * 1000000 / total;
+    } else {
+      *lower = *upper = 0;
+    }
+  }
+
+  /// divide all counts by 2^bits
+  void decay(int bits) {
+    for (unsigned p = 0; p < h.size(); ++p)
+      h[p] >>= bits;
+    _contract();
+  }
+
   void dump(Formatter *f) const;
   void encode(bufferlist &bl) const;
   void decode(bufferlist::iterator &bl);
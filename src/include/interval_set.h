@@ -237,6 +237,12 @@ class interval_set {
   void encode_nohead(bufferlist& bl) const {
     ::encode_nohead(m, bl);
   }
+  void bound_encode(size_t& p, uint64_t features=0) const {
+    ::bound_encode(m, p);
+  }
+  void encode(bufferlist::contiguous_appender& p, uint64_t features=0) const {
+    ::encode(m, p);
+  }
   void decode(bufferlist::iterator& bl) {
     ::decode(m, bl);
     _size = 0;
@@ -546,5 +552,17 @@ inline void decode(interval_set<T>& s, bufferlist::iterator& p)
 {
   s.decode(p);
 }
+template<class T>
+inline void bound_encode(const interval_set<T>& s, size_t& p,
+			 uint64_t features=0)
+{
+  s.bound_encode(p, features);
+}
+template<class T>
+inline void encode(const interval_set<T>& s,
+		   bufferlist::contiguous_appender& p, uint64_t features=0)
+{
+  s.encode(p, features);
+}
 
 #endif
@@ -90,6 +90,12 @@ struct ceph_entity_inst {
 #define CEPH_MSGR_TAG_BADAUTHORIZER 11 /* bad authorizer */
 #define CEPH_MSGR_TAG_FEATURES      12 /* insufficient features */
 #define CEPH_MSGR_TAG_SEQ           13 /* 64-bit int follows with seen seq number */
+#define CEPH_MSGR_TAG_MSG_FRAG      14 /* le32 len + le32 total (front +
+					  middle + data of the whole message)
+					  + leading data bytes of the next
+					  MSG_LAST message */
+#define CEPH_MSGR_TAG_MSG_LAST      15 /* message whose leading data came in
+					  MSG_FRAGs; data_len counts them */
 
 
 /*
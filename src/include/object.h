@@ -53,8 +53,15 @@ struct object_t {
   void decode(bufferlist::iterator &bl) {
     ::decode(name, bl);
   }
+  void bound_encode(size_t& p, uint64_t features=0) const {
+    ::bound_encode(name, p);
+  }
+  void encode(bufferlist::contiguous_appender& p, uint64_t features=0) const {
+    ::encode(name, p);
+  }
 };
 WRITE_CLASS_ENCODER(object_t)
+WRITE_CLASS_BOUNDED_ENCODER(object_t)
 
 inline bool operator==(const object_t& l, const object_t& r) {
   return l.name == r.name;
@@ -122,6 +129,13 @@ struct snapid_t {
 
 inline void encode(snapid_t i, bufferlist &bl) { encode(i.val, bl); }
 inline void decode(snapid_t &i, bufferlist::iterator &p) { decode(i.val, p); }
+inline void bound_encode(snapid_t i, size_t& p, uint64_t features=0) {
+  bound_encode(i.val, p);
+}
+inline void encode(snapid_t i, bufferlist::contiguous_appender& p,
+		   uint64_t features=0) {
+  encode(i.val, p);
+}
 
 inline ostream& operator<<(ostream& out, snapid_t s) {
   if (s == CEPH_NOSNAP)
@@ -97,6 +97,13 @@ public:
     ::decode(tv.tv_sec, p);
     ::decode(tv.tv_nsec, p);
   }
+  void bound_encode(size_t& p, uint64_t features=0) const {
+    p += sizeof(ceph_le32) * 2;
+  }
+  void encode(bufferlist::contiguous_appender& p, uint64_t features=0) const {
+    ::encode(tv.tv_sec, p);
+    ::encode(tv.tv_nsec, p);
+  }
 
   void encode_timeval(struct ceph_timespec *t) const {
     t->tv_sec = tv.tv_sec;
@@ -293,6 +300,7 @@ public:
   }
 };
 WRITE_CLASS_ENCODER(utime_t)
+WRITE_CLASS_BOUNDED_ENCODER(utime_t)
 
 
 // arithmetic operators
@@ -1113,6 +1113,24 @@ int librados::IoCtxImpl::_notify_ack(
   return 0;
 }
 
+/* this is called with IoCtxImpl::lock held */
+int librados::IoCtxImpl::_notify_ack(
+  const object_t& oid,
+  uint64_t notify_id, uint64_t ver,
+  const vector<uint64_t>& cookies)
+{
+  // one op carrying every ack rather than an op per watch
+  ::ObjectOperation rd;
+  prepare_assert_ops(&rd);
+  for (vector<uint64_t>::const_iterator p = cookies.begin();
+       p != cookies.end();
+       ++p)
+    rd.notify_ack(notify_id, ver, *p);
+  objecter->read(oid, oloc, rd, snap_seq, (bufferlist*)NULL, 0, 0, 0);
+
+  return 0;
+}
+
 int librados::IoCtxImpl::unwatch(const object_t& oid, uint64_t cookie)
 {
   bufferlist inbl, outbl;
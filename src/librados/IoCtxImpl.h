@@ -200,6 +200,9 @@ struct librados::IoCtxImpl {
   int _notify_ack(
     const object_t& oid, uint64_t notify_id, uint64_t ver,
     uint64_t cookie);
+  int _notify_ack(
+    const object_t& oid, uint64_t notify_id, uint64_t ver,
+    const vector<uint64_t>& cookies);
 
   version_t last_version();
   void set_assert_version(uint64_t ver);
@@ -595,16 +595,73 @@ public:
   }
 };
 
+/*
+ * a notify that names several of our watches: run each callback, then
+ * ack them all in a single op.
+ */
+class C_WatchNotifyBatch : public Context {
+  vector<librados::WatchContext *> ctxs;
+  Mutex *client_lock;
+  uint8_t opcode;
+  uint64_t ver;
+  uint64_t notify_id;
+  bufferlist bl;
+
+public:
+  C_WatchNotifyBatch(vector<librados::WatchContext *>& _ctxs,
+		     Mutex *_client_lock,
+		     uint8_t _o, uint64_t _v, uint64_t _n, bufferlist& _bl) :
+    client_lock(_client_lock), opcode(_o), ver(_v), notify_id(_n), bl(_bl) {
+    ctxs.swap(_ctxs);
+  }
+
+  void finish(int r) {
+    vector<uint64_t> cookies;
+    for (vector<librados::WatchContext *>::iterator p = ctxs.begin();
+	 p != ctxs.end();
+	 ++p) {
+      (*p)->ctx->notify(opcode, ver, bl);
+      cookies.push_back((*p)->cookie);
+    }
+    if (opcode != WATCH_NOTIFY_COMPLETE) {
+      client_lock->Lock();
+      ctxs[0]->io_ctx_impl->_notify_ack(ctxs[0]->oid, notify_id, ver, cookies);
+      client_lock->Unlock();
+    }
+    for (vector<librados::WatchContext *>::iterator p = ctxs.begin();
+	 p != ctxs.end();
+	 ++p)
+      (*p)->put();
+  }
+};
+
 void librados::RadosClient::watch_notify(MWatchNotify *m)
 {
   assert(lock.is_locked());
+  vector<WatchContext *> ctxs;
   map<uint64_t, WatchContext *>::iterator iter = watchers.find(m->cookie);
   if (iter != watchers.end()) {
-    WatchContext *wc = iter->second;
-    assert(wc);
-    wc->get();
-    finisher.queue(new C_WatchNotify(wc, &lock, m->opcode, m->ver, m->notify_id, m->bl));
+    assert(iter->second);
+    ctxs.push_back(iter->second);
+  }
+  for (vector<uint64_t>::iterator p = m->extra_cookies.begin();
+       p != m->extra_cookies.end();
+       ++p) {
+    iter = watchers.find(*p);
+    if (iter != watchers.end()) {
+      assert(iter->second);
+      ctxs.push_back(iter->second);
+    }
   }
+  for (vector<WatchContext *>::iterator p = ctxs.begin();
+       p != ctxs.end();
+       ++p)
+    (*p)->get();
+
+  if (ctxs.size() == 1)
+    finisher.queue(new C_WatchNotify(ctxs[0], &lock, m->opcode, m->ver, m->notify_id, m->bl));
+  else if (!ctxs.empty())
+    finisher.queue(new C_WatchNotifyBatch(ctxs, &lock, m->opcode, m->ver, m->notify_id, m->bl));
   m->put();
 }
 
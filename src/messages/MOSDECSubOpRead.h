@@ -0,0 +1,82 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * Copyright (C) 2013 Inktank Storage, Inc.
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#ifndef MOSDECSUBOPREAD_H
+#define MOSDECSUBOPREAD_H
+
+#include "msg/Message.h"
+#include "osd/osd_types.h"
+
+/**
+ * Ask the holder of a shard of an erasure coded object for a range
+ * of its chunk (len 0 reads to the end of the shard) and, optionally,
+ * for its attributes.
+ */
+class MOSDECSubOpRead : public Message {
+  static const int HEAD_VERSION = 1;
+  static const int COMPAT_VERSION = 1;
+
+public:
+  pg_t pgid;
+  epoch_t map_epoch;
+  tid_t tid;
+  hobject_t hoid;
+  uint64_t off, len;
+  bool want_attrs;
+
+  int get_cost() const {
+    return len;
+  }
+
+  MOSDECSubOpRead() :
+    Message(MSG_OSD_EC_READ, HEAD_VERSION, COMPAT_VERSION),
+    map_epoch(0), tid(0), off(0), len(0), want_attrs(false)
+    {}
+
+  virtual void decode_payload() {
+    bufferlist::iterator p = payload.begin();
+    ::decode(pgid, p);
+    ::decode(map_epoch, p);
+    ::decode(tid, p);
+    ::decode(hoid, p);
+    ::decode(off, p);
+    ::decode(len, p);
+    ::decode(want_attrs, p);
+  }
+
+  virtual void encode_payload(uint64_t features) {
+    ::encode(pgid, payload);
+    ::encode(map_epoch, payload);
+    ::encode(tid, payload);
+    ::encode(hoid, payload);
+    ::encode(off, payload);
+    ::encode(len, payload);
+    ::encode(want_attrs, payload);
+  }
+
+  const char *get_type_name() const { return "MOSDECSubOpRead"; }
+
+  void print(ostream& out) const {
+    out << "MOSDECSubOpRead(" << pgid
+	<< " " << map_epoch
+	<< " tid " << tid
+	<< " " << hoid
+	<< " " << off << "~" << len;
+    if (want_attrs)
+      out << " +attrs";
+    out << ")";
+  }
+};
+
+#endif
@@ -0,0 +1,78 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * Copyright (C) 2013 Inktank Storage, Inc.
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#ifndef MOSDECSUBOPREADREPLY_H
+#define MOSDECSUBOPREADREPLY_H
+
+#include "msg/Message.h"
+#include "osd/osd_types.h"
+
+class MOSDECSubOpReadReply : public Message {
+  static const int HEAD_VERSION = 1;
+  static const int COMPAT_VERSION = 1;
+
+public:
+  pg_t pgid;
+  epoch_t map_epoch;
+  tid_t tid;
+  hobject_t hoid;
+  int32_t result;
+  bufferlist buffer;
+  map<string, bufferlist> attrs;
+
+  int get_cost() const {
+    return buffer.length();
+  }
+
+  MOSDECSubOpReadReply() :
+    Message(MSG_OSD_EC_READ_REPLY, HEAD_VERSION, COMPAT_VERSION),
+    map_epoch(0), tid(0), result(0)
+    {}
+
+  virtual void decode_payload() {
+    bufferlist::iterator p = payload.begin();
+    ::decode(pgid, p);
+    ::decode(map_epoch, p);
+    ::decode(tid, p);
+    ::decode(hoid, p);
+    ::decode(result, p);
+    ::decode(attrs, p);
+    buffer.claim(data);
+  }
+
+  virtual void encode_payload(uint64_t features) {
+    ::encode(pgid, payload);
+    ::encode(map_epoch, payload);
+    ::encode(tid, payload);
+    ::encode(hoid, payload);
+    ::encode(result, payload);
+    ::encode(attrs, payload);
+    data = buffer;
+  }
+
+  const char *get_type_name() const { return "MOSDECSubOpReadReply"; }
+
+  void print(ostream& out) const {
+    out << "MOSDECSubOpReadReply(" << pgid
+	<< " " << map_epoch
+	<< " tid " << tid
+	<< " " << hoid
+	<< " = " << result
+	<< " len " << buffer.length()
+	<< " attrs " << attrs.size()
+	<< ")";
+  }
+};
+
+#endif
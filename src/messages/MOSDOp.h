@@ -19,6 +19,7 @@
 #include "msg/Message.h"
 #include "osd/osd_types.h"
 #include "include/ceph_features.h"
+#include "include/atomic.h"
 
 /*
  * OSD op
@@ -54,15 +55,29 @@ private:
   snapid_t snap_seq;
   vector<snapid_t> snaps;
 
+  /// 1 while oid, ops and snap context are still encoded in the
+  /// payload at p; cleared only once they are all in place
+  atomic_t final_decode_needed;
+  bufferlist::iterator p;
+
 public:
   friend class MOSDOpReply;
 
   // read
-  snapid_t get_snapid() { return snapid; }
+  snapid_t get_snapid() {
+    assert(!final_decode_needed.read());
+    return snapid;
+  }
   void set_snapid(snapid_t s) { snapid = s; }
   // writ
-  snapid_t get_snap_seq() const { return snap_seq; }
-  const vector<snapid_t> &get_snaps() const { return snaps; }
+  snapid_t get_snap_seq() const {
+    assert(!final_decode_needed.read());
+    return snap_seq;
+  }
+  const vector<snapid_t> &get_snaps() const {
+    assert(!final_decode_needed.read());
+    return snaps;
+  }
   void set_snaps(const vector<snapid_t>& i) {
     snaps = i;
   }
@@ -76,7 +91,10 @@ public:
   int get_client_inc() { return client_inc; }
   tid_t get_client_tid() { return header.tid; }
   
-  object_t& get_oid() { return oid; }
+  object_t& get_oid() {
+    assert(!final_decode_needed.read());
+    return oid;
+  }
 
   pg_t     get_pg() const { return pgid; }
 
@@ -91,14 +109,16 @@ public:
   utime_t get_mtime() { return mtime; }
 
   MOSDOp()
-    : Message(CEPH_MSG_OSD_OP, HEAD_VERSION, COMPAT_VERSION) { }
+    : Message(CEPH_MSG_OSD_OP, HEAD_VERSION, COMPAT_VERSION),
+      final_decode_needed(0) { }
   MOSDOp(int inc, long tid,
          object_t& _oid, object_locator_t& _oloc, pg_t _pgid, epoch_t _osdmap_epoch,
 	 int _flags)
     : Message(CEPH_MSG_OSD_OP, HEAD_VERSION, COMPAT_VERSION),
       client_inc(inc),
       osdmap_epoch(_osdmap_epoch), flags(_flags), retry_attempt(-1),
-      oid(_oid), oloc(_oloc), pgid(_pgid) {
+      oid(_oid), oloc(_oloc), pgid(_pgid),
+      final_decode_needed(0) {
     set_tid(tid);
   }
 private:
@@ -171,11 +191,18 @@ public:
    * @return retry attempt, or -1 if we don't know
    */
   int get_retry_attempt() const {
+    assert(!final_decode_needed.read());
     return retry_attempt;
   }
 
+  /// true until finish_decode() has decoded oid, ops and snap context
+  bool is_final_decode_needed() const {
+    return final_decode_needed.read();
+  }
+
   // marshalling
   virtual void encode_payload(uint64_t features) {
+    assert(!final_decode_needed.read());
 
     OSDOp::merge_osd_op_vector_in_data(ops, data);
 
@@ -231,31 +258,58 @@ struct ceph_osd_request_head {
       ::encode_nohead(oid.name, payload);
       ::encode_nohead(snaps, payload);
     } else {
-      ::encode(client_inc, payload);
-      ::encode(osdmap_epoch, payload);
-      ::encode(flags, payload);
-      ::encode(mtime, payload);
-      ::encode(reassert_version, payload);
-
-      ::encode(oloc, payload);
-      ::encode(pgid, payload);
-      ::encode(oid, payload);
-
       __u16 num_ops = ops.size();
-      ::encode(num_ops, payload);
+      size_t len = 0;
+      ::bound_encode(client_inc, len);
+      ::bound_encode(osdmap_epoch, len);
+      ::bound_encode(flags, len);
+      ::bound_encode(mtime, len);
+      ::bound_encode(reassert_version, len);
+      ::bound_encode(oloc, len);
+      ::bound_encode(pgid, len);
+      ::bound_encode(oid, len);
+      ::bound_encode(num_ops, len);
+      len += sizeof(ceph_osd_op) * num_ops;
+      ::bound_encode(snapid, len);
+      ::bound_encode(snap_seq, len);
+      ::bound_encode(snaps, len);
+      ::bound_encode(retry_attempt, len);
+
+      bufferlist::contiguous_appender p(payload, len);
+      ::encode(client_inc, p);
+      ::encode(osdmap_epoch, p);
+      ::encode(flags, p);
+      ::encode(mtime, p);
+      ::encode(reassert_version, p);
+
+      ::encode(oloc, p);
+      ::encode(pgid, p);
+      ::encode(oid, p);
+
+      ::encode(num_ops, p);
       for (unsigned i = 0; i < ops.size(); i++)
-	::encode(ops[i].op, payload);
+	::encode(ops[i].op, p);
 
-      ::encode(snapid, payload);
-      ::encode(snap_seq, payload);
-      ::encode(snaps, payload);
+      ::encode(snapid, p);
+      ::encode(snap_seq, p);
+      ::encode(snaps, p);
 
-      ::encode(retry_attempt, payload);
+      ::encode(retry_attempt, p);
     }
   }
 
+  /*
+   * decode_payload() runs on the messenger's reader thread and only
+   * decodes what the OSD needs to route the op (map epoch, flags,
+   * locator and pgid).  The object name, ops and snap context are left
+   * in the payload for finish_decode(), which the OSD calls from the
+   * op worker thread: the reader does not pay for it, and ops dropped
+   * before they reach their pg (no such pg here, pg being deleted, a
+   * stale map epoch) are never fully decoded.  Misdirected ops are
+   * only decoded to build the -ENXIO reply.
+   */
   virtual void decode_payload() {
-    bufferlist::iterator p = payload.begin();
+    p = payload.begin();
 
     if (header.version < 2) {
       // old decode
@@ -297,6 +351,10 @@ struct ceph_osd_request_head {
 				oid.name.length()));
 
       retry_attempt = -1;
+
+      // the pgid needs the object name; nothing left to defer
+      OSDOp::split_osd_op_vector_in_data(ops, data);
+      final_decode_needed.set(0);
     } else {
       // new decode 
       ::decode(client_inc, p);
@@ -315,32 +373,72 @@ struct ceph_osd_request_head {
 	::decode(pgid, p);
       }
 
-      ::decode(oid, p);
+      final_decode_needed.set(1);
+    }
+  }
+
+  /**
+   * decode what decode_payload() left behind; a no-op if done already
+   *
+   * Called by the thread that handles the op only.  print() may run
+   * concurrently (op tracker dumps), so everything is decoded aside
+   * and published at once by clearing final_decode_needed.
+   *
+   * @return -EINVAL, leaving no object nor ops, if the payload is
+   * malformed
+   */
+  int finish_decode() {
+    if (!final_decode_needed.read())
+      return 0;
+
+    object_t d_oid;
+    vector<OSDOp> d_ops;
+    snapid_t d_snapid, d_snap_seq;
+    vector<snapid_t> d_snaps;
+    int32_t d_retry_attempt = -1;
+    int r = 0;
+    try {
+      ::decode(d_oid, p);
 
       //::decode(ops, p);
       __u16 num_ops;
       ::decode(num_ops, p);
-      ops.resize(num_ops);
+      d_ops.resize(num_ops);
       for (unsigned i = 0; i < num_ops; i++)
-	::decode(ops[i].op, p);
+	::decode(d_ops[i].op, p);
 
-      ::decode(snapid, p);
-      ::decode(snap_seq, p);
-      ::decode(snaps, p);
+      ::decode(d_snapid, p);
+      ::decode(d_snap_seq, p);
+      ::decode(d_snaps, p);
 
       if (header.version >= 4)
-	::decode(retry_attempt, p);
-      else
-	retry_attempt = -1;
-    }
+	::decode(d_retry_attempt, p);
 
-    OSDOp::split_osd_op_vector_in_data(ops, data);
+      OSDOp::split_osd_op_vector_in_data(d_ops, data);
+    } catch (const buffer::error& e) {
+      r = -EINVAL;
+    }
+    if (r == 0) {
+      oid.name.swap(d_oid.name);
+      ops.swap(d_ops);
+      snapid = d_snapid;
+      snap_seq = d_snap_seq;
+      snaps.swap(d_snaps);
+      retry_attempt = d_retry_attempt;
+    }
+    final_decode_needed.dec();  // orders the stores above before it
+    return r;
   }
 
 
   const char *get_type_name() const { return "osd_op"; }
   void print(ostream& out) const {
     out << "osd_op(" << get_reqid();
+    if (final_decode_needed.read()) {
+      // only the routing fields are decoded so far
+      out << " " << pgid << " e" << osdmap_epoch << " (undecoded))";
+      return;
+    }
     out << " ";
     if (!oloc.nspace.empty())
       out << oloc.nspace << "/";
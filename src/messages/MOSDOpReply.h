@@ -126,6 +126,7 @@ public:
     : Message(CEPH_MSG_OSD_OPREPLY, HEAD_VERSION, COMPAT_VERSION) { }
   MOSDOpReply(MOSDOp *req, int r, epoch_t e, int acktype)
     : Message(CEPH_MSG_OSD_OPREPLY, HEAD_VERSION, COMPAT_VERSION) {
+    req->finish_decode();  // a malformed op is answered without its ops
     set_tid(req->get_tid());
     ops = req->ops;
     result = r;
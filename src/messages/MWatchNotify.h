@@ -17,6 +17,7 @@
 #define CEPH_MWATCHNOTIFY_H
 
 #include "msg/Message.h"
+#include "include/ceph_features.h"
 
 
 class MWatchNotify : public Message {
@@ -26,6 +27,8 @@ class MWatchNotify : public Message {
   uint64_t notify_id;
   uint8_t opcode;
   bufferlist bl;
+  /// further watches on this connection the notify is for (v2)
+  vector<uint64_t> extra_cookies;
 
   MWatchNotify() : Message(CEPH_MSG_WATCH_NOTIFY) { }
   MWatchNotify(uint64_t c, uint64_t v, uint64_t i, uint8_t o, bufferlist b) : Message(CEPH_MSG_WATCH_NOTIFY),
@@ -44,20 +47,31 @@ public:
     ::decode(notify_id, p);
     if (msg_ver >= 1)
       ::decode(bl, p);
+    if (msg_ver >= 2)
+      ::decode(extra_cookies, p);
   }
   void encode_payload(uint64_t features) {
     uint8_t msg_ver = 1;
+    if (!extra_cookies.empty()) {
+      assert(features & CEPH_FEATURE_OSD_NOTIFY_BATCH);
+      msg_ver = 2;
+    }
     ::encode(msg_ver, payload);
     ::encode(opcode, payload);
     ::encode(cookie, payload);
     ::encode(ver, payload);
     ::encode(notify_id, payload);
     ::encode(bl, payload);
+    if (msg_ver >= 2)
+      ::encode(extra_cookies, payload);
   }
 
   const char *get_type_name() const { return "watch-notify"; }
   void print(ostream& out) const {
-    out << "watch-notify(c=" << cookie << " v=" << ver << " i=" << notify_id << " opcode=" << (int)opcode << ")";
+    out << "watch-notify(c=" << cookie;
+    if (!extra_cookies.empty())
+      out << "+" << extra_cookies.size();
+    out << " v=" << ver << " i=" << notify_id << " opcode=" << (int)opcode << ")";
   }
 };
 
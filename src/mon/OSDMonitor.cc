@@ -2763,6 +2763,15 @@ int OSDMonitor::prepare_new_pool(string& name, uint64_t auid, int crush_ruleset,
       return r;
     default_properties["erasure-code-directory"] =
       g_conf->osd_pool_default_erasure_code_directory;
+    default_properties["erasure-code-stripe-width"] =
+      stringify(g_conf->osd_pool_erasure_code_stripe_width);
+    int ruleset = crush_ruleset >= 0 ? crush_ruleset :
+      g_conf->osd_pool_default_crush_erasure_ruleset;
+    if (osdmap.crush->ruleset_uses_firstn(ruleset)) {
+      ss << "crush ruleset " << ruleset
+	 << " uses firstn, erasure coded pools need indep";
+      return -EINVAL;
+    }
   }
 
   for (map<int64_t,string>::iterator p = pending_inc.new_pool_names.begin();
@@ -2986,6 +2995,11 @@ int OSDMonitor::prepare_command_pool_set(map<string,cmd_vartype> &cmdmap,
       ss << "error parsing integer value '" << val << "': " << interr;
       return -EINVAL;
     }
+    if (p.is_erasure() && osdmap.crush->ruleset_uses_firstn(n)) {
+      ss << "crush ruleset " << n
+	 << " uses firstn, erasure coded pools need indep";
+      return -EINVAL;
+    }
     if (osdmap.crush->rule_exists(n)) {
       p.crush_ruleset = n;
       ss << "set pool " << pool << " crush_ruleset to " << n;
@@ -3017,6 +3031,8 @@ int OSDMonitor::prepare_command_pool_set(map<string,cmd_vartype> &cmdmap,
       p.hit_set_params = HitSet::Params(new ExplicitHashHitSet::Params);
     else if (val == "explicit_object")
       p.hit_set_params = HitSet::Params(new ExplicitObjectHitSet::Params);
+    else if (val == "counting")
+      p.hit_set_params = HitSet::Params(new CountingHitSet::Params);
     else {
       ss << "unrecognized hit_set type '" << val << "'";
       return -EINVAL;
@@ -3036,6 +3052,13 @@ int OSDMonitor::prepare_command_pool_set(map<string,cmd_vartype> &cmdmap,
     }
     p.hit_set_count = n;
     ss << "set hit_set_count to " << n;
+  } else if (var == "hit_set_halflife") {
+    if (interr.length() || n < 0) {
+      ss << "error parsing integer value '" << val << "': " << interr;
+      return -EINVAL;
+    }
+    p.hit_set_halflife = n;
+    ss << "set hit_set_halflife to " << n;
   } else if (var == "hit_set_fpp") {
     if (floaterr.length()) {
       ss << "error parsing floating point value '" << val << "': " << floaterr;
@@ -3048,6 +3071,63 @@ int OSDMonitor::prepare_command_pool_set(map<string,cmd_vartype> &cmdmap,
     BloomHitSet::Params *bloomp = static_cast<BloomHitSet::Params*>(p.hit_set_params.impl.get());
     bloomp->set_fpp(f);
     ss << "set hit_set_fpp to " << bloomp->get_fpp();
+  } else if (var == "target_max_bytes") {
+    if (interr.length() || n < 0) {
+      ss << "error parsing integer value '" << val << "': " << interr;
+      return -EINVAL;
+    }
+    p.target_max_bytes = n;
+    ss << "set pool " << pool << " target_max_bytes to " << n;
+  } else if (var == "target_max_objects") {
+    if (interr.length() || n < 0) {
+      ss << "error parsing integer value '" << val << "': " << interr;
+      return -EINVAL;
+    }
+    p.target_max_objects = n;
+    ss << "set pool " << pool << " target_max_objects to " << n;
+  } else if (var == "cache_target_dirty_ratio") {
+    if (floaterr.length()) {
+      ss << "error parsing floating point value '" << val << "': " << floaterr;
+      return -EINVAL;
+    }
+    if (f < 0 || f > 1.0) {
+      ss << "value must be in the range 0..1";
+      return -ERANGE;
+    }
+    p.cache_target_dirty_ratio_micro = f * 1000000;
+    ss << "set pool " << pool << " cache_target_dirty_ratio to " << f;
+  } else if (var == "cache_target_full_ratio") {
+    if (floaterr.length()) {
+      ss << "error parsing floating point value '" << val << "': " << floaterr;
+      return -EINVAL;
+    }
+    if (f < 0 || f > 1.0) {
+      ss << "value must be in the range 0..1";
+      return -ERANGE;
+    }
+    p.cache_target_full_ratio_micro = f * 1000000;
+    ss << "set pool " << pool << " cache_target_full_ratio to " << f;
+  } else if (var == "cache_min_flush_age") {
+    if (interr.length() || n < 0) {
+      ss << "error parsing integer value '" << val << "': " << interr;
+      return -EINVAL;
+    }
+    p.cache_min_flush_age = n;
+    ss << "set pool " << pool << " cache_min_flush_age to " << n;
+  } else if (var == "cache_min_evict_age") {
+    if (interr.length() || n < 0) {
+      ss << "error parsing integer value '" << val << "': " << interr;
+      return -EINVAL;
+    }
+    p.cache_min_evict_age = n;
+    ss << "set pool " << pool << " cache_min_evict_age to " << n;
+  } else if (var == "cache_min_promote_hits") {
+    if (interr.length() || n < 0) {
+      ss << "error parsing integer value '" << val << "': " << interr;
+      return -EINVAL;
+    }
+    p.cache_min_promote_hits = n;
+    ss << "set pool " << pool << " cache_min_promote_hits to " << n;
   } else {
     ss << "unrecognized variable '" << var << "'";
     return -EINVAL;
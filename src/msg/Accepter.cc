@@ -13,6 +13,7 @@
  */
 
 #include <sys/socket.h>
+#include <sys/un.h>
 #include <netinet/tcp.h>
 #include <sys/uio.h>
 #include <limits.h>
@@ -146,11 +147,60 @@ int Accepter::bind(const entity_addr_t &bind_addr, const set<int>& avoid_ports)
 
   msgr->init_local_connection();
 
+  listen_addr.nonce = nonce;
+  bind_unix(listen_addr);
+
   ldout(msgr->cct,1) << "accepter.bind my_inst.addr is " << msgr->get_myaddr()
 		     << " need_addr=" << msgr->get_need_addr() << dendl;
   return 0;
 }
 
+void Accepter::bind_unix(const entity_addr_t &listen_addr)
+{
+  close_unix();
+  string path = msgr->get_unix_socket_path(listen_addr);
+  if (path.empty())
+    return;
+
+  struct sockaddr_un sun;
+  memset(&sun, 0, sizeof(sun));
+  sun.sun_family = AF_UNIX;
+  if (path.length() >= sizeof(sun.sun_path)) {
+    lderr(msgr->cct) << "accepter.bind_unix path " << path << " is too long" << dendl;
+    return;
+  }
+  strcpy(sun.sun_path, path.c_str());
+
+  int sd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  if (sd < 0) {
+    lderr(msgr->cct) << "accepter.bind_unix unable to create socket: "
+		     << cpp_strerror(errno) << dendl;
+    return;
+  }
+  // whoever had our addr and nonce before us is gone
+  ::unlink(path.c_str());
+  if (::bind(sd, (struct sockaddr *)&sun, sizeof(sun)) < 0 ||
+      ::listen(sd, 128) < 0) {
+    lderr(msgr->cct) << "accepter.bind_unix unable to listen on " << path
+		     << ": " << cpp_strerror(errno) << dendl;
+    ::close(sd);
+    return;
+  }
+  ldout(msgr->cct,10) << "accepter.bind_unix listening on " << path << dendl;
+  unix_sd = sd;
+  unix_path = path;
+}
+
+void Accepter::close_unix()
+{
+  if (unix_sd < 0)
+    return;
+  ::close(unix_sd);
+  unix_sd = -1;
+  ::unlink(unix_path.c_str());
+  unix_path.clear();
+}
+
 int Accepter::rebind(const set<int>& avoid_ports)
 {
   ldout(msgr->cct,1) << "accepter.rebind avoid " << avoid_ports << dendl;
@@ -193,26 +243,36 @@ void *Accepter::entry()
 
   char buf[80];
 
-  struct pollfd pfd;
-  pfd.fd = listen_sd;
-  pfd.events = POLLIN | POLLERR | POLLNVAL | POLLHUP;
+  struct pollfd pfd[2];
+  pfd[0].fd = listen_sd;
+  pfd[0].events = POLLIN | POLLERR | POLLNVAL | POLLHUP;
+  pfd[1].fd = unix_sd;
+  pfd[1].events = POLLIN | POLLERR | POLLNVAL | POLLHUP;
+  int nfds = unix_sd >= 0 ? 2 : 1;
   while (!done) {
     ldout(msgr->cct,20) << "accepter calling poll" << dendl;
-    int r = poll(&pfd, 1, -1);
+    int r = poll(pfd, nfds, -1);
     if (r < 0)
       break;
     ldout(msgr->cct,20) << "accepter poll got " << r << dendl;
 
-    if (pfd.revents & (POLLERR | POLLNVAL | POLLHUP))
+    if (pfd[0].revents & (POLLERR | POLLNVAL | POLLHUP))
       break;
+    if (nfds > 1 && (pfd[1].revents & (POLLERR | POLLNVAL | POLLHUP))) {
+      ldout(msgr->cct,0) << "accepter lost unix socket " << unix_path
+			 << ", same-host peers will use tcp" << dendl;
+      nfds = 1;
+      continue;
+    }
 
-    ldout(msgr->cct,10) << "pfd.revents=" << pfd.revents << dendl;
+    ldout(msgr->cct,10) << "pfd.revents=" << pfd[0].revents << dendl;
     if (done) break;
 
     // accept
+    int from = (nfds > 1 && (pfd[1].revents & POLLIN)) ? unix_sd : listen_sd;
     entity_addr_t addr;
     socklen_t slen = sizeof(addr.ss_addr());
-    int sd = ::accept(listen_sd, (sockaddr*)&addr.ss_addr(), &slen);
+    int sd = ::accept(from, (sockaddr*)&addr.ss_addr(), &slen);
     if (sd >= 0) {
       errors = 0;
       ldout(msgr->cct,10) << "accepted incoming on sd " << sd << dendl;
@@ -232,6 +292,7 @@ void *Accepter::entry()
     ::close(listen_sd);
     listen_sd = -1;
   }
+  close_unix();
   ldout(msgr->cct,10) << "accepter stopping" << dendl;
   return 0;
 }
@@ -253,6 +314,7 @@ void Accepter::stop()
     ::close(listen_sd);
     listen_sd = -1;
   }
+  close_unix();
   done = false;
 }
 
@@ -30,8 +30,16 @@ class Accepter : public Thread {
   int listen_sd;
   uint64_t nonce;
 
+  /// same-host listener, if ms_unix_socket_dir is set
+  int unix_sd;
+  string unix_path;
+
+  void bind_unix(const entity_addr_t &listen_addr);
+  void close_unix();
+
 public:
-  Accepter(SimpleMessenger *r, uint64_t n) : msgr(r), done(false), listen_sd(-1), nonce(n) {}
+  Accepter(SimpleMessenger *r, uint64_t n)
+    : msgr(r), done(false), listen_sd(-1), nonce(n), unix_sd(-1) {}
     
   void *entry();
   void stop();
@@ -36,6 +36,39 @@ double DispatchQueue::get_max_age(utime_t now) {
     return (now - marrival.begin()->first);
 }
 
+bool DispatchQueue::can_fast_dispatch(Message *m)
+{
+  return !stop && msgr->ms_can_fast_dispatch(m);
+}
+
+/*
+ * Hand m to the fast dispatchers from the calling (reader) thread.
+ * If they turn it down, it is still ours and the caller enqueues it.
+ */
+bool DispatchQueue::fast_dispatch(Message *m)
+{
+  uint64_t msize = m->get_dispatch_throttle_size();
+  m->set_dispatch_throttle_size(0);
+  Connection *con = m->get_connection().get();
+
+  ldout(cct,1) << "<== " << m->get_source_inst()
+	       << " " << m->get_seq()
+	       << " ==== " << *m
+	       << " ==== " << m->get_payload().length() << "+" << m->get_middle().length()
+	       << "+" << m->get_data().length()
+	       << " (" << m->get_footer().front_crc << " " << m->get_footer().middle_crc
+	       << " " << m->get_footer().data_crc << ")"
+	       << " " << m << " con " << m->get_connection()
+	       << " (fast)" << dendl;
+  if (!msgr->ms_fast_dispatch(m)) {
+    ldout(cct,20) << "fast dispatch declined " << m << ", queueing" << dendl;
+    m->set_dispatch_throttle_size(msize);
+    return false;
+  }
+  msgr->dispatch_throttle_release(msize, con);
+  return true;
+}
+
 void DispatchQueue::enqueue(Message *m, int priority, uint64_t id)
 {
   Mutex::Locker l(lock);
@@ -120,9 +153,11 @@ void DispatchQueue::entry()
 		       << " " << m->get_footer().data_crc << ")"
 		       << " " << m << " con " << m->get_connection()
 		       << dendl;
+	  // m may be gone after dispatch; the Connection is only a key
+	  Connection *con = m->get_connection().get();
 	  msgr->ms_deliver_dispatch(m);
 
-	  msgr->dispatch_throttle_release(msize);
+	  msgr->dispatch_throttle_release(msize, con);
 
 	  ldout(cct,20) << "done calling dispatch on " << m << dendl;
 	}
@@ -149,7 +184,8 @@ void DispatchQueue::discard_queue(uint64_t id) {
     assert(!(i->is_code())); // We don't discard id 0, ever!
     Message *m = i->get_message();
     remove_arrival(m);
-    msgr->dispatch_throttle_release(m->get_dispatch_throttle_size());
+    msgr->dispatch_throttle_release(m->get_dispatch_throttle_size(),
+				    m->get_connection().get());
     m->put();
   }
 }
@@ -158,6 +158,8 @@ class DispatchQueue {
     cond.Signal();
   }
 
+  bool can_fast_dispatch(Message *m);
+  bool fast_dispatch(Message *m);
   void enqueue(Message *m, int priority, uint64_t id);
   void discard_queue(uint64_t id);
   uint64_t get_id() {
@@ -33,6 +33,39 @@ public:
   // how i receive messages
   virtual bool ms_dispatch(Message *m) = 0;
 
+  /**
+   * @defgroup FastDispatch Fast dispatch
+   * @{
+   *
+   * A Dispatcher may take some messages straight from the thread
+   * which read them, skipping the DispatchQueue and its single
+   * thread.  ms_fast_dispatch() runs concurrently with ms_dispatch()
+   * and with itself (once per Connection at a time), so it must do
+   * its own locking and must not block.  It may be called with
+   * Messenger locks held, so it must not call back into the Messenger
+   * either.
+   */
+  /**
+   * @return true if this Dispatcher may fast dispatch anything at
+   * all; checked once, when it is added to the Messenger.
+   */
+  virtual bool ms_can_fast_dispatch_any() const { return false; }
+  /**
+   * @return true if m should be offered to ms_fast_dispatch().
+   */
+  virtual bool ms_can_fast_dispatch(Message *m) const { return false; }
+  /**
+   * Take a Message from the thread which read it.
+   *
+   * @param m The Message. If it is taken, so is the reference to it.
+   * @return true if m was taken, false to have it queued for
+   * ms_dispatch() instead (the caller keeps the reference).
+   */
+  virtual bool ms_fast_dispatch(Message *m) { return false; }
+  /**
+   * @} //FastDispatch
+   */
+
   /**
    * This function will be called whenever a new Connection is made to the
    * Messenger.
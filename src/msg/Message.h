@@ -107,6 +107,9 @@
 #define MSG_OSD_PG_PULL        106
 #define MSG_OSD_PG_PUSH_REPLY  107
 
+#define MSG_OSD_EC_READ        110
+#define MSG_OSD_EC_READ_REPLY  111
+
 // *** MDS ***
 
 #define MSG_MDS_BEACON             100  // to monitor
@@ -363,9 +366,9 @@ protected:
   virtual ~Message() { 
     assert(nref.read() == 0);
     if (byte_throttler)
-      byte_throttler->put(payload.length() + middle.length() + data.length());
+      byte_throttler->put(payload.length() + middle.length() + data.length(), connection.get());
     if (msg_throttler)
-      msg_throttler->put();
+      msg_throttler->put(1, connection.get());
   }
 public:
   const ConnectionRef& get_connection() { return connection; }
@@ -394,13 +397,13 @@ public:
 
   void clear_payload() {
     if (byte_throttler)
-      byte_throttler->put(payload.length() + middle.length());
+      byte_throttler->put(payload.length() + middle.length(), connection.get());
     payload.clear();
     middle.clear();
   }
   void clear_data() {
     if (byte_throttler)
-      byte_throttler->put(data.length());
+      byte_throttler->put(data.length(), connection.get());
     data.clear();
   }
 
@@ -408,33 +411,33 @@ public:
   bufferlist& get_payload() { return payload; }
   void set_payload(bufferlist& bl) {
     if (byte_throttler)
-      byte_throttler->put(payload.length());
+      byte_throttler->put(payload.length(), connection.get());
     payload.claim(bl);
     if (byte_throttler)
-      byte_throttler->take(payload.length());
+      byte_throttler->take(payload.length(), connection.get());
   }
 
   void set_middle(bufferlist& bl) {
     if (byte_throttler)
-      byte_throttler->put(payload.length());
+      byte_throttler->put(payload.length(), connection.get());
     middle.claim(bl);
     if (byte_throttler)
-      byte_throttler->take(payload.length());
+      byte_throttler->take(payload.length(), connection.get());
   }
   bufferlist& get_middle() { return middle; }
 
   void set_data(const bufferlist &d) {
     if (byte_throttler)
-      byte_throttler->put(data.length());
+      byte_throttler->put(data.length(), connection.get());
     data = d;
     if (byte_throttler)
-      byte_throttler->take(data.length());
+      byte_throttler->take(data.length(), connection.get());
   }
 
   bufferlist& get_data() { return data; }
   void claim_data(bufferlist& bl) {
     if (byte_throttler)
-      byte_throttler->put(data.length());
+      byte_throttler->put(data.length(), connection.get());
     bl.claim(data);
   }
   off_t get_data_len() { return data.length(); }
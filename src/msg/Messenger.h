@@ -39,6 +39,7 @@ class Timer;
 class Messenger {
 private:
   list<Dispatcher*> dispatchers;
+  list<Dispatcher*> fast_dispatchers;
 
 protected:
   /// the "name" of the local daemon. eg client.99
@@ -301,6 +302,8 @@ public:
   void add_dispatcher_head(Dispatcher *d) { 
     bool first = dispatchers.empty();
     dispatchers.push_front(d);
+    if (d->ms_can_fast_dispatch_any())
+      fast_dispatchers.push_front(d);
     if (first)
       ready();
   }
@@ -314,6 +317,8 @@ public:
   void add_dispatcher_tail(Dispatcher *d) { 
     bool first = dispatchers.empty();
     dispatchers.push_back(d);
+    if (d->ms_can_fast_dispatch_any())
+      fast_dispatchers.push_back(d);
     if (first)
       ready();
   }
@@ -592,6 +597,40 @@ public:
     assert(!cct->_conf->ms_die_on_unhandled_msg);
     m->put();
   }
+  /**
+   * Check whether a fast Dispatcher wants to see m from the thread
+   * which read it, before it goes on the dispatch queue.
+   *
+   * @param m The Message we are testing.
+   */
+  bool ms_can_fast_dispatch(Message *m) {
+    for (list<Dispatcher*>::iterator p = fast_dispatchers.begin();
+	 p != fast_dispatchers.end();
+	 ++p) {
+      if ((*p)->ms_can_fast_dispatch(m))
+	return true;
+    }
+    return false;
+  }
+  /**
+   * Offer a Message to the first fast Dispatcher which takes its
+   * type.
+   *
+   * @param m The Message to deliver. If it is taken, so is one
+   * reference to it.
+   * @return true if it was taken, false if it must be queued for
+   * ms_deliver_dispatch() as usual.
+   */
+  bool ms_fast_dispatch(Message *m) {
+    m->set_dispatch_stamp(ceph_clock_now(cct));
+    for (list<Dispatcher*>::iterator p = fast_dispatchers.begin();
+	 p != fast_dispatchers.end();
+	 ++p) {
+      if ((*p)->ms_can_fast_dispatch(m))
+	return (*p)->ms_fast_dispatch(m);
+    }
+    return false;
+  }
   /**
    * Notify each Dispatcher of a new Connection. Call
    * this function whenever a new Connection is initiated.
@@ -13,10 +13,12 @@
  */
 
 #include <sys/socket.h>
+#include <sys/un.h>
 #include <netinet/tcp.h>
 #include <sys/uio.h>
 #include <limits.h>
 #include <poll.h>
+#include <fcntl.h>
 
 #include "Message.h"
 #include "Pipe.h"
@@ -24,6 +26,7 @@
 
 #include "common/debug.h"
 #include "common/errno.h"
+#include "include/intarith.h"
 
 // Below included to get encode_encrypt(); That probably should be in Crypto.h, instead
 
@@ -65,13 +68,19 @@ Pipe::Pipe(SimpleMessenger *r, int st, Connection *con)
     state(st),
     session_security(NULL),
     connection_state(NULL),
-    reader_running(false), reader_needs_join(false),
+    backoff_seed(0),
+    reader_running(false), reader_needs_join(false), reader_parked(false),
+    reader_dispatching(false), notify_on_dispatch_done(false),
     writer_running(false),
     in_q(&(r->dispatch_queue)),
+    out_frag(NULL), out_frag_prio(0), out_frag_sent(0),
     keepalive(false),
     close_on_empty(false),
     connect_seq(0), peer_global_seq(0),
-    out_seq(0), in_seq(0), in_seq_acked(0) {
+    out_seq(0), in_seq(0), in_seq_acked(0),
+    unix_socket(false),
+    in_frag_total(0),
+    recv_ofs(0), recv_len(0), recv_buf_sliced(false) {
   if (con) {
     connection_state = con;
     connection_state->reset_pipe(this);
@@ -83,6 +92,11 @@ Pipe::Pipe(SimpleMessenger *r, int st, Connection *con)
   if (randomize_out_seq()) {
     lsubdout(msgr->cct,ms,15) << "Pipe(): Could not get random bytes to set seq number for session reset; set seq number to " << out_seq << dendl;
   }
+  // nobody seeds rand(): processes losing the same peer would draw the
+  // same backoffs
+  if (get_random_bytes((char *)&backoff_seed, sizeof(backoff_seed)))
+    backoff_seed = getpid() ^ msgr->get_myaddr().get_nonce() ^
+      ceph_clock_now(msgr->cct).usec();
     
 
   msgr->timeout = msgr->cct->_conf->ms_tcp_read_timeout * 1000; //convert to ms
@@ -94,6 +108,7 @@ Pipe::~Pipe()
 {
   assert(out_q.empty());
   assert(sent.empty());
+  assert(!out_frag);
   delete session_security;
   delete delay_thread;
 }
@@ -147,15 +162,17 @@ void Pipe::start_writer()
   writer_thread.create(msgr->cct->_conf->ms_rwthread_stack_bytes);
 }
 
-void Pipe::join_reader()
+/*
+ * wait for the reader to let go of the socket.  it stays around,
+ * waiting in reader() until we are open again, so that reconnecting
+ * doesn't cost a thread.
+ */
+void Pipe::park_reader()
 {
-  if (!reader_running)
-    return;
-  cond.Signal();
-  pipe_lock.Unlock();
-  reader_thread.join();
-  pipe_lock.Lock();
-  reader_needs_join = false;
+  while (reader_running && !reader_parked) {
+    cond.Signal();
+    cond.Wait(pipe_lock);
+  }
 }
 
 void Pipe::DelayedDelivery::discard()
@@ -164,7 +181,8 @@ void Pipe::DelayedDelivery::discard()
   Mutex::Locker l(delay_lock);
   while (!delay_queue.empty()) {
     Message *m = delay_queue.front().second;
-    pipe->msgr->dispatch_throttle_release(m->get_dispatch_throttle_size());
+    pipe->msgr->dispatch_throttle_release(m->get_dispatch_throttle_size(),
+					  m->get_connection().get());
     m->put();
     delay_queue.pop_front();
   }
@@ -177,7 +195,9 @@ void Pipe::DelayedDelivery::flush()
   while (!delay_queue.empty()) {
     Message *m = delay_queue.front().second;
     delay_queue.pop_front();
-    pipe->in_q->enqueue(m, m->get_priority(), pipe->conn_id);
+    if (!pipe->in_q->can_fast_dispatch(m) ||
+	!pipe->in_q->fast_dispatch(m))
+      pipe->in_q->enqueue(m, m->get_priority(), pipe->conn_id);
   }
 }
 
@@ -201,7 +221,9 @@ void *Pipe::DelayedDelivery::entry()
     Message *m = delay_queue.front().second;
     lgeneric_subdout(pipe->msgr->cct, ms, 10) << pipe->_pipe_prefix(_dout) << "DelayedDelivery::entry dequeuing message " << m << " for delivery, past " << release << dendl;
     delay_queue.pop_front();
-    pipe->in_q->enqueue(m, m->get_priority(), pipe->conn_id);
+    if (!pipe->in_q->can_fast_dispatch(m) ||
+	!pipe->in_q->fast_dispatch(m))
+      pipe->in_q->enqueue(m, m->get_priority(), pipe->conn_id);
   }
   lgeneric_subdout(pipe->msgr->cct, ms, 20) << pipe->_pipe_prefix(_dout) << "DelayedDelivery::entry stop" << dendl;
   return NULL;
@@ -241,8 +263,6 @@ int Pipe::accept()
   // used for reading in the remote acked seq on connect
   uint64_t newly_acked_seq = 0;
 
-  set_socket_options();
-
   // announce myself.
   r = tcp_write(CEPH_BANNER, strlen(CEPH_BANNER));
   if (r < 0) {
@@ -263,6 +283,10 @@ int Pipe::accept()
     ldout(msgr->cct,0) << "accept failed to getpeername " << errno << " " << strerror_r(errno, buf, sizeof(buf)) << dendl;
     goto fail_unlocked;
   }
+  unix_socket = socket_addr.get_family() == AF_UNIX;
+  if (unix_socket)
+    socket_addr = entity_addr_t();  // same host; the peer knows its ip
+  set_socket_options();
   ::encode(socket_addr, addrs);
 
   r = tcp_write(addrs.c_str(), addrs.length());
@@ -297,6 +321,10 @@ int Pipe::accept()
   }
 
   ldout(msgr->cct,10) << "accept peer addr is " << peer_addr << dendl;
+  if (peer_addr.is_blank_ip() && unix_socket) {
+    ldout(msgr->cct,0) << "accept peer on unix socket has no ip" << dendl;
+    goto fail_unlocked;
+  }
   if (peer_addr.is_blank_ip()) {
     // peer apparently doesn't know what ip they have; figure it out for them.
     int port = peer_addr.get_port();
@@ -407,6 +435,7 @@ int Pipe::accept()
 
     ldout(msgr->cct,10) << "accept:  setting up session_security." << dendl;
 
+  retry_existing_lookup:
     msgr->lock.Lock();
     pipe_lock.Lock();
     if (msgr->dispatch_queue.stop)
@@ -418,6 +447,26 @@ int Pipe::accept()
     existing = msgr->_lookup_pipe(peer_addr);
     if (existing) {
       existing->pipe_lock.Lock(true);  // skip lockdep check (we are locking a second Pipe here)
+      if (existing->reader_dispatching) {
+	/*
+	 * its reader is handing a message to a fast dispatcher; let it
+	 * finish (and queue the message if it was turned down) before
+	 * we replace the pipe and steal its in_seq and queue.  drop our
+	 * locks while we wait, the dispatcher may need them.
+	 */
+	ldout(msgr->cct,10) << "accept existing " << existing
+			    << " is fast dispatching, waiting" << dendl;
+	existing->get();
+	pipe_lock.Unlock();
+	msgr->lock.Unlock();
+	existing->notify_on_dispatch_done = true;
+	while (existing->reader_dispatching)
+	  existing->cond.Wait(existing->pipe_lock);
+	existing->pipe_lock.Unlock();
+	existing->put();
+	existing = 0;
+	goto retry_existing_lookup;
+      }
 
       if (connect.global_seq < existing->peer_global_seq) {
 	ldout(msgr->cct,10) << "accept existing " << existing << ".gseq " << existing->peer_global_seq
@@ -738,7 +787,7 @@ int Pipe::accept()
 void Pipe::set_socket_options()
 {
   // disable Nagle algorithm?
-  if (msgr->cct->_conf->ms_tcp_nodelay) {
+  if (msgr->cct->_conf->ms_tcp_nodelay && !unix_socket) {
     int flag = 1;
     int r = ::setsockopt(sd, IPPROTO_TCP, TCP_NODELAY, (char*)&flag, sizeof(flag));
     if (r < 0) {
@@ -756,6 +805,73 @@ void Pipe::set_socket_options()
   }
 }
 
+int Pipe::connect_unix()
+{
+  entity_addr_t any;
+  any.set_family(peer_addr.get_family());
+  any.set_port(peer_addr.get_port());
+  any.set_nonce(peer_addr.get_nonce());
+  string paths[2] = { msgr->get_unix_socket_path(peer_addr),
+		      msgr->get_unix_socket_path(any) };
+
+  for (int i = 0; i < 2; ++i) {
+    struct sockaddr_un sun;
+    if (paths[i].empty() || paths[i].length() >= sizeof(sun.sun_path))
+      continue;
+    memset(&sun, 0, sizeof(sun));
+    sun.sun_family = AF_UNIX;
+    strcpy(sun.sun_path, paths[i].c_str());
+
+    int usd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (usd < 0)
+      return -1;
+    if (::connect(usd, (sockaddr*)&sun, sizeof(sun)) == 0) {
+      ldout(msgr->cct,10) << "connected to " << peer_addr << " via " << paths[i] << dendl;
+      unix_socket = true;
+      return usd;
+    }
+    ldout(msgr->cct,20) << "connect_unix " << paths[i] << ": " << cpp_strerror(errno) << dendl;
+    ::close(usd);
+  }
+  return -1;
+}
+
+int Pipe::tcp_connect()
+{
+  int flags = ::fcntl(sd, F_GETFL);
+  if (flags < 0 || ::fcntl(sd, F_SETFL, flags | O_NONBLOCK) < 0)
+    return -1;
+
+  int rc = ::connect(sd, (sockaddr*)&peer_addr.addr, peer_addr.addr_size());
+  if (rc < 0 && errno == EINPROGRESS) {
+    struct pollfd pfd;
+    pfd.fd = sd;
+    pfd.events = POLLOUT;
+    int timeout = msgr->cct->_conf->ms_tcp_connect_timeout * 1000;
+    do {
+      rc = poll(&pfd, 1, timeout ? timeout : -1);
+    } while (rc < 0 && errno == EINTR);
+    if (rc == 0) {
+      errno = ETIMEDOUT;
+      rc = -1;
+    } else if (rc > 0) {
+      int err = 0;
+      socklen_t len = sizeof(err);
+      if (::getsockopt(sd, SOL_SOCKET, SO_ERROR, &err, &len) < 0) {
+	rc = -1;
+      } else if (err) {
+	errno = err;
+	rc = -1;
+      } else {
+	rc = 0;
+      }
+    }
+  }
+  if (rc == 0 && ::fcntl(sd, F_SETFL, flags) < 0)
+    rc = -1;
+  return rc;
+}
+
 int Pipe::connect()
 {
   bool got_bad_auth = false;
@@ -766,8 +882,8 @@ int Pipe::connect()
   __u32 cseq = connect_seq;
   __u32 gseq = msgr->get_global_seq();
 
-  // stop reader thrad
-  join_reader();
+  // get the reader off the old socket
+  park_reader();
 
   pipe_lock.Unlock();
   
@@ -783,26 +899,36 @@ int Pipe::connect()
   bufferlist addrbl, myaddrbl;
   const md_config_t *conf = msgr->cct->_conf;
 
-  // close old socket.  this is safe because we stopped the reader thread above.
+  // close old socket.  this is safe because we parked the reader thread above.
   if (sd >= 0)
     ::close(sd);
+  reset_recv_buffer();
 
   char buf[80];
 
-  // create socket?
-  sd = ::socket(peer_addr.get_family(), SOCK_STREAM, 0);
+  // same host?  use the peer's unix socket if it has one.  we need
+  // to know our own ip for that, since we can't learn it over one.
+  sd = -1;
+  unix_socket = false;
+  if (!msgr->get_need_addr() && peer_addr.is_same_host(msgr->get_myaddr()))
+    sd = connect_unix();
+
   if (sd < 0) {
-    lderr(msgr->cct) << "connect couldn't created socket " << strerror_r(errno, buf, sizeof(buf)) << dendl;
-    goto fail;
-  }
+    // create socket?
+    sd = ::socket(peer_addr.get_family(), SOCK_STREAM, 0);
+    if (sd < 0) {
+      lderr(msgr->cct) << "connect couldn't created socket " << strerror_r(errno, buf, sizeof(buf)) << dendl;
+      goto fail;
+    }
 
-  // connect!
-  ldout(msgr->cct,10) << "connecting to " << peer_addr << dendl;
-  rc = ::connect(sd, (sockaddr*)&peer_addr.addr, peer_addr.addr_size());
-  if (rc < 0) {
-    ldout(msgr->cct,2) << "connect error " << peer_addr
-	     << ", " << errno << ": " << strerror_r(errno, buf, sizeof(buf)) << dendl;
-    goto fail;
+    // connect!
+    ldout(msgr->cct,10) << "connecting to " << peer_addr << dendl;
+    rc = tcp_connect();
+    if (rc < 0) {
+      ldout(msgr->cct,2) << "connect error " << peer_addr
+	       << ", " << errno << ": " << strerror_r(errno, buf, sizeof(buf)) << dendl;
+      goto fail;
+    }
   }
 
   set_socket_options();
@@ -861,7 +987,8 @@ int Pipe::connect()
 
   ldout(msgr->cct,20) << "connect peer addr for me is " << peer_addr_for_me << dendl;
 
-  msgr->learned_addr(peer_addr_for_me);
+  if (!unix_socket)
+    msgr->learned_addr(peer_addr_for_me);
 
   ::encode(msgr->my_inst.addr, myaddrbl);
 
@@ -1082,6 +1209,8 @@ int Pipe::connect()
       if (!reader_running) {
 	ldout(msgr->cct,20) << "connect starting reader" << dendl;
 	start_reader();
+      } else {
+	cond.Signal();  // wake the parked reader
       }
       maybe_start_delay_thread();
       delete authorizer;
@@ -1152,6 +1281,14 @@ void Pipe::join()
 
 void Pipe::requeue_sent()
 {
+  if (out_frag) {
+    // its data goes out again from the start; the peer drops the
+    // fragments it has when the connection goes
+    ldout(msgr->cct,10) << "requeue_sent " << *out_frag << " after "
+			<< out_frag_sent << " bytes of fragments" << dendl;
+    out_q[out_frag_prio].push_front(out_frag);
+    out_frag = NULL;
+  }
   if (sent.empty())
     return;
 
@@ -1199,6 +1336,11 @@ void Pipe::discard_out_queue()
     (*p)->put();
   }
   sent.clear();
+  if (out_frag) {
+    ldout(msgr->cct,20) << "  discard " << out_frag << dendl;
+    out_frag->put();
+    out_frag = NULL;
+  }
   for (map<int,list<Message*> >::iterator p = out_q.begin(); p != out_q.end(); ++p)
     for (list<Message*>::iterator r = p->second.begin(); r != p->second.end(); ++r) {
       ldout(msgr->cct,20) << "  discard " << *r << dendl;
@@ -1214,7 +1356,7 @@ void Pipe::fault(bool onread)
   cond.Signal();
 
   if (onread && state == STATE_CONNECTING) {
-    ldout(msgr->cct,10) << "fault already connecting, reader shutting down" << dendl;
+    ldout(msgr->cct,10) << "fault already connecting, reader waiting" << dendl;
     return;
   }
   
@@ -1293,8 +1435,13 @@ void Pipe::fault(bool onread)
     ldout(msgr->cct,0) << "fault" << dendl;
     backoff.set_from_double(conf->ms_initial_backoff);
   } else {
-    ldout(msgr->cct,10) << "fault waiting " << backoff << dendl;
-    cond.WaitInterval(msgr->cct, pipe_lock, backoff);
+    // wait somewhere in the upper half of the backoff, so that
+    // everyone who lost the same peer doesn't come back at once
+    utime_t wait;
+    wait.set_from_double((double)backoff *
+			 (.5 + .5 * (double)(rand_r(&backoff_seed) % 10000) / 10000.0));
+    ldout(msgr->cct,10) << "fault waiting " << wait << dendl;
+    cond.WaitInterval(msgr->cct, pipe_lock, wait);
     backoff += backoff;
     if (backoff > conf->ms_max_backoff)
       backoff.set_from_double(conf->ms_max_backoff);
@@ -1362,16 +1509,24 @@ void Pipe::reader()
   }
 
   // loop.
-  while (state != STATE_CLOSED &&
-	 state != STATE_CONNECTING) {
+  while (state != STATE_CLOSED) {
     assert(pipe_lock.is_locked());
 
     // sleep if (re)connecting
-    if (state == STATE_STANDBY) {
+    if (state == STATE_STANDBY ||
+	state == STATE_CONNECTING ||
+	state == STATE_WAIT) {
       ldout(msgr->cct,20) << "reader sleeping during reconnect|standby" << dendl;
+      if (!reader_parked) {
+	// fragments don't survive the connection
+	discard_in_frags();
+	reader_parked = true;
+	cond.Signal();  // connect() may be waiting for us
+      }
       cond.Wait(pipe_lock);
       continue;
     }
+    reader_parked = false;
 
     pipe_lock.Unlock();
 
@@ -1406,10 +1561,21 @@ void Pipe::reader()
       continue;
     }
 
-    else if (tag == CEPH_MSGR_TAG_MSG) {
-      ldout(msgr->cct,20) << "reader got MSG" << dendl;
+    else if (tag == CEPH_MSGR_TAG_MSG_FRAG) {
+      ldout(msgr->cct,20) << "reader got MSG_FRAG" << dendl;
+      int r = read_frag();
+      pipe_lock.Lock();
+      if (r < 0)
+	fault(true);
+      continue;
+    }
+
+    else if (tag == CEPH_MSGR_TAG_MSG ||
+	     tag == CEPH_MSGR_TAG_MSG_LAST) {
+      ldout(msgr->cct,20) << "reader got "
+			  << (tag == CEPH_MSGR_TAG_MSG ? "MSG" : "MSG_LAST") << dendl;
       Message *m = 0;
-      int r = read_message(&m);
+      int r = read_message(&m, tag == CEPH_MSGR_TAG_MSG_LAST);
 
       pipe_lock.Lock();
       
@@ -1421,7 +1587,8 @@ void Pipe::reader()
 
       if (state == STATE_CLOSED ||
 	  state == STATE_CONNECTING) {
-	msgr->dispatch_throttle_release(m->get_dispatch_throttle_size());
+	msgr->dispatch_throttle_release(m->get_dispatch_throttle_size(),
+				      m->get_connection().get());
 	m->put();
 	continue;
       }
@@ -1435,7 +1602,8 @@ void Pipe::reader()
 	ldout(msgr->cct,0) << "reader got old message "
 		<< m->get_seq() << " <= " << in_seq << " " << m << " " << *m
 		<< ", discarding" << dendl;
-	msgr->dispatch_throttle_release(m->get_dispatch_throttle_size());
+	msgr->dispatch_throttle_release(m->get_dispatch_throttle_size(),
+				      m->get_connection().get());
 	m->put();
 	if (connection_state->has_feature(CEPH_FEATURE_RECONNECT_SEQ) &&
 	    msgr->cct->_conf->ms_die_on_old_message)
@@ -1462,6 +1630,26 @@ void Pipe::reader()
 	  lsubdout(msgr->cct, ms, 1) << "queue_received will delay until " << release << " on " << m << " " << *m << dendl;
 	}
 	delay_thread->queue(release, m);
+      } else if (in_q->can_fast_dispatch(m)) {
+	reader_dispatching = true;
+	pipe_lock.Unlock();
+	bool taken = in_q->fast_dispatch(m);
+	pipe_lock.Lock();
+	if (!taken) {
+	  if (state == STATE_CLOSED) {
+	    // marked down or faulted (lossy) meanwhile; its queue is gone
+	    msgr->dispatch_throttle_release(m->get_dispatch_throttle_size(),
+					    m->get_connection().get());
+	    m->put();
+	  } else {
+	    in_q->enqueue(m, m->get_priority(), conn_id);
+	  }
+	}
+	reader_dispatching = false;
+	if (notify_on_dispatch_done) {
+	  notify_on_dispatch_done = false;
+	  cond.Signal();
+	}
       } else {
 	in_q->enqueue(m, m->get_priority(), conn_id);
       }
@@ -1487,6 +1675,9 @@ void Pipe::reader()
   }
 
  
+  // fragments don't survive the connection
+  discard_in_frags();
+
   // reap?
   reader_running = false;
   reader_needs_join = true;
@@ -1515,6 +1706,7 @@ void Pipe::writer()
     // connect?
     if (state == STATE_CONNECTING) {
       assert(!policy.server);
+      out_pending.clear();  // belongs to the old session
       connect();
       continue;
     }
@@ -1525,6 +1717,7 @@ void Pipe::writer()
       char tag = CEPH_MSGR_TAG_CLOSE;
       state = STATE_CLOSED;
       state_closed.set(1);
+      out_pending.clear();
       pipe_lock.Unlock();
       if (sd) {
 	int r = ::write(sd, &tag, 1);
@@ -1565,9 +1758,68 @@ void Pipe::writer()
 	in_seq_acked = send_seq;
       }
 
-      // grab outgoing message
-      Message *m = _get_next_outgoing();
+      // a large message goes out as MSG_FRAGs of its data followed by
+      // a MSG_LAST with the rest.  between fragments, anything queued
+      // at a higher priority is sent whole.  the message takes its seq
+      // only with the MSG_LAST, so seqs still arrive in order.
+      unsigned frag_bytes = msgr->cct->_conf->ms_tcp_frag_bytes;
+      Message *m = 0;
+      bool last = false;
+      if (out_frag && (out_q.empty() || out_q.rbegin()->first <= out_frag_prio)) {
+	// each fragment ends on a page boundary of where the data lands
+	// (data_off), so the receiver can keep the data aligned
+	unsigned off = le32_to_cpu(out_frag->get_header().data_off) + out_frag_sent;
+	unsigned len = ROUND_UP_TO(frag_bytes, CEPH_PAGE_SIZE) - (off & ~CEPH_PAGE_MASK);
+	if (frag_bytes &&
+	    out_frag->get_data().length() - out_frag_sent > len) {
+	  m = out_frag;
+	  m->get();
+	  bufferlist bl;
+	  bl.substr_of(m->get_data(), out_frag_sent, len);
+	  pipe_lock.Unlock();
+
+	  ldout(msgr->cct,20) << "writer sending fragment of " << m << " at "
+			      << out_frag_sent << dendl;
+	  ceph_msg_header& h = m->get_header();
+	  int rc = write_frag(bl, le32_to_cpu(h.front_len) + le32_to_cpu(h.middle_len) +
+			      le32_to_cpu(h.data_len));
+
+	  pipe_lock.Lock();
+	  if (rc < 0) {
+	    ldout(msgr->cct,1) << "writer error sending fragment of " << m << ", "
+			       << errno << ": " << strerror_r(errno, buf, sizeof(buf)) << dendl;
+	    fault();
+	  } else if (out_frag == m) {
+	    out_frag_sent += len;
+	  }
+	  m->put();
+	  continue;
+	}
+	m = out_frag;
+	out_frag = NULL;
+	last = true;
+      } else {
+	int prio = out_q.empty() ? 0 : out_q.rbegin()->first;
+	m = _get_next_outgoing();
+	// whatever cuts in on out_frag goes out whole
+	if (m && frag_bytes && !out_frag &&
+	    m->get_data().length() > frag_bytes &&
+	    connection_state->has_feature(CEPH_FEATURE_MSG_FRAG)) {
+	  ldout(msgr->cct,20) << "writer fragmenting " << m << " " << *m << dendl;
+	  // make sure the data is final before any of it goes out
+	  m->set_connection(connection_state.get());
+	  m->encode(connection_state->get_features(), false);
+	  m->set_seq(0);
+	  out_frag = m;
+	  out_frag_prio = prio;
+	  out_frag_sent = 0;
+	  continue;
+	}
+      }
       if (m) {
+	// batch with whatever is queued behind us
+	bool more = is_queued();
+
 	m->set_seq(++out_seq);
 	if (!policy.lossy || close_on_empty) {
 	  // put on sent list
@@ -1612,12 +1864,20 @@ void Pipe::writer()
 
 	bufferlist blist = m->get_payload();
 	blist.append(m->get_middle());
-	blist.append(m->get_data());
+	if (last) {
+	  bufferlist rest;
+	  rest.substr_of(m->get_data(), out_frag_sent,
+			 m->get_data().length() - out_frag_sent);
+	  blist.claim_append(rest);
+	} else {
+	  blist.append(m->get_data());
+	}
 
 	pipe_lock.Unlock();
 
         ldout(msgr->cct,20) << "writer sending " << m->get_seq() << " " << m << dendl;
-	int rc = write_message(header, footer, blist);
+	int rc = write_message(header, footer, blist, more,
+			       last ? CEPH_MSGR_TAG_MSG_LAST : CEPH_MSGR_TAG_MSG);
 
 	pipe_lock.Lock();
 	if (rc < 0) {
@@ -1629,6 +1889,24 @@ void Pipe::writer()
       }
       continue;
     }
+
+    // push out the tail of a batch (or a lone ack/keepalive) before
+    // going idle
+    if (out_pending.length()) {
+      if (state == STATE_CONNECTING || state == STATE_WAIT || state == STATE_STANDBY) {
+	out_pending.clear();
+	continue;
+      }
+      pipe_lock.Unlock();
+      int rc = flush_pending();
+      pipe_lock.Lock();
+      if (rc < 0) {
+	ldout(msgr->cct,1) << "writer error flushing, "
+			   << errno << ": " << strerror_r(errno, buf, sizeof(buf)) << dendl;
+	fault();
+      }
+      continue;
+    }
     
     if (sent.empty() && close_on_empty) {
       ldout(msgr->cct,10) << "writer out and sent queues empty, closing" << dendl;
@@ -1684,7 +1962,73 @@ static void alloc_aligned_buffer(bufferlist& data, unsigned len, unsigned off)
   }
 }
 
-int Pipe::read_message(Message **pm)
+int Pipe::read_frag()
+{
+  ceph_le32 le_len[2];
+  if (tcp_read((char*)le_len, sizeof(le_len)) < 0)
+    return -1;
+  unsigned len = le_len[0];
+  uint64_t total = le_len[1];
+  if (len == 0 || in_frags.length() + len >= total ||
+      (in_frag_total && total != in_frag_total)) {
+    ldout(msgr->cct,0) << "reader got bad MSG_FRAG of " << len << "/" << total
+		       << " bytes after " << in_frags.length() << "/" << in_frag_total
+		       << dendl;
+    return -1;
+  }
+  ldout(msgr->cct,20) << "reader got fragment of " << len << "/" << total
+		      << " bytes after " << in_frags.length() << dendl;
+
+  // the first fragment takes the whole message from the throttlers.
+  // taking them a fragment at a time lets connections that each hold
+  // part of a message fill the throttlers and wait on each other.  the
+  // bytes are held until the MSG_LAST, whose message then owns them.
+  if (!in_frag_total) {
+    Connection *con = connection_state.get();
+    if (policy.throttler_bytes)
+      policy.throttler_bytes->get(total, con, get_throttle_name());
+    msgr->dispatch_throttler.get(total, con, get_throttle_name());
+    in_frag_total = total;
+  }
+
+  // the sender ends each fragment on a page boundary of the data's
+  // final position; lay the buffer out to match
+  bufferlist frag;
+  alloc_aligned_buffer(frag, len, -len & ~CEPH_PAGE_MASK);
+  for (list<bufferptr>::const_iterator p = frag.buffers().begin();
+       p != frag.buffers().end();
+       ++p) {
+    if (tcp_read((char*)p->c_str(), p->length()) < 0)
+      return -1;  // discard_in_frags() gives the throttlers back
+  }
+  in_frags.claim_append(frag);
+  return 0;
+}
+
+const string& Pipe::get_throttle_name()
+{
+  if (throttle_name.empty()) {
+    ostringstream ss;
+    ss << ceph_entity_type_name(peer_type) << " " << peer_addr;
+    throttle_name = ss.str();
+  }
+  return throttle_name;
+}
+
+void Pipe::discard_in_frags()
+{
+  if (!in_frag_total)
+    return;
+  ldout(msgr->cct,10) << "discarding " << in_frags.length() << " bytes of fragments of "
+		      << in_frag_total << dendl;
+  if (policy.throttler_bytes)
+    policy.throttler_bytes->put(in_frag_total, connection_state.get());
+  msgr->dispatch_throttle_release(in_frag_total, connection_state.get());
+  in_frags.clear();
+  in_frag_total = 0;
+}
+
+int Pipe::read_message(Message **pm, bool last)
 {
   int ret = -1;
   // envelope
@@ -1723,37 +2067,57 @@ int Pipe::read_message(Message **pm)
     return -1;
   }
 
-  bufferlist front, middle, data;
+  bufferlist front, middle, data, frags;
   int front_len, middle_len;
-  unsigned data_len, data_off;
+  unsigned data_len, data_off, frags_len;
   int aborted;
   Message *message;
   utime_t recv_stamp = ceph_clock_now(msgr->cct);
 
+  uint64_t message_size = header.front_len + header.middle_len + header.data_len;
+  uint64_t reserved = 0;
+
+  // the leading data came in MSG_FRAGs, which already hold the whole
+  // message's share of the throttlers
+  if (last) {
+    if (in_frags.length() == 0 || in_frags.length() >= header.data_len ||
+	message_size != in_frag_total) {
+      ldout(msgr->cct,0) << "reader got MSG_LAST of " << message_size
+			 << " bytes with data_len " << header.data_len
+			 << " after " << in_frags.length() << "/" << in_frag_total
+			 << " bytes of fragments" << dendl;
+      return -1;
+    }
+    frags.claim(in_frags);
+    reserved = in_frag_total;
+    in_frag_total = 0;
+  }
+  frags_len = frags.length();
+
   if (policy.throttler_messages) {
     ldout(msgr->cct,10) << "reader wants " << 1 << " message from policy throttler "
 			<< policy.throttler_messages->get_current() << "/"
 			<< policy.throttler_messages->get_max() << dendl;
-    policy.throttler_messages->get();
+    policy.throttler_messages->get(1, connection_state.get(), get_throttle_name());
   }
 
-  uint64_t message_size = header.front_len + header.middle_len + header.data_len;
-  if (message_size) {
+  if (message_size > reserved) {
+    uint64_t want = message_size - reserved;
     if (policy.throttler_bytes) {
-      ldout(msgr->cct,10) << "reader wants " << message_size << " bytes from policy throttler "
+      ldout(msgr->cct,10) << "reader wants " << want << " bytes from policy throttler "
 	       << policy.throttler_bytes->get_current() << "/"
 	       << policy.throttler_bytes->get_max() << dendl;
-      policy.throttler_bytes->get(message_size);
+      policy.throttler_bytes->get(want, connection_state.get(), get_throttle_name());
     }
 
     // throttle total bytes waiting for dispatch.  do this _after_ the
     // policy throttle, as this one does not deadlock (unless dispatch
     // blocks indefinitely, which it shouldn't).  in contrast, the
     // policy throttle carries for the lifetime of the message.
-    ldout(msgr->cct,10) << "reader wants " << message_size << " from dispatch throttler "
+    ldout(msgr->cct,10) << "reader wants " << want << " from dispatch throttler "
 	     << msgr->dispatch_throttler.get_current() << "/"
 	     << msgr->dispatch_throttler.get_max() << dendl;
-    msgr->dispatch_throttler.get(message_size);
+    msgr->dispatch_throttler.get(want, connection_state.get(), get_throttle_name());
   }
 
   utime_t throttle_stamp = ceph_clock_now(msgr->cct);
@@ -1761,20 +2125,16 @@ int Pipe::read_message(Message **pm)
   // read front
   front_len = header.front_len;
   if (front_len) {
-    bufferptr bp = buffer::create(front_len);
-    if (tcp_read(bp.c_str(), front_len) < 0)
+    if (tcp_read_section(front, front_len) < 0)
       goto out_dethrottle;
-    front.push_back(bp);
     ldout(msgr->cct,20) << "reader got front " << front.length() << dendl;
   }
 
   // read middle
   middle_len = header.middle_len;
   if (middle_len) {
-    bufferptr bp = buffer::create(middle_len);
-    if (tcp_read(bp.c_str(), middle_len) < 0)
+    if (tcp_read_section(middle, middle_len) < 0)
       goto out_dethrottle;
-    middle.push_back(bp);
     ldout(msgr->cct,20) << "reader got middle " << middle.length() << dendl;
   }
 
@@ -1783,8 +2143,9 @@ int Pipe::read_message(Message **pm)
   data_len = le32_to_cpu(header.data_len);
   data_off = le32_to_cpu(header.data_off);
   if (data_len) {
-    unsigned offset = 0;
-    unsigned left = data_len;
+    unsigned offset = frags_len;
+    unsigned left = data_len - frags_len;
+    data.claim(frags);
 
     bufferlist newbuf, rxbuf;
     bufferlist::iterator blp;
@@ -1814,9 +2175,9 @@ int Pipe::read_message(Message **pm)
       } else {
 	if (!newbuf.length()) {
 	  ldout(msgr->cct,20) << "reader allocating new rx buffer at offset " << offset << dendl;
-	  alloc_aligned_buffer(newbuf, data_len, data_off);
+	  alloc_aligned_buffer(newbuf, data_len - frags_len, data_off + frags_len);
 	  blp = newbuf.begin();
-	  blp.advance(offset);
+	  blp.advance(offset - frags_len);
 	}
       }
       bufferptr bp = blp.get_current_ptr();
@@ -1882,6 +2243,8 @@ int Pipe::read_message(Message **pm)
     } 
   }
 
+  // the throttlers know us by our Connection
+  message->set_connection(connection_state.get());
   message->set_byte_throttler(policy.throttler_bytes);
   message->set_message_throttler(policy.throttler_messages);
 
@@ -1902,17 +2265,17 @@ int Pipe::read_message(Message **pm)
     ldout(msgr->cct,10) << "reader releasing " << 1 << " message to policy throttler "
 			<< policy.throttler_messages->get_current() << "/"
 			<< policy.throttler_messages->get_max() << dendl;
-    policy.throttler_messages->put();
+    policy.throttler_messages->put(1, connection_state.get());
   }
   if (message_size) {
     if (policy.throttler_bytes) {
       ldout(msgr->cct,10) << "reader releasing " << message_size << " bytes to policy throttler "
 			  << policy.throttler_bytes->get_current() << "/"
 			  << policy.throttler_bytes->get_max() << dendl;
-      policy.throttler_bytes->put(message_size);
+      policy.throttler_bytes->put(message_size, connection_state.get());
     }
 
-    msgr->dispatch_throttle_release(message_size);
+    msgr->dispatch_throttle_release(message_size, connection_state.get());
   }
   return ret;
 }
@@ -1975,18 +2338,8 @@ int Pipe::write_ack(uint64_t seq)
   ceph_le64 s;
   s = seq;
 
-  struct msghdr msg;
-  memset(&msg, 0, sizeof(msg));
-  struct iovec msgvec[2];
-  msgvec[0].iov_base = &c;
-  msgvec[0].iov_len = 1;
-  msgvec[1].iov_base = &s;
-  msgvec[1].iov_len = sizeof(s);
-  msg.msg_iov = msgvec;
-  msg.msg_iovlen = 2;
-  
-  if (do_sendmsg(&msg, 1 + sizeof(s), true) < 0)
-    return -1;	
+  out_pending.append(&c, 1);
+  out_pending.append((char*)&s, sizeof(s));
   return 0;
 }
 
@@ -1995,47 +2348,22 @@ int Pipe::write_keepalive()
   ldout(msgr->cct,10) << "write_keepalive" << dendl;
 
   char c = CEPH_MSGR_TAG_KEEPALIVE;
-
-  struct msghdr msg;
-  memset(&msg, 0, sizeof(msg));
-  struct iovec msgvec[2];
-  msgvec[0].iov_base = &c;
-  msgvec[0].iov_len = 1;
-  msg.msg_iov = msgvec;
-  msg.msg_iovlen = 1;
-  
-  if (do_sendmsg(&msg, 1) < 0)
-    return -1;	
+  out_pending.append(&c, 1);
   return 0;
 }
 
 
-int Pipe::write_message(ceph_msg_header& header, ceph_msg_footer& footer, bufferlist& blist)
+int Pipe::write_message(ceph_msg_header& header, ceph_msg_footer& footer, bufferlist& blist,
+			bool more, char tag)
 {
-  int ret;
+  // tag and envelope are copied, so the caller's header need not
+  // outlive the batch
+  out_pending.append(&tag, 1);
 
-  // set up msghdr and iovecs
-  struct msghdr msg;
-  memset(&msg, 0, sizeof(msg));
-  struct iovec *msgvec = new iovec[3 + blist.buffers().size()];  // conservative upper bound
-  msg.msg_iov = msgvec;
-  int msglen = 0;
-  
-  // send tag
-  char tag = CEPH_MSGR_TAG_MSG;
-  msgvec[msg.msg_iovlen].iov_base = &tag;
-  msgvec[msg.msg_iovlen].iov_len = 1;
-  msglen++;
-  msg.msg_iovlen++;
-
-  // send envelope
-  ceph_msg_header_old oldheader;
   if (connection_state->has_feature(CEPH_FEATURE_NOSRCADDR)) {
-    msgvec[msg.msg_iovlen].iov_base = (char*)&header;
-    msgvec[msg.msg_iovlen].iov_len = sizeof(header);
-    msglen += sizeof(header);
-    msg.msg_iovlen++;
+    out_pending.append((char*)&header, sizeof(header));
   } else {
+    ceph_msg_header_old oldheader;
     memcpy(&oldheader, &header, sizeof(header));
     oldheader.src.name = header.src;
     oldheader.src.addr = connection_state->get_peer_addr();
@@ -2043,91 +2371,100 @@ int Pipe::write_message(ceph_msg_header& header, ceph_msg_footer& footer, buffer
     oldheader.reserved = header.reserved;
     oldheader.crc = ceph_crc32c(0, (unsigned char*)&oldheader,
 				sizeof(oldheader) - sizeof(oldheader.crc));
-    msgvec[msg.msg_iovlen].iov_base = (char*)&oldheader;
-    msgvec[msg.msg_iovlen].iov_len = sizeof(oldheader);
-    msglen += sizeof(oldheader);
-    msg.msg_iovlen++;
+    out_pending.append((char*)&oldheader, sizeof(oldheader));
   }
 
-  // payload (front+data)
-  list<bufferptr>::const_iterator pb = blist.buffers().begin();
-  int b_off = 0;  // carry-over buffer offset, if any
-  int bl_pos = 0; // blist pos
-  int left = blist.length();
-
-  while (left > 0) {
-    int donow = MIN(left, (int)pb->length()-b_off);
-    if (donow == 0) {
-      ldout(msgr->cct,0) << "donow = " << donow << " left " << left << " pb->length " << pb->length()
-	      << " b_off " << b_off << dendl;
-    }
-    assert(donow > 0);
-    ldout(msgr->cct,30) << " bl_pos " << bl_pos << " b_off " << b_off
-	     << " leftinchunk " << left
-	     << " buffer len " << pb->length()
-	     << " writing " << donow 
-	     << dendl;
-    
-    if (msg.msg_iovlen >= IOV_MAX-2) {
-      if (do_sendmsg(&msg, msglen, true))
-	goto fail;
-      
-      // and restart the iov
-      msg.msg_iov = msgvec;
-      msg.msg_iovlen = 0;
-      msglen = 0;
-    }
-    
-    msgvec[msg.msg_iovlen].iov_base = (void*)(pb->c_str()+b_off);
-    msgvec[msg.msg_iovlen].iov_len = donow;
-    msglen += donow;
-    msg.msg_iovlen++;
-    
-    left -= donow;
-    assert(left >= 0);
-    b_off += donow;
-    bl_pos += donow;
-    if (left == 0)
-      break;
-    while (b_off == (int)pb->length()) {
-      ++pb;
-      b_off = 0;
-    }
+  // payload (front+middle+data).  small segments are copied into the
+  // tail of out_pending so that runs of them become a single iovec;
+  // larger ones are referenced in place.
+  unsigned coalesce = msgr->cct->_conf->ms_tcp_coalesce_bytes;
+  for (list<bufferptr>::const_iterator pb = blist.buffers().begin();
+       pb != blist.buffers().end();
+       ++pb) {
+    if (pb->length() == 0)
+      continue;
+    if (pb->length() < coalesce)
+      out_pending.append(pb->c_str(), pb->length());
+    else
+      out_pending.append(*pb);
   }
-  assert(left == 0);
 
   // send footer; if receiver doesn't support signatures, use the old footer format
-
-  ceph_msg_footer_old old_footer;
   if (connection_state->has_feature(CEPH_FEATURE_MSG_AUTH)) {
-    msgvec[msg.msg_iovlen].iov_base = (void*)&footer;
-    msgvec[msg.msg_iovlen].iov_len = sizeof(footer);
-    msglen += sizeof(footer);
-    msg.msg_iovlen++;
+    out_pending.append((char*)&footer, sizeof(footer));
   } else {
+    ceph_msg_footer_old old_footer;
     old_footer.front_crc = footer.front_crc;   
     old_footer.middle_crc = footer.middle_crc;   
     old_footer.data_crc = footer.data_crc;   
     old_footer.flags = footer.flags;   
-    msgvec[msg.msg_iovlen].iov_base = (char*)&old_footer;
-    msgvec[msg.msg_iovlen].iov_len = sizeof(old_footer);
-    msglen += sizeof(old_footer);
-    msg.msg_iovlen++;
+    out_pending.append((char*)&old_footer, sizeof(old_footer));
   }
 
-  // send
-  if (do_sendmsg(&msg, msglen))
-    goto fail;
+  // keep batching while the caller has more to send, unless the batch
+  // is already big enough to be worth a syscall on its own
+  if (more &&
+      out_pending.length() < msgr->cct->_conf->ms_tcp_batch_bytes &&
+      out_pending.buffers().size() < IOV_MAX)
+    return 0;
+  return flush_pending(more);
+}
 
-  ret = 0;
+int Pipe::write_frag(bufferlist& bl, unsigned total)
+{
+  char tag = CEPH_MSGR_TAG_MSG_FRAG;
+  ceph_le32 len[2];
+  len[0] = bl.length();
+  len[1] = total;
+  out_pending.append(&tag, 1);
+  out_pending.append((char*)len, sizeof(len));
+  out_pending.append(bl);
+  return flush_pending(true);
+}
+
+int Pipe::flush_pending(bool more)
+{
+  if (out_pending.length() == 0)
+    return 0;
+
+  ldout(msgr->cct,20) << "flush_pending " << out_pending.length() << " bytes in "
+		      << out_pending.buffers().size() << " segments"
+		      << (more ? " (more)" : "") << dendl;
+
+  unsigned nvec = MIN(out_pending.buffers().size(), (unsigned)IOV_MAX);
+  struct iovec *msgvec = new iovec[nvec];
+  int ret = 0;
+
+  struct msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = msgvec;
+  int msglen = 0;
+
+  unsigned left = out_pending.buffers().size();
+  for (list<bufferptr>::const_iterator pb = out_pending.buffers().begin();
+       pb != out_pending.buffers().end();
+       ++pb) {
+    msgvec[msg.msg_iovlen].iov_base = (void*)pb->c_str();
+    msgvec[msg.msg_iovlen].iov_len = pb->length();
+    msglen += pb->length();
+    msg.msg_iovlen++;
+    --left;
+
+    if (msg.msg_iovlen == nvec || left == 0) {
+      if (do_sendmsg(&msg, msglen, more || left > 0)) {
+	ret = -1;
+	break;
+      }
+      // and restart the iov
+      memset(&msg, 0, sizeof(msg));
+      msg.msg_iov = msgvec;
+      msglen = 0;
+    }
+  }
 
- out:
   delete[] msgvec;
+  out_pending.clear();
   return ret;
-
- fail:
-  ret = -1;
-  goto out;
 }
 
 
@@ -2160,10 +2497,28 @@ int Pipe::tcp_read(char *buf, int len)
   return len;
 }
 
+int Pipe::tcp_read_section(bufferlist& bl, unsigned len)
+{
+  if (recv_len >= len) {
+    bl.push_back(bufferptr(recv_buf, recv_ofs, len));
+    recv_buf_sliced = true;
+    recv_ofs += len;
+    recv_len -= len;
+    return 0;
+  }
+  bufferptr bp = buffer::create(len);
+  if (tcp_read(bp.c_str(), len) < 0)
+    return -1;
+  bl.push_back(bp);
+  return 0;
+}
+
 int Pipe::tcp_read_wait()
 {
   if (sd < 0)
     return -1;
+  if (has_pending_data())
+    return 0;
   struct pollfd pfd;
   short evmask;
   pfd.fd = sd;
@@ -2188,10 +2543,42 @@ int Pipe::tcp_read_wait()
   return 0;
 }
 
+int Pipe::buffered_recv(char *buf, int len, int flags)
+{
+  if (recv_len) {
+    int n = MIN((unsigned)len, recv_len);
+    memcpy(buf, recv_buf.c_str() + recv_ofs, n);
+    recv_ofs += n;
+    recv_len -= n;
+    return n;
+  }
+
+  int prefetch = msgr->cct->_conf->ms_tcp_prefetch_max_size;
+  if (len >= prefetch)
+    return ::recv(sd, buf, len, flags);
+
+  // refill.  if fronts were sliced out of the old buffer, leave it to
+  // them.
+  if (!recv_buf.have_raw() || recv_buf_sliced ||
+      recv_buf.length() != (unsigned)prefetch) {
+    recv_buf = buffer::create_page_aligned(prefetch);
+    recv_buf_sliced = false;
+  }
+  recv_ofs = 0;
+  int got = ::recv(sd, recv_buf.c_str(), recv_buf.length(), flags);
+  if (got <= 0)
+    return got;
+  int n = MIN(len, got);
+  memcpy(buf, recv_buf.c_str(), n);
+  recv_ofs = n;
+  recv_len = got - n;
+  return n;
+}
+
 int Pipe::tcp_read_nonblocking(char *buf, int len)
 {
 again:
-  int got = ::recv( sd, buf, len, MSG_DONTWAIT );
+  int got = buffered_recv(buf, len, MSG_DONTWAIT);
   if (got < 0) {
     if (errno == EAGAIN || errno == EINTR) {
       goto again;
@@ -153,13 +153,24 @@ class DispatchQueue;
     ConnectionRef connection_state;
 
     utime_t backoff;         // backoff time
+    unsigned backoff_seed;   ///< rand_r() state for the backoff jitter
 
     bool reader_running, reader_needs_join;
+    /// reader thread is waiting for a (re)connect and off the socket
+    bool reader_parked;
+    bool reader_dispatching; /// reader thread is in a fast dispatch, pipe_lock dropped
+    bool notify_on_dispatch_done; /// somebody waits on cond for the above to clear
     bool writer_running;
 
     map<int, list<Message*> > out_q;  // priority queue for outbound msgs
     DispatchQueue *in_q;
     list<Message*> sent;
+    /// message whose data is going out in MSG_FRAGs (see writer()),
+    /// the out_q priority it came from, and how much data has been
+    /// sent.  it gets its seq when its MSG_LAST goes out.
+    Message *out_frag;
+    int out_frag_prio;
+    unsigned out_frag_sent;
     Cond cond;
     bool keepalive;
     bool halt_delivery; //if a pipe's queue is destroyed, stop adding to it
@@ -169,7 +180,24 @@ class DispatchQueue;
     uint64_t out_seq;
     uint64_t in_seq, in_seq_acked;
     
+    /// sd is a unix-domain socket to a peer on this host
+    bool unix_socket;
+
     void set_socket_options();
+    /**
+     * Try the peer's unix-domain socket, as bound to its own ip or to
+     * INADDR_ANY.
+     *
+     * @return a connected socket, or -1 if the peer has none
+     */
+    int connect_unix();
+    /**
+     * Connect sd to peer_addr, giving up after ms_tcp_connect_timeout
+     * instead of waiting out the kernel's SYN retries.
+     *
+     * @return 0 for success, or -1 on error (with errno set)
+     */
+    int tcp_connect();
 
     int accept();   // server handshake
     int connect();  // client handshake
@@ -179,8 +207,62 @@ class DispatchQueue;
 
     int randomize_out_seq();
 
-    int read_message(Message **pm);
-    int write_message(ceph_msg_header& h, ceph_msg_footer& f, bufferlist& body);
+    /**
+     * read a message following a MSG or MSG_LAST tag
+     *
+     * @param last the tag was MSG_LAST: the leading data is in in_frags
+     * @return 0 for success (*pm is NULL if the message was aborted),
+     *         or <0 on error
+     */
+    int read_message(Message **pm, bool last=false);
+    /**
+     * read a MSG_FRAG onto in_frags.  the first fragment of a message
+     * takes the whole message's size from the policy and dispatch
+     * throttlers, so that a connection never holds part of a message
+     * while it waits for room for the rest.
+     *
+     * @return 0 for success, or -1 on error
+     */
+    int read_frag();
+    /// drop in_frags and give their throttler bytes back
+    void discard_in_frags();
+    /// data received in MSG_FRAGs for the next MSG_LAST; reader only
+    bufferlist in_frags;
+    /// size of the message in_frags belong to, as taken from the
+    /// throttlers (0 if none); reader only
+    uint64_t in_frag_total;
+    /// how the throttlers show our Connection; reader only
+    string throttle_name;
+    const string& get_throttle_name();
+
+    /// bytes queued by write_{message,ack,keepalive} but not yet sent;
+    /// only touched by the writer thread
+    bufferlist out_pending;
+
+    /**
+     * Queue a message on out_pending.  Segments shorter than
+     * ms_tcp_coalesce_bytes are copied so that adjacent ones share an
+     * iovec; the rest are referenced in place.  If more is set and the
+     * batch is still under ms_tcp_batch_bytes nothing is sent yet.
+     *
+     * @return 0, or -1 if a flush failed
+     */
+    int write_message(ceph_msg_header& h, ceph_msg_footer& f, bufferlist& body,
+		      bool more=false, char tag=CEPH_MSGR_TAG_MSG);
+    /**
+     * Send bl as a MSG_FRAG of a message of total bytes (front, middle
+     * and data), along with whatever is batched on out_pending.
+     *
+     * @return 0, or -1 on failure (unrecoverable -- close the socket).
+     */
+    int write_frag(bufferlist& bl, unsigned total);
+    /**
+     * Send out_pending with as few sendmsg calls as IOV_MAX allows and
+     * clear it.  If more is set, the final call passes MSG_MORE.
+     *
+     * @return 0, or -1 on failure (unrecoverable -- close the socket).
+     */
+    int flush_pending(bool more=false);
     /**
      * Write the given data (of length len) to the Pipe's socket. This function
      * will loop until all passed data has been written out.
@@ -210,7 +292,7 @@ class DispatchQueue;
     void start_reader();
     void start_writer();
     void maybe_start_delay_thread();
-    void join_reader();
+    void park_reader();
 
     // public constructors
     static const Pipe& Server(int s);
@@ -218,7 +300,7 @@ class DispatchQueue;
 
     __u32 get_out_seq() { return out_seq; }
 
-    bool is_queued() { return !out_q.empty() || keepalive; }
+    bool is_queued() { return !out_q.empty() || out_frag || keepalive; }
 
     entity_addr_t& get_peer_addr() { return peer_addr; }
 
@@ -262,7 +344,8 @@ class DispatchQueue;
       return m;
     }
 
-    /// move all messages in the sent list back into the queue at the highest priority.
+    /// move all messages in the sent list back into the queue at the
+    /// highest priority, and out_frag back to the head of its own.
     void requeue_sent();
     /// discard messages requeued by requeued_sent() up to a given seq
     void discard_requeued_up_to(uint64_t seq);
@@ -301,6 +384,41 @@ class DispatchQueue;
      */
     int tcp_read_nonblocking(char *buf, int len);
 
+    /**
+     * recv() through the read-ahead buffer
+     *
+     * Bytes already buffered are served first.  Reads shorter than
+     * ms_tcp_prefetch_max_size refill the buffer with whatever the
+     * socket has; longer ones go straight into buf.
+     *
+     * @return bytes copied into buf, or the recv() result on error/EOF
+     */
+    int buffered_recv(char *buf, int len, int flags);
+
+    /**
+     * read a message section of len bytes onto bl
+     *
+     * If the whole section is already buffered it is sliced out of
+     * recv_buf without copying; otherwise it is read into a fresh
+     * buffer.
+     *
+     * @return 0 for success, or -1 on error
+     */
+    int tcp_read_section(bufferlist& bl, unsigned len);
+
+    /// read-ahead buffer; [recv_ofs, recv_ofs+recv_len) is unconsumed.
+    /// once a section has been sliced out of it (recv_buf_sliced) it is
+    /// replaced rather than rewritten: the slice may still be alive, and
+    /// the raw may carry crcs cached for it.
+    bufferptr recv_buf;
+    unsigned recv_ofs, recv_len;
+    bool recv_buf_sliced;
+
+    bool has_pending_data() { return recv_len > 0; }
+    void reset_recv_buffer() {
+      recv_ofs = recv_len = 0;
+    }
+
     /**
      * blocking write of bytes to socket
      *
@@ -55,6 +55,7 @@ SimpleMessenger::SimpleMessenger(CephContext *cct, entity_name_t name,
     local_connection(new Connection(this))
 {
   ceph_spin_init(&global_seq_lock);
+  dispatch_throttler.set_fair_share(cct->_conf->ms_dispatch_throttle_fair_share);
   init_local_connection();
 }
 
@@ -187,13 +188,13 @@ int SimpleMessenger::get_proto_version(int peer_type, bool connect)
 #undef dout_prefix
 #define dout_prefix _prefix(_dout, this)
 
-void SimpleMessenger::dispatch_throttle_release(uint64_t msize)
+void SimpleMessenger::dispatch_throttle_release(uint64_t msize, Connection *con)
 {
   if (msize) {
     ldout(cct,10) << "dispatch_throttle_release " << msize << " to dispatch throttler "
 	    << dispatch_throttler.get_current() << "/"
 	    << dispatch_throttler.get_max() << dendl;
-    dispatch_throttler.put(msize);
+    dispatch_throttler.put(msize, con);
   }
 }
 
@@ -702,6 +703,17 @@ void SimpleMessenger::learned_addr(const entity_addr_t &peer_addr_for_me)
   lock.Unlock();
 }
 
+string SimpleMessenger::get_unix_socket_path(const entity_addr_t& addr)
+{
+  const string& dir = cct->_conf->ms_unix_socket_dir;
+  if (dir.empty() || !addr.is_ip())
+    return string();
+  entity_addr_t a = addr;
+  ostringstream ss;
+  ss << dir << "/" << a.ss_addr() << "." << a.get_nonce();
+  return ss.str();
+}
+
 void SimpleMessenger::unlearn_addr()
 {
   lock.Lock();
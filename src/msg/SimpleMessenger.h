@@ -416,6 +416,13 @@ public:
    */
   void learned_addr(const entity_addr_t& peer_addr_for_me);
 
+  /**
+   * Path of the unix-domain socket that a messenger bound to addr
+   * listens on for peers on the same host, or "" if ms_unix_socket_dir
+   * is not set.
+   */
+  string get_unix_socket_path(const entity_addr_t& addr);
+
   /**
    * Tell the SimpleMessenger its address is no longer known
    *
@@ -445,8 +452,9 @@ public:
    * Release memory accounting back to the dispatch throttler.
    *
    * @param msize The amount of memory to release.
+   * @param con The Connection it was taken for.
    */
-  void dispatch_throttle_release(uint64_t msize);
+  void dispatch_throttle_release(uint64_t msize, Connection *con);
 
   /**
    * This function is used by the reaper thread. As long as nobody
@@ -115,11 +115,20 @@ public:
     ::decode(_type, bl);
     ::decode(_num, bl);
   }
+  void bound_encode(size_t& p, uint64_t features=0) const {
+    ::bound_encode(_type, p);
+    ::bound_encode(_num, p);
+  }
+  void encode(bufferlist::contiguous_appender& p, uint64_t features=0) const {
+    ::encode(_type, p);
+    ::encode(_num, p);
+  }
   void dump(Formatter *f) const;
 
   static void generate_test_instances(list<entity_name_t*>& o);
 };
 WRITE_CLASS_ENCODER(entity_name_t)
+WRITE_CLASS_BOUNDED_ENCODER(entity_name_t)
 
 inline bool operator== (const entity_name_t& l, const entity_name_t& r) { 
   return (l.type() == r.type()) && (l.num() == r.num()); }
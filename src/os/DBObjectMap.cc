@@ -156,7 +156,8 @@ string DBObjectMap::ghobject_key(const ghobject_t &oid)
     t += snprintf(t, end - t, ".%llx", (long long unsigned)oid.hobj.pool);
   snprintf(t, end - t, ".%.*X", (int)(sizeof(oid.hobj.hash)*2), oid.hobj.hash);
 
-  if (oid.generation != ghobject_t::NO_GEN) {
+  if (oid.generation != ghobject_t::NO_GEN ||
+      oid.shard_id != ghobject_t::NO_SHARD) {
     assert(oid.shard_id != ghobject_t::NO_SHARD);
 
     t += snprintf(t, end - t, ".%llx", (long long unsigned)oid.generation);
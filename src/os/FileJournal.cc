@@ -838,7 +838,7 @@ void FileJournal::queue_completions_thru(uint64_t seq)
     if (next.finish)
       finisher->queue(next.finish);
     if (next.tracked_op)
-      next.tracked_op->mark_event("journaled_completion_queued");
+      next.tracked_op->mark_event(TrackedOp::EVENT_JOURNALED_COMPLETION_QUEUED);
   }
   finisher_cond.Signal();
 }
@@ -898,7 +898,7 @@ int FileJournal::prepare_single_write(bufferlist& bl, off64_t& queue_pos, uint64
   bl.append((const char*)&h, sizeof(h));
 
   if (next_write.tracked_op)
-    next_write.tracked_op->mark_event("write_thread_in_journal_buffer");
+    next_write.tracked_op->mark_event(TrackedOp::EVENT_WRITE_THREAD_IN_JOURNAL_BUFFER);
 
   // pop from writeq
   pop_write();
@@ -1429,7 +1429,7 @@ void FileJournal::submit_entry(uint64_t seq, bufferlist& e, int alignment,
   throttle_ops.take(1);
   throttle_bytes.take(e.length());
   if (osd_op)
-    osd_op->mark_event("commit_queued_for_journal_write");
+    osd_op->mark_event(TrackedOp::EVENT_COMMIT_QUEUED_FOR_JOURNAL_WRITE);
   if (logger) {
     logger->set(l_os_jq_max_ops, throttle_ops.get_max());
     logger->set(l_os_jq_max_bytes, throttle_bytes.get_max());
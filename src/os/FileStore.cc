@@ -183,7 +183,7 @@ int FileStore::lfn_truncate(coll_t cid, const ghobject_t& oid, off_t length)
   r = ::ftruncate(**fd, length);
   if (r < 0)
     r = -errno;
-  if (r >= 0 && m_filestore_sloppy_crc) {
+  if (r >= 0 && (m_filestore_sloppy_crc || m_filestore_strict_crc)) {
     int rc = backend->_crc_update_truncate(**fd, length);
     assert(rc >= 0);
   }
@@ -435,6 +435,7 @@ FileStore::FileStore(const std::string &base, const std::string &jdev, const cha
   m_filestore_dump_fmt(true),
   m_filestore_sloppy_crc(g_conf->filestore_sloppy_crc),
   m_filestore_sloppy_crc_block_size(g_conf->filestore_sloppy_crc_block_size),
+  m_filestore_strict_crc(g_conf->filestore_strict_crc),
   m_fs_type(FS_TYPE_NONE),
   m_filestore_max_inline_xattr_size(0),
   m_filestore_max_inline_xattrs(0)
@@ -2554,17 +2555,26 @@ int FileStore::read(
     return got;
   }
   bptr.set_length(got);   // properly size the buffer
-  bl.push_back(bptr);   // put it in the target bufferlist
+  bufferlist rbl;
+  rbl.push_back(bptr);
 
-  if (m_filestore_sloppy_crc && (!replaying || backend->can_checkpoint())) {
+  if ((m_filestore_sloppy_crc || m_filestore_strict_crc) &&
+      (!replaying || backend->can_checkpoint())) {
     ostringstream ss;
-    int errors = backend->_crc_verify_read(**fd, offset, got, bl, &ss);
-    if (errors > 0) {
-      dout(0) << "FileStore::read " << cid << "/" << oid << " " << offset << "~"
-	      << got << " ... BAD CRC:\n" << ss.str() << dendl;
-      assert(0 == "bad crc on read");
+    int errors = backend->_crc_verify_read(**fd, offset, got, rbl, &ss);
+    if (errors > 0 || (errors < 0 && m_filestore_strict_crc)) {
+      derr << "FileStore::read " << cid << "/" << oid << " " << offset << "~"
+	   << got << " ... BAD CRC:\n" << ss.str() << dendl;
+      if (!m_filestore_strict_crc)
+	assert(0 == "bad crc on read");
+      // report the damage like a media error so that scrub and the
+      // client path treat it as such
+      lfn_close(fd);
+      assert(allow_eio || !m_filestore_fail_eio);
+      return -EIO;
     }
   }
+  bl.claim_append(rbl);   // put it in the target bufferlist
 
   lfn_close(fd);
 
@@ -2729,7 +2739,7 @@ int FileStore::_write(coll_t cid, const ghobject_t& oid,
   if (r == 0)
     r = bl.length();
 
-  if (r >= 0 && m_filestore_sloppy_crc) {
+  if (r >= 0 && (m_filestore_sloppy_crc || m_filestore_strict_crc)) {
     int rc = backend->_crc_update_write(**fd, offset, len, bl);
     assert(rc >= 0);
   }
@@ -2765,7 +2775,7 @@ int FileStore::_zero(coll_t cid, const ghobject_t& oid, uint64_t offset, size_t
     ret = -errno;
   lfn_close(fd);
 
-  if (ret >= 0 && m_filestore_sloppy_crc) {
+  if (ret >= 0 && (m_filestore_sloppy_crc || m_filestore_strict_crc)) {
     int rc = backend->_crc_update_zero(**fd, offset, len);
     assert(rc >= 0);
   }
@@ -2923,7 +2933,7 @@ int FileStore::_do_copy_range(int from, int to, uint64_t srcoff, uint64_t len, u
       break;
     pos += r;
   }
-  if (r >= 0 && m_filestore_sloppy_crc) {
+  if (r >= 0 && (m_filestore_sloppy_crc || m_filestore_strict_crc)) {
     int rc = backend->_crc_update_clone_range(from, to, srcoff, len, dstoff);
     assert(rc >= 0);
   }
@@ -4586,6 +4596,7 @@ const char** FileStore::get_tracked_conf_keys() const
     "filestore_replica_fadvise",
     "filestore_sloppy_crc",
     "filestore_sloppy_crc_block_size",
+    "filestore_strict_crc",
     NULL
   };
   return KEYS;
@@ -4615,6 +4626,7 @@ void FileStore::handle_conf_change(const struct md_config_t *conf,
       changed.count("filestore_fail_eio") ||
       changed.count("filestore_sloppy_crc") ||
       changed.count("filestore_sloppy_crc_block_size") ||
+      changed.count("filestore_strict_crc") ||
       changed.count("filestore_replica_fadvise")) {
     Mutex::Locker l(lock);
     m_filestore_min_sync_interval = conf->filestore_min_sync_interval;
@@ -4628,6 +4640,7 @@ void FileStore::handle_conf_change(const struct md_config_t *conf,
     m_filestore_replica_fadvise = conf->filestore_replica_fadvise;
     m_filestore_sloppy_crc = conf->filestore_sloppy_crc;
     m_filestore_sloppy_crc_block_size = conf->filestore_sloppy_crc_block_size;
+    m_filestore_strict_crc = conf->filestore_strict_crc;
   }
   if (changed.count("filestore_commit_timeout")) {
     Mutex::Locker l(sync_entry_timeo_lock);
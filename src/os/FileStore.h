@@ -635,6 +635,7 @@ private:
   atomic_t m_filestore_kill_at;
   bool m_filestore_sloppy_crc;
   int m_filestore_sloppy_crc_block_size;
+  bool m_filestore_strict_crc;
   enum fs_types m_fs_type;
 
   //Determined xattr handling based on fs type
@@ -697,6 +698,9 @@ protected:
   int get_crc_block_size() {
     return filestore->m_filestore_sloppy_crc_block_size;
   }
+  bool get_crc_strict() {
+    return filestore->m_filestore_strict_crc;
+  }
 public:
   FileStoreBackend(FileStore *fs) : filestore(fs) {}
   virtual ~FileStoreBackend() {};
@@ -713,7 +717,7 @@ public:
   virtual int do_fiemap(int fd, off_t start, size_t len, struct fiemap **pfiemap) = 0;
   virtual int clone_range(int from, int to, uint64_t srcoff, uint64_t len, uint64_t dstoff) = 0;
 
-  // hooks for (sloppy) crc tracking
+  // hooks for (sloppy or strict) crc tracking
   virtual int _crc_update_write(int fd, loff_t off, size_t len, const bufferlist& bl) = 0;
   virtual int _crc_update_truncate(int fd, loff_t off) = 0;
   virtual int _crc_update_zero(int fd, loff_t off, size_t len) = 0;
@@ -39,6 +39,7 @@
 #include "common/errno.h"
 #include "common/config.h"
 #include "common/sync_filesystem.h"
+#include "common/safe_io.h"
 
 #include "common/SloppyCRCMap.h"
 #include "os/chain_xattr.h"
@@ -302,6 +303,68 @@ int GenericFileStoreBackend::_crc_save(int fd, SloppyCRCMap *cm)
   return r;
 }
 
+/**
+ * read [off, off+len) from fd, zero-filling anything past EOF
+ *
+ * In strict mode every block crc covers a full block_size worth of
+ * data, with the bytes past the end of the object counted as zeros.
+ * This lets us cover the (short) last block of an object, and keeps
+ * the crc valid if the object is later extended by a truncate.
+ */
+int GenericFileStoreBackend::_crc_read_block(int fd, loff_t off, size_t len,
+					     bufferlist *bl)
+{
+  bufferptr bp(len);
+  int r = safe_pread(fd, bp.c_str(), len, off);
+  if (r < 0) {
+    derr << __func__ << " got " << cpp_strerror(r) << dendl;
+    return r;
+  }
+  if ((size_t)r < len)
+    memset(bp.c_str() + r, 0, len - r);
+  bl->append(bp);
+  return 0;
+}
+
+/// recalculate the crc for the block starting at off from the file contents
+int GenericFileStoreBackend::_crc_update_block(int fd, loff_t off,
+					       SloppyCRCMap *cm)
+{
+  int block_size = get_crc_block_size();
+  assert(ALIGNED(off, block_size));
+  bufferlist bl;
+  int r = _crc_read_block(fd, off, block_size, &bl);
+  if (r < 0)
+    return r;
+  cm->write(off, block_size, bl);
+  return 0;
+}
+
+/**
+ * recalculate the crcs of the partial blocks at either end of an extent
+ *
+ * SloppyCRCMap invalidates blocks that are only partially covered by an
+ * update.  In strict mode we instead re-read those blocks (which already
+ * reflect the update) so that every block of the object stays covered.
+ */
+int GenericFileStoreBackend::_crc_update_partial_blocks(int fd, loff_t off, size_t len,
+							SloppyCRCMap *cm)
+{
+  int block_size = get_crc_block_size();
+  loff_t end = off + len;
+  int r = 0;
+  if (!ALIGNED(off, block_size)) {
+    r = _crc_update_block(fd, ALIGN_DOWN(off, block_size), cm);
+    if (r < 0)
+      return r;
+  }
+  if (!ALIGNED(end, block_size) &&
+      ALIGN_DOWN(end, block_size) != ALIGN_DOWN(off, block_size)) {
+    r = _crc_update_block(fd, ALIGN_DOWN(end, block_size), cm);
+  }
+  return r;
+}
+
 int GenericFileStoreBackend::_crc_update_write(int fd, loff_t off, size_t len, const bufferlist& bl)
 {
   SloppyCRCMap scm(get_crc_block_size());
@@ -311,6 +374,11 @@ int GenericFileStoreBackend::_crc_update_write(int fd, loff_t off, size_t len, c
   ostringstream ss;
   scm.write(off, len, bl, &ss);
   dout(30) << __func__ << "\n" << ss.str() << dendl;
+  if (get_crc_strict()) {
+    r = _crc_update_partial_blocks(fd, off, len, &scm);
+    if (r < 0)
+      return r;
+  }
   r = _crc_save(fd, &scm);
   return r;
 }
@@ -322,6 +390,11 @@ int GenericFileStoreBackend::_crc_update_truncate(int fd, loff_t off)
   if (r < 0)
     return r;
   scm.truncate(off);
+  if (get_crc_strict() && !ALIGNED(off, get_crc_block_size())) {
+    r = _crc_update_block(fd, ALIGN_DOWN(off, get_crc_block_size()), &scm);
+    if (r < 0)
+      return r;
+  }
   r = _crc_save(fd, &scm);
   return r;
 }
@@ -333,6 +406,11 @@ int GenericFileStoreBackend::_crc_update_zero(int fd, loff_t off, size_t len)
   if (r < 0)
     return r;
   scm.zero(off, len);
+  if (get_crc_strict()) {
+    r = _crc_update_partial_blocks(fd, off, len, &scm);
+    if (r < 0)
+      return r;
+  }
   r = _crc_save(fd, &scm);
   return r;
 }
@@ -351,6 +429,20 @@ int GenericFileStoreBackend::_crc_update_clone_range(int srcfd, int destfd,
   ostringstream ss;
   scm_dst.clone_range(srcoff, len, dstoff, scm_src, &ss);
   dout(30) << __func__ << "\n" << ss.str() << dendl;
+  if (get_crc_strict()) {
+    int block_size = get_crc_block_size();
+    if (ALIGNED(srcoff, block_size) && ALIGNED(dstoff, block_size)) {
+      r = _crc_update_partial_blocks(destfd, dstoff, len, &scm_dst);
+    } else {
+      // source blocks do not line up with ours; recalculate them all
+      for (loff_t pos = ALIGN_DOWN(dstoff, block_size);
+	   pos < (loff_t)(dstoff + len) && r >= 0;
+	   pos += block_size)
+	r = _crc_update_block(destfd, pos, &scm_dst);
+    }
+    if (r < 0)
+      return r;
+  }
   r = _crc_save(destfd, &scm_dst);
   return r;
 }
@@ -362,5 +454,27 @@ int GenericFileStoreBackend::_crc_verify_read(int fd, loff_t off, size_t len, co
   int r = _crc_load_or_init(fd, &scm);
   if (r < 0)
     return r;
-  return scm.read(off, len, bl, out);
+  if (!get_crc_strict())
+    return scm.read(off, len, bl, out);
+
+  // extend the read to whole blocks so that the partial blocks at either
+  // end (including the last block of the object) are verified too
+  int block_size = get_crc_block_size();
+  loff_t start = ALIGN_DOWN(off, block_size);
+  loff_t end = ALIGN_UP((loff_t)(off + len), block_size);
+  if (start == end)
+    return 0;
+  bufferlist full;
+  if (start < off) {
+    r = _crc_read_block(fd, start, off - start, &full);
+    if (r < 0)
+      return r;
+  }
+  full.append(bl);
+  if ((loff_t)(off + len) < end) {
+    r = _crc_read_block(fd, off + len, end - (off + len), &full);
+    if (r < 0)
+      return r;
+  }
+  return scm.read(start, end - start, full, out);
 }
@@ -46,6 +46,9 @@ public:
 private:
   int _crc_load_or_init(int fd, SloppyCRCMap *cm);
   int _crc_save(int fd, SloppyCRCMap *cm);
+  int _crc_read_block(int fd, loff_t off, size_t len, bufferlist *bl);
+  int _crc_update_block(int fd, loff_t off, SloppyCRCMap *cm);
+  int _crc_update_partial_blocks(int fd, loff_t off, size_t len, SloppyCRCMap *cm);
 public:
   virtual int _crc_update_write(int fd, loff_t off, size_t len, const bufferlist& bl);
   virtual int _crc_update_truncate(int fd, loff_t off);
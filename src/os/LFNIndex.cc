@@ -661,7 +661,10 @@ string LFNIndex::lfn_generate_object_name(const ghobject_t &oid)
     t += snprintf(t, end - t, "%llx", (long long unsigned)oid.hobj.pool);
   full_name += string(buf);
 
-  if (oid.generation != ghobject_t::NO_GEN) {
+  // erasure coded objects carry their shard, with or without a
+  // generation: the parser reads back NO_GEN as is
+  if (oid.generation != ghobject_t::NO_GEN ||
+      oid.shard_id != ghobject_t::NO_SHARD) {
     assert(oid.shard_id != ghobject_t::NO_SHARD);
     full_name.append("_");
 
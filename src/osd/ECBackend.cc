@@ -0,0 +1,1218 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * Copyright (C) 2013 Inktank Storage, Inc.
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+#include <algorithm>
+
+#include "ECBackend.h"
+#include "common/errno.h"
+#include "messages/MOSDECSubOpRead.h"
+#include "messages/MOSDECSubOpReadReply.h"
+#include "messages/MOSDPGPush.h"
+#include "messages/MOSDPGPushReply.h"
+
+#define dout_subsys ceph_subsys_osd
+#define DOUT_PREFIX_ARGS this
+#undef dout_prefix
+#define dout_prefix _prefix(_dout, this)
+static ostream& _prefix(std::ostream *_dout, ECBackend *pgb) {
+  return *_dout << pgb->get_parent()->gen_dbg_prefix();
+}
+
+struct C_ECBackend_ReadShard : public Context {
+  ECBackend *pg;
+  OpRequestRef op;
+  C_ECBackend_ReadShard(ECBackend *pg, OpRequestRef op)
+    : pg(pg), op(op) {}
+  void finish(int) {
+    pg->finish_sub_read(op);
+  }
+};
+
+struct C_ECBackend_LocalRecovered : public Context {
+  ECBackend *pg;
+  hobject_t hoid;
+  C_ECBackend_LocalRecovered(ECBackend *pg, const hobject_t &hoid)
+    : pg(pg), hoid(hoid) {}
+  void finish(int) {
+    pg->on_local_recovered(hoid);
+  }
+};
+
+ECBackend::ECBackend(
+  PGBackend::Listener *pg,
+  coll_t coll,
+  OSDService *osd,
+  ceph::ErasureCodeInterfaceRef ec_impl,
+  uint64_t stripe_width) :
+  PGBackend(pg), coll(coll), osd(osd), cct(osd->cct),
+  temp_created(false),
+  temp_coll(coll_t::make_temp_coll(pg->get_info().pgid)),
+  ec_impl(ec_impl),
+  // the code pads a stripe up to its alignment: widen the stripe to
+  // the padded size so that the shards never store padding
+  sinfo(ec_impl->get_data_chunk_count() * ec_impl->get_chunk_size(stripe_width),
+	ec_impl->get_chunk_size(stripe_width)) {}
+
+int ECBackend::get_shard(int osd)
+{
+  shard_t shard;
+  if (osd == this->osd->whoami) {
+    shard = get_info().shard;
+  } else {
+    map<int, pg_info_t>::const_iterator i =
+      get_parent()->get_peer_info().find(osd);
+    if (i == get_parent()->get_peer_info().end())
+      return -1;
+    shard = i->second.shard;
+  }
+  if (shard >= ec_impl->get_chunk_count())  // NO_SHARD too
+    return -1;
+  return shard;
+}
+
+bool ECBackend::shard_is_readable(int osd, const hobject_t &hoid)
+{
+  if (osd == this->osd->whoami)
+    return !get_parent()->get_local_missing().is_missing(hoid);
+
+  map<int, pg_missing_t>::const_iterator m =
+    get_parent()->get_peer_missing().find(osd);
+  if (m != get_parent()->get_peer_missing().end() &&
+      m->second.is_missing(hoid))
+    return false;
+  map<int, pg_info_t>::const_iterator i =
+    get_parent()->get_peer_info().find(osd);
+  if (i != get_parent()->get_peer_info().end() &&
+      i->second.last_backfill < hoid)
+    return false;
+  return true;
+}
+
+void ECBackend::get_readable_shards(
+  const hobject_t &hoid,
+  map<int, int> *shards)
+{
+  const vector<int> &acting = get_parent()->get_actingbackfill();
+  for (vector<int>::const_iterator i = acting.begin();
+       i != acting.end();
+       ++i) {
+    int shard = get_shard(*i);
+    if (shard < 0 || shards->count(shard))
+      continue;
+    if (shard_is_readable(*i, hoid))
+      (*shards)[shard] = *i;
+  }
+}
+
+void ECBackend::run_recovery_op(
+  PGBackend::RecoveryHandle *_h,
+  int priority)
+{
+  ECRecoveryHandle *h = static_cast<ECRecoveryHandle *>(_h);
+  for (list<hobject_t>::iterator i = h->ops.begin();
+       i != h->ops.end();
+       ++i) {
+    map<hobject_t, RecoveryOp>::iterator r = recovery_ops.find(*i);
+    assert(r != recovery_ops.end());
+    RecoveryOp &rop = r->second;
+    if (rop.missing_on_shards.empty()) {
+      dout(0) << __func__ << ": " << *i << " is missing on "
+	      << rop.missing_on << " which hold no shard, giving up" << dendl;
+      get_parent()->cancel_pull(*i);
+      recovery_ops.erase(r);
+      continue;
+    }
+
+    rop.priority = priority;
+    dout(10) << __func__ << ": " << *i << " rebuilding shards "
+	     << rop.missing_on_shards << dendl;
+    send_recovery_read(rop);
+  }
+  delete h;
+}
+
+uint64_t ECBackend::get_recovery_chunk_size() const
+{
+  uint64_t chunk_size = sinfo.get_chunk_size();
+  uint64_t max = cct->_conf->osd_recovery_max_chunk;
+  return std::max(chunk_size, max - max % chunk_size);
+}
+
+void ECBackend::send_recovery_read(RecoveryOp &rop)
+{
+  tid_t tid = osd->get_tid();
+  ReadOp &op = tid_to_read_map[tid];
+  op.tid = tid;
+  op.hoid = rop.hoid;
+  op.priority = rop.priority;
+  op.chunk_off = rop.recovery_progress.data_recovered_to;
+  op.chunk_len = get_recovery_chunk_size();
+  if (rop.obc) {
+    uint64_t shard_size = get_ondisk_size(rop.obc->obs.oi.size);
+    op.chunk_len = std::min(op.chunk_len, shard_size - op.chunk_off);
+  } else {
+    // we were missing the object ourselves: its size comes with the
+    // attributes of the first read
+    op.may_be_short = true;
+  }
+  op.want_attrs = rop.recovery_progress.first;
+  op.want = rop.missing_on_shards;
+  rop.read_tid = tid;
+  dout(10) << __func__ << ": " << rop.hoid << " shards at " << op.chunk_off
+	   << "~" << op.chunk_len << " (tid " << tid << ")" << dendl;
+  start_read_op(op);
+}
+
+void ECBackend::recover_object(
+  const hobject_t &hoid,
+  ObjectContextRef head,
+  ObjectContextRef obc,
+  RecoveryHandle *_h
+  )
+{
+  dout(10) << __func__ << ": " << hoid << dendl;
+  ECRecoveryHandle *h = static_cast<ECRecoveryHandle *>(_h);
+  assert(!recovery_ops.count(hoid));
+  RecoveryOp &rop = recovery_ops[hoid];
+  rop.hoid = hoid;
+  rop.obc = obc;
+
+  const pg_missing_t &local_missing = get_parent()->get_local_missing();
+  if (local_missing.is_missing(hoid)) {
+    assert(!obc);
+    rop.v = local_missing.missing.find(hoid)->second.need;
+    rop.missing_on.insert(osd->whoami);
+  } else {
+    assert(obc);
+    rop.v = obc->obs.oi.version;
+  }
+
+  const vector<int> &acting = get_parent()->get_actingbackfill();
+  for (vector<int>::const_iterator i = acting.begin();
+       i != acting.end();
+       ++i) {
+    if (*i == osd->whoami)
+      continue;
+    map<int, pg_missing_t>::const_iterator m =
+      get_parent()->get_peer_missing().find(*i);
+    if (m != get_parent()->get_peer_missing().end() &&
+	m->second.is_missing(hoid))
+      rop.missing_on.insert(*i);
+  }
+  // pg_missing_t is kept per osd: the shard each osd holds comes from
+  // its pg_info_t
+  for (set<int>::iterator i = rop.missing_on.begin();
+       i != rop.missing_on.end();
+       ++i) {
+    int shard = get_shard(*i);
+    if (shard >= 0)
+      rop.missing_on_shards.insert(shard);
+  }
+  h->ops.push_back(hoid);
+}
+
+void ECBackend::check_recovery_sources(const OSDMapRef osdmap)
+{
+  list<tid_t> to_check;
+  for (map<tid_t, ReadOp>::iterator i = tid_to_read_map.begin();
+       i != tid_to_read_map.end();
+       ++i) {
+    for (map<int, int>::iterator j = i->second.in_flight.begin();
+	 j != i->second.in_flight.end();
+	 ) {
+      if (osdmap->is_down(j->first)) {
+	dout(10) << __func__ << ": osd." << j->first << " is down, shard "
+		 << j->second << " of " << i->second.hoid << " is lost" << dendl;
+	i->second.bad.insert(j->second);
+	i->second.in_flight.erase(j++);
+	to_check.push_back(i->first);
+      } else {
+	++j;
+      }
+    }
+  }
+  for (list<tid_t>::iterator i = to_check.begin(); i != to_check.end(); ++i) {
+    map<tid_t, ReadOp>::iterator j = tid_to_read_map.find(*i);
+    if (j == tid_to_read_map.end())
+      continue;
+    int r = send_reads(j->second);
+    if (r < 0 || j->second.in_flight.empty())
+      finish_read_op(j->second, r < 0 ? r : 0);
+  }
+}
+
+bool ECBackend::can_handle_while_inactive(OpRequestRef op)
+{
+  return false;
+}
+
+bool ECBackend::handle_message(
+  OpRequestRef op
+  )
+{
+  dout(10) << __func__ << ": " << op << dendl;
+  switch (op->get_req()->get_type()) {
+  case MSG_OSD_EC_READ:
+    handle_sub_read(op);
+    return true;
+
+  case MSG_OSD_EC_READ_REPLY:
+    handle_sub_read_reply(op);
+    return true;
+
+  case MSG_OSD_PG_PUSH:
+    handle_push(op);
+    return true;
+
+  case MSG_OSD_PG_PUSH_REPLY:
+    handle_push_reply(op);
+    return true;
+
+  default:
+    break;
+  }
+  return false;
+}
+
+void ECBackend::clear_state()
+{
+  // drop the recovery reads, client reads survive until on_change
+  for (map<tid_t, ReadOp>::iterator i = tid_to_read_map.begin();
+       i != tid_to_read_map.end();
+       ) {
+    if (!i->second.on_complete)
+      tid_to_read_map.erase(i++);
+    else
+      ++i;
+  }
+  recovery_ops.clear();
+}
+
+void ECBackend::on_change(ObjectStore::Transaction *t)
+{
+  dout(10) << __func__ << dendl;
+  // clear temp
+  for (set<hobject_t>::iterator i = temp_contents.begin();
+       i != temp_contents.end();
+       ++i) {
+    dout(10) << __func__ << ": Removing oid "
+	     << *i << " from the temp collection" << dendl;
+    t->remove(get_temp_coll(t), get_local_oid(*i));
+  }
+  temp_contents.clear();
+  clear_state();
+
+  list<Context*> canceled;
+  for (map<tid_t, ReadOp>::iterator i = tid_to_read_map.begin();
+       i != tid_to_read_map.end();
+       ++i) {
+    assert(i->second.on_complete);
+    canceled.push_back(i->second.on_complete);
+  }
+  tid_to_read_map.clear();
+  for (list<Context*>::iterator i = canceled.begin();
+       i != canceled.end();
+       ++i)
+    (*i)->complete(-ECANCELED);
+}
+
+coll_t ECBackend::get_temp_coll(ObjectStore::Transaction *t)
+{
+  if (temp_created)
+    return temp_coll;
+  if (!osd->store->collection_exists(temp_coll))
+      t->create_collection(temp_coll);
+  temp_created = true;
+  return temp_coll;
+}
+
+void ECBackend::on_flushed()
+{
+  if (temp_created &&
+      !osd->store->collection_empty(get_temp_coll())) {
+    vector<hobject_t> objects;
+    osd->store->collection_list(get_temp_coll(), objects);
+    derr << __func__ << ": found objects in the temp collection: "
+	 << objects << ", crashing now"
+	 << dendl;
+    assert(0 == "found garbage in the temp collection");
+  }
+}
+
+void ECBackend::RecoveryOp::dump(Formatter *f) const
+{
+  f->dump_stream("hoid") << hoid;
+  f->dump_stream("v") << v;
+  f->dump_stream("missing_on") << missing_on;
+  f->dump_stream("missing_on_shards") << missing_on_shards;
+  f->dump_stream("recovery_progress") << recovery_progress;
+  f->dump_stream("waiting_on_pushes") << waiting_on_pushes;
+  f->dump_int("waiting_on_local", waiting_on_local);
+  f->dump_unsigned("read_tid", read_tid);
+}
+
+void ECBackend::dump_recovery_info(Formatter *f) const
+{
+  f->open_array_section("recovery_ops");
+  for (map<hobject_t, RecoveryOp>::const_iterator i = recovery_ops.begin();
+       i != recovery_ops.end();
+       ++i) {
+    f->open_object_section("op");
+    i->second.dump(f);
+    f->close_section();
+  }
+  f->close_section();
+}
+
+int ECBackend::objects_list_partial(
+  const hobject_t &begin,
+  int min,
+  int max,
+  snapid_t seq,
+  vector<hobject_t> *ls,
+  hobject_t *next)
+{
+  // only the objects of our shard
+  shard_t shard = get_info().shard;
+  ghobject_t _next = get_local_oid(begin);
+  size_t found = ls->size();
+  int r = 0;
+  while (ls->size() == found && !_next.is_max()) {
+    vector<ghobject_t> objects;
+    r = osd->store->collection_list_partial(
+      coll,
+      _next,
+      min,
+      max,
+      seq,
+      &objects,
+      &_next);
+    if (r < 0)
+      break;
+    for (vector<ghobject_t>::iterator i = objects.begin();
+	 i != objects.end();
+	 ++i) {
+      if (i->shard_id == shard)
+	ls->push_back(i->hobj);
+    }
+    _next.shard_id = shard;
+  }
+  *next = _next.hobj;
+  return r;
+}
+
+int ECBackend::objects_list_range(
+  const hobject_t &start,
+  const hobject_t &end,
+  snapid_t seq,
+  vector<hobject_t> *ls)
+{
+  vector<ghobject_t> objects;
+  int r = osd->store->collection_list_range(
+    coll,
+    get_local_oid(start),
+    get_local_oid(end),
+    seq,
+    &objects);
+  ls->reserve(objects.size());
+  shard_t shard = get_info().shard;
+  for (vector<ghobject_t>::iterator i = objects.begin();
+       i != objects.end();
+       ++i) {
+    if (i->shard_id == shard)
+      ls->push_back(i->hobj);
+  }
+  return r;
+}
+
+int ECBackend::objects_get_attr(
+  const hobject_t &hoid,
+  const string &attr,
+  bufferlist *out)
+{
+  // attributes are replicated verbatim on every shard
+  bufferptr bp;
+  int r = osd->store->getattr(
+    coll,
+    get_local_oid(hoid),
+    attr.c_str(),
+    bp);
+  if (r >= 0 && out) {
+    out->clear();
+    out->push_back(bp);
+  }
+  return r;
+}
+
+void ECBackend::objects_read_async(
+  const hobject_t &hoid,
+  uint64_t off,
+  uint64_t len,
+  uint64_t size,
+  bufferlist *bl,
+  Context *on_complete)
+{
+  if (off >= size) {
+    on_complete->complete(0);
+    return;
+  }
+  uint64_t end = (len == 0 || off + len > size) ? size : off + len;
+  pair<uint64_t, uint64_t> bounds =
+    sinfo.offset_len_to_stripe_bounds(off, end - off);
+
+  tid_t tid = osd->get_tid();
+  ReadOp &op = tid_to_read_map[tid];
+  op.tid = tid;
+  op.hoid = hoid;
+  op.priority = cct->_conf->osd_client_op_priority;
+  op.chunk_off = sinfo.aligned_logical_offset_to_chunk_offset(bounds.first);
+  op.chunk_len = sinfo.aligned_logical_offset_to_chunk_offset(bounds.second);
+  for (unsigned i = 0; i < ec_impl->get_data_chunk_count(); ++i)
+    op.want.insert(i);
+  op.off = off;
+  op.len = end - off;
+  op.out = bl;
+  op.on_complete = on_complete;
+  dout(10) << __func__ << ": " << hoid << " " << off << "~" << op.len
+	   << " reading shards at " << op.chunk_off << "~" << op.chunk_len
+	   << " (tid " << tid << ")" << dendl;
+  start_read_op(op);
+}
+
+void ECBackend::start_read_op(ReadOp &op)
+{
+  int r = send_reads(op);
+  if (r < 0 || op.in_flight.empty())
+    finish_read_op(op, r < 0 ? r : 0);
+}
+
+int ECBackend::send_reads(ReadOp &op)
+{
+  map<int, int> readable;
+  get_readable_shards(op.hoid, &readable);
+
+  // shards we already hold or can read locally are free
+  map<int, int> available;
+  for (map<int, int>::iterator i = readable.begin();
+       i != readable.end();
+       ++i) {
+    if (op.bad.count(i->first))
+      continue;
+    available[i->first] =
+      (i->second == osd->whoami || op.chunks.count(i->first)) ? 0 : 1;
+  }
+  set<int> minimum;
+  int r = ec_impl->minimum_to_decode_with_cost(op.want, available, &minimum);
+  if (r < 0) {
+    dout(0) << __func__ << ": " << op.hoid << " cannot decode " << op.want
+	    << " from " << available << dendl;
+    return -EIO;
+  }
+  op.minimum = minimum;
+
+  set<int> in_flight;
+  for (map<int, int>::iterator i = op.in_flight.begin();
+       i != op.in_flight.end();
+       ++i)
+    in_flight.insert(i->second);
+
+  for (set<int>::iterator i = minimum.begin(); i != minimum.end(); ++i) {
+    if (op.chunks.count(*i) || in_flight.count(*i))
+      continue;
+    int to = readable[*i];
+    if (to == osd->whoami) {
+      bufferlist bl;
+      map<string, bufferptr> attrs;
+      r = do_local_read(op.hoid, op.chunk_off, op.chunk_len,
+			op.want_attrs && !op.have_attrs, &bl, &attrs);
+      if (r < 0 || !op.len_ok(bl.length())) {
+	dout(0) << __func__ << ": " << op.hoid << " local shard " << *i
+		<< " read failed: " << r << ", len " << bl.length() << dendl;
+	op.bad.insert(*i);
+	return send_reads(op);
+      }
+      op.chunks[*i].claim(bl);
+      if (op.want_attrs && !op.have_attrs) {
+	op.attrs.swap(attrs);
+	op.have_attrs = true;
+      }
+    } else {
+      MOSDECSubOpRead *msg = new MOSDECSubOpRead;
+      msg->set_priority(op.priority);
+      msg->pgid = get_info().pgid;
+      msg->map_epoch = get_osdmap()->get_epoch();
+      msg->tid = op.tid;
+      msg->hoid = op.hoid;
+      msg->off = op.chunk_off;
+      msg->len = op.chunk_len;
+      msg->want_attrs = op.want_attrs && !op.have_attrs;
+      dout(20) << __func__ << ": reading shard " << *i << " from osd."
+	       << to << dendl;
+      get_parent()->send_message(to, msg);
+      op.in_flight[to] = *i;
+    }
+  }
+  return 0;
+}
+
+int ECBackend::do_local_read(
+  const hobject_t &hoid,
+  uint64_t off,
+  uint64_t len,
+  bool want_attrs,
+  bufferlist *bl,
+  map<string, bufferptr> *attrs)
+{
+  ghobject_t oid = get_local_oid(hoid);
+  int r = osd->store->read(coll, oid, off, len, *bl);
+  if (r < 0)
+    return r;
+  if (want_attrs) {
+    r = osd->store->getattrs(coll, oid, *attrs);
+    if (r < 0)
+      return r;
+  }
+  return 0;
+}
+
+void ECBackend::finish_read_op(ReadOp &op, int r)
+{
+  tid_t tid = op.tid;
+  if (!op.on_complete) {
+    continue_recovery_op(op, r);
+    tid_to_read_map.erase(tid);
+    return;
+  }
+
+  if (r >= 0) {
+    map<int, bufferlist> to_decode;
+    for (set<int>::iterator i = op.minimum.begin();
+	 i != op.minimum.end();
+	 ++i)
+      to_decode[*i].claim(op.chunks[*i]);
+    bufferlist decoded;
+    r = ECUtil::decode(sinfo, ec_impl, to_decode, &decoded);
+    if (r >= 0) {
+      uint64_t skip =
+	op.off - sinfo.aligned_chunk_offset_to_logical_offset(op.chunk_off);
+      assert(decoded.length() >= skip + op.len);
+      op.out->substr_of(decoded, skip, op.len);
+      r = op.len;
+    }
+  }
+  dout(10) << __func__ << ": " << op.hoid << " " << op.off << "~" << op.len
+	   << " = " << r << dendl;
+  Context *on_complete = op.on_complete;
+  tid_to_read_map.erase(tid);
+  on_complete->complete(r);
+}
+
+void ECBackend::handle_sub_read(OpRequestRef op)
+{
+  MOSDECSubOpRead *m = static_cast<MOSDECSubOpRead *>(op->get_req());
+  assert(m->get_header().type == MSG_OSD_EC_READ);
+  dout(10) << __func__ << ": " << *m << dendl;
+  op->mark_started();
+
+  // an empty transaction on the pg sequencer is applied after the
+  // writes already queued, so the read below sees them.
+  ObjectStore::Transaction *t = new ObjectStore::Transaction;
+  t->register_on_applied(
+    get_parent()->bless_context(
+      new C_ECBackend_ReadShard(this, op)));
+  get_parent()->queue_transaction(t);
+}
+
+void ECBackend::finish_sub_read(OpRequestRef op)
+{
+  MOSDECSubOpRead *m = static_cast<MOSDECSubOpRead *>(op->get_req());
+  MOSDECSubOpReadReply *reply = new MOSDECSubOpReadReply;
+  reply->set_priority(m->get_priority());
+  reply->pgid = get_info().pgid;
+  reply->map_epoch = m->map_epoch;
+  reply->tid = m->tid;
+  reply->hoid = m->hoid;
+
+  map<string, bufferptr> attrs;
+  reply->result = do_local_read(m->hoid, m->off, m->len, m->want_attrs,
+				&reply->buffer, &attrs);
+  for (map<string, bufferptr>::iterator i = attrs.begin();
+       i != attrs.end();
+       ++i)
+    reply->attrs[i->first].push_back(i->second);
+  dout(10) << __func__ << ": " << *reply << dendl;
+  osd->send_message_osd_cluster(reply, m->get_connection());
+}
+
+void ECBackend::handle_sub_read_reply(OpRequestRef op)
+{
+  MOSDECSubOpReadReply *m = static_cast<MOSDECSubOpReadReply *>(op->get_req());
+  assert(m->get_header().type == MSG_OSD_EC_READ_REPLY);
+  int from = m->get_source().num();
+  dout(10) << __func__ << ": " << *m << " from osd." << from << dendl;
+
+  map<tid_t, ReadOp>::iterator i = tid_to_read_map.find(m->tid);
+  if (i == tid_to_read_map.end()) {
+    dout(10) << __func__ << ": tid " << m->tid << " is gone" << dendl;
+    return;
+  }
+  ReadOp &rop = i->second;
+  map<int, int>::iterator j = rop.in_flight.find(from);
+  if (j == rop.in_flight.end()) {
+    dout(10) << __func__ << ": not waiting on osd." << from << dendl;
+    return;
+  }
+  int shard = j->second;
+  rop.in_flight.erase(j);
+
+  if (m->result < 0 || !rop.len_ok(m->buffer.length())) {
+    dout(0) << __func__ << ": " << rop.hoid << " shard " << shard
+	    << " from osd." << from << " failed: " << m->result
+	    << ", len " << m->buffer.length() << dendl;
+    rop.bad.insert(shard);
+    int r = send_reads(rop);
+    if (r < 0) {
+      finish_read_op(rop, r);
+      return;
+    }
+  } else {
+    rop.chunks[shard].claim(m->buffer);
+    if (rop.want_attrs && !rop.have_attrs && !m->attrs.empty()) {
+      for (map<string, bufferlist>::iterator k = m->attrs.begin();
+	   k != m->attrs.end();
+	   ++k)
+	rop.attrs[k->first] = bufferptr(k->second.c_str(), k->second.length());
+      rop.have_attrs = true;
+    }
+  }
+  if (rop.in_flight.empty())
+    finish_read_op(rop, 0);
+}
+
+void ECBackend::continue_recovery_op(ReadOp &op, int r)
+{
+  map<hobject_t, RecoveryOp>::iterator i = recovery_ops.find(op.hoid);
+  assert(i != recovery_ops.end());
+  RecoveryOp &rop = i->second;
+  ObjectRecoveryProgress &progress = rop.recovery_progress;
+
+  if (r >= 0 && !rop.obc) {
+    // we were missing the object ourselves
+    if (op.have_attrs)
+      rop.obc = get_parent()->get_obc(rop.hoid, op.attrs);
+    if (!rop.obc)
+      r = -EIO;
+  }
+  uint64_t shard_size = 0, len = 0;
+  if (r >= 0) {
+    shard_size = get_ondisk_size(rop.obc->obs.oi.size);
+    len = std::min(get_recovery_chunk_size(), shard_size - progress.data_recovered_to);
+  }
+  map<int, bufferlist> rebuilt;
+  if (r >= 0) {
+    map<int, bufferlist> to_decode;
+    for (set<int>::iterator j = op.minimum.begin();
+	 j != op.minimum.end();
+	 ++j) {
+      // a short read is only fine where the object ends
+      if (op.chunks[*j].length() != len)
+	r = -EIO;
+      to_decode[*j].claim(op.chunks[*j]);
+    }
+    map<int, bufferlist*> out;
+    for (set<int>::iterator j = op.want.begin(); j != op.want.end(); ++j)
+      out[*j] = &rebuilt[*j];
+    if (to_decode.empty())
+      r = -EIO;
+    else if (r >= 0)
+      r = ECUtil::decode(sinfo, ec_impl, to_decode, out);
+  }
+  if (r < 0) {
+    dout(0) << __func__ << ": failed to rebuild " << rop.hoid
+	    << ": " << cpp_strerror(r) << dendl;
+    get_parent()->cancel_pull(rop.hoid);
+    recovery_ops.erase(i);
+    return;
+  }
+
+  if (progress.first) {
+    rop.recovery_info.soid = rop.hoid;
+    rop.recovery_info.version = rop.v;
+    rop.recovery_info.size = rop.obc->obs.oi.size;
+    rop.recovery_info.oi = rop.obc->obs.oi;
+    rop.stat.num_objects_recovered = 1;
+    rop.stat.num_bytes_recovered = rop.recovery_info.size;
+  }
+  ObjectRecoveryProgress after = progress;
+  after.first = false;
+  after.data_recovered_to = progress.data_recovered_to + len;
+  after.data_complete = after.data_recovered_to >= shard_size;
+  after.omap_complete = true;
+
+  for (set<int>::iterator j = rop.missing_on.begin();
+       j != rop.missing_on.end();
+       ++j) {
+    int shard = get_shard(*j);
+    if (shard < 0)
+      continue;
+    bufferlist &data = rebuilt[shard];
+    dout(10) << __func__ << ": " << rop.hoid << " shard " << shard << " "
+	     << progress.data_recovered_to << "~" << data.length()
+	     << " to osd." << *j << dendl;
+    if (*j == osd->whoami) {
+      ghobject_t oid = get_local_oid(rop.hoid);
+      ObjectStore::Transaction *t = new ObjectStore::Transaction;
+      if (progress.first) {
+	// drop any stale copy
+	get_parent()->on_local_recover_start(rop.hoid, t);
+	t->remove(coll, oid);
+	t->touch(coll, oid);
+	t->setattrs(coll, oid, op.attrs);
+      }
+      if (data.length())
+	t->write(coll, oid, progress.data_recovered_to, data.length(), data);
+      if (after.data_complete)
+	get_parent()->on_local_recover(
+	  rop.hoid, rop.stat, rop.recovery_info, rop.obc, t);
+      t->register_on_complete(
+	get_parent()->bless_context(
+	  new C_ECBackend_LocalRecovered(this, rop.hoid)));
+      rop.waiting_on_local = true;
+      get_parent()->queue_transaction(t);
+    } else {
+      if (progress.first)
+	get_parent()->begin_peer_recover(*j, rop.hoid);
+      PushOp pop;
+      pop.soid = rop.hoid;
+      pop.version = rop.v;
+      pop.data = data;
+      if (data.length())
+	pop.data_included.insert(progress.data_recovered_to, data.length());
+      if (progress.first)
+	pop.attrset = op.attrs;
+      pop.recovery_info = rop.recovery_info;
+      pop.before_progress = progress;
+      pop.after_progress = after;
+
+      MOSDPGPush *msg = new MOSDPGPush;
+      msg->set_priority(rop.priority);
+      msg->pgid = get_info().pgid;
+      msg->map_epoch = get_osdmap()->get_epoch();
+      msg->pushes.push_back(pop);
+      msg->compute_cost(cct);
+      rop.waiting_on_pushes.insert(*j);
+      get_parent()->send_message(*j, msg);
+    }
+  }
+  progress = after;
+  maybe_continue_recovery_op(rop.hoid);
+}
+
+void ECBackend::on_local_recovered(const hobject_t &hoid)
+{
+  map<hobject_t, RecoveryOp>::iterator i = recovery_ops.find(hoid);
+  if (i == recovery_ops.end())
+    return;
+  i->second.waiting_on_local = false;
+  maybe_continue_recovery_op(hoid);
+}
+
+void ECBackend::maybe_continue_recovery_op(const hobject_t &hoid)
+{
+  map<hobject_t, RecoveryOp>::iterator i = recovery_ops.find(hoid);
+  assert(i != recovery_ops.end());
+  RecoveryOp &rop = i->second;
+  if (rop.waiting_on_local || !rop.waiting_on_pushes.empty()) {
+    dout(10) << __func__ << ": " << hoid << " still waiting on "
+	     << rop.waiting_on_pushes
+	     << (rop.waiting_on_local ? " and the local write" : "")
+	     << dendl;
+    return;
+  }
+  if (!rop.recovery_progress.data_complete) {
+    // every osd has the previous piece: on to the next one
+    send_recovery_read(rop);
+    return;
+  }
+  dout(10) << __func__ << ": " << hoid << " recovered" << dendl;
+  recovery_ops.erase(i);
+  get_parent()->on_global_recover(hoid);
+}
+
+void ECBackend::handle_push(OpRequestRef op)
+{
+  MOSDPGPush *m = static_cast<MOSDPGPush *>(op->get_req());
+  assert(m->get_header().type == MSG_OSD_PG_PUSH);
+  op->mark_started();
+
+  vector<PushReplyOp> replies;
+  ObjectStore::Transaction *t = new ObjectStore::Transaction;
+  for (vector<PushOp>::iterator i = m->pushes.begin();
+       i != m->pushes.end();
+       ++i) {
+    dout(10) << __func__ << ": " << i->recovery_info
+	     << " " << i->after_progress << dendl;
+    const hobject_t &hoid = i->recovery_info.soid;
+    ghobject_t oid = get_local_oid(hoid);
+    if (i->before_progress.first) {
+      // the shard is rebuilt whole: drop whatever stale copy we hold
+      get_parent()->on_local_recover_start(hoid, t);
+      t->remove(coll, oid);
+      t->touch(coll, oid);
+      t->setattrs(coll, oid, i->attrset);
+    }
+    uint64_t off = 0;
+    for (interval_set<uint64_t>::const_iterator p = i->data_included.begin();
+	 p != i->data_included.end();
+	 ++p) {
+      bufferlist bit;
+      bit.substr_of(i->data, off, p.get_len());
+      t->write(coll, oid, p.get_start(), p.get_len(), bit);
+      off += p.get_len();
+    }
+    if (i->after_progress.data_complete) {
+      get_parent()->on_local_recover(
+	hoid,
+	object_stat_sum_t(),
+	i->recovery_info,
+	ObjectContextRef(), // ok, is replica
+	t);
+    }
+    replies.push_back(PushReplyOp());
+    replies.back().soid = hoid;
+  }
+
+  MOSDPGPushReply *reply = new MOSDPGPushReply;
+  reply->set_priority(m->get_priority());
+  reply->pgid = get_info().pgid;
+  reply->map_epoch = m->map_epoch;
+  reply->replies.swap(replies);
+  reply->compute_cost(cct);
+
+  t->register_on_complete(
+    new C_OSD_SendMessageOnConn(
+      osd, reply, m->get_connection()));
+
+  get_parent()->queue_transaction(t);
+}
+
+void ECBackend::handle_push_reply(OpRequestRef op)
+{
+  MOSDPGPushReply *m = static_cast<MOSDPGPushReply *>(op->get_req());
+  assert(m->get_header().type == MSG_OSD_PG_PUSH_REPLY);
+  int from = m->get_source().num();
+
+  for (vector<PushReplyOp>::iterator i = m->replies.begin();
+       i != m->replies.end();
+       ++i) {
+    map<hobject_t, RecoveryOp>::iterator j = recovery_ops.find(i->soid);
+    if (j == recovery_ops.end() ||
+	!j->second.waiting_on_pushes.count(from)) {
+      dout(10) << "huh, i wasn't pushing " << i->soid << " to osd." << from
+	       << dendl;
+      continue;
+    }
+    j->second.waiting_on_pushes.erase(from);
+    if (j->second.recovery_progress.data_complete)
+      get_parent()->on_peer_recover(
+	from, i->soid, j->second.recovery_info, j->second.stat);
+    maybe_continue_recovery_op(i->soid);
+  }
+}
+
+bool ECBackend::get_shard_transactions(
+  ObjectStore::Transaction &t,
+  map<int, ObjectStore::Transaction> *out)
+{
+  map<int, int> shards;  // osd -> shard
+  const vector<int> &acting = get_parent()->get_actingbackfill();
+  for (vector<int>::const_iterator i = acting.begin();
+       i != acting.end();
+       ++i) {
+    shards[*i] = get_shard(*i);
+    (*out)[*i];
+  }
+
+  // ReplicatedPG::prepare_transaction refused what check_transaction
+  // does not accept
+  int r = split_transaction(sinfo, ec_impl, t, shards, out);
+  assert(r == 0);
+
+  // completions stay with the local transaction
+  list<ObjectStore::Transaction*> tls;
+  tls.push_back(&t);
+  Context *on_applied, *on_commit, *on_applied_sync;
+  ObjectStore::Transaction::collect_contexts(
+    tls, &on_applied, &on_commit, &on_applied_sync);
+  ObjectStore::Transaction &local = (*out)[osd->whoami];
+  local.register_on_applied(on_applied);
+  local.register_on_commit(on_commit);
+  local.register_on_applied_sync(on_applied_sync);
+  return true;
+}
+
+int ECBackend::check_transaction(ObjectStore::Transaction &t)
+{
+  // with no shard nothing is encoded: t is only walked through
+  map<int, ObjectStore::Transaction> none;
+  return split_transaction(sinfo, ec_impl, t, map<int, int>(), &none);
+}
+
+/// key under which the osd holding shard stores oid
+static ghobject_t shard_oid(const ghobject_t &oid, int shard)
+{
+  if (shard < 0)
+    return oid;
+  return ghobject_t(oid.hobj, oid.generation, shard);
+}
+
+int ECBackend::split_transaction(
+  const ECUtil::stripe_info_t &sinfo,
+  ceph::ErasureCodeInterfaceRef &ec_impl,
+  ObjectStore::Transaction &t,
+  const map<int, int> &shards,
+  map<int, ObjectStore::Transaction> *out)
+{
+  set<int> want;
+  for (map<int, int>::const_iterator j = shards.begin();
+       j != shards.end();
+       ++j)
+    if (j->second >= 0)
+      want.insert(j->second);
+
+  ObjectStore::Transaction::iterator i = t.begin();
+  while (i.have_op()) {
+    int op = i.get_op();
+    switch (op) {
+    case ObjectStore::Transaction::OP_NOP:
+      break;
+
+    case ObjectStore::Transaction::OP_WRITE:
+      {
+	coll_t cid = i.get_cid();
+	ghobject_t oid = i.get_oid();
+	uint64_t off = i.get_length();
+	uint64_t len = i.get_length();
+	bufferlist bl;
+	i.get_bl(bl);
+	assert(bl.length() == len);
+	if (!sinfo.logical_offset_is_stripe_aligned(off))
+	  return -EOPNOTSUPP;
+	map<int, bufferlist> encoded;
+	if (!want.empty()) {
+	  int r = ECUtil::encode(sinfo, ec_impl, bl, want, &encoded);
+	  if (r < 0)
+	    return r;
+	}
+	uint64_t chunk_off = sinfo.aligned_logical_offset_to_chunk_offset(off);
+	for (map<int, int>::const_iterator j = shards.begin(); j != shards.end(); ++j) {
+	  if (j->second < 0)
+	    continue;
+	  bufferlist &chunk = encoded[j->second];
+	  (*out)[j->first].write(cid, shard_oid(oid, j->second), chunk_off, chunk.length(), chunk);
+	}
+      }
+      break;
+
+    case ObjectStore::Transaction::OP_TRUNCATE:
+      {
+	coll_t cid = i.get_cid();
+	ghobject_t oid = i.get_oid();
+	uint64_t off = i.get_length();
+	// the chunks would keep the rest of the last stripe around
+	if (!sinfo.logical_offset_is_stripe_aligned(off))
+	  return -EOPNOTSUPP;
+	uint64_t chunk_off = sinfo.aligned_logical_offset_to_chunk_offset(off);
+	for (map<int, int>::const_iterator j = shards.begin(); j != shards.end(); ++j)
+	  (*out)[j->first].truncate(cid, shard_oid(oid, j->second), chunk_off);
+      }
+      break;
+
+    // everything else is applied as is by every shard
+    case ObjectStore::Transaction::OP_TOUCH:
+      {
+	coll_t cid = i.get_cid();
+	ghobject_t oid = i.get_oid();
+	for (map<int, int>::const_iterator j = shards.begin(); j != shards.end(); ++j)
+	  (*out)[j->first].touch(cid, shard_oid(oid, j->second));
+      }
+      break;
+
+    case ObjectStore::Transaction::OP_REMOVE:
+      {
+	coll_t cid = i.get_cid();
+	ghobject_t oid = i.get_oid();
+	for (map<int, int>::const_iterator j = shards.begin(); j != shards.end(); ++j)
+	  (*out)[j->first].remove(cid, shard_oid(oid, j->second));
+      }
+      break;
+
+    case ObjectStore::Transaction::OP_SETATTR:
+      {
+	coll_t cid = i.get_cid();
+	ghobject_t oid = i.get_oid();
+	string name = i.get_attrname();
+	bufferlist bl;
+	i.get_bl(bl);
+	for (map<int, int>::const_iterator j = shards.begin(); j != shards.end(); ++j)
+	  (*out)[j->first].setattr(cid, shard_oid(oid, j->second), name, bl);
+      }
+      break;
+
+    case ObjectStore::Transaction::OP_SETATTRS:
+      {
+	coll_t cid = i.get_cid();
+	ghobject_t oid = i.get_oid();
+	map<string, bufferptr> aset;
+	i.get_attrset(aset);
+	for (map<int, int>::const_iterator j = shards.begin(); j != shards.end(); ++j)
+	  (*out)[j->first].setattrs(cid, shard_oid(oid, j->second), aset);
+      }
+      break;
+
+    case ObjectStore::Transaction::OP_RMATTR:
+      {
+	coll_t cid = i.get_cid();
+	ghobject_t oid = i.get_oid();
+	string name = i.get_attrname();
+	for (map<int, int>::const_iterator j = shards.begin(); j != shards.end(); ++j)
+	  (*out)[j->first].rmattr(cid, shard_oid(oid, j->second), name);
+      }
+      break;
+
+    case ObjectStore::Transaction::OP_RMATTRS:
+      {
+	coll_t cid = i.get_cid();
+	ghobject_t oid = i.get_oid();
+	for (map<int, int>::const_iterator j = shards.begin(); j != shards.end(); ++j)
+	  (*out)[j->first].rmattrs(cid, shard_oid(oid, j->second));
+      }
+      break;
+
+    case ObjectStore::Transaction::OP_CLONE:
+      {
+	coll_t cid = i.get_cid();
+	ghobject_t oid = i.get_oid();
+	ghobject_t noid = i.get_oid();
+	for (map<int, int>::const_iterator j = shards.begin(); j != shards.end(); ++j)
+	  (*out)[j->first].clone(cid, shard_oid(oid, j->second),
+				    shard_oid(noid, j->second));
+      }
+      break;
+
+    case ObjectStore::Transaction::OP_MKCOLL:
+      {
+	coll_t cid = i.get_cid();
+	for (map<int, int>::const_iterator j = shards.begin(); j != shards.end(); ++j)
+	  (*out)[j->first].create_collection(cid);
+      }
+      break;
+
+    case ObjectStore::Transaction::OP_COLL_ADD:
+      {
+	coll_t ncid = i.get_cid();
+	coll_t ocid = i.get_cid();
+	ghobject_t oid = i.get_oid();
+	for (map<int, int>::const_iterator j = shards.begin(); j != shards.end(); ++j)
+	  (*out)[j->first].collection_add(ncid, ocid, shard_oid(oid, j->second));
+      }
+      break;
+
+    case ObjectStore::Transaction::OP_COLL_REMOVE:
+      {
+	coll_t cid = i.get_cid();
+	ghobject_t oid = i.get_oid();
+	for (map<int, int>::const_iterator j = shards.begin(); j != shards.end(); ++j)
+	  (*out)[j->first].collection_remove(cid, shard_oid(oid, j->second));
+      }
+      break;
+
+    case ObjectStore::Transaction::OP_COLL_MOVE_RENAME:
+      {
+	coll_t oldcid = i.get_cid();
+	ghobject_t oldoid = i.get_oid();
+	coll_t newcid = i.get_cid();
+	ghobject_t newoid = i.get_oid();
+	for (map<int, int>::const_iterator j = shards.begin(); j != shards.end(); ++j)
+	  (*out)[j->first].collection_move_rename(
+	    oldcid, shard_oid(oldoid, j->second),
+	    newcid, shard_oid(newoid, j->second));
+      }
+      break;
+
+    case ObjectStore::Transaction::OP_OMAP_CLEAR:
+      {
+	coll_t cid = i.get_cid();
+	ghobject_t oid = i.get_oid();
+	for (map<int, int>::const_iterator j = shards.begin(); j != shards.end(); ++j)
+	  (*out)[j->first].omap_clear(cid, shard_oid(oid, j->second));
+      }
+      break;
+
+    case ObjectStore::Transaction::OP_OMAP_SETKEYS:
+      {
+	coll_t cid = i.get_cid();
+	ghobject_t oid = i.get_oid();
+	map<string, bufferlist> aset;
+	i.get_attrset(aset);
+	for (map<int, int>::const_iterator j = shards.begin(); j != shards.end(); ++j)
+	  (*out)[j->first].omap_setkeys(cid, shard_oid(oid, j->second), aset);
+      }
+      break;
+
+    case ObjectStore::Transaction::OP_OMAP_RMKEYS:
+      {
+	coll_t cid = i.get_cid();
+	ghobject_t oid = i.get_oid();
+	set<string> keys;
+	i.get_keyset(keys);
+	for (map<int, int>::const_iterator j = shards.begin(); j != shards.end(); ++j)
+	  (*out)[j->first].omap_rmkeys(cid, shard_oid(oid, j->second), keys);
+      }
+      break;
+
+    case ObjectStore::Transaction::OP_OMAP_RMKEYRANGE:
+      {
+	coll_t cid = i.get_cid();
+	ghobject_t oid = i.get_oid();
+	string first = i.get_key();
+	string last = i.get_key();
+	for (map<int, int>::const_iterator j = shards.begin(); j != shards.end(); ++j)
+	  (*out)[j->first].omap_rmkeyrange(cid, shard_oid(oid, j->second), first, last);
+      }
+      break;
+
+    case ObjectStore::Transaction::OP_OMAP_SETHEADER:
+      {
+	coll_t cid = i.get_cid();
+	ghobject_t oid = i.get_oid();
+	bufferlist bl;
+	i.get_bl(bl);
+	for (map<int, int>::const_iterator j = shards.begin(); j != shards.end(); ++j)
+	  (*out)[j->first].omap_setheader(cid, shard_oid(oid, j->second), bl);
+      }
+      break;
+
+    case ObjectStore::Transaction::OP_STARTSYNC:
+      for (map<int, int>::const_iterator j = shards.begin(); j != shards.end(); ++j)
+	(*out)[j->first].start_sync();
+      break;
+
+    default:
+      // zero, clone_range, collection_move... cannot be expressed on
+      // the chunks
+      return -EOPNOTSUPP;
+    }
+  }
+  return 0;
+}
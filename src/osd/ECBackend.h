@@ -0,0 +1,275 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * Copyright (C) 2013 Inktank Storage, Inc.
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#ifndef ECBACKEND_H
+#define ECBACKEND_H
+
+#include "OSD.h"
+#include "PGBackend.h"
+#include "ECUtil.h"
+#include "ErasureCodeInterface.h"
+#include "osd_types.h"
+
+/**
+ * ECBackend
+ *
+ * Stores each object as the k + m chunks of an erasure code, one
+ * chunk per osd.  The primary gives each osd its shard when the pg
+ * activates (PG::assign_shards) and the shard is kept in pg_info_t, so
+ * it survives remaps.  Each osd stores its chunk of hoid under
+ * ghobject_t(hoid, NO_GEN, shard).
+ *
+ * Objects are encoded stripe by stripe (see ECUtil), so writes are
+ * limited to appends at a stripe boundary, whole object writes,
+ * stripe aligned truncates and attribute updates: the primary turns
+ * the logical transaction into one transaction per shard and ships
+ * it with the usual sub ops.
+ *
+ * Reads gather the cheapest set of shards able to decode the data
+ * chunks.  Recovery reads the minimum set of shards needed to rebuild
+ * the missing ones, decodes only those and pushes each to the osd
+ * missing it, osd_recovery_max_chunk bytes of each shard at a time.
+ */
+class ECBackend : public PGBackend {
+  struct ECRecoveryHandle : public PGBackend::RecoveryHandle {
+    list<hobject_t> ops;
+  };
+  friend struct C_ECBackend_ReadShard;
+  friend struct C_ECBackend_LocalRecovered;
+public:
+  coll_t coll;
+  OSDService *osd;
+  CephContext *cct;
+
+private:
+  bool temp_created;
+  const coll_t temp_coll;
+  coll_t get_temp_coll() const {
+    return temp_coll;
+  }
+  // Track contents of temp collection, clear on reset
+  set<hobject_t> temp_contents;
+
+  ceph::ErasureCodeInterfaceRef ec_impl;
+  const ECUtil::stripe_info_t sinfo;
+
+public:
+  ECBackend(
+    PGBackend::Listener *pg,
+    coll_t coll,
+    OSDService *osd,
+    ceph::ErasureCodeInterfaceRef ec_impl,
+    uint64_t stripe_width);
+
+  /// @see PGBackend::open_recovery_op
+  PGBackend::RecoveryHandle *open_recovery_op() {
+    return new ECRecoveryHandle;
+  }
+
+  /// @see PGBackend::run_recovery_op
+  void run_recovery_op(
+    PGBackend::RecoveryHandle *h,
+    int priority);
+
+  /// @see PGBackend::recover_object
+  void recover_object(
+    const hobject_t &hoid,
+    ObjectContextRef head,
+    ObjectContextRef obc,
+    RecoveryHandle *h
+    );
+
+  void check_recovery_sources(const OSDMapRef osdmap);
+
+  bool can_handle_while_inactive(OpRequestRef op);
+
+  bool handle_message(
+    OpRequestRef op
+    );
+
+  void on_change(ObjectStore::Transaction *t);
+  void clear_state();
+  void on_flushed();
+
+  void temp_colls(list<coll_t> *out) {
+    if (temp_created)
+      out->push_back(temp_coll);
+  }
+  void split_colls(
+    pg_t child,
+    int split_bits,
+    int seed,
+    ObjectStore::Transaction *t) {
+    coll_t target = coll_t::make_temp_coll(child);
+    if (!temp_created)
+      return;
+    t->create_collection(target);
+    t->split_collection(
+      temp_coll,
+      split_bits,
+      seed,
+      target);
+  }
+
+  void dump_recovery_info(Formatter *f) const;
+
+  coll_t get_temp_coll(ObjectStore::Transaction *t);
+  void add_temp_obj(const hobject_t &oid) {
+    temp_contents.insert(oid);
+  }
+  void clear_temp_obj(const hobject_t &oid) {
+    temp_contents.erase(oid);
+  }
+
+  int objects_list_partial(
+    const hobject_t &begin,
+    int min,
+    int max,
+    snapid_t seq,
+    vector<hobject_t> *ls,
+    hobject_t *next);
+
+  int objects_list_range(
+    const hobject_t &start,
+    const hobject_t &end,
+    snapid_t seq,
+    vector<hobject_t> *ls);
+
+  int objects_get_attr(
+    const hobject_t &hoid,
+    const string &attr,
+    bufferlist *out);
+
+  void objects_read_async(
+    const hobject_t &hoid,
+    uint64_t off,
+    uint64_t len,
+    uint64_t size,
+    bufferlist *bl,
+    Context *on_complete);
+
+  bool get_shard_transactions(
+    ObjectStore::Transaction &t,
+    map<int, ObjectStore::Transaction> *out);
+  int check_transaction(ObjectStore::Transaction &t);
+
+  /**
+   * Append to out[osd] what osd applies of t, for each osd -> shard of
+   * shards (-1 for an osd holding no shard), with the objects keyed by
+   * the shard of the osd.  Returns -EOPNOTSUPP if t
+   * holds an operation the shards cannot apply: zero, clone_range,
+   * collection_move..., or a write or truncate off a stripe boundary.
+   */
+  static int split_transaction(
+    const ECUtil::stripe_info_t &sinfo,
+    ceph::ErasureCodeInterfaceRef &ec_impl,
+    ObjectStore::Transaction &t,
+    const map<int, int> &shards,
+    map<int, ObjectStore::Transaction> *out);
+
+  uint64_t get_stripe_width() const {
+    return sinfo.get_stripe_width();
+  }
+  uint64_t get_ondisk_size(uint64_t logical_size) const {
+    return sinfo.logical_to_next_chunk_offset(logical_size);
+  }
+
+private:
+  /// shard held by osd, -1 if it holds none
+  int get_shard(int osd);
+  /// key of hoid in our collection
+  ghobject_t get_local_oid(const hobject_t &hoid) {
+    return ghobject_t(hoid, ghobject_t::NO_GEN, get_info().shard);
+  }
+  /// true if osd holds an up to date shard of hoid
+  bool shard_is_readable(int osd, const hobject_t &hoid);
+  /// shard -> osd for the readable shards of hoid
+  void get_readable_shards(const hobject_t &hoid, map<int, int> *shards);
+
+  // reads
+  struct ReadOp {
+    tid_t tid;
+    hobject_t hoid;
+    int priority;
+    uint64_t chunk_off, chunk_len;   ///< extent of each shard, len 0 to the end
+    bool may_be_short;               ///< shards may end within the extent
+    bool want_attrs;
+    set<int> want;                   ///< shards to read or rebuild
+    set<int> minimum;                ///< shards the decode will use
+    set<int> bad;                    ///< shards which failed to read
+    map<int, int> in_flight;         ///< osd -> shard being read
+    map<int, bufferlist> chunks;     ///< shard -> data read
+    map<string, bufferptr> attrs;
+    bool have_attrs;
+
+    // client read
+    uint64_t off, len;
+    bufferlist *out;
+    Context *on_complete;
+
+    ReadOp()
+      : tid(0), priority(0), chunk_off(0), chunk_len(0), may_be_short(false),
+	want_attrs(false), have_attrs(false), off(0), len(0), out(NULL),
+	on_complete(NULL) {}
+
+    /// true if len bytes is what a shard should return
+    bool len_ok(uint64_t len) const {
+      if (!chunk_len)
+	return true;
+      return may_be_short ? len <= chunk_len : len == chunk_len;
+    }
+  };
+  map<tid_t, ReadOp> tid_to_read_map;
+
+  void start_read_op(ReadOp &op);
+  int send_reads(ReadOp &op);
+  void finish_read_op(ReadOp &op, int r);
+  void handle_sub_read(OpRequestRef op);
+  void finish_sub_read(OpRequestRef op);
+  void handle_sub_read_reply(OpRequestRef op);
+  int do_local_read(const hobject_t &hoid, uint64_t off, uint64_t len,
+		    bool want_attrs, bufferlist *bl,
+		    map<string, bufferptr> *attrs);
+
+  // recovery
+  struct RecoveryOp {
+    hobject_t hoid;
+    eversion_t v;
+    ObjectContextRef obc;
+    int priority;
+    set<int> missing_on;             ///< osds missing their shard
+    set<int> missing_on_shards;      ///< the shards they hold, from their pg_info
+    ObjectRecoveryInfo recovery_info;
+    ObjectRecoveryProgress recovery_progress;  ///< of each shard
+    object_stat_sum_t stat;
+    set<int> waiting_on_pushes;
+    bool waiting_on_local;
+    tid_t read_tid;
+
+    RecoveryOp() : priority(0), waiting_on_local(false), read_tid(0) {}
+    void dump(Formatter *f) const;
+  };
+  map<hobject_t, RecoveryOp> recovery_ops;
+
+  /// bytes of each shard rebuilt and pushed at once
+  uint64_t get_recovery_chunk_size() const;
+  void send_recovery_read(RecoveryOp &rop);
+  void continue_recovery_op(ReadOp &rop, int r);
+  void on_local_recovered(const hobject_t &hoid);
+  void maybe_continue_recovery_op(const hobject_t &hoid);
+  void handle_push(OpRequestRef op);
+  void handle_push_reply(OpRequestRef op);
+};
+
+#endif
@@ -0,0 +1,149 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * Copyright (C) 2013 Inktank Storage, Inc.
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include <errno.h>
+#include <algorithm>
+#include "ECUtil.h"
+
+using namespace std;
+
+int ECUtil::encode(
+  const stripe_info_t &sinfo,
+  ceph::ErasureCodeInterfaceRef &ec_impl,
+  bufferlist &in,
+  const set<int> &want,
+  map<int, bufferlist> *out)
+{
+  uint64_t logical_size = in.length();
+  uint64_t width = sinfo.get_stripe_width();
+
+  for (uint64_t i = 0; i < logical_size; i += width) {
+    bufferlist buf;
+    buf.substr_of(in, i, std::min(width, logical_size - i));
+    if (buf.length() < width)
+      buf.append_zero(width - buf.length());
+
+    map<int, bufferlist> encoded;
+    int r = ec_impl->encode(want, buf, &encoded);
+    if (r < 0)
+      return r;
+
+    for (set<int>::const_iterator j = want.begin(); j != want.end(); ++j) {
+      map<int, bufferlist>::iterator k = encoded.find(*j);
+      assert(k != encoded.end());
+      assert(k->second.length() == sinfo.get_chunk_size());
+      (*out)[*j].claim_append(k->second);
+    }
+  }
+  return 0;
+}
+
+int ECUtil::decode(
+  const stripe_info_t &sinfo,
+  ceph::ErasureCodeInterfaceRef &ec_impl,
+  map<int, bufferlist> &to_decode,
+  bufferlist *out)
+{
+  assert(to_decode.size());
+
+  uint64_t total_chunk_size = to_decode.begin()->second.length();
+  assert(total_chunk_size % sinfo.get_chunk_size() == 0);
+
+  set<int> want;
+  for (unsigned i = 0; i < ec_impl->get_data_chunk_count(); ++i)
+    want.insert(i);
+
+  for (map<int, bufferlist>::iterator i = to_decode.begin();
+       i != to_decode.end();
+       ++i) {
+    if (i->second.length() != total_chunk_size)
+      return -EIO;
+  }
+
+  for (uint64_t i = 0; i < total_chunk_size; i += sinfo.get_chunk_size()) {
+    map<int, bufferlist> chunks;
+    for (map<int, bufferlist>::iterator j = to_decode.begin();
+	 j != to_decode.end();
+	 ++j) {
+      bufferlist &chunk = chunks[j->first];
+      chunk.substr_of(j->second, i, sinfo.get_chunk_size());
+      if (chunk.buffers().size() > 1)
+	chunk.rebuild();
+    }
+    map<int, bufferlist> decoded;
+    int r = ec_impl->decode(want, chunks, &decoded);
+    if (r < 0)
+      return r;
+
+    // the data chunks are the stripe, verbatim, followed by the
+    // padding the code needed to respect its alignment.
+    bufferlist stripe;
+    for (set<int>::iterator j = want.begin(); j != want.end(); ++j) {
+      assert(decoded.count(*j));
+      stripe.append(decoded[*j]);
+    }
+    assert(stripe.length() >= sinfo.get_stripe_width());
+    bufferlist bl;
+    bl.substr_of(stripe, 0, sinfo.get_stripe_width());
+    out->claim_append(bl);
+  }
+  return 0;
+}
+
+int ECUtil::decode(
+  const stripe_info_t &sinfo,
+  ceph::ErasureCodeInterfaceRef &ec_impl,
+  map<int, bufferlist> &to_decode,
+  map<int, bufferlist*> &out)
+{
+  assert(to_decode.size());
+
+  uint64_t total_chunk_size = to_decode.begin()->second.length();
+  assert(total_chunk_size % sinfo.get_chunk_size() == 0);
+
+  set<int> want;
+  for (map<int, bufferlist*>::iterator i = out.begin(); i != out.end(); ++i)
+    want.insert(i->first);
+
+  for (map<int, bufferlist>::iterator i = to_decode.begin();
+       i != to_decode.end();
+       ++i) {
+    if (i->second.length() != total_chunk_size)
+      return -EIO;
+  }
+
+  for (uint64_t i = 0; i < total_chunk_size; i += sinfo.get_chunk_size()) {
+    map<int, bufferlist> chunks;
+    for (map<int, bufferlist>::iterator j = to_decode.begin();
+	 j != to_decode.end();
+	 ++j) {
+      bufferlist &chunk = chunks[j->first];
+      chunk.substr_of(j->second, i, sinfo.get_chunk_size());
+      if (chunk.buffers().size() > 1)
+	chunk.rebuild();
+    }
+    map<int, bufferlist> decoded;
+    int r = ec_impl->decode(want, chunks, &decoded);
+    if (r < 0)
+      return r;
+    for (map<int, bufferlist*>::iterator j = out.begin();
+	 j != out.end();
+	 ++j) {
+      assert(decoded.count(j->first));
+      assert(decoded[j->first].length() == sinfo.get_chunk_size());
+      j->second->claim_append(decoded[j->first]);
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,122 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * Copyright (C) 2013 Inktank Storage, Inc.
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#ifndef ECUTIL_H
+#define ECUTIL_H
+
+#include <map>
+#include <set>
+
+#include "include/buffer.h"
+#include "include/assert.h"
+#include "ErasureCodeInterface.h"
+
+/**
+ * Helpers for objects striped over the chunks of an erasure code.
+ *
+ * The logical object is cut into stripes of stripe_width bytes.
+ * Each stripe is encoded on its own and contributes chunk_size bytes
+ * to every shard, so that byte range [n * stripe_width, (n + 1) *
+ * stripe_width) of the object lives at [n * chunk_size, (n + 1) *
+ * chunk_size) of each shard.  Encoding stripe by stripe is what lets
+ * an append only touch the tail of each shard.
+ */
+namespace ECUtil {
+
+class stripe_info_t {
+  const uint64_t stripe_width;
+  const uint64_t chunk_size;
+public:
+  stripe_info_t(uint64_t stripe_width, uint64_t chunk_size)
+    : stripe_width(stripe_width), chunk_size(chunk_size) {
+    assert(stripe_width > 0);
+    assert(chunk_size > 0);
+  }
+  uint64_t get_stripe_width() const {
+    return stripe_width;
+  }
+  uint64_t get_chunk_size() const {
+    return chunk_size;
+  }
+  bool logical_offset_is_stripe_aligned(uint64_t logical) const {
+    return (logical % stripe_width) == 0;
+  }
+  uint64_t logical_to_prev_stripe_offset(uint64_t offset) const {
+    return offset - (offset % stripe_width);
+  }
+  uint64_t logical_to_next_stripe_offset(uint64_t offset) const {
+    return offset % stripe_width ?
+      offset - (offset % stripe_width) + stripe_width :
+      offset;
+  }
+  uint64_t logical_to_prev_chunk_offset(uint64_t offset) const {
+    return (offset / stripe_width) * chunk_size;
+  }
+  uint64_t logical_to_next_chunk_offset(uint64_t offset) const {
+    return ((offset + stripe_width - 1) / stripe_width) * chunk_size;
+  }
+  uint64_t aligned_logical_offset_to_chunk_offset(uint64_t offset) const {
+    assert(logical_offset_is_stripe_aligned(offset));
+    return (offset / stripe_width) * chunk_size;
+  }
+  uint64_t aligned_chunk_offset_to_logical_offset(uint64_t offset) const {
+    assert(offset % chunk_size == 0);
+    return (offset / chunk_size) * stripe_width;
+  }
+  /// stripe aligned [off, len) covering the logical range [off, off + len)
+  std::pair<uint64_t, uint64_t> offset_len_to_stripe_bounds(
+    uint64_t off, uint64_t len) const {
+    uint64_t start = logical_to_prev_stripe_offset(off);
+    uint64_t end = logical_to_next_stripe_offset(off + len);
+    return std::make_pair(start, end - start);
+  }
+};
+
+/**
+ * Encode **in** stripe by stripe and append the resulting chunks to
+ * **out** for every shard in **want**.  The last stripe is padded
+ * with zeros if **in** is not a multiple of the stripe width.
+ */
+int encode(
+  const stripe_info_t &sinfo,
+  ceph::ErasureCodeInterfaceRef &ec_impl,
+  bufferlist &in,
+  const std::set<int> &want,
+  std::map<int, bufferlist> *out);
+
+/**
+ * Rebuild the logical content of the stripes held in **to_decode**.
+ * All the buffers must have the same length, a multiple of the chunk
+ * size, and there must be enough of them to decode the data chunks.
+ * **out** receives whole stripes, padding included.
+ */
+int decode(
+  const stripe_info_t &sinfo,
+  ceph::ErasureCodeInterfaceRef &ec_impl,
+  std::map<int, bufferlist> &to_decode,
+  bufferlist *out);
+
+/**
+ * Rebuild the chunks of the shards listed in **out** from the chunks
+ * held in **to_decode**.  The rebuilt chunks are appended to the
+ * bufferlists **out** points to.
+ */
+int decode(
+  const stripe_info_t &sinfo,
+  ceph::ErasureCodeInterfaceRef &ec_impl,
+  std::map<int, bufferlist> &to_decode,
+  std::map<int, bufferlist*> &out);
+
+}
+#endif
@@ -108,6 +108,37 @@ namespace ceph {
   public:
     virtual ~ErasureCodeInterface() {}
 
+    /**
+     * Return the number of chunks created by a call to the **encode**
+     * method. Each chunk is stored in a different place, which is
+     * why the erasure coded pool size is **get_chunk_count()**.
+     *
+     * @return the number of chunks created by encode()
+     */
+    virtual unsigned int get_chunk_count() const = 0;
+
+    /**
+     * Return the number of data chunks created by a call to the
+     * **encode** method. The data chunks contain the buffer provided
+     * to **encode**, verbatim, with padding at the end of the last
+     * chunk.
+     *
+     * @return the number of data chunks created by encode()
+     */
+    virtual unsigned int get_data_chunk_count() const = 0;
+
+    /**
+     * Return the size (in bytes) of a single chunk created by a call
+     * to the **encode** method of an **object_size** bytes long
+     * buffer. All chunks have the same size, including the padding
+     * the implementation may need to respect its alignment
+     * constraints.
+     *
+     * @param [in] object_size the number of bytes given to encode()
+     * @return the size of each chunk
+     */
+    virtual unsigned int get_chunk_size(unsigned int object_size) const = 0;
+
     /**
      * Compute the smallest subset of **available** chunks that needs
      * to be retrieved in order to successfully decode
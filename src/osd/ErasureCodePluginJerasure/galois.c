@@ -51,6 +51,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include <string.h>
 
 #include "galois.h"
+#include "galois_simd.h"
 
 #define NONE (10)
 #define TABLE (11)
@@ -437,6 +438,7 @@ void galois_w08_region_multiply(char *region,      /* Region to multiply */
   unsigned long l, *lp2;
   unsigned char *lp;
   int sol;
+  int done;
 
   ur1 = (unsigned char *) region;
   ur2 = (r2 == NULL) ? ur1 : (unsigned char *) r2;
@@ -457,9 +459,11 @@ void galois_w08_region_multiply(char *region,      /* Region to multiply */
       exit(1);
     }
   }
+  done = galois_simd_w08_region_multiply(ur1, ur2, nbytes, multby,
+                                         (r2 != NULL && add));
   srow = multby * nw[8];
   if (r2 == NULL || !add) {
-    for (i = 0; i < nbytes; i++) {
+    for (i = done; i < nbytes; i++) {
       prod = galois_mult_tables[8][srow+ur1[i]];
       ur2[i] = prod;
     }
@@ -467,7 +471,7 @@ void galois_w08_region_multiply(char *region,      /* Region to multiply */
     sol = sizeof(long);
     lp2 = &l;
     lp = (unsigned char *) lp2;
-    for (i = 0; i < nbytes; i += sol) {
+    for (i = done; i < nbytes; i += sol) {
       cp = ur2+i;
       lp2 = (unsigned long *) cp;
       for (j = 0; j < sol; j++) {
@@ -492,6 +496,7 @@ void galois_w16_region_multiply(char *region,      /* Region to multiply */
   unsigned long l, *lp2, *lptop;
   unsigned short *lp;
   int sol;
+  int done;
 
   ur1 = (unsigned short *) region;
   ur2 = (r2 == NULL) ? ur1 : (unsigned short *) r2;
@@ -528,8 +533,13 @@ void galois_w16_region_multiply(char *region,      /* Region to multiply */
   }
   log1 = galois_log_tables[16][multby];
 
+  done = galois_simd_w16_region_multiply((unsigned char *) ur1,
+                                         (unsigned char *) ur2,
+                                         nbytes * 2, multby,
+                                         (r2 != NULL && add)) / 2;
+
   if (r2 == NULL || !add) {
-    for (i = 0; i < nbytes; i++) {
+    for (i = done; i < nbytes; i++) {
       if (ur1[i] == 0) {
         ur2[i] = 0;
       } else {
@@ -541,7 +551,7 @@ void galois_w16_region_multiply(char *region,      /* Region to multiply */
     sol = sizeof(long)/2;
     lp2 = &l;
     lp = (unsigned short *) lp2;
-    for (i = 0; i < nbytes; i += sol) {
+    for (i = done; i < nbytes; i += sol) {
       cp = ur2+i;
       lp2 = (unsigned long *) cp;
       for (j = 0; j < sol; j++) {
@@ -750,12 +760,15 @@ void galois_region_xor(           char *r1,         /* Region 1 */
   long *l3;
   long *ltop;
   char *ctop;
+  int done;
   
+  done = galois_simd_region_xor((unsigned char *) r1, (unsigned char *) r2,
+                                (unsigned char *) r3, nbytes);
   ctop = r1 + nbytes;
   ltop = (long *) ctop;
-  l1 = (long *) r1;
-  l2 = (long *) r2;
-  l3 = (long *) r3;
+  l1 = (long *) (r1 + done);
+  l2 = (long *) (r2 + done);
+  l3 = (long *) (r3 + done);
  
   while (l1 < ltop) {
     *l3 = ((*l1)  ^ (*l2));
@@ -0,0 +1,118 @@
+/*
+ * Ceph - scalable distributed file system
+ *
+ * Copyright (C) 2013 Inktank Storage, Inc.
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+/*
+ * built with -mavx2, only called if the cpu has it.  Same as
+ * galois_ssse3.c, on both 128 bit lanes at once: vpshufb, vpackuswb
+ * and vpunpck*bw work lane by lane, so each table is loaded in both.
+ */
+
+#include <immintrin.h>
+#include "galois_simd.h"
+
+static inline __m256i load_table(const unsigned char *table)
+{
+  __m128i t = _mm_loadu_si128((const __m128i *)table);
+  return _mm256_inserti128_si256(_mm256_castsi128_si256(t), t, 1);
+}
+
+int galois_avx2_w08_region_multiply(const unsigned char *src,
+                                    unsigned char *dst,
+                                    int nbytes,
+                                    const unsigned char tables[][16],
+                                    int add)
+{
+  const __m256i mask = _mm256_set1_epi8(0x0f);
+  const __m256i tlo = load_table(tables[0]);
+  const __m256i thi = load_table(tables[1]);
+  __m256i in, lo, hi, out;
+  int i;
+
+  for (i = 0; i + 32 <= nbytes; i += 32) {
+    in = _mm256_loadu_si256((const __m256i *)(src + i));
+    lo = _mm256_and_si256(in, mask);
+    hi = _mm256_and_si256(_mm256_srli_epi64(in, 4), mask);
+    out = _mm256_xor_si256(_mm256_shuffle_epi8(tlo, lo),
+                           _mm256_shuffle_epi8(thi, hi));
+    if (add)
+      out = _mm256_xor_si256(out,
+                             _mm256_loadu_si256((const __m256i *)(dst + i)));
+    _mm256_storeu_si256((__m256i *)(dst + i), out);
+  }
+  return i;
+}
+
+int galois_avx2_w16_region_multiply(const unsigned char *src,
+                                    unsigned char *dst,
+                                    int nbytes,
+                                    const unsigned char tables[][16],
+                                    int add)
+{
+  const __m256i mask = _mm256_set1_epi8(0x0f);
+  const __m256i low_bytes = _mm256_set1_epi16(0x00ff);
+  __m256i t[8];
+  __m256i a, b, l, h, n0, n1, n2, n3, rl, rh;
+  int i;
+
+  for (i = 0; i < 8; i++)
+    t[i] = load_table(tables[i]);
+
+  for (i = 0; i + 64 <= nbytes; i += 64) {
+    a = _mm256_loadu_si256((const __m256i *)(src + i));
+    b = _mm256_loadu_si256((const __m256i *)(src + i + 32));
+    l = _mm256_packus_epi16(_mm256_and_si256(a, low_bytes),
+                            _mm256_and_si256(b, low_bytes));
+    h = _mm256_packus_epi16(_mm256_srli_epi16(a, 8), _mm256_srli_epi16(b, 8));
+    n0 = _mm256_and_si256(l, mask);
+    n1 = _mm256_and_si256(_mm256_srli_epi64(l, 4), mask);
+    n2 = _mm256_and_si256(h, mask);
+    n3 = _mm256_and_si256(_mm256_srli_epi64(h, 4), mask);
+
+    rl = _mm256_xor_si256(
+      _mm256_xor_si256(_mm256_shuffle_epi8(t[0], n0),
+                       _mm256_shuffle_epi8(t[2], n1)),
+      _mm256_xor_si256(_mm256_shuffle_epi8(t[4], n2),
+                       _mm256_shuffle_epi8(t[6], n3)));
+    rh = _mm256_xor_si256(
+      _mm256_xor_si256(_mm256_shuffle_epi8(t[1], n0),
+                       _mm256_shuffle_epi8(t[3], n1)),
+      _mm256_xor_si256(_mm256_shuffle_epi8(t[5], n2),
+                       _mm256_shuffle_epi8(t[7], n3)));
+
+    a = _mm256_unpacklo_epi8(rl, rh);
+    b = _mm256_unpackhi_epi8(rl, rh);
+    if (add) {
+      a = _mm256_xor_si256(a, _mm256_loadu_si256((const __m256i *)(dst + i)));
+      b = _mm256_xor_si256(b,
+                           _mm256_loadu_si256((const __m256i *)(dst + i + 32)));
+    }
+    _mm256_storeu_si256((__m256i *)(dst + i), a);
+    _mm256_storeu_si256((__m256i *)(dst + i + 32), b);
+  }
+  return i;
+}
+
+int galois_avx2_region_xor(const unsigned char *r1,
+                           const unsigned char *r2,
+                           unsigned char *r3,
+                           int nbytes)
+{
+  __m256i a, b;
+  int i;
+
+  for (i = 0; i + 32 <= nbytes; i += 32) {
+    a = _mm256_loadu_si256((const __m256i *)(r1 + i));
+    b = _mm256_loadu_si256((const __m256i *)(r2 + i));
+    _mm256_storeu_si256((__m256i *)(r3 + i), _mm256_xor_si256(a, b));
+  }
+  return i;
+}
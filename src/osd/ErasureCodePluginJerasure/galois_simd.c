@@ -0,0 +1,141 @@
+/*
+ * Ceph - scalable distributed file system
+ *
+ * Copyright (C) 2013 Inktank Storage, Inc.
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include "acconfig.h"
+#include "arch/probe.h"
+#include "arch/intel.h"
+#include "galois.h"
+#include "galois_simd.h"
+
+/* below this many bytes building the tables costs more than it saves */
+#define GALOIS_SIMD_MIN_BYTES 64
+
+static int galois_simd_probed = -1;
+static int galois_simd = GALOIS_SIMD_NONE;
+
+static int galois_simd_probe(void)
+{
+  int level = GALOIS_SIMD_NONE;
+
+  ceph_arch_probe();
+#ifdef HAVE_INTEL_SSSE3
+  if (ceph_arch_intel_ssse3)
+    level = GALOIS_SIMD_SSSE3;
+#endif
+#ifdef HAVE_INTEL_AVX2
+  if (ceph_arch_intel_avx2)
+    level = GALOIS_SIMD_AVX2;
+#endif
+  return level;
+}
+
+int galois_simd_level(void)
+{
+  if (galois_simd_probed < 0) {
+    galois_simd_probed = galois_simd_probe();
+    galois_simd = galois_simd_probed;
+  }
+  return galois_simd;
+}
+
+int galois_simd_set_level(int level)
+{
+  galois_simd_level();
+  galois_simd = level < galois_simd_probed ? level : galois_simd_probed;
+  return galois_simd;
+}
+
+int galois_simd_w08_region_multiply(unsigned char *src,
+                                    unsigned char *dst,
+                                    int nbytes,
+                                    int multby,
+                                    int add)
+{
+  unsigned char tables[2][16];
+  int level = galois_simd_level();
+  int i;
+
+  if (level == GALOIS_SIMD_NONE || nbytes < GALOIS_SIMD_MIN_BYTES)
+    return 0;
+
+  for (i = 0; i < 16; i++) {
+    tables[0][i] = galois_single_multiply(i, multby, 8);
+    tables[1][i] = galois_single_multiply(i << 4, multby, 8);
+  }
+
+  switch (level) {
+#ifdef HAVE_INTEL_AVX2
+  case GALOIS_SIMD_AVX2:
+    return galois_avx2_w08_region_multiply(src, dst, nbytes, tables, add);
+#endif
+#ifdef HAVE_INTEL_SSSE3
+  case GALOIS_SIMD_SSSE3:
+    return galois_ssse3_w08_region_multiply(src, dst, nbytes, tables, add);
+#endif
+  default:
+    return 0;
+  }
+}
+
+int galois_simd_w16_region_multiply(unsigned char *src,
+                                    unsigned char *dst,
+                                    int nbytes,
+                                    int multby,
+                                    int add)
+{
+  unsigned char tables[8][16];
+  int level = galois_simd_level();
+  int i, n, prod;
+
+  if (level == GALOIS_SIMD_NONE || nbytes < GALOIS_SIMD_MIN_BYTES)
+    return 0;
+
+  for (n = 0; n < 4; n++) {
+    for (i = 0; i < 16; i++) {
+      prod = galois_single_multiply(i << (4 * n), multby, 16);
+      tables[2 * n][i] = prod & 0xff;
+      tables[2 * n + 1][i] = (prod >> 8) & 0xff;
+    }
+  }
+
+  switch (level) {
+#ifdef HAVE_INTEL_AVX2
+  case GALOIS_SIMD_AVX2:
+    return galois_avx2_w16_region_multiply(src, dst, nbytes, tables, add);
+#endif
+#ifdef HAVE_INTEL_SSSE3
+  case GALOIS_SIMD_SSSE3:
+    return galois_ssse3_w16_region_multiply(src, dst, nbytes, tables, add);
+#endif
+  default:
+    return 0;
+  }
+}
+
+int galois_simd_region_xor(unsigned char *r1,
+                           unsigned char *r2,
+                           unsigned char *r3,
+                           int nbytes)
+{
+  switch (galois_simd_level()) {
+#ifdef HAVE_INTEL_AVX2
+  case GALOIS_SIMD_AVX2:
+    return galois_avx2_region_xor(r1, r2, r3, nbytes);
+#endif
+#ifdef HAVE_INTEL_SSSE3
+  case GALOIS_SIMD_SSSE3:
+    return galois_ssse3_region_xor(r1, r2, r3, nbytes);
+#endif
+  default:
+    return 0;
+  }
+}
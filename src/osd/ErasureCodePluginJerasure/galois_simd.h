@@ -0,0 +1,92 @@
+/*
+ * Ceph - scalable distributed file system
+ *
+ * Copyright (C) 2013 Inktank Storage, Inc.
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#ifndef _GALOIS_SIMD_H
+#define _GALOIS_SIMD_H
+
+/*
+ * Split table region multiply.
+ *
+ * The product of a region by a constant is the xor of the products
+ * of each nibble of the region by the constant.  A nibble has 16
+ * values, so the partial products fit a 16 byte table and pshufb
+ * looks up a whole vector of them at once: two tables for w=8, eight
+ * for w=16 (four nibbles times the two bytes of the product).
+ *
+ * The galois_simd_* functions pick the widest kernel the cpu (see
+ * arch/probe.h) and the compiler support.  They process the longest
+ * prefix of the region which is a multiple of the vector size and
+ * return its length in bytes, leaving the rest to the scalar code of
+ * galois.c.  They return 0 if no kernel is available.
+ */
+
+#define GALOIS_SIMD_NONE  0
+#define GALOIS_SIMD_SSSE3 1
+#define GALOIS_SIMD_AVX2  2
+
+/* the kernel in use, probed on first call */
+extern int galois_simd_level(void);
+/* use at most level, returns the level in use */
+extern int galois_simd_set_level(int level);
+
+extern int galois_simd_w08_region_multiply(unsigned char *src,
+                                           unsigned char *dst,
+                                           int nbytes,
+                                           int multby,
+                                           int add);
+extern int galois_simd_w16_region_multiply(unsigned char *src,
+                                           unsigned char *dst,
+                                           int nbytes,
+                                           int multby,
+                                           int add);
+extern int galois_simd_region_xor(unsigned char *r1,
+                                  unsigned char *r2,
+                                  unsigned char *r3,
+                                  int nbytes);
+
+/*
+ * The kernels, each built with the compiler flags of its instruction
+ * set.  tables[0] and tables[1] are the products of the low and high
+ * nibbles for w=8; tables[2 * n + b] is byte b of the products of
+ * nibble n for w=16.
+ */
+extern int galois_ssse3_w08_region_multiply(const unsigned char *src,
+                                            unsigned char *dst,
+                                            int nbytes,
+                                            const unsigned char tables[][16],
+                                            int add);
+extern int galois_ssse3_w16_region_multiply(const unsigned char *src,
+                                            unsigned char *dst,
+                                            int nbytes,
+                                            const unsigned char tables[][16],
+                                            int add);
+extern int galois_ssse3_region_xor(const unsigned char *r1,
+                                   const unsigned char *r2,
+                                   unsigned char *r3,
+                                   int nbytes);
+
+extern int galois_avx2_w08_region_multiply(const unsigned char *src,
+                                           unsigned char *dst,
+                                           int nbytes,
+                                           const unsigned char tables[][16],
+                                           int add);
+extern int galois_avx2_w16_region_multiply(const unsigned char *src,
+                                           unsigned char *dst,
+                                           int nbytes,
+                                           const unsigned char tables[][16],
+                                           int add);
+extern int galois_avx2_region_xor(const unsigned char *r1,
+                                  const unsigned char *r2,
+                                  unsigned char *r3,
+                                  int nbytes);
+
+#endif
@@ -0,0 +1,107 @@
+/*
+ * Ceph - scalable distributed file system
+ *
+ * Copyright (C) 2013 Inktank Storage, Inc.
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+/* built with -mssse3, only called if the cpu has it */
+
+#include <tmmintrin.h>
+#include "galois_simd.h"
+
+int galois_ssse3_w08_region_multiply(const unsigned char *src,
+                                     unsigned char *dst,
+                                     int nbytes,
+                                     const unsigned char tables[][16],
+                                     int add)
+{
+  const __m128i mask = _mm_set1_epi8(0x0f);
+  const __m128i tlo = _mm_loadu_si128((const __m128i *)tables[0]);
+  const __m128i thi = _mm_loadu_si128((const __m128i *)tables[1]);
+  __m128i in, lo, hi, out;
+  int i;
+
+  for (i = 0; i + 16 <= nbytes; i += 16) {
+    in = _mm_loadu_si128((const __m128i *)(src + i));
+    lo = _mm_and_si128(in, mask);
+    hi = _mm_and_si128(_mm_srli_epi64(in, 4), mask);
+    out = _mm_xor_si128(_mm_shuffle_epi8(tlo, lo),
+                        _mm_shuffle_epi8(thi, hi));
+    if (add)
+      out = _mm_xor_si128(out, _mm_loadu_si128((const __m128i *)(dst + i)));
+    _mm_storeu_si128((__m128i *)(dst + i), out);
+  }
+  return i;
+}
+
+/*
+ * The low and high bytes of 16 words are gathered in two vectors so
+ * that each nibble has a vector of its own, and scattered back once
+ * multiplied.
+ */
+int galois_ssse3_w16_region_multiply(const unsigned char *src,
+                                     unsigned char *dst,
+                                     int nbytes,
+                                     const unsigned char tables[][16],
+                                     int add)
+{
+  const __m128i mask = _mm_set1_epi8(0x0f);
+  const __m128i low_bytes = _mm_set1_epi16(0x00ff);
+  __m128i t[8];
+  __m128i a, b, l, h, n0, n1, n2, n3, rl, rh;
+  int i;
+
+  for (i = 0; i < 8; i++)
+    t[i] = _mm_loadu_si128((const __m128i *)tables[i]);
+
+  for (i = 0; i + 32 <= nbytes; i += 32) {
+    a = _mm_loadu_si128((const __m128i *)(src + i));
+    b = _mm_loadu_si128((const __m128i *)(src + i + 16));
+    l = _mm_packus_epi16(_mm_and_si128(a, low_bytes),
+                         _mm_and_si128(b, low_bytes));
+    h = _mm_packus_epi16(_mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8));
+    n0 = _mm_and_si128(l, mask);
+    n1 = _mm_and_si128(_mm_srli_epi64(l, 4), mask);
+    n2 = _mm_and_si128(h, mask);
+    n3 = _mm_and_si128(_mm_srli_epi64(h, 4), mask);
+
+    rl = _mm_xor_si128(
+      _mm_xor_si128(_mm_shuffle_epi8(t[0], n0), _mm_shuffle_epi8(t[2], n1)),
+      _mm_xor_si128(_mm_shuffle_epi8(t[4], n2), _mm_shuffle_epi8(t[6], n3)));
+    rh = _mm_xor_si128(
+      _mm_xor_si128(_mm_shuffle_epi8(t[1], n0), _mm_shuffle_epi8(t[3], n1)),
+      _mm_xor_si128(_mm_shuffle_epi8(t[5], n2), _mm_shuffle_epi8(t[7], n3)));
+
+    a = _mm_unpacklo_epi8(rl, rh);
+    b = _mm_unpackhi_epi8(rl, rh);
+    if (add) {
+      a = _mm_xor_si128(a, _mm_loadu_si128((const __m128i *)(dst + i)));
+      b = _mm_xor_si128(b, _mm_loadu_si128((const __m128i *)(dst + i + 16)));
+    }
+    _mm_storeu_si128((__m128i *)(dst + i), a);
+    _mm_storeu_si128((__m128i *)(dst + i + 16), b);
+  }
+  return i;
+}
+
+int galois_ssse3_region_xor(const unsigned char *r1,
+                            const unsigned char *r2,
+                            unsigned char *r3,
+                            int nbytes)
+{
+  __m128i a, b;
+  int i;
+
+  for (i = 0; i + 16 <= nbytes; i += 16) {
+    a = _mm_loadu_si128((const __m128i *)(r1 + i));
+    b = _mm_loadu_si128((const __m128i *)(r2 + i));
+    _mm_storeu_si128((__m128i *)(r3 + i), _mm_xor_si128(a, b));
+  }
+  return i;
+}
@@ -0,0 +1,267 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * Copyright (C) 2013 Inktank Storage, Inc.
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include <errno.h>
+#include <algorithm>
+#include "common/debug.h"
+#include "include/stringify.h"
+#include "ErasureCodeLrc.h"
+extern "C" {
+#include "osd/ErasureCodePluginJerasure/galois.h"
+}
+
+#define dout_subsys ceph_subsys_osd
+#undef dout_prefix
+#define dout_prefix _prefix(_dout)
+
+static ostream& _prefix(std::ostream* _dout)
+{
+  return *_dout << "ErasureCodeLrc: ";
+}
+
+int ErasureCodeLrc::init(const map<std::string,std::string> &parameters)
+{
+  k = ErasureCodeJerasure::to_int("erasure-code-k", parameters, DEFAULT_K);
+  m = ErasureCodeJerasure::to_int("erasure-code-m", parameters, DEFAULT_M);
+  l = ErasureCodeJerasure::to_int("erasure-code-l", parameters, DEFAULT_L);
+  if (k < 1 || m < 1 || l < 1 || (k + m) % l != 0) {
+    derr << "k=" << k << " m=" << m << " l=" << l
+	 << " must be positive and k + m must be a multiple of l" << dendl;
+    return -EINVAL;
+  }
+  dout(10) << "k=" << k << " m=" << m << " l=" << l
+	   << " groups=" << get_group_count() << dendl;
+
+  map<std::string,std::string> global_parameters = parameters;
+  global_parameters["erasure-code-k"] = stringify(k);
+  global_parameters["erasure-code-m"] = stringify(m);
+  global.init(global_parameters);
+  return 0;
+}
+
+void ErasureCodeLrc::get_group_chunks(int group, set<int> *chunks) const
+{
+  for (int i = group * l; i < (group + 1) * l; i++)
+    chunks->insert(i);
+  chunks->insert(get_local_parity(group));
+}
+
+bool ErasureCodeLrc::local_repair(int chunk,
+				  const map<int, int> &available,
+				  set<int> *needed,
+				  int *cost) const
+{
+  set<int> group;
+  get_group_chunks(get_group(chunk), &group);
+  for (set<int>::iterator i = group.begin(); i != group.end(); ++i) {
+    if (*i == chunk)
+      continue;
+    map<int, int>::const_iterator a = available.find(*i);
+    if (a == available.end())
+      return false;
+    if (needed->insert(*i).second)
+      *cost += a->second;
+  }
+  return true;
+}
+
+int ErasureCodeLrc::minimum_to_decode(const set<int> &want_to_read,
+				      const set<int> &available_chunks,
+				      set<int> *minimum)
+{
+  map<int, int> available;
+  for (set<int>::const_iterator i = available_chunks.begin();
+       i != available_chunks.end();
+       ++i)
+    available[*i] = 1;
+  return minimum_to_decode_with_cost(want_to_read, available, minimum);
+}
+
+int ErasureCodeLrc::minimum_to_decode_with_cost(const set<int> &want_to_read,
+						const map<int, int> &available,
+						set<int> *minimum)
+{
+  set<int> wanted, missing;
+  int wanted_cost = 0;
+  for (set<int>::const_iterator i = want_to_read.begin();
+       i != want_to_read.end();
+       ++i) {
+    map<int, int>::const_iterator a = available.find(*i);
+    if (a == available.end()) {
+      missing.insert(*i);
+    } else {
+      wanted.insert(*i);
+      wanted_cost += a->second;
+    }
+  }
+  if (missing.empty()) {
+    *minimum = want_to_read;
+    return 0;
+  }
+
+  // rebuild each missing chunk from its group
+  set<int> local = wanted;
+  int local_cost = wanted_cost;
+  bool local_ok = true;
+  for (set<int>::iterator i = missing.begin(); i != missing.end(); ++i) {
+    if (!local_repair(*i, available, &local, &local_cost)) {
+      local_ok = false;
+      break;
+    }
+  }
+
+  // or decode the global layer from the k cheapest chunks, counting
+  // the chunks of the global layer which can be rebuilt locally
+  vector<pair<int, int> > candidates;   // cost, chunk
+  map<int, set<int> > reads;
+  for (int i = 0; i < k + m; i++) {
+    map<int, int>::const_iterator a = available.find(i);
+    if (a != available.end()) {
+      candidates.push_back(make_pair(a->second, i));
+      reads[i].insert(i);
+    } else {
+      set<int> needed;
+      int cost = 0;
+      if (local_repair(i, available, &needed, &cost)) {
+	candidates.push_back(make_pair(cost, i));
+	reads[i].swap(needed);
+      }
+    }
+  }
+  bool global_ok = candidates.size() >= (unsigned)k;
+  set<int> global = wanted;
+  int global_cost = 0;
+  if (global_ok) {
+    sort(candidates.begin(), candidates.end());
+    for (int i = 0; i < k; i++) {
+      set<int> &r = reads[candidates[i].second];
+      global.insert(r.begin(), r.end());
+    }
+    for (set<int>::iterator i = global.begin(); i != global.end(); ++i)
+      global_cost += available.find(*i)->second;
+  }
+
+  dout(20) << __func__ << " want " << want_to_read
+	   << " local " << local_ok << " " << local << " cost " << local_cost
+	   << " global " << global_ok << " " << global << " cost " << global_cost
+	   << dendl;
+  if (local_ok && (!global_ok || local_cost <= global_cost))
+    minimum->swap(local);
+  else if (global_ok)
+    minimum->swap(global);
+  else
+    return -EIO;
+  return 0;
+}
+
+void ErasureCodeLrc::local_decode(int chunk, unsigned blocksize,
+				  map<int, bufferlist> *decoded)
+{
+  set<int> group;
+  get_group_chunks(get_group(chunk), &group);
+  bufferptr ptr(blocksize);
+  bool first = true;
+  for (set<int>::iterator i = group.begin(); i != group.end(); ++i) {
+    if (*i == chunk)
+      continue;
+    assert(decoded->count(*i));
+    bufferlist &b = (*decoded)[*i];
+    assert(b.length() == blocksize);
+    if (first) {
+      memcpy(ptr.c_str(), b.c_str(), blocksize);
+      first = false;
+    } else {
+      galois_region_xor(b.c_str(), ptr.c_str(), ptr.c_str(), blocksize);
+    }
+  }
+  (*decoded)[chunk].clear();
+  (*decoded)[chunk].push_back(ptr);
+}
+
+int ErasureCodeLrc::encode(const set<int> &want_to_encode,
+			   const bufferlist &in,
+			   map<int, bufferlist> *encoded)
+{
+  set<int> global_want;
+  for (int i = 0; i < k + m; i++)
+    global_want.insert(i);
+  int r = global.encode(global_want, in, encoded);
+  if (r)
+    return r;
+  unsigned blocksize = encoded->begin()->second.length();
+  for (unsigned g = 0; g < get_group_count(); g++)
+    if (want_to_encode.count(get_local_parity(g)))
+      local_decode(get_local_parity(g), blocksize, encoded);
+  for (int i = 0; i < k + m; i++)
+    if (want_to_encode.count(i) == 0)
+      encoded->erase(i);
+  return 0;
+}
+
+int ErasureCodeLrc::decode(const set<int> &want_to_read,
+			   const map<int, bufferlist> &chunks,
+			   map<int, bufferlist> *decoded)
+{
+  unsigned blocksize = chunks.begin()->second.length();
+  *decoded = chunks;
+
+  // a group missing a single chunk rebuilds it locally
+  for (unsigned g = 0; g < get_group_count(); g++) {
+    set<int> group;
+    get_group_chunks(g, &group);
+    int lost = -1;
+    unsigned lost_count = 0;
+    for (set<int>::iterator i = group.begin(); i != group.end(); ++i) {
+      if (!decoded->count(*i)) {
+	lost = *i;
+	lost_count++;
+      }
+    }
+    if (lost_count == 1)
+      local_decode(lost, blocksize, decoded);
+  }
+  bool done = true;
+  for (set<int>::const_iterator i = want_to_read.begin();
+       i != want_to_read.end();
+       ++i)
+    if (!decoded->count(*i))
+      done = false;
+  if (done)
+    return 0;
+
+  // otherwise the global layer rebuilds all its chunks
+  map<int, bufferlist> global_chunks;
+  set<int> global_want;
+  for (int i = 0; i < k + m; i++) {
+    global_want.insert(i);
+    if (decoded->count(i))
+      global_chunks[i] = (*decoded)[i];
+  }
+  if (global_chunks.size() < (unsigned)k)
+    return -EIO;
+  map<int, bufferlist> global_decoded;
+  int r = global.decode(global_want, global_chunks, &global_decoded);
+  if (r)
+    return r;
+  for (int i = 0; i < k + m; i++)
+    (*decoded)[i] = global_decoded[i];
+
+  // and the local parities are computed again
+  for (set<int>::const_iterator i = want_to_read.begin();
+       i != want_to_read.end();
+       ++i)
+    if (!decoded->count(*i))
+      local_decode(*i, blocksize, decoded);
+  return 0;
+}
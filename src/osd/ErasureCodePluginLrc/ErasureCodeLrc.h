@@ -0,0 +1,105 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * Copyright (C) 2013 Inktank Storage, Inc.
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#ifndef CEPH_ERASURE_CODE_LRC_H
+#define CEPH_ERASURE_CODE_LRC_H
+
+#include "osd/ErasureCodeInterface.h"
+#include "osd/ErasureCodePluginJerasure/ErasureCodeJerasure.h"
+
+/**
+ * Locally repairable code.
+ *
+ * Two layers: the k data chunks are encoded with m Reed-Solomon
+ * coding chunks (jerasure reed_sol_van), then the k + m chunks are
+ * split in groups of l consecutive chunks and each group gets a
+ * local parity chunk, the xor of its members.  The local parity of
+ * group g is chunk k + m + g.
+ *
+ * A single missing chunk is rebuilt from the l other chunks of its
+ * group instead of k chunks, which is what makes repairs cheap.  When
+ * a group misses more than one chunk the global layer takes over and
+ * needs k chunks, as Reed-Solomon does.
+ *
+ * k + m must be a multiple of l.
+ */
+class ErasureCodeLrc : public ErasureCodeInterface {
+public:
+  static const int DEFAULT_K = 4;
+  static const int DEFAULT_M = 2;
+  static const int DEFAULT_L = 3;
+
+  int k;
+  int m;
+  int l;
+  ErasureCodeJerasureReedSolomonVandermonde global;
+
+  ErasureCodeLrc() : k(0), m(0), l(0) {}
+  virtual ~ErasureCodeLrc() {}
+
+  /// @return 0 on success, -EINVAL if the parameters are inconsistent
+  int init(const map<std::string,std::string> &parameters);
+
+  virtual unsigned int get_chunk_count() const {
+    return k + m + get_group_count();
+  }
+
+  virtual unsigned int get_data_chunk_count() const {
+    return k;
+  }
+
+  virtual unsigned int get_chunk_size(unsigned int object_size) const {
+    return global.get_chunk_size(object_size);
+  }
+
+  virtual int minimum_to_decode(const set<int> &want_to_read,
+                                const set<int> &available_chunks,
+                                set<int> *minimum);
+
+  virtual int minimum_to_decode_with_cost(const set<int> &want_to_read,
+                                          const map<int, int> &available,
+                                          set<int> *minimum);
+
+  virtual int encode(const set<int> &want_to_encode,
+                     const bufferlist &in,
+                     map<int, bufferlist> *encoded);
+
+  virtual int decode(const set<int> &want_to_read,
+                     const map<int, bufferlist> &chunks,
+                     map<int, bufferlist> *decoded);
+
+  unsigned int get_group_count() const {
+    return (k + m) / l;
+  }
+  /// group of a chunk, be it a member or the local parity
+  int get_group(int chunk) const {
+    return chunk < k + m ? chunk / l : chunk - k - m;
+  }
+  int get_local_parity(int group) const {
+    return k + m + group;
+  }
+  /// members and local parity of **group**
+  void get_group_chunks(int group, set<int> *chunks) const;
+
+private:
+  /// chunks to read to repair **chunk** within its group, false if
+  /// some of them are not **available**
+  bool local_repair(int chunk, const map<int, int> &available,
+                    set<int> *needed, int *cost) const;
+  /// xor the other chunks of the group of **chunk** into it
+  void local_decode(int chunk, unsigned blocksize,
+                    map<int, bufferlist> *decoded);
+};
+
+#endif
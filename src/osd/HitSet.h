@@ -36,7 +36,8 @@ public:
     TYPE_NONE = 0,
     TYPE_EXPLICIT_HASH = 1,
     TYPE_EXPLICIT_OBJECT = 2,
-    TYPE_BLOOM = 3
+    TYPE_BLOOM = 3,
+    TYPE_COUNTING = 4
   } impl_type_t;
 
   static const char *get_type_name(impl_type_t t) {
@@ -45,6 +46,7 @@ public:
     case TYPE_EXPLICIT_HASH: return "explicit_hash";
     case TYPE_EXPLICIT_OBJECT: return "explicit_object";
     case TYPE_BLOOM: return "bloom";
+    case TYPE_COUNTING: return "counting";
     default: return "???";
     }
   }
@@ -61,6 +63,10 @@ public:
     virtual bool is_full() const = 0;
     virtual void insert(const hobject_t& o) = 0;
     virtual bool contains(const hobject_t& o) const = 0;
+    /// (estimated) number of inserts of o; 0 or 1 unless we count
+    virtual unsigned count(const hobject_t& o) const {
+      return contains(o) ? 1 : 0;
+    }
     virtual unsigned insert_count() const = 0;
     virtual unsigned approx_unique_insert_count() const = 0;
     virtual void encode(bufferlist &bl) const = 0;
@@ -145,6 +151,10 @@ public:
   bool contains(const hobject_t& o) const {
     return impl->contains(o);
   }
+  /// query how many times a hash was inserted (may overestimate)
+  unsigned count(const hobject_t& o) const {
+    return impl->count(o);
+  }
 
   unsigned insert_count() const {
     return impl->insert_count();
@@ -169,6 +179,72 @@ private:
 WRITE_CLASS_ENCODER(HitSet);
 WRITE_CLASS_ENCODER(HitSet::Params);
 
+typedef std::tr1::shared_ptr<HitSet> HitSetRef;
+
+/**
+ * the archived HitSets of a PG, by start time
+ */
+struct HitSetArchive {
+  map<time_t,HitSetRef> sets;
+
+  void add(time_t start, HitSetRef hs) {
+    sets.insert(make_pair(start, hs));
+  }
+  void remove(time_t start) {
+    sets.erase(start);
+  }
+  void clear() {
+    sets.clear();
+  }
+  bool have(time_t start) const {
+    return sets.count(start);
+  }
+  size_t size() const {
+    return sets.size();
+  }
+
+  /**
+   * temperature of oid
+   *
+   * An object found in the newest set is worth 1000000, in the one
+   * before 500000, and so on.
+   */
+  int32_t get_temp(const hobject_t& oid) const {
+    int32_t temp = 0;
+    int shift = 0;
+    for (map<time_t,HitSetRef>::const_reverse_iterator p = sets.rbegin();
+	 p != sets.rend() && shift < 20;
+	 ++p, ++shift) {
+      if (p->second->contains(oid))
+	temp += 1000000 >> shift;
+    }
+    return temp;
+  }
+
+  /**
+   * estimated hits on oid
+   *
+   * Count what the newest max_sets sets saw, halving the contribution
+   * of each set for every halflife sets it is older than the newest
+   * (0 to not decay).  Sets that do not count hits contribute 1 if
+   * they contain oid.
+   */
+  unsigned get_count(const hobject_t& oid, unsigned max_sets,
+		     unsigned halflife) const {
+    unsigned count = 0;
+    unsigned age = 0;
+    for (map<time_t,HitSetRef>::const_reverse_iterator p = sets.rbegin();
+	 p != sets.rend() && age < max_sets;
+	 ++p, ++age) {
+      unsigned shift = halflife ? age / halflife : 0;
+      if (shift >= 16)
+	break;
+      count += p->second->count(oid) >> shift;
+    }
+    return count;
+  }
+};
+
 ostream& operator<<(ostream& out, const HitSet::Params& p);
 
 /**
@@ -471,4 +547,218 @@ public:
 };
 WRITE_CLASS_ENCODER(BloomHitSet)
 
+/**
+ * count hits with a count-min sketch
+ *
+ * depth rows of width saturating 16 bit counters, each row indexed by
+ * a different hash of the object hash.  An insert bumps the smallest
+ * of the object's counters (conservative update) and a lookup returns
+ * the smallest, which never undercounts and overcounts by about
+ * e * inserts / width with probability 1 - e^-depth.
+ *
+ * With a halflife, every halflife inserts all counters are halved so
+ * that the set favors recent hits over old ones.
+ */
+class CountingHitSet : public HitSet::Impl {
+  uint32_t width;
+  uint32_t depth;
+  uint32_t seed;
+  uint32_t halflife;          ///< inserts between decays; 0 for never
+  uint64_t count_total;       ///< inserts
+  uint32_t since_decay;       ///< inserts since last decay
+  vector<uint16_t> counters;  ///< depth rows of width counters
+
+  static uint32_t mix(uint32_t h) {
+    // murmur3 finalizer
+    h ^= h >> 16;
+    h *= 0x85ebca6b;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35;
+    h ^= h >> 16;
+    return h;
+  }
+  unsigned slot(unsigned row, uint32_t hash) const {
+    return row * width + mix(hash ^ (seed + row * 0x9e3779b9)) % width;
+  }
+
+public:
+  HitSet::impl_type_t get_type() const {
+    return HitSet::TYPE_COUNTING;
+  }
+
+  class Params : public HitSet::Params::Impl {
+  public:
+    virtual HitSet::impl_type_t get_type() const {
+      return HitSet::TYPE_COUNTING;
+    }
+    virtual HitSet::Impl *get_new_impl() const {
+      return new CountingHitSet(this);
+    }
+
+    uint32_t width;     ///< counters per row; 0 to size from the last set
+    uint32_t depth;     ///< rows
+    uint32_t seed;      ///< seed for the row hashes
+    uint32_t halflife;  ///< inserts between halving all counters; 0 for never
+
+    Params()
+      : width(0), depth(4), seed(0), halflife(0) {}
+    Params(uint32_t w, uint32_t d, uint32_t s, uint32_t hl)
+      : width(w), depth(d), seed(s), halflife(hl) {}
+    Params(const Params &o)
+      : width(o.width), depth(o.depth), seed(o.seed), halflife(o.halflife) {}
+    ~Params() {}
+
+    void encode(bufferlist& bl) const {
+      ENCODE_START(1, 1, bl);
+      ::encode(width, bl);
+      ::encode(depth, bl);
+      ::encode(seed, bl);
+      ::encode(halflife, bl);
+      ENCODE_FINISH(bl);
+    }
+    void decode(bufferlist::iterator& bl) {
+      DECODE_START(1, bl);
+      ::decode(width, bl);
+      ::decode(depth, bl);
+      ::decode(seed, bl);
+      ::decode(halflife, bl);
+      DECODE_FINISH(bl);
+    }
+    void dump(Formatter *f) const {
+      f->dump_unsigned("width", width);
+      f->dump_unsigned("depth", depth);
+      f->dump_unsigned("seed", seed);
+      f->dump_unsigned("halflife", halflife);
+    }
+    void dump_stream(ostream& o) const {
+      o << "width: " << width << ", depth: " << depth
+	<< ", seed: " << seed << ", halflife: " << halflife;
+    }
+    static void generate_test_instances(list<Params*>& o) {
+      o.push_back(new Params);
+      o.push_back(new Params(1024, 3, 99, 5000));
+    }
+  };
+
+  CountingHitSet()
+    : width(0), depth(0), seed(0), halflife(0), count_total(0),
+      since_decay(0) {}
+  CountingHitSet(unsigned w, unsigned d, unsigned s, unsigned hl)
+    : width(w ? w : 1), depth(d ? d : 1), seed(s), halflife(hl),
+      count_total(0), since_decay(0),
+      counters(width * depth) {}
+  CountingHitSet(const CountingHitSet::Params *p)
+    : width(p->width ? p->width : 1), depth(p->depth ? p->depth : 1),
+      seed(p->seed), halflife(p->halflife), count_total(0), since_decay(0),
+      counters(width * depth) {}
+  CountingHitSet(const CountingHitSet &o)
+    : width(o.width), depth(o.depth), seed(o.seed), halflife(o.halflife),
+      count_total(o.count_total), since_decay(o.since_decay),
+      counters(o.counters) {}
+
+  HitSet::Impl *clone() const {
+    return new CountingHitSet(*this);
+  }
+
+  bool is_full() const {
+    return false;
+  }
+
+  void insert(const hobject_t& o) {
+    if (counters.empty())
+      return;
+    unsigned m = count(o);
+    if (m < 0xffff) {
+      for (unsigned i = 0; i < depth; ++i) {
+	uint16_t& c = counters[slot(i, o.hash)];
+	if (c == m)
+	  ++c;
+      }
+    }
+    ++count_total;
+    if (halflife && ++since_decay >= halflife)
+      decay();
+  }
+  bool contains(const hobject_t& o) const {
+    return count(o) > 0;
+  }
+  unsigned count(const hobject_t& o) const {
+    if (counters.empty())
+      return 0;
+    unsigned m = 0xffff;
+    for (unsigned i = 0; i < depth && m; ++i)
+      m = MIN(m, counters[slot(i, o.hash)]);
+    return m;
+  }
+  /// halve all counters
+  void decay() {
+    for (vector<uint16_t>::iterator p = counters.begin();
+	 p != counters.end();
+	 ++p)
+      *p >>= 1;
+    since_decay = 0;
+  }
+  unsigned insert_count() const {
+    return count_total;
+  }
+  unsigned approx_unique_insert_count() const {
+    // linear counting over the first row
+    if (counters.empty())
+      return 0;
+    unsigned zero = 0;
+    for (unsigned i = 0; i < width; ++i)
+      if (counters[i] == 0)
+	++zero;
+    if (zero == 0)
+      return width;  // saturated; we can't tell
+    return (unsigned)((double)width * std::log((double)width / (double)zero));
+  }
+  /// bytes of counters we hold
+  size_t get_counters_bytes() const {
+    return counters.size() * sizeof(uint16_t);
+  }
+
+  void encode(bufferlist &bl) const {
+    ENCODE_START(1, 1, bl);
+    ::encode(width, bl);
+    ::encode(depth, bl);
+    ::encode(seed, bl);
+    ::encode(halflife, bl);
+    ::encode(count_total, bl);
+    ::encode(since_decay, bl);
+    ::encode(counters, bl);
+    ENCODE_FINISH(bl);
+  }
+  void decode(bufferlist::iterator &bl) {
+    DECODE_START(1, bl);
+    ::decode(width, bl);
+    ::decode(depth, bl);
+    ::decode(seed, bl);
+    ::decode(halflife, bl);
+    ::decode(count_total, bl);
+    ::decode(since_decay, bl);
+    ::decode(counters, bl);
+    DECODE_FINISH(bl);
+    if (counters.size() != (size_t)width * depth)
+      throw buffer::malformed_input("CountingHitSet counters do not match width * depth");
+  }
+  void dump(Formatter *f) const {
+    f->dump_unsigned("width", width);
+    f->dump_unsigned("depth", depth);
+    f->dump_unsigned("seed", seed);
+    f->dump_unsigned("halflife", halflife);
+    f->dump_unsigned("insert_count", count_total);
+    f->dump_unsigned("since_decay", since_decay);
+  }
+  static void generate_test_instances(list<CountingHitSet*>& o) {
+    o.push_back(new CountingHitSet);
+    o.push_back(new CountingHitSet(16, 2, 1, 0));
+    o.back()->insert(hobject_t());
+    o.back()->insert(hobject_t("asdf", "", CEPH_NOSNAP, 123, 1, ""));
+    o.back()->insert(hobject_t("asdf", "", CEPH_NOSNAP, 123, 1, ""));
+    o.back()->insert(hobject_t("qwer", "", CEPH_NOSNAP, 456, 1, ""));
+  }
+};
+WRITE_CLASS_ENCODER(CountingHitSet)
+
 #endif
@@ -98,6 +98,8 @@
 #include "messages/MWatchNotify.h"
 #include "messages/MOSDPGPush.h"
 #include "messages/MOSDPGPushReply.h"
+#include "messages/MOSDECSubOpRead.h"
+#include "messages/MOSDECSubOpReadReply.h"
 #include "messages/MOSDPGPull.h"
 
 #include "common/perf_counters.h"
@@ -208,6 +210,16 @@ OSDService::OSDService(OSD *osd) :
   local_reserver(&reserver_finisher, cct->_conf->osd_max_backfills),
   remote_reserver(&reserver_finisher, cct->_conf->osd_max_backfills),
   pg_temp_lock("OSDService::pg_temp_lock"),
+  snap_trim_throttle_lock("OSDService::snap_trim_throttle_lock"),
+  snap_trim_timer(cct, snap_trim_throttle_lock, false),
+  snap_trim_window_objects(0),
+  snap_trim_window_bytes(0),
+  agent_lock("OSD::agent_lock"),
+  agent_valid_iterator(false),
+  agent_progress(false),
+  agent_ops(0),
+  agent_stop_flag(false),
+  agent_thread(this),
   map_cache_lock("OSDService::map_lock"),
   map_cache(cct->_conf->osd_map_cache_size),
   map_bl_cache(cct->_conf->osd_map_cache_size),
@@ -425,6 +437,11 @@ void OSDService::shutdown()
     Mutex::Locker l(backfill_request_lock);
     backfill_request_timer.shutdown();
   }
+
+  {
+    Mutex::Locker l(snap_trim_throttle_lock);
+    snap_trim_timer.shutdown();
+  }
   osdmap = OSDMapRef();
   next_osdmap = OSDMapRef();
 }
@@ -441,6 +458,7 @@ void OSDService::init()
     objecter->init_locked();
   }
   watch_timer.init();
+  agent_thread.create();
 }
 
 #undef dout_prefix
@@ -796,6 +814,7 @@ OSD::OSD(CephContext *cct_, ObjectStore *store_,
   monc(mc),
   logger(NULL),
   recoverystate_perf(NULL),
+  buffer_pool_perf(NULL),
   store(store_),
   clog(cct, client_messenger, &mc->monmap, LogClient::NO_FLAGS),
   whoami(id),
@@ -818,12 +837,13 @@ OSD::OSD(CephContext *cct_, ObjectStore *store_,
   heartbeat_dispatcher(this),
   stat_lock("OSD::stat_lock"),
   finished_lock("OSD::finished_lock"),
-  op_tracker(cct),
+  op_tracker(cct, cct->_conf->osd_num_op_tracker_shard),
   test_ops_hook(NULL),
   op_wq(this, cct->_conf->osd_op_thread_timeout, &op_tp),
   peering_wq(this, cct->_conf->osd_op_thread_timeout, &op_tp),
   map_lock("OSD::map_lock"),
   peer_map_epoch_lock("OSD::peer_map_epoch_lock"),
+  pg_map_lock("OSD::pg_map_lock"),
   debug_drop_pg_create_probability(cct->_conf->osd_debug_drop_pg_create_probability),
   debug_drop_pg_create_duration(cct->_conf->osd_debug_drop_pg_create_duration),
   debug_drop_pg_create_left(-1),
@@ -849,6 +869,7 @@ OSD::OSD(CephContext *cct_, ObjectStore *store_,
                                          cct->_conf->osd_op_log_threshold);
   op_tracker.set_history_size_and_duration(cct->_conf->osd_op_history_size,
                                            cct->_conf->osd_op_history_duration);
+  op_tracker.set_slow_detail_only(cct->_conf->osd_op_tracker_slow_detail_only);
 }
 
 OSD::~OSD()
@@ -860,6 +881,10 @@ OSD::~OSD()
   cct->get_perfcounters_collection()->remove(logger);
   delete recoverystate_perf;
   delete logger;
+  if (buffer_pool_perf) {
+    cct->get_perfcounters_collection()->remove(buffer_pool_perf);
+    delete buffer_pool_perf;
+  }
   delete store;
 }
 
@@ -1009,6 +1034,7 @@ int OSD::init()
 
   tick_timer.init();
   service.backfill_request_timer.init();
+  service.snap_trim_timer.init();
 
   // mount.
   dout(2) << "mounting " << dev_path << " "
@@ -1050,6 +1076,11 @@ int OSD::init()
     }
   }
 
+  // erasure coded pgs key their objects by shard
+  if (superblock.compat_features.incompat.contains(CEPH_OSD_FEATURE_INCOMPAT_SHARDS) &&
+      !store->get_allow_sharded_objects())
+    store->set_allow_sharded_objects();
+
   assert_warn(whoami == superblock.whoami);
   if (whoami != superblock.whoami) {
     derr << "OSD::init: superblock says osd"
@@ -1111,6 +1142,7 @@ int OSD::init()
   check_osdmap_features();
 
   create_recoverystate_perf();
+  create_buffer_pool_perf();
 
   bind_epoch = osdmap->get_epoch();
 
@@ -1336,6 +1368,17 @@ void OSD::create_logger()
 
   osd_plb.add_u64_counter(l_osd_rop, "recovery_ops");       // recovery ops (started)
 
+  osd_plb.add_u64_counter(l_osd_snap_trim, "snap_trim");             // clones trimmed
+  osd_plb.add_u64_counter(l_osd_snap_trim_bytes, "snap_trim_bytes"); // clone bytes released
+  osd_plb.add_u64_counter(l_osd_snap_trim_txn, "snap_trim_txn");     // snap trim transactions
+  osd_plb.add_u64_counter(l_osd_snap_trim_throttled, "snap_trim_throttled"); // batches delayed by rate limit
+
+  osd_plb.add_u64_counter(l_osd_agent_wake, "agent_wake");     // tiering agent wake up
+  osd_plb.add_u64_counter(l_osd_agent_skip, "agent_skip");     // objects skipped by agent
+  osd_plb.add_u64_counter(l_osd_agent_flush, "agent_flush");   // tiering agent flushes
+  osd_plb.add_u64_counter(l_osd_agent_evict, "agent_evict");   // tiering agent evictions
+  osd_plb.add_u64_counter(l_osd_agent_throttled, "agent_throttled"); // agent held back by client load
+
   osd_plb.add_u64(l_osd_loadavg, "loadavg");
   osd_plb.add_u64(l_osd_buf, "buffer_bytes");       // total ceph::buffer bytes
 
@@ -1350,6 +1393,8 @@ void OSD::create_logger()
   osd_plb.add_u64_counter(l_osd_mape_dup, "map_message_epoch_dups"); // dup osdmap epochs
   osd_plb.add_u64_counter(l_osd_waiting_for_map,
 			  "messages_delayed_for_map"); // dup osdmap epochs
+  osd_plb.add_time_avg(l_osd_map_to_active_lat,
+		       "map_to_active_latency"); // interval change -> pg active
 
   osd_plb.add_u64(l_osd_stat_bytes, "stat_bytes");
   osd_plb.add_u64(l_osd_stat_bytes_used, "stat_bytes_used");
@@ -1399,6 +1444,52 @@ void OSD::create_recoverystate_perf()
   cct->get_perfcounters_collection()->add(recoverystate_perf);
 }
 
+void OSD::create_buffer_pool_perf()
+{
+  dout(10) << "create_buffer_pool_perf" << dendl;
+
+  unsigned classes = buffer::get_pool_classes();
+  PerfCountersBuilder bp_perf(cct, "buffer_pool", bp_first,
+			      bp_first + 1 + classes * bp_class_stats);
+  static const char *stat_names[bp_class_stats] = {
+    "in_use", "cached", "hits", "misses"
+  };
+  // the builder keeps the name pointers
+  buffer_pool_perf_names.resize(classes * bp_class_stats);
+  for (unsigned c = 0; c < classes; ++c) {
+    buffer::pool_stat_t s;
+    buffer::get_pool_stat(c, &s);
+    for (unsigned i = 0; i < bp_class_stats; ++i) {
+      unsigned n = c * bp_class_stats + i;
+      ostringstream ss;
+      ss << (s.size >> 10) << "k_" << stat_names[i];
+      buffer_pool_perf_names[n] = ss.str();
+      if (i == bp_class_hits || i == bp_class_misses)
+	bp_perf.add_u64_counter(bp_first + 1 + n,
+				buffer_pool_perf_names[n].c_str());
+      else
+	bp_perf.add_u64(bp_first + 1 + n, buffer_pool_perf_names[n].c_str());
+    }
+  }
+
+  buffer_pool_perf = bp_perf.create_perf_counters();
+  cct->get_perfcounters_collection()->add(buffer_pool_perf);
+}
+
+void OSD::update_buffer_pool_perf()
+{
+  unsigned classes = buffer::get_pool_classes();
+  for (unsigned c = 0; c < classes; ++c) {
+    buffer::pool_stat_t s;
+    buffer::get_pool_stat(c, &s);
+    int base = bp_first + 1 + c * bp_class_stats;
+    buffer_pool_perf->set(base + bp_class_in_use, s.in_use);
+    buffer_pool_perf->set(base + bp_class_cached, s.cached);
+    buffer_pool_perf->set(base + bp_class_hits, s.hits);
+    buffer_pool_perf->set(base + bp_class_misses, s.misses);
+  }
+}
+
 void OSD::suicide(int exitcode)
 {
   if (cct->_conf->filestore_blackhole) {
@@ -1440,6 +1531,8 @@ int OSD::shutdown()
   state = STATE_STOPPING;
   heartbeat_lock.Unlock();
 
+  service.agent_stop();
+
   // Debugging
   cct->_conf->set_val("debug_osd", "100");
   cct->_conf->set_val("debug_journal", "100");
@@ -1679,7 +1772,10 @@ PG *OSD::_open_lock_pg(
 
   PG* pg = _make_pg(createmap, pgid);
 
-  pg_map[pgid] = pg;
+  {
+    RWLock::WLocker l(pg_map_lock);
+    pg_map[pgid] = pg;
+  }
 
   pg->lock(no_lockdep_check);
   pg->get("PGMap");  // because it's in pg_map
@@ -1710,7 +1806,10 @@ void OSD::add_newly_split_pg(PG *pg, PG::RecoveryCtx *rctx)
 {
   epoch_t e(service.get_osdmap()->get_epoch());
   pg->get("PGMap");  // For pg_map
-  pg_map[pg->info.pgid] = pg;
+  {
+    RWLock::WLocker l(pg_map_lock);
+    pg_map[pg->info.pgid] = pg;
+  }
   dout(10) << "Adding newly split pg " << *pg << dendl;
   vector<int> up, acting;
   pg->get_osdmap()->pg_to_up_acting_osds(pg->info.pgid, up, acting);
@@ -3002,6 +3101,7 @@ void OSD::tick()
   dout(5) << "tick" << dendl;
 
   logger->set(l_osd_buf, buffer::get_total_alloc());
+  update_buffer_pool_perf();
 
   if (is_active() || is_waiting_for_healthy()) {
     map_lock.get_read();
@@ -3371,10 +3471,30 @@ bool OSD::ms_handle_reset(Connection *con)
     return false;
   session->wstate.reset();
   session->con.reset(NULL);  // break con <-> session ref cycle
+  {
+    // whatever they were, they are gone with the connection
+    Mutex::Locker l(session->slow_dispatch_lock);
+    session->slow_dispatch.clear();
+  }
   session->put();
   return true;
 }
 
+void OSD::ms_handle_remote_reset(Connection *con)
+{
+  OSD::Session *session = (OSD::Session *)con->get_priv();
+  dout(1) << "ms_handle_remote_reset con " << con << " session " << session << dendl;
+  if (!session)
+    return;
+  {
+    // the messenger dropped what it had queued from the old session,
+    // which the peer resends anyway
+    Mutex::Locker l(session->slow_dispatch_lock);
+    session->slow_dispatch.clear();
+  }
+  session->put();
+}
+
 struct C_OSD_GetVersion : public Context {
   OSD *osd;
   uint64_t oldest, newest;
@@ -3701,6 +3821,147 @@ void OSDService::send_pg_temp()
   monc->send_mon_message(m);
 }
 
+// -- snap trim throttle --
+
+unsigned OSDService::get_snap_trim_budget(unsigned want, utime_t *retry)
+{
+  Mutex::Locker l(snap_trim_throttle_lock);
+  utime_t now = ceph_clock_now(cct);
+  if (now - snap_trim_window_start >= utime_t(1, 0)) {
+    snap_trim_window_start = now;
+    snap_trim_window_objects = 0;
+    snap_trim_window_bytes = 0;
+  }
+
+  uint64_t max_objects = cct->_conf->osd_snap_trim_max_objects_per_sec > 0 ?
+    cct->_conf->osd_snap_trim_max_objects_per_sec : 0;
+  uint64_t max_bytes = cct->_conf->osd_snap_trim_max_bytes_per_sec;
+  unsigned budget = want;
+  if (max_objects) {
+    if (snap_trim_window_objects >= max_objects)
+      budget = 0;
+    else if (snap_trim_window_objects + budget > max_objects)
+      budget = max_objects - snap_trim_window_objects;
+  }
+  if (max_bytes && snap_trim_window_bytes >= max_bytes)
+    budget = 0;
+
+  if (!budget) {
+    *retry = snap_trim_window_start;
+    *retry += utime_t(1, 0);
+    return 0;
+  }
+  snap_trim_window_objects += budget;
+  return budget;
+}
+
+void OSDService::snap_trim_done(unsigned reserved, unsigned trimmed,
+				uint64_t bytes)
+{
+  assert(trimmed <= reserved);
+  Mutex::Locker l(snap_trim_throttle_lock);
+  unsigned unused = reserved - trimmed;
+  if (snap_trim_window_objects > unused)
+    snap_trim_window_objects -= unused;
+  else
+    snap_trim_window_objects = 0;
+  snap_trim_window_bytes += bytes;
+}
+
+// -- tiering agent --
+
+int OSDService::agent_get_max_ops()
+{
+  int max = cct->_conf->osd_agent_max_ops;
+  if (cct->_conf->osd_agent_busy_ops > 0 &&
+      osd->op_tracker.get_num_ops_in_flight() >=
+      cct->_conf->osd_agent_busy_ops)
+    max = MIN(max, cct->_conf->osd_agent_max_low_ops);
+  return max;
+}
+
+void OSDService::agent_entry()
+{
+  dout(10) << __func__ << " start" << dendl;
+  agent_lock.Lock();
+
+  while (!agent_stop_flag) {
+    if (agent_queue.empty()) {
+      dout(20) << __func__ << " empty queue" << dendl;
+      agent_cond.Wait(agent_lock);
+      continue;
+    }
+    uint64_t level = agent_queue.rbegin()->first;
+    set<PGRef>& top = agent_queue.rbegin()->second;
+    int limit = agent_get_max_ops();
+    int max = limit - agent_ops;
+    dout(10) << __func__
+	     << " tiers " << agent_queue.size()
+	     << ", top is " << level
+	     << " with pgs " << top.size()
+	     << ", ops " << agent_ops << "/" << limit
+	     << dendl;
+    utime_t delay;
+    delay.set_from_double(cct->_conf->osd_agent_delay_time);
+    if (max <= 0) {
+      dout(20) << __func__ << " throttled" << dendl;
+      if (limit < cct->_conf->osd_agent_max_ops)
+	logger->inc(l_osd_agent_throttled);
+      // a flush completing wakes us, but client load may go away too
+      agent_cond.WaitInterval(cct, agent_lock, delay);
+      continue;
+    }
+
+    if (!agent_valid_iterator || agent_queue_pos == top.end()) {
+      if (agent_valid_iterator && !agent_progress) {
+	// a whole pass over the pgs found nothing to do
+	dout(20) << __func__ << " no progress, waiting" << dendl;
+	agent_valid_iterator = false;
+	agent_cond.WaitInterval(cct, agent_lock, delay);
+	continue;
+      }
+      agent_queue_pos = top.begin();
+      agent_valid_iterator = true;
+      agent_progress = false;
+    }
+    PGRef pg = *agent_queue_pos;
+    ++agent_queue_pos;
+    agent_lock.Unlock();
+    logger->inc(l_osd_agent_wake);
+    bool did = pg->agent_work(max);
+    agent_lock.Lock();
+    if (did)
+      agent_progress = true;
+  }
+  agent_lock.Unlock();
+  dout(10) << __func__ << " finish" << dendl;
+}
+
+void OSDService::agent_stop()
+{
+  {
+    Mutex::Locker l(agent_lock);
+    agent_stop_flag = true;
+    agent_cond.Signal();
+  }
+  if (agent_thread.is_started())
+    agent_thread.join();
+}
+
+struct C_QueueSnapTrim : public Context {
+  PGRef pg;
+  C_QueueSnapTrim(PG *pg) : pg(pg) {}
+  void finish(int r) {
+    pg->queue_snap_trim();
+  }
+};
+
+void OSDService::queue_for_snap_trim_at(PG *pg, utime_t when)
+{
+  Mutex::Locker l(snap_trim_throttle_lock);
+  snap_trim_timer.add_event_at(when, new C_QueueSnapTrim(pg));
+}
+
 void OSD::send_failures()
 {
   assert(osd_lock.is_locked());
@@ -4465,6 +4726,7 @@ bool OSD::ms_dispatch(Message *m)
   osd_lock.Lock();
   if (is_stopping()) {
     osd_lock.Unlock();
+    clear_slow_dispatch(m);
     m->put();
     return true;
   }
@@ -4586,6 +4848,7 @@ void OSD::do_waiters()
     finished_lock.Lock();
   }
   finished_lock.Unlock();
+  update_dispatch_waiters();
   dout(10) << "do_waiters -- finish" << dendl;
 }
 
@@ -4654,7 +4917,184 @@ void OSD::dispatch_op(OpRequestRef op)
   case MSG_OSD_PG_PUSH_REPLY:
     handle_replica_op<MOSDPGPushReply, MSG_OSD_PG_PUSH_REPLY>(op);
     break;
+  case MSG_OSD_EC_READ:
+    handle_replica_op<MOSDECSubOpRead, MSG_OSD_EC_READ>(op);
+    break;
+  case MSG_OSD_EC_READ_REPLY:
+    handle_replica_op<MOSDECSubOpReadReply, MSG_OSD_EC_READ_REPLY>(op);
+    break;
+  }
+
+  // whatever osd_fast_dispatch says now: it may have just been turned off
+  slow_dispatch_done(op);
+}
+
+void OSD::update_dispatch_waiters()
+{
+  assert(osd_lock.is_locked());
+  bool waiting = !waiting_for_osdmap.empty() || !waiting_for_pg.empty();
+  if (!waiting) {
+    Mutex::Locker l(finished_lock);
+    waiting = !finished.empty();
+  }
+  dispatch_waiters.set(waiting);
+}
+
+/*
+ * An op ms_fast_dispatch() turned down holds back the later ops of
+ * its session until it has been through dispatch_op().  By then it has
+ * been queued to its pg, dropped, or put on one of our wait lists, in
+ * which case dispatch_waiters (updated first) holds them back instead.
+ */
+void OSD::slow_dispatch_done(OpRequestRef op)
+{
+  update_dispatch_waiters();
+  clear_slow_dispatch(op->get_req());
+}
+
+/// m, turned down by ms_fast_dispatch(), no longer holds back its session
+void OSD::clear_slow_dispatch(Message *m)
+{
+  Session *session = static_cast<Session*>(m->get_connection()->get_priv());
+  if (!session)
+    return;
+  session->slow_dispatch_lock.Lock();
+  session->slow_dispatch.erase(m);
+  session->slow_dispatch_lock.Unlock();
+  session->put();
+}
+
+bool OSD::ms_can_fast_dispatch(Message *m) const
+{
+  switch (m->get_type()) {
+  case CEPH_MSG_OSD_OP:
+  case MSG_OSD_SUBOP:
+  case MSG_OSD_SUBOPREPLY:
+  case MSG_OSD_PG_PUSH:
+  case MSG_OSD_PG_PULL:
+  case MSG_OSD_PG_PUSH_REPLY:
+  case MSG_OSD_EC_READ:
+  case MSG_OSD_EC_READ_REPLY:
+    return cct->_conf->osd_fast_dispatch;
+  default:
+    return false;
+  }
+}
+
+/*
+ * Client and replica ops come here straight from the messenger reader
+ * threads, without osd_lock or the DispatchQueue thread.  The common
+ * case (sender on our map, pg here) is queued to the pg right away;
+ * anything else is turned down and takes the usual way through
+ * ms_dispatch().  Ops of a session keep their order: while one of them
+ * is on the slow path, or anything waits on our lists, the later ones
+ * follow it there.
+ */
+bool OSD::ms_fast_dispatch(Message *m)
+{
+  Session *session = static_cast<Session*>(m->get_connection()->get_priv());
+  if (!session)
+    return false;
+
+  // only this (reader) thread adds to slow_dispatch
+  session->slow_dispatch_lock.Lock();
+  bool behind = !session->slow_dispatch.empty();
+  session->slow_dispatch_lock.Unlock();
+
+  bool taken = !behind && !dispatch_waiters.read() && fast_dispatch_op(m);
+  if (!taken) {
+    session->slow_dispatch_lock.Lock();
+    session->slow_dispatch.insert(m);
+    session->slow_dispatch_lock.Unlock();
   }
+  session->put();
+  return taken;
+}
+
+template<typename T>
+static void get_replica_op_target(Message *m, epoch_t *epoch, pg_t *pgid)
+{
+  T *r = static_cast<T*>(m);
+  *epoch = r->map_epoch;
+  *pgid = r->pgid;
+}
+
+/*
+ * the checks of handle_op() and handle_replica_op(), against the
+ * published map; false whenever they would do more than queue the op
+ */
+bool OSD::fast_dispatch_op(Message *m)
+{
+  if (!is_active())
+    return false;
+  OSDMapRef curmap = service.get_osdmap();
+
+  epoch_t epoch;
+  pg_t pgid;
+  if (m->get_type() == CEPH_MSG_OSD_OP) {
+    MOSDOp *op = static_cast<MOSDOp*>(m);
+    epoch = op->get_map_epoch();
+    if (epoch != curmap->get_epoch() ||  // we wait for it, or it needs ours
+	op_is_discardable(op) ||
+	curmap->is_blacklisted(m->get_source_addr()) ||
+	cct->_conf->osd_debug_drop_op_probability > 0)
+      return false;
+    pgid = op->get_pg();
+    if ((op->get_flags() & CEPH_OSD_FLAG_PGOP) == 0 &&
+	curmap->have_pg_pool(pgid.pool()))
+      pgid = curmap->raw_pg_to_pg(pgid);
+  } else {
+    switch (m->get_type()) {
+    case MSG_OSD_SUBOP:
+      get_replica_op_target<MOSDSubOp>(m, &epoch, &pgid);
+      break;
+    case MSG_OSD_SUBOPREPLY:
+      get_replica_op_target<MOSDSubOpReply>(m, &epoch, &pgid);
+      break;
+    case MSG_OSD_PG_PUSH:
+      get_replica_op_target<MOSDPGPush>(m, &epoch, &pgid);
+      break;
+    case MSG_OSD_PG_PULL:
+      get_replica_op_target<MOSDPGPull>(m, &epoch, &pgid);
+      break;
+    case MSG_OSD_PG_PUSH_REPLY:
+      get_replica_op_target<MOSDPGPushReply>(m, &epoch, &pgid);
+      break;
+    case MSG_OSD_EC_READ:
+      get_replica_op_target<MOSDECSubOpRead>(m, &epoch, &pgid);
+      break;
+    case MSG_OSD_EC_READ_REPLY:
+      get_replica_op_target<MOSDECSubOpReadReply>(m, &epoch, &pgid);
+      break;
+    default:
+      return false;
+    }
+    if (epoch != curmap->get_epoch() ||
+	!m->get_connection()->peer_is_osd() ||
+	service.splitting(pgid))
+      return false;
+    if (m->get_connection()->get_messenger() == cluster_messenger) {
+      int from = m->get_source().num();
+      if (!curmap->have_inst(from) ||
+	  curmap->get_cluster_addr(from) != m->get_source_inst().addr)
+	return false;  // dead osd, to be marked down
+      note_peer_epoch(from, epoch);
+    }
+  }
+
+  PGRef pg;
+  {
+    RWLock::RLocker l(pg_map_lock);
+    hash_map<pg_t, PG*>::iterator p = pg_map.find(pgid);
+    if (p == pg_map.end())
+      return false;
+    pg = p->second;
+  }
+
+  OpRequestRef op = op_tracker.create_request<OpRequest>(m);
+  op->mark_event(OpRequest::EVENT_FAST_DISPATCH);
+  enqueue_op(pg.get(), op);
+  return true;
 }
 
 void OSD::_dispatch(Message *m)
@@ -4718,7 +5158,7 @@ void OSD::_dispatch(Message *m)
   default:
     {
       OpRequestRef op = op_tracker.create_request<OpRequest>(m);
-      op->mark_event("waiting_for_osdmap");
+      op->mark_event(OpRequest::EVENT_WAITING_FOR_OSDMAP);
       // no map?  starting up?
       if (!osdmap) {
         dout(7) << "no OSDMap, not booted" << dendl;
@@ -5128,12 +5568,12 @@ void OSD::handle_osd_map(MOSDMap *m)
       t.write(coll_t::META_COLL, oid, 0, bl.length(), bl);
       pin_map_inc_bl(e, bl);
 
+      // start from a copy of the previous epoch; it shares whatever the
+      // incremental leaves untouched with the cached previous map
       OSDMap *o = new OSDMap;
       if (e > 1) {
-	bufferlist obl;
 	OSDMapRef prev = get_map(e - 1);
-	prev->encode(obl);
-	o->decode(obl);
+	*o = *prev;
       }
 
       OSDMap::Incremental inc;
@@ -5380,9 +5820,12 @@ void OSD::check_osdmap_features()
   }
 
   if ((features & CEPH_FEATURE_OSD_ERASURE_CODES) &&
-      (!superblock.compat_features.incompat.contains(CEPH_OSD_FEATURE_INCOMPAT_ERASURECODES))) {
+      (!superblock.compat_features.incompat.contains(CEPH_OSD_FEATURE_INCOMPAT_ERASURECODES) ||
+       !superblock.compat_features.incompat.contains(CEPH_OSD_FEATURE_INCOMPAT_SHARDS))) {
     dout(0) << __func__ << " enabling on-disk ERASURE CODES compat feature" << dendl;
     superblock.compat_features.incompat.insert(CEPH_OSD_FEATURE_INCOMPAT_ERASURECODES);
+    superblock.compat_features.incompat.insert(CEPH_OSD_FEATURE_INCOMPAT_SHARDS);
+    store->set_allow_sharded_objects();
     ObjectStore::Transaction t;
     write_superblock(t);
     int err = store->apply_transaction(t);
@@ -5729,25 +6172,48 @@ OSDMapRef OSDService::_add_map(OSDMap *o)
 
 OSDMapRef OSDService::try_get_map(epoch_t epoch)
 {
-  Mutex::Locker l(map_cache_lock);
-  OSDMapRef retval = map_cache.lookup(epoch);
-  if (retval) {
-    dout(30) << "get_map " << epoch << " -cached" << dendl;
-    return retval;
+  bufferlist bl;
+  bool need_read = false;
+  {
+    Mutex::Locker l(map_cache_lock);
+    OSDMapRef retval = map_cache.lookup(epoch);
+    if (retval) {
+      dout(30) << "get_map " << epoch << " -cached" << dendl;
+      return retval;
+    }
+    if (epoch > 0 && !map_bl_cache.lookup(epoch, &bl))
+      need_read = true;
   }
 
+  // Read and decode without map_cache_lock: the peering workers walk
+  // their pgs through the same run of epochs in parallel and should
+  // not queue up behind one another's decode.
+  if (need_read &&
+      store->read(coll_t::META_COLL, OSD::get_osdmap_pobject_name(epoch),
+		  0, 0, bl) < 0)
+    return OSDMapRef();
+
   OSDMap *map = new OSDMap;
   if (epoch > 0) {
     dout(20) << "get_map " << epoch << " - loading and decoding " << map << dendl;
-    bufferlist bl;
-    if (!_get_map_bl(epoch, bl)) {
-      delete map;
-      return OSDMapRef();
-    }
     map->decode(bl);
   } else {
     dout(20) << "get_map " << epoch << " - return initial " << map << dendl;
   }
+
+  Mutex::Locker l(map_cache_lock);
+  if (need_read) {
+    bufferlist cached;
+    if (!map_bl_cache.lookup(epoch, &cached))
+      _add_map_bl(epoch, bl);
+  }
+  OSDMapRef retval = map_cache.lookup(epoch);
+  if (retval) {
+    // someone else decoded it while we did
+    dout(30) << "get_map " << epoch << " -raced" << dendl;
+    delete map;
+    return retval;
+  }
   return _add_map(map);
 }
 
@@ -6713,7 +7179,10 @@ void OSD::_remove_pg(PG *pg)
   remove_wq.queue(make_pair(PGRef(pg), deleting));
 
   // remove from map
-  pg_map.erase(pg->info.pgid);
+  {
+    RWLock::WLocker l(pg_map_lock);
+    pg_map.erase(pg->info.pgid);
+  }
   pg->put("PGMap"); // since we've taken it out of map
 }
 
@@ -6950,21 +7419,10 @@ void OSD::handle_op(OpRequestRef op)
     return;
   }
 
-  // we don't need encoded payload anymore
-  m->clear_payload();
-
   // require same or newer map
   if (!require_same_or_newer_map(op, m->get_map_epoch()))
     return;
 
-  // object name too long?
-  if (m->get_oid().name.size() > MAX_CEPH_OBJECT_NAME_LEN) {
-    dout(4) << "handle_op '" << m->get_oid().name << "' is longer than "
-	    << MAX_CEPH_OBJECT_NAME_LEN << " bytes!" << dendl;
-    service.reply_op_error(op, -ENAMETOOLONG);
-    return;
-  }
-
   // blacklisted?
   if (osdmap->is_blacklisted(m->get_source_addr())) {
     dout(4) << "handle_op " << m->get_source_addr() << " is blacklisted" << dendl;
@@ -6975,14 +7433,6 @@ void OSD::handle_op(OpRequestRef op)
   _share_map_incoming(m->get_source(), m->get_connection().get(), m->get_map_epoch(),
 		      static_cast<Session *>(m->get_connection()->get_priv()));
 
-  if (op->rmw_flags == 0) {
-    int r = init_op_flags(op);
-    if (r) {
-      service.reply_op_error(op, r);
-      return;
-    }
-  }
-
   if (cct->_conf->osd_debug_drop_op_probability > 0 &&
       !m->get_source().is_mds()) {
     if ((double)rand() / (double)RAND_MAX < cct->_conf->osd_debug_drop_op_probability) {
@@ -6991,34 +7441,8 @@ void OSD::handle_op(OpRequestRef op)
     }
   }
 
-  if (op->may_write()) {
-    // full?
-    if ((service.check_failsafe_full() ||
-	 osdmap->test_flag(CEPH_OSDMAP_FULL) ||
-	 m->get_map_epoch() < superblock.last_map_marked_full) &&
-	!m->get_source().is_mds()) {  // FIXME: we'll exclude mds writes for now.
-      // Drop the request, since the client will retry when the full
-      // flag is unset.
-      return;
-    }
-
-    // invalid?
-    if (m->get_snapid() != CEPH_NOSNAP) {
-      service.reply_op_error(op, -EINVAL);
-      return;
-    }
-
-    // too big?
-    if (cct->_conf->osd_max_write_size &&
-	m->get_data_len() > cct->_conf->osd_max_write_size << 20) {
-      // journal can't hold commit!
-      derr << "handle_op msg data len " << m->get_data_len()
-	   << " > osd_max_write_size " << (cct->_conf->osd_max_write_size << 20)
-	   << " on " << *m << dendl;
-      service.reply_op_error(op, -OSD_WRITETOOBIG);
-      return;
-    }
-  }
+  // the checks that need the ops wait for finish_op_decode() in the
+  // op worker thread; routing only needs the pgid and flags
   // calc actual pgid
   pg_t pgid = m->get_pg();
   int64_t pool = pgid.pool();
@@ -7130,7 +7554,7 @@ bool OSD::op_is_discardable(MOSDOp *op)
 }
 
 /*
- * enqueue called with osd_lock held
+ * enqueue called with osd_lock held, or from the fast dispatch path
  */
 void OSD::enqueue_op(PG *pg, OpRequestRef op)
 {
@@ -7142,18 +7566,68 @@ void OSD::enqueue_op(PG *pg, OpRequestRef op)
   pg->queue_op(op);
 }
 
+OSD::op_queue_class_t OSD::get_op_queue_class(OpRequestRef op)
+{
+  switch (op->get_req()->get_type()) {
+  case MSG_OSD_PG_PUSH:
+  case MSG_OSD_PG_PULL:
+  case MSG_OSD_PG_PUSH_REPLY:
+    return OP_CLASS_RECOVERY;
+
+  case MSG_OSD_PG_SCAN:
+  case MSG_OSD_PG_BACKFILL:
+    return OP_CLASS_BACKFILL;
+
+  case MSG_OSD_SUBOP:
+  case MSG_OSD_SUBOPREPLY:
+    {
+      vector<OSDOp> *ops;
+      if (op->get_req()->get_type() == MSG_OSD_SUBOP)
+	ops = &static_cast<MOSDSubOp*>(op->get_req())->ops;
+      else
+	ops = &static_cast<MOSDSubOpReply*>(op->get_req())->ops;
+      if (ops->empty())
+	break;
+      switch ((*ops)[0].op.op) {
+      case CEPH_OSD_OP_PULL:
+      case CEPH_OSD_OP_PUSH:
+	return OP_CLASS_RECOVERY;
+      case CEPH_OSD_OP_SCRUB:
+      case CEPH_OSD_OP_SCRUB_RESERVE:
+      case CEPH_OSD_OP_SCRUB_UNRESERVE:
+      case CEPH_OSD_OP_SCRUB_STOP:
+      case CEPH_OSD_OP_SCRUB_MAP:
+	return OP_CLASS_SCRUB;
+      }
+    }
+    break;
+  }
+  // client ops and the replication of client writes
+  return OP_CLASS_CLIENT;
+}
+
 void OSD::OpWQ::_enqueue(pair<PGRef, OpRequestRef> item)
 {
   unsigned priority = item.second->get_req()->get_priority();
   unsigned cost = item.second->get_req()->get_cost();
-  if (priority >= CEPH_MSG_PRIO_LOW)
-    pqueue.enqueue_strict(
-      item.second->get_req()->get_source_inst(),
-      priority, item);
-  else
-    pqueue.enqueue(item.second->get_req()->get_source_inst(),
-      priority, cost, item);
-  osd->logger->set(l_osd_opq, pqueue.length());
+  if (use_mclock) {
+    if (priority >= CEPH_MSG_PRIO_LOW)
+      mqueue.enqueue_strict(
+	item.second->get_req()->get_source_inst(),
+	priority, item);
+    else
+      mqueue.enqueue(item.second->get_req()->get_source_inst(),
+	get_op_queue_class(item.second), cost, item);
+  } else {
+    if (priority >= CEPH_MSG_PRIO_LOW)
+      pqueue.enqueue_strict(
+	item.second->get_req()->get_source_inst(),
+	priority, item);
+    else
+      pqueue.enqueue(item.second->get_req()->get_source_inst(),
+	priority, cost, item);
+  }
+  osd->logger->set(l_osd_opq, _length());
 }
 
 void OSD::OpWQ::_enqueue_front(pair<PGRef, OpRequestRef> item)
@@ -7168,27 +7642,38 @@ void OSD::OpWQ::_enqueue_front(pair<PGRef, OpRequestRef> item)
   }
   unsigned priority = item.second->get_req()->get_priority();
   unsigned cost = item.second->get_req()->get_cost();
-  if (priority >= CEPH_MSG_PRIO_LOW)
-    pqueue.enqueue_strict_front(
-      item.second->get_req()->get_source_inst(),
-      priority, item);
-  else
-    pqueue.enqueue_front(item.second->get_req()->get_source_inst(),
-      priority, cost, item);
-  osd->logger->set(l_osd_opq, pqueue.length());
+  if (use_mclock) {
+    if (priority >= CEPH_MSG_PRIO_LOW)
+      mqueue.enqueue_strict_front(
+	item.second->get_req()->get_source_inst(),
+	priority, item);
+    else
+      mqueue.enqueue_front(item.second->get_req()->get_source_inst(),
+	get_op_queue_class(item.second), cost, item);
+  } else {
+    if (priority >= CEPH_MSG_PRIO_LOW)
+      pqueue.enqueue_strict_front(
+	item.second->get_req()->get_source_inst(),
+	priority, item);
+    else
+      pqueue.enqueue_front(item.second->get_req()->get_source_inst(),
+	priority, cost, item);
+  }
+  osd->logger->set(l_osd_opq, _length());
 }
 
 PGRef OSD::OpWQ::_dequeue()
 {
-  assert(!pqueue.empty());
+  assert(!_empty());
   PGRef pg;
   {
     Mutex::Locker l(qlock);
-    pair<PGRef, OpRequestRef> ret = pqueue.dequeue();
+    pair<PGRef, OpRequestRef> ret =
+      use_mclock ? mqueue.dequeue() : pqueue.dequeue();
     pg = ret.first;
     pg_for_processing[&*pg].push_back(ret.second);
   }
-  osd->logger->set(l_osd_opq, pqueue.length());
+  osd->logger->set(l_osd_opq, _length());
   return pg;
 }
 
@@ -7221,6 +7706,75 @@ void OSDService::dequeue_pg(PG *pg, list<OpRequestRef> *dequeued)
 /*
  * NOTE: dequeue called in worker thread, with pg lock
  */
+/*
+ * decode the rest of a client op and run the checks that need its ops
+ *
+ * NOTE: called in worker thread, with pg lock
+ *
+ * @return false if the op was answered or dropped
+ */
+bool OSD::finish_op_decode(PG *pg, OpRequestRef op)
+{
+  MOSDOp *m = static_cast<MOSDOp*>(op->get_req());
+  if (op->rmw_flags)
+    return true;  // been here before
+
+  if (m->finish_decode() < 0) {
+    derr << "finish_op_decode malformed " << *m << " from "
+	 << m->get_source_inst() << dendl;
+    op->mark_event("malformed");
+    service.reply_op_error(op, -EINVAL);
+    return false;
+  }
+
+  // we don't need encoded payload anymore
+  m->clear_payload();
+
+  // object name too long?
+  if (m->get_oid().name.size() > MAX_CEPH_OBJECT_NAME_LEN) {
+    dout(4) << "handle_op '" << m->get_oid().name << "' is longer than "
+	    << MAX_CEPH_OBJECT_NAME_LEN << " bytes!" << dendl;
+    service.reply_op_error(op, -ENAMETOOLONG);
+    return false;
+  }
+
+  int r = init_op_flags(op);
+  if (r) {
+    service.reply_op_error(op, r);
+    return false;
+  }
+
+  if (op->may_write()) {
+    // full?
+    if ((service.check_failsafe_full() ||
+	 pg->get_osdmap()->test_flag(CEPH_OSDMAP_FULL) ||
+	 m->get_map_epoch() < service.get_last_map_marked_full()) &&
+	!m->get_source().is_mds()) {  // FIXME: we'll exclude mds writes for now.
+      // Drop the request, since the client will retry when the full
+      // flag is unset.
+      return false;
+    }
+
+    // invalid?
+    if (m->get_snapid() != CEPH_NOSNAP) {
+      service.reply_op_error(op, -EINVAL);
+      return false;
+    }
+
+    // too big?
+    if (cct->_conf->osd_max_write_size &&
+	m->get_data_len() > cct->_conf->osd_max_write_size << 20) {
+      // journal can't hold commit!
+      derr << "handle_op msg data len " << m->get_data_len()
+	   << " > osd_max_write_size " << (cct->_conf->osd_max_write_size << 20)
+	   << " on " << *m << dendl;
+      service.reply_op_error(op, -OSD_WRITETOOBIG);
+      return false;
+    }
+  }
+  return true;
+}
+
 void OSD::dequeue_op(
   PGRef pg, OpRequestRef op,
   ThreadPool::TPHandle &handle)
@@ -7234,6 +7788,14 @@ void OSD::dequeue_op(
   if (pg->deleting)
     return;
 
+  if (op->get_req()->get_type() == CEPH_MSG_OSD_OP) {
+    // drop stale and misdirected ops before paying for their decode
+    if (pg->can_discard_request(op))
+      return;
+    if (!finish_op_decode(pg.get(), op))
+      return;
+  }
+
   op->mark_reached_pg();
 
   pg->do_request(op, handle);
@@ -7332,6 +7894,7 @@ const char** OSD::get_tracked_conf_keys() const
     "osd_max_backfills",
     "osd_op_complaint_time", "osd_op_log_threshold",
     "osd_op_history_size", "osd_op_history_duration",
+    "osd_op_tracker_slow_detail_only",
     NULL
   };
   return KEYS;
@@ -7354,6 +7917,9 @@ void OSD::handle_conf_change(const struct md_config_t *conf,
     op_tracker.set_history_size_and_duration(cct->_conf->osd_op_history_size,
                                              cct->_conf->osd_op_history_duration);
   }
+  if (changed.count("osd_op_tracker_slow_detail_only")) {
+    op_tracker.set_slow_detail_only(cct->_conf->osd_op_tracker_slow_detail_only);
+  }
 }
 
 // --------------------------------
@@ -7445,10 +8011,21 @@ bool OSD::RecoveryWQ::_enqueue(PG *pg) {
 }
 
 void OSD::PeeringWQ::_dequeue(list<PG*> *out) {
+  // Take no more than our share of the queue so that a map change
+  // touching many pgs is spread across all the op threads instead of
+  // being advanced a batch at a time by whichever thread woke first.
+  uint64_t max = osd->cct->_conf->osd_peering_wq_batch_size;
+  uint64_t threads = osd->cct->_conf->osd_op_threads;
+  if (threads > 1) {
+    uint64_t share = (peering_queue.size() + threads - 1) / threads;
+    if (share < max)
+      max = share;
+  }
+  if (max < 1)
+    max = 1;
   set<PG*> got;
   for (list<PG*>::iterator i = peering_queue.begin();
-      i != peering_queue.end() &&
-      out->size() < osd->cct->_conf->osd_peering_wq_batch_size;
+      i != peering_queue.end() && out->size() < max;
       ) {
         if (in_use.count(*i)) {
           ++i;
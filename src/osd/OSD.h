@@ -54,6 +54,7 @@ using namespace __gnu_cxx;
 #include "common/simple_cache.hpp"
 #include "common/sharedptr_registry.hpp"
 #include "common/PrioritizedQueue.h"
+#include "common/mClockQueue.h"
 
 #define CEPH_OSD_PROTOCOL    10 /* cluster internal */
 
@@ -100,6 +101,17 @@ enum {
 
   l_osd_rop,
 
+  l_osd_snap_trim,
+  l_osd_snap_trim_bytes,
+  l_osd_snap_trim_txn,
+  l_osd_snap_trim_throttled,
+
+  l_osd_agent_wake,
+  l_osd_agent_skip,
+  l_osd_agent_flush,
+  l_osd_agent_evict,
+  l_osd_agent_throttled,
+
   l_osd_loadavg,
   l_osd_buf,
 
@@ -115,6 +127,8 @@ enum {
 
   l_osd_waiting_for_map,
 
+  l_osd_map_to_active_lat,
+
   l_osd_stat_bytes,
   l_osd_stat_bytes_used,
   l_osd_stat_bytes_avail,
@@ -157,6 +171,19 @@ enum {
   rs_last,
 };
 
+// buffer pool perf counters: bp_class_stats counters for each of
+// buffer::get_pool_classes() size classes, starting at bp_first + 1
+enum {
+  bp_first = 30000,
+};
+enum {
+  bp_class_in_use,
+  bp_class_cached,
+  bp_class_hits,
+  bp_class_misses,
+  bp_class_stats,
+};
+
 class Messenger;
 class Message;
 class MonClient;
@@ -319,6 +346,10 @@ public:
     Mutex::Locker l(publish_lock);
     return superblock;
   }
+  epoch_t get_last_map_marked_full() {
+    Mutex::Locker l(publish_lock);
+    return superblock.last_map_marked_full;
+  }
   void publish_superblock(const OSDSuperblock &block) {
     Mutex::Locker l(publish_lock);
     superblock = block;
@@ -331,9 +362,31 @@ public:
     Mutex::Locker l(publish_lock);
     return osdmap;
   }
+  /// when recently published epochs were published, see
+  /// get_map_publish_stamp()
+  map<epoch_t, utime_t> map_publish_stamps;
   void publish_map(OSDMapRef map) {
     Mutex::Locker l(publish_lock);
     osdmap = map;
+    map_publish_stamps[map->get_epoch()] = ceph_clock_now(cct);
+    while (map_publish_stamps.size() > (unsigned)cct->_conf->osd_map_cache_size)
+      map_publish_stamps.erase(map_publish_stamps.begin());
+  }
+  /**
+   * when epoch e became visible to the pg workers
+   *
+   * Epochs consumed together are published at once, so this is the
+   * stamp of the first publish at or after e, or utime_t() if e is
+   * older than anything we remember.
+   */
+  utime_t get_map_publish_stamp(epoch_t e) {
+    Mutex::Locker l(publish_lock);
+    if (map_publish_stamps.empty() || e < map_publish_stamps.begin()->first)
+      return utime_t();
+    map<epoch_t, utime_t>::iterator p = map_publish_stamps.lower_bound(e);
+    if (p == map_publish_stamps.end())
+      return utime_t();
+    return p->second;
   }
 
   /*
@@ -493,6 +546,95 @@ public:
   bool queue_for_snap_trim(PG *pg) {
     return snap_trim_wq.queue(pg);
   }
+
+  // -- snap trim throttle --
+  Mutex snap_trim_throttle_lock;
+  SafeTimer snap_trim_timer;
+  utime_t snap_trim_window_start;
+  uint64_t snap_trim_window_objects;
+  uint64_t snap_trim_window_bytes;
+  /// reserve up to want clones to trim now; 0 and *retry if throttled
+  unsigned get_snap_trim_budget(unsigned want, utime_t *retry);
+  /// return the unused part of a reservation and account bytes released
+  void snap_trim_done(unsigned reserved, unsigned trimmed, uint64_t bytes);
+  void queue_for_snap_trim_at(PG *pg, utime_t when);
+
+  // -- tiering agent --
+  Mutex agent_lock;
+  Cond agent_cond;
+  map<uint64_t, set<PGRef> > agent_queue;  ///< pgs by effort level
+  set<PGRef>::iterator agent_queue_pos;
+  bool agent_valid_iterator;
+  bool agent_progress;  ///< some pg did work in this pass over the queue
+  int agent_ops;        ///< agent flushes in flight
+  bool agent_stop_flag;
+  struct AgentThread : public Thread {
+    OSDService *osd;
+    AgentThread(OSDService *o) : osd(o) {}
+    void *entry() {
+      osd->agent_entry();
+      return NULL;
+    }
+  } agent_thread;
+
+  void agent_entry();
+  void agent_stop();
+  /// agent flushes allowed in flight, lower while clients keep us busy
+  int agent_get_max_ops();
+
+  void _agent_enqueue(PG *pg, uint64_t level) {
+    if (!agent_queue.empty() &&
+	agent_queue.rbegin()->first < level)
+      agent_valid_iterator = false;  // inserting a higher level
+    set<PGRef>& nq = agent_queue[level];
+    if (nq.empty())
+      agent_cond.Signal();
+    nq.insert(pg);
+  }
+  void _agent_dequeue(PG *pg, uint64_t old_level) {
+    map<uint64_t, set<PGRef> >::iterator p = agent_queue.find(old_level);
+    assert(p != agent_queue.end());
+    set<PGRef>::iterator q = p->second.find(pg);
+    assert(q != p->second.end());
+    bool top = p->first == agent_queue.rbegin()->first;
+    if (top && agent_valid_iterator && q == agent_queue_pos)
+      ++agent_queue_pos;
+    p->second.erase(q);
+    if (p->second.empty()) {
+      if (top)
+	agent_valid_iterator = false;
+      agent_queue.erase(p);
+    }
+  }
+
+  /// enable agent for a pg
+  void agent_enable_pg(PG *pg, uint64_t level) {
+    Mutex::Locker l(agent_lock);
+    _agent_enqueue(pg, level);
+  }
+  /// adjust the level of a pg's agent work
+  void agent_adjust_pg(PG *pg, uint64_t old_level, uint64_t new_level) {
+    Mutex::Locker l(agent_lock);
+    _agent_dequeue(pg, old_level);
+    _agent_enqueue(pg, new_level);
+  }
+  /// disable agent for a pg
+  void agent_disable_pg(PG *pg, uint64_t old_level) {
+    Mutex::Locker l(agent_lock);
+    _agent_dequeue(pg, old_level);
+  }
+  /// note the start of an agent flush
+  void agent_start_op() {
+    Mutex::Locker l(agent_lock);
+    ++agent_ops;
+  }
+  /// note the end of an agent flush
+  void agent_finish_op() {
+    Mutex::Locker l(agent_lock);
+    assert(agent_ops > 0);
+    --agent_ops;
+    agent_cond.Signal();
+  }
   bool queue_for_scrub(PG *pg) {
     return scrub_wq.queue(pg);
   }
@@ -672,6 +814,8 @@ protected:
   MonClient   *monc;
   PerfCounters      *logger;
   PerfCounters      *recoverystate_perf;
+  PerfCounters      *buffer_pool_perf;
+  vector<string>    buffer_pool_perf_names;  ///< storage for counter names
   ObjectStore *store;
 
   LogClient clog;
@@ -693,9 +837,15 @@ protected:
 
   void create_logger();
   void create_recoverystate_perf();
+  void create_buffer_pool_perf();
+  void update_buffer_pool_perf();
   void tick();
   void _dispatch(Message *m);
   void dispatch_op(OpRequestRef op);
+  bool fast_dispatch_op(Message *m);
+  void slow_dispatch_done(OpRequestRef op);
+  void clear_slow_dispatch(Message *m);
+  void update_dispatch_waiters();
 
   void check_osdmap_features();
 
@@ -817,7 +967,13 @@ public:
     ConnectionRef con;
     WatchConState wstate;
 
-    Session() : auid(-1), last_sent_epoch(0), con(0) {}
+    /// ops ms_fast_dispatch() turned down which have not been through
+    /// dispatch_op() yet; later ops of the session must not pass them
+    Mutex slow_dispatch_lock;
+    set<Message*> slow_dispatch;
+
+    Session() : auid(-1), last_sent_epoch(0), con(0),
+		slow_dispatch_lock("Session::slow_dispatch_lock") {}
   };
 
 private:
@@ -937,6 +1093,9 @@ private:
     finished_lock.Unlock();
   }
   void do_waiters();
+  /// set while any op waits in waiting_for_osdmap, waiting_for_pg or
+  /// finished; the fast dispatch path keeps out of the way meanwhile
+  atomic_t dispatch_waiters;
   
   // -- op tracking --
   OpTracker op_tracker;
@@ -948,24 +1107,62 @@ private:
 
   // -- op queue --
 
+  /// classes of ops scheduled by the mclock op queue
+  enum op_queue_class_t {
+    OP_CLASS_CLIENT,
+    OP_CLASS_RECOVERY,
+    OP_CLASS_BACKFILL,
+    OP_CLASS_SCRUB,
+  };
+  static op_queue_class_t get_op_queue_class(OpRequestRef op);
+
   struct OpWQ: public ThreadPool::WorkQueueVal<pair<PGRef, OpRequestRef>,
 					       PGRef > {
     Mutex qlock;
     map<PG*, list<OpRequestRef> > pg_for_processing;
     OSD *osd;
+    bool use_mclock;
     PrioritizedQueue<pair<PGRef, OpRequestRef>, entity_inst_t > pqueue;
+    mClockQueue<pair<PGRef, OpRequestRef>, entity_inst_t > mqueue;
     OpWQ(OSD *o, time_t ti, ThreadPool *tp)
       : ThreadPool::WorkQueueVal<pair<PGRef, OpRequestRef>, PGRef >(
 	"OSD::OpWQ", ti, ti*10, tp),
 	qlock("OpWQ::qlock"),
 	osd(o),
+	use_mclock(o->cct->_conf->osd_op_queue == "mclock"),
 	pqueue(o->cct->_conf->osd_op_pq_max_tokens_per_priority,
-	       o->cct->_conf->osd_op_pq_min_cost)
-    {}
+	       o->cct->_conf->osd_op_pq_min_cost),
+	mqueue(o->cct->_conf->osd_op_pq_min_cost)
+    {
+      md_config_t *conf = o->cct->_conf;
+      mqueue.set_class(OP_CLASS_CLIENT,
+		       conf->osd_op_queue_mclock_client_op_res,
+		       conf->osd_op_queue_mclock_client_op_wgt,
+		       conf->osd_op_queue_mclock_client_op_lim);
+      mqueue.set_class(OP_CLASS_RECOVERY,
+		       conf->osd_op_queue_mclock_recovery_res,
+		       conf->osd_op_queue_mclock_recovery_wgt,
+		       conf->osd_op_queue_mclock_recovery_lim);
+      mqueue.set_class(OP_CLASS_BACKFILL,
+		       conf->osd_op_queue_mclock_backfill_res,
+		       conf->osd_op_queue_mclock_backfill_wgt,
+		       conf->osd_op_queue_mclock_backfill_lim);
+      mqueue.set_class(OP_CLASS_SCRUB,
+		       conf->osd_op_queue_mclock_scrub_res,
+		       conf->osd_op_queue_mclock_scrub_wgt,
+		       conf->osd_op_queue_mclock_scrub_lim);
+    }
 
     void dump(Formatter *f) {
       Mutex::Locker l(qlock);
-      pqueue.dump(f);
+      f->dump_string("queue", use_mclock ? "mclock" : "prioritized");
+      if (use_mclock)
+	mqueue.dump(f);
+      else
+	pqueue.dump(f);
+    }
+    unsigned _length() {
+      return use_mclock ? mqueue.length() : pqueue.length();
     }
 
     void _enqueue_front(pair<PGRef, OpRequestRef> item);
@@ -982,11 +1179,17 @@ private:
     void dequeue(PG *pg, list<OpRequestRef> *dequeued = 0) {
       lock();
       if (!dequeued) {
-	pqueue.remove_by_filter(Pred(pg));
+	if (use_mclock)
+	  mqueue.remove_by_filter(Pred(pg));
+	else
+	  pqueue.remove_by_filter(Pred(pg));
 	pg_for_processing.erase(pg);
       } else {
 	list<pair<PGRef, OpRequestRef> > _dequeued;
-	pqueue.remove_by_filter(Pred(pg), &_dequeued);
+	if (use_mclock)
+	  mqueue.remove_by_filter(Pred(pg), &_dequeued);
+	else
+	  pqueue.remove_by_filter(Pred(pg), &_dequeued);
 	for (list<pair<PGRef, OpRequestRef> >::iterator i = _dequeued.begin();
 	     i != _dequeued.end();
 	     ++i) {
@@ -1002,7 +1205,7 @@ private:
       unlock();
     }
     bool _empty() {
-      return pqueue.empty();
+      return use_mclock ? mqueue.empty() : pqueue.empty();
     }
     void _process(PGRef pg, ThreadPool::TPHandle &handle);
   } op_wq;
@@ -1011,6 +1214,8 @@ private:
   void dequeue_op(
     PGRef pg, OpRequestRef op,
     ThreadPool::TPHandle &handle);
+  /// decode the rest of a client op in the worker thread and check it
+  bool finish_op_decode(PG *pg, OpRequestRef op);
 
   // -- peering queue --
   struct PeeringWQ : public ThreadPool::BatchWorkQueue<PG> {
@@ -1143,6 +1348,9 @@ private:
 protected:
   // -- placement groups --
   hash_map<pg_t, PG*> pg_map;
+  /// changes to pg_map take this for write (with osd_lock held), the
+  /// fast dispatch path looks pgs up under it for read
+  RWLock pg_map_lock;
   map<pg_t, list<OpRequestRef> > waiting_for_pg;
   map<pg_t, list<PG::CephPeeringEvtRef> > peering_wait_for_split;
   PGRecoveryStats pg_recovery_stats;
@@ -1705,7 +1913,10 @@ protected:
 			    bool& isvalid, CryptoKey& session_key);
   void ms_handle_connect(Connection *con);
   bool ms_handle_reset(Connection *con);
-  void ms_handle_remote_reset(Connection *con) {}
+  void ms_handle_remote_reset(Connection *con);
+  bool ms_can_fast_dispatch_any() const { return true; }
+  bool ms_can_fast_dispatch(Message *m) const;
+  bool ms_fast_dispatch(Message *m);
 
  public:
   /* internal and external can point to the same messenger, they will still
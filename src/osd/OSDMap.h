@@ -198,6 +198,24 @@ private:
   };
   std::tr1::shared_ptr<addrs_s> osd_addrs;
 
+  /*
+   * osd_addrs, pg_temp, osd_uuid and crush are shared between a map
+   * and the copies made of it (see apply_incremental), so that the
+   * consecutive epochs we cache only hold one instance of whatever did
+   * not change.  Anything modifying them in place must take a private
+   * copy first.
+   */
+  template<typename T>
+  static void cow(std::tr1::shared_ptr<T>& p) {
+    if (!p.unique())
+      p.reset(new T(*p));
+  }
+  template<typename T>
+  static void cow_reset(std::tr1::shared_ptr<T>& p) {
+    if (!p.unique())
+      p.reset(new T);
+  }
+
   vector<__u32>   osd_weight;   // 16.16 fixed point, 0x10000 = "in", 0 = "out"
   vector<osd_info_t> osd_info;
   std::tr1::shared_ptr< map<pg_t,vector<int> > > pg_temp;  // temp pg mapping (e.g. while we rebuild)
@@ -450,6 +468,13 @@ private:
    */
   uint64_t get_features(uint64_t *mask) const;
 
+  /**
+   * apply an incremental to this map, making it the next epoch
+   *
+   * A map built by copying the previous epoch and applying the
+   * incremental keeps sharing the sub-structures the incremental does
+   * not touch with the previous epoch.
+   */
   int apply_incremental(const Incremental &inc);
 
   /// try to re-use/reference addrs in oldmap from newmap
@@ -37,6 +37,8 @@ void OpRequest::_dump(utime_t now, Formatter *f) const
     f->close_section(); // client_info
   }
   {
+    list<pair<utime_t, string> > events;
+    get_events(&events);
     f->open_array_section("events");
     for (list<pair<utime_t, string> >::const_iterator i = events.begin();
 	 i != events.end();
@@ -39,12 +39,20 @@ struct osd_reqid_t {
   osd_reqid_t(const entity_name_t& a, int i, tid_t t)
     : name(a), tid(t), inc(i) {}
 
+  void bound_encode(size_t& p, uint64_t features=0) const {
+    p += BOUNDED_ENCODE_HEADER_LEN;
+    ::bound_encode(name, p);
+    ::bound_encode(tid, p);
+    ::bound_encode(inc, p);
+  }
+  void encode(bufferlist::contiguous_appender& p, uint64_t features=0) const;
   void encode(bufferlist &bl) const;
   void decode(bufferlist::iterator &bl);
   void dump(Formatter *f) const;
   static void generate_test_instances(list<osd_reqid_t*>& o);
 };
 WRITE_CLASS_ENCODER(osd_reqid_t)
+WRITE_CLASS_BOUNDED_ENCODER(osd_reqid_t)
 
 /**
  * The OpRequest takes in a Message* and takes over a single reference
@@ -113,14 +121,14 @@ public:
   }
 
   void mark_queued_for_pg() {
-    mark_event("queued_for_pg");
-    current = "queued for pg";
+    mark_event(EVENT_QUEUED_FOR_PG);
+    current.clear();
     hit_flag_points |= flag_queued_for_pg;
     latest_flag_point = flag_queued_for_pg;
   }
   void mark_reached_pg() {
-    mark_event("reached_pg");
-    current = "reached pg";
+    mark_event(EVENT_REACHED_PG);
+    current.clear();
     hit_flag_points |= flag_reached_pg;
     latest_flag_point = flag_reached_pg;
   }
@@ -131,8 +139,8 @@ public:
     latest_flag_point = flag_delayed;
   }
   void mark_started() {
-    mark_event("started");
-    current = "started";
+    mark_event(EVENT_STARTED);
+    current.clear();
     hit_flag_points |= flag_started;
     latest_flag_point = flag_started;
   }
@@ -143,8 +151,8 @@ public:
     latest_flag_point = flag_sub_op_sent;
   }
   void mark_commit_sent() {
-    mark_event("commit_sent");
-    current = "commit sent";
+    mark_event(EVENT_COMMIT_SENT);
+    current.clear();
     hit_flag_points |= flag_commit_sent;
     latest_flag_point = flag_commit_sent;
   }
@@ -33,6 +33,8 @@
 #include "messages/MOSDPGPush.h"
 #include "messages/MOSDPGPushReply.h"
 #include "messages/MOSDPGPull.h"
+#include "messages/MOSDECSubOpRead.h"
+#include "messages/MOSDECSubOpReadReply.h"
 
 #include "messages/MOSDSubOp.h"
 #include "messages/MOSDSubOpReply.h"
@@ -304,7 +306,7 @@ bool PG::proc_replica_info(int from, const pg_info_t &oinfo)
 void PG::remove_snap_mapped_object(
   ObjectStore::Transaction& t, const hobject_t& soid)
 {
-  t.remove(coll, soid);
+  t.remove(coll, get_local_oid(soid));
   OSDriver::OSTransaction _t(osdriver.get_transaction(&t));
   if (soid.snap < CEPH_MAXSNAP) {
     int r = snap_mapper.remove_oid(
@@ -847,12 +849,32 @@ map<int, pg_info_t>::const_iterator PG::find_best_info(const map<int, pg_info_t>
   return best;
 }
 
+/**
+ * Claim for an erasure coded pg the shard info says the osd holds.
+ * Fails if the osd holds data but no shard, an invalid shard or one
+ * already claimed: that data cannot be used.
+ */
+static bool claim_shard(const pg_info_t &info, unsigned num_shards,
+			set<shard_t> *shards)
+{
+  if (info.shard == ghobject_t::NO_SHARD)
+    return info.is_empty();
+  if (info.shard >= num_shards || shards->count(info.shard))
+    return false;
+  shards->insert(info.shard);
+  return true;
+}
+
 /**
  * calculate the desired acting set.
  *
  * Choose an appropriate acting set.  Prefer up[0], unless it is
  * incomplete, or another osd has a longer tail that allows us to
  * bring other up nodes up to date.
+ *
+ * On erasure coded pgs an osd is only accepted if it holds a shard no
+ * osd before it claimed: up osds which do not are backfilled, strays
+ * are left out.
  */
 bool PG::calc_acting(int& newest_update_osd_id, vector<int>& want, vector<int>& backfill) const
 {
@@ -919,6 +941,12 @@ bool PG::calc_acting(int& newest_update_osd_id, vector<int>& want, vector<int>&
   want.push_back(primary->first);
   unsigned usable = 1;
 
+  bool erasure = pool.info.is_erasure();
+  unsigned num_shards = get_osdmap()->get_pg_size(info.pgid);
+  set<shard_t> shards;
+  if (erasure)
+    claim_shard(primary->second, num_shards, &shards);
+
   // select replicas that have log contiguity with primary.
   // prefer up, then acting, then any peer_info osds 
   for (vector<int>::const_iterator i = up.begin();
@@ -930,6 +958,9 @@ bool PG::calc_acting(int& newest_update_osd_id, vector<int>& want, vector<int>&
     if (cur_info.is_incomplete() || cur_info.last_update < primary->second.log_tail) {
       dout(10) << " osd." << *i << " (up) backfill " << cur_info << dendl;
       backfill.push_back(*i);
+    } else if (erasure && !claim_shard(cur_info, num_shards, &shards)) {
+      dout(10) << " osd." << *i << " (up) backfill, shard taken " << cur_info << dendl;
+      backfill.push_back(*i);
     } else {
       want.push_back(*i);
       usable++;
@@ -954,6 +985,8 @@ bool PG::calc_acting(int& newest_update_osd_id, vector<int>& want, vector<int>&
     const pg_info_t &cur_info = all_info.find(*i)->second;
     if (cur_info.is_incomplete() || cur_info.last_update < primary->second.log_tail) {
       dout(10) << " osd." << *i << " (stray) REJECTED " << cur_info << dendl;
+    } else if (erasure && !claim_shard(cur_info, num_shards, &shards)) {
+      dout(10) << " osd." << *i << " (stray) REJECTED, shard taken " << cur_info << dendl;
     } else {
       want.push_back(*i);
       dout(10) << " osd." << *i << " (stray) accepted " << cur_info << dendl;
@@ -979,6 +1012,8 @@ bool PG::calc_acting(int& newest_update_osd_id, vector<int>& want, vector<int>&
 
     if (i->second.is_incomplete() || i->second.last_update < primary->second.log_tail) {
       dout(10) << " osd." << i->first << " (stray) REJECTED " << i->second << dendl;
+    } else if (erasure && !claim_shard(i->second, num_shards, &shards)) {
+      dout(10) << " osd." << i->first << " (stray) REJECTED, shard taken " << i->second << dendl;
     } else {
       want.push_back(i->first);
       dout(10) << " osd." << i->first << " (stray) accepted " << i->second << dendl;
@@ -1071,6 +1106,80 @@ bool PG::choose_acting(int& newest_update_osd)
   return true;
 }
 
+/**
+ * Give each osd of actingbackfill the shard of the erasure coded pg it
+ * holds.  An osd keeps a valid shard no osd before it claimed, as
+ * calc_acting checked.  The others get the shard of their position in
+ * up if it is free, else the lowest free one.  Those which stored data
+ * under another shard are added to reshard: they must be backfilled.
+ */
+void PG::assign_shards(set<int> *reshard)
+{
+  unsigned num_shards = get_osdmap()->get_pg_size(info.pgid);
+  set<shard_t> taken;
+  vector<int> unassigned;
+  for (vector<int>::const_iterator i = actingbackfill.begin();
+       i != actingbackfill.end();
+       ++i) {
+    const pg_info_t &pi = *i == osd->whoami ? info : peer_info[*i];
+    if (pi.shard < num_shards && !taken.count(pi.shard))
+      taken.insert(pi.shard);
+    else
+      unassigned.push_back(*i);
+  }
+
+  for (vector<int>::iterator i = unassigned.begin();
+       i != unassigned.end();
+       ++i) {
+    pg_info_t &pi = *i == osd->whoami ? info : peer_info[*i];
+    shard_t shard = ghobject_t::NO_SHARD;
+    unsigned pos = find(up.begin(), up.end(), *i) - up.begin();
+    if (pos < num_shards && !taken.count(pos)) {
+      shard = pos;
+    } else {
+      for (unsigned s = 0; s < num_shards; ++s) {
+	if (!taken.count(s)) {
+	  shard = s;
+	  break;
+	}
+      }
+    }
+    if (shard != ghobject_t::NO_SHARD)
+      taken.insert(shard);
+    dout(10) << __func__ << " osd." << *i << " shard " << (int)pi.shard
+	     << " -> " << (int)shard << dendl;
+    if (!pi.is_empty() && shard != pi.shard)
+      reshard->insert(*i);
+    pi.shard = shard;
+  }
+}
+
+/**
+ * Take the shard of the erasure coded pg the primary gave us.  What we
+ * stored under any other shard is of no use: drop it, recovery or
+ * backfill brings in the objects of the new shard.
+ */
+void PG::change_shard(ObjectStore::Transaction& t, shard_t shard)
+{
+  if (shard == info.shard)
+    return;
+  dout(10) << __func__ << " " << (int)info.shard << " -> " << (int)shard << dendl;
+  vector<ghobject_t> objects;
+  osd->store->collection_list(coll, objects);
+  for (vector<ghobject_t>::iterator i = objects.begin();
+       i != objects.end();
+       ++i) {
+    if (i->shard_id == shard)
+      continue;
+    if (i->shard_id == info.shard)
+      remove_snap_mapped_object(t, i->hobj);
+    else
+      t.remove(coll, *i);
+  }
+  info.shard = shard;
+  dirty_info = true;
+}
+
 /* Build the might_have_unfound set.
  *
  * This is used by the primary OSD during recovery.
@@ -1164,6 +1273,11 @@ void PG::activate(ObjectStore::Transaction& t,
 
   info.last_epoch_started = query_epoch;
 
+  // osds which must be backfilled under a new shard
+  set<int> reshard;
+  if (is_primary() && pool.info.is_erasure())
+    assign_shards(&reshard);
+
   const pg_missing_t &missing = pg_log.get_missing();
 
   if (is_primary()) {
@@ -1241,7 +1355,7 @@ void PG::activate(ObjectStore::Transaction& t,
 
       bool needs_past_intervals = pi.dne();
 
-      if (pi.last_update == info.last_update) {
+      if (pi.last_update == info.last_update && !reshard.count(peer)) {
         // empty log
 	if (!pi.is_empty() && activator_map) {
 	  dout(10) << "activate peer osd." << peer << " is up to date, queueing in pending_activators" << dendl;
@@ -1256,7 +1370,9 @@ void PG::activate(ObjectStore::Transaction& t,
 	  dout(10) << "activate peer osd." << peer << " is up to date, but sending pg_log anyway" << dendl;
 	  m = new MOSDPGLog(get_osdmap()->get_epoch(), info);
 	}
-      } else if (pg_log.get_tail() > pi.last_update || pi.last_backfill == hobject_t()) {
+      } else if (pg_log.get_tail() > pi.last_update ||
+		 pi.last_backfill == hobject_t() ||
+		 reshard.count(peer)) {
 	// backfill
 	osd->clog.info() << info.pgid << " restarting backfill on osd." << peer
 			 << " from (" << pi.log_tail << "," << pi.last_update << "] " << pi.last_backfill
@@ -1300,6 +1416,8 @@ void PG::activate(ObjectStore::Transaction& t,
       }
       
       if (m) {
+	// the shard the peer holds is ours to decide
+	m->info.shard = pi.shard;
 	dout(10) << "activate peer osd." << peer << " sending " << m->log << dendl;
 	//m->log.print(cout);
 	osd->send_message_osd_cluster(peer, m, get_osdmap()->get_epoch());
@@ -2729,14 +2847,15 @@ void PG::_scan_list(
        ++p, i++) {
     handle.reset_tp_timeout();
     hobject_t poid = *p;
+    ghobject_t oid = get_local_oid(poid);
 
     struct stat st;
-    int r = osd->store->stat(coll, poid, &st, true);
+    int r = osd->store->stat(coll, oid, &st, true);
     if (r == 0) {
       ScrubMap::object &o = map.objects[poid];
       o.size = st.st_size;
       assert(!o.negative);
-      osd->store->getattrs(coll, poid, o.attrs);
+      osd->store->getattrs(coll, oid, o.attrs);
 
       // calculate the CRC32 on deep scrubs
       if (deep) {
@@ -2744,7 +2863,7 @@ void PG::_scan_list(
         bufferlist bl, hdrbl;
         int r;
         __u64 pos = 0;
-        while ( (r = osd->store->read(coll, poid, pos,
+        while ( (r = osd->store->read(coll, oid, pos,
                                        cct->_conf->osd_deep_scrub_stride, bl,
 		                      true)) > 0) {
 	  handle.reset_tp_timeout();
@@ -2761,7 +2880,7 @@ void PG::_scan_list(
         o.digest_present = true;
 
         bl.clear();
-        r = osd->store->omap_get_header(coll, poid, &hdrbl, true);
+        r = osd->store->omap_get_header(coll, oid, &hdrbl, true);
         if (r == 0) {
           dout(25) << "CRC header " << string(hdrbl.c_str(), hdrbl.length())
              << dendl;
@@ -2775,7 +2894,7 @@ void PG::_scan_list(
 	}
 
         ObjectMap::ObjectMapIterator iter = osd->store->get_omap_iterator(
-          coll, poid);
+          coll, oid);
         assert(iter);
 	uint64_t keys_scanned = 0;
         for (iter->seek_to_first(); iter->valid() ; iter->next()) {
@@ -3803,7 +3922,9 @@ enum PG::error_type PG::_compare_scrub_objects(ScrubMap::object &auth,
     error = DEEP_ERROR;
     errorstream << "candidate had a read error";
   }
-  if (auth.digest_present && candidate.digest_present) {
+  // the shards of an erasure coded object hold different data
+  if (auth.digest_present && candidate.digest_present &&
+      !pool.info.is_erasure()) {
     if (auth.digest != candidate.digest) {
       if (error != CLEAN)
         errorstream << ", ";
@@ -3917,7 +4038,7 @@ map<int, ScrubMap *>::const_iterator PG::_select_auth_object(
       // invalid object info, probably corrupt
       continue;
     }
-    if (oi.size != i->second.size) {
+    if (get_pgbackend()->get_ondisk_size(oi.size) != i->second.size) {
       // invalid size, probably corrupt
       dout(10) << __func__ << ": rejecting osd " << j->first
 	       << " for obj " << obj
@@ -4773,15 +4894,25 @@ ostream& operator<<(ostream& out, const PG& pg)
 bool PG::can_discard_op(OpRequestRef op)
 {
   MOSDOp *m = static_cast<MOSDOp*>(op->get_req());
+  // until the ops are decoded, go by the read/write flags the client
+  // routed the op with
+  bool may_write, may_read;
+  if (m->is_final_decode_needed()) {
+    may_write = m->get_flags() & CEPH_OSD_FLAG_WRITE;
+    may_read = m->get_flags() & CEPH_OSD_FLAG_READ;
+  } else {
+    may_write = op->may_write();
+    may_read = op->may_read();
+  }
   if (OSD::op_is_discardable(m)) {
     dout(20) << " discard " << *m << dendl;
     return true;
-  } else if (op->may_write() &&
+  } else if (may_write &&
 	     (!is_primary() ||
 	      !same_for_modify_since(m->get_map_epoch()))) {
     osd->handle_misdirected_op(this, op);
     return true;
-  } else if (op->may_read() &&
+  } else if (may_read &&
 	     !same_for_read_since(m->get_map_epoch())) {
     osd->handle_misdirected_op(this, op);
     return true;
@@ -4853,6 +4984,10 @@ bool PG::can_discard_request(OpRequestRef op)
     return can_discard_replica_op<MOSDPGPull, MSG_OSD_PG_PULL>(op);
   case MSG_OSD_PG_PUSH_REPLY:
     return can_discard_replica_op<MOSDPGPushReply, MSG_OSD_PG_PUSH_REPLY>(op);
+  case MSG_OSD_EC_READ:
+    return can_discard_replica_op<MOSDECSubOpRead, MSG_OSD_EC_READ>(op);
+  case MSG_OSD_EC_READ_REPLY:
+    return can_discard_replica_op<MOSDECSubOpReadReply, MSG_OSD_EC_READ_REPLY>(op);
   case MSG_OSD_SUBOPREPLY:
     return false;
   case MSG_OSD_PG_SCAN:
@@ -4916,6 +5051,16 @@ bool PG::op_must_wait_for_map(OSDMapRef curmap, OpRequestRef op)
     return !have_same_or_newer_map(
       curmap,
       static_cast<MOSDPGPushReply*>(op->get_req())->map_epoch);
+
+  case MSG_OSD_EC_READ:
+    return !have_same_or_newer_map(
+      curmap,
+      static_cast<MOSDECSubOpRead*>(op->get_req())->map_epoch);
+
+  case MSG_OSD_EC_READ_REPLY:
+    return !have_same_or_newer_map(
+      curmap,
+      static_cast<MOSDECSubOpReadReply*>(op->get_req())->map_epoch);
   }
   assert(0);
   return false;
@@ -5938,6 +6083,12 @@ PG::RecoveryState::Active::Active(my_context ctx)
 	       context< RecoveryMachine >().get_info_map());
   assert(pg->is_active());
   dout(10) << "Activate Finished" << dendl;
+
+  utime_t published =
+    pg->osd->get_map_publish_stamp(pg->info.history.same_interval_since);
+  if (published != utime_t())
+    pg->osd->logger->tinc(l_osd_map_to_active_lat,
+			  ceph_clock_now(pg->cct) - published);
 }
 
 boost::statechart::result PG::RecoveryState::Active::react(const AdvMap& advmap)
@@ -6279,6 +6430,9 @@ boost::statechart::result PG::RecoveryState::Stray::react(const MLogRec& logevt)
   MOSDPGLog *msg = logevt.msg.get();
   dout(10) << "got info+log from osd." << logevt.from << " " << msg->info << " " << msg->log << dendl;
 
+  ObjectStore::Transaction* t = context<RecoveryMachine>().get_cur_transaction();
+  pg->change_shard(*t, msg->info.shard);
+
   if (msg->info.last_backfill == hobject_t()) {
     // restart backfill
     pg->unreg_next_scrub();
@@ -6289,7 +6443,6 @@ boost::statechart::result PG::RecoveryState::Stray::react(const MLogRec& logevt)
     pg->pg_log.claim_log(msg->log);
     pg->pg_log.reset_backfill();
   } else {
-    ObjectStore::Transaction* t = context<RecoveryMachine>().get_cur_transaction();
     pg->merge_log(*t, msg->info, msg->log, logevt.from);
   }
 
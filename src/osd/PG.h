@@ -290,6 +290,11 @@ public:
 
   const coll_t coll;
   PGLog  pg_log;
+
+  /// key of hoid in our collection: erasure coded pgs store the shard we hold
+  ghobject_t get_local_oid(const hobject_t &hoid) const {
+    return ghobject_t(hoid, ghobject_t::NO_GEN, info.shard);
+  }
   static string get_info_key(pg_t pgid) {
     return stringify(pgid) + "_info";
   }
@@ -637,6 +642,8 @@ public:
   map<int, pg_info_t>::const_iterator find_best_info(const map<int, pg_info_t> &infos) const;
   bool calc_acting(int& newest_update_osd, vector<int>& want, vector<int>& backfill) const;
   bool choose_acting(int& newest_update_osd);
+  void assign_shards(set<int> *reshard);
+  void change_shard(ObjectStore::Transaction& t, shard_t shard);
   void build_might_have_unfound();
   void replay_queued_ops();
   void activate(ObjectStore::Transaction& t,
@@ -1839,6 +1846,9 @@ public:
   virtual void do_backfill(OpRequestRef op) = 0;
   virtual void snap_trimmer() = 0;
 
+  /// do some tiering agent work on up to max objects; false if idle
+  virtual bool agent_work(int max) = 0;
+
   virtual int do_command(cmdmap_t cmdmap, ostream& ss,
 			 bufferlist& idata, bufferlist& odata) = 0;
 
@@ -232,6 +232,42 @@
      const hobject_t &hoid,
      const string &attr,
      bufferlist *out) = 0;
+
+   /**
+    * Read [off, off + len) of hoid, whose logical size is size.
+    *
+    * on_complete is called, under the same locks as the other
+    * callbacks, with the number of bytes read into bl or a negative
+    * error.  Backends which hold the whole object locally may call it
+    * before returning.
+    */
+   virtual void objects_read_async(
+     const hobject_t &hoid,
+     uint64_t off,
+     uint64_t len,
+     uint64_t size,
+     bufferlist *bl,
+     Context *on_complete) = 0;
+
+   /// Write path
+
+   /**
+    * Split the logical transaction t into the transactions applied by
+    * each osd in actingbackfill.  Returns false, leaving out alone, if
+    * every osd applies t as is.
+    */
+   virtual bool get_shard_transactions(
+     ObjectStore::Transaction &t,
+     map<int, ObjectStore::Transaction> *out) = 0;
+
+   /// -EOPNOTSUPP if get_shard_transactions cannot split t
+   virtual int check_transaction(ObjectStore::Transaction &t) = 0;
+
+   /// logical bytes per stripe, or 0 if objects are not striped
+   virtual uint64_t get_stripe_width() const = 0;
+
+   /// bytes each osd stores for an object of logical_size bytes
+   virtual uint64_t get_ondisk_size(uint64_t logical_size) const = 0;
  };
 
 #endif
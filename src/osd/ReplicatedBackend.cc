@@ -291,3 +291,15 @@ int ReplicatedBackend::objects_get_attr(
   }
   return r;
 }
+
+void ReplicatedBackend::objects_read_async(
+  const hobject_t &hoid,
+  uint64_t off,
+  uint64_t len,
+  uint64_t size,
+  bufferlist *bl,
+  Context *on_complete)
+{
+  int r = osd->store->read(coll, hoid, off, len, *bl);
+  on_complete->complete(r);
+}
@@ -171,6 +171,40 @@ public:
     const hobject_t &hoid,
     const string &attr,
     bufferlist *out);
+
+  void objects_read_async(
+    const hobject_t &hoid,
+    uint64_t off,
+    uint64_t len,
+    uint64_t size,
+    bufferlist *bl,
+    Context *on_complete);
+
+  bool get_shard_transactions(
+    ObjectStore::Transaction &t,
+    map<int, ObjectStore::Transaction> *out) {
+    return false;
+  }
+  int check_transaction(ObjectStore::Transaction &t) {
+    return 0;
+  }
+  uint64_t get_stripe_width() const {
+    return 0;
+  }
+  uint64_t get_ondisk_size(uint64_t logical_size) const {
+    return logical_size;
+  }
+
+  /// what a holder of soid at have lacks of need, per the log; false
+  /// if some entry in between didn't record its extents
+  static bool calc_delta_subset(const pg_log_t &log,
+				const hobject_t& soid,
+				eversion_t have, eversion_t need,
+				uint64_t size,
+				interval_set<uint64_t>& data_subset);
+  /// is our copy of soid at the version a delta was built against?
+  static bool have_delta_base(ObjectStore *store, coll_t coll,
+			      const hobject_t& soid, eversion_t base);
 private:
   // push
   struct PushInfo {
@@ -317,7 +351,9 @@ private:
 		 eversion_t version,
 		 interval_set<uint64_t> &data_subset,
 		 map<hobject_t, interval_set<uint64_t> >& clone_subsets,
-		 PushOp *op);
+		 PushOp *op,
+		 eversion_t delta_base = eversion_t());
+  bool peer_supports_delta_recovery(int peer);
   void calc_head_subsets(ObjectContextRef obc, SnapSet& snapset, const hobject_t& head,
 			 const pg_missing_t& missing,
 			 const hobject_t &last_backfill,
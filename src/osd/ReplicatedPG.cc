@@ -18,6 +18,8 @@
 #include "boost/tuple/tuple.hpp"
 #include "PG.h"
 #include "ReplicatedPG.h"
+#include "ECBackend.h"
+#include "ErasureCodePlugin.h"
 #include "OSD.h"
 #include "OpRequest.h"
 
@@ -161,7 +163,7 @@ void ReplicatedPG::on_local_recover_start(
 {
   pg_log.revise_have(oid, eversion_t());
   remove_snap_mapped_object(*t, oid);
-  t->remove(coll, oid);
+  t->remove(coll, get_local_oid(oid));
 }
 
 void ReplicatedPG::on_local_recover(
@@ -199,7 +201,7 @@ void ReplicatedPG::on_local_recover(
       recovery_info.oi.version = latest->version;
       bufferlist bl;
       ::encode(recovery_info.oi, bl);
-      t->setattr(coll, recovery_info.soid, OI_ATTR, bl);
+      t->setattr(coll, get_local_oid(recovery_info.soid), OI_ATTR, bl);
     }
   }
 
@@ -868,7 +870,7 @@ void ReplicatedPG::do_pg_op(OpRequestRef op)
 	    result = -ENOENT;
 	    break;
 	  }
-	  result = osd->store->read(coll, oid, 0, 0, osd_op.outdata);
+	  result = osd->store->read(coll, get_local_oid(oid), 0, 0, osd_op.outdata);
 	}
       }
       break;
@@ -934,7 +936,7 @@ ReplicatedPG::ReplicatedPG(OSDService *o, OSDMapRef curmap,
 			   const PGPool &_pool, pg_t p, const hobject_t& oid,
 			   const hobject_t& ioid) :
   PG(o, curmap, _pool, p, oid, ioid),
-  pgbackend(new ReplicatedBackend(this, coll_t(p), o)),
+  pgbackend(build_pg_backend(o, _pool, p)),
   snapset_contexts_lock("ReplicatedPG::snapset_contexts"),
   temp_seq(0),
   snap_trimmer_machine(this)
@@ -942,6 +944,33 @@ ReplicatedPG::ReplicatedPG(OSDService *o, OSDMapRef curmap,
   snap_trimmer_machine.initiate();
 }
 
+PGBackend *ReplicatedPG::build_pg_backend(
+  OSDService *o, const PGPool &_pool, pg_t p)
+{
+  if (!_pool.info.is_erasure())
+    return new ReplicatedBackend(this, coll_t(p), o);
+
+  map<string,string> parameters = _pool.info.properties;
+  if (!parameters.count("erasure-code-directory"))
+    parameters["erasure-code-directory"] =
+      cct->_conf->osd_pool_default_erasure_code_directory;
+  uint64_t stripe_width = cct->_conf->osd_pool_erasure_code_stripe_width;
+  map<string,string>::iterator w = parameters.find("erasure-code-stripe-width");
+  if (w != parameters.end())
+    stripe_width = strtoull(w->second.c_str(), NULL, 10);
+
+  ceph::ErasureCodeInterfaceRef ec_impl;
+  int r = ceph::ErasureCodePluginRegistry::instance().factory(
+    parameters["erasure-code-plugin"], parameters, &ec_impl);
+  if (r) {
+    derr << __func__ << ": unable to load erasure code plugin "
+	 << parameters["erasure-code-plugin"] << " for pool "
+	 << _pool.name << ": " << cpp_strerror(r) << dendl;
+    assert(0 == "unable to load the erasure code plugin");
+  }
+  return new ECBackend(this, coll_t(p), o, ec_impl, stripe_width);
+}
+
 void ReplicatedPG::get_src_oloc(const object_t& oid, const object_locator_t& oloc, object_locator_t& src_oloc)
 {
   src_oloc = oloc;
@@ -1124,8 +1153,11 @@ void ReplicatedPG::do_op(OpRequestRef op)
     }
   }
 
+  if (agent_state)
+    agent_choose_mode();
+
   if ((m->get_flags() & CEPH_OSD_FLAG_IGNORE_CACHE) == 0 &&
-      maybe_handle_cache(op, obc, r))
+      maybe_handle_cache(op, oid, obc, r))
     return;
 
   if (r) {
@@ -1324,8 +1356,8 @@ void ReplicatedPG::do_op(OpRequestRef op)
   execute_ctx(ctx);
 }
 
-bool ReplicatedPG::maybe_handle_cache(OpRequestRef op, ObjectContextRef obc,
-                                      int r)
+bool ReplicatedPG::maybe_handle_cache(OpRequestRef op, const hobject_t& oid,
+				      ObjectContextRef obc, int r)
 {
   if (obc)
     dout(25) << __func__ << " " << obc->obs.oi << " "
@@ -1350,6 +1382,10 @@ bool ReplicatedPG::maybe_handle_cache(OpRequestRef op, ObjectContextRef obc,
     if (can_skip_promote(op, obc)) {
       return false;
     }
+    if (!op->may_write() && !read_wants_promote(oid)) {
+      do_cache_redirect(op, obc);
+      return true;
+    }
     promote_object(op, obc);
     return true;
 
@@ -1363,7 +1399,10 @@ bool ReplicatedPG::maybe_handle_cache(OpRequestRef op, ObjectContextRef obc,
   case pg_pool_t::CACHEMODE_READONLY: // TODO: clean this case up
     if (!obc.get() && r == -ENOENT) {
       // we don't have the object and op's a read
-      promote_object(op, obc);
+      if (read_wants_promote(oid))
+	promote_object(op, obc);
+      else
+	do_cache_redirect(op, obc);
       return true;
     }
     if (obc.get() && obc->obs.exists) { // we have the object locally
@@ -1396,6 +1435,18 @@ bool ReplicatedPG::can_skip_promote(OpRequestRef op, ObjectContextRef obc)
   return false;
 }
 
+bool ReplicatedPG::read_wants_promote(const hobject_t& oid)
+{
+  if (!pool.info.cache_min_promote_hits)
+    return true;
+  // this read is already in the current HitSet
+  unsigned hits = hit_set_get_count(oid, pool.info.hit_set_count,
+				    pool.info.hit_set_halflife);
+  dout(20) << __func__ << " " << oid << " hits " << hits << "/"
+	   << pool.info.cache_min_promote_hits << dendl;
+  return hits >= pool.info.cache_min_promote_hits;
+}
+
 void ReplicatedPG::do_cache_redirect(OpRequestRef op, ObjectContextRef obc)
 {
   MOSDOp *m = static_cast<MOSDOp*>(op->get_req());
@@ -1475,6 +1526,19 @@ void ReplicatedPG::execute_ctx(OpContext *ctx)
   // before we finally apply the resulting transaction.
   ctx->op_t = ObjectStore::Transaction();
   ctx->local_t = ObjectStore::Transaction();
+  ctx->delta_stats = object_stat_sum_t();
+  ctx->bytes_written = ctx->bytes_read = 0;
+  ctx->num_read = ctx->num_write = 0;
+  ctx->current_osd_subop_num = 0;
+  ctx->watch_connects.clear();
+  ctx->watch_disconnects.clear();
+  ctx->notifies.clear();
+  ctx->notify_acks.clear();
+  ctx->modified_ranges.clear();
+  ctx->extents_known = false;
+  ctx->logged_extents.clear();
+  for (vector<OSDOp>::iterator p = ctx->ops.begin(); p != ctx->ops.end(); ++p)
+    p->outdata.clear();
 
   // dup/replay?
   if (op->may_write()) {
@@ -2058,7 +2122,40 @@ void ReplicatedPG::do_backfill(OpRequestRef op)
   }
 }
 
-ReplicatedPG::RepGather *ReplicatedPG::trim_object(const hobject_t &coid)
+/*
+ * trim a batch of clones in a single transaction.  each clone still
+ * gets its own log entries; the first clone's obc anchors the repop and
+ * the others are carried in ctx->batch_obcs.
+ */
+ReplicatedPG::RepGather *ReplicatedPG::trim_objects(
+  const vector<hobject_t> &coids,
+  uint64_t *bytes_released)
+{
+  assert(!coids.empty());
+  ObjectContextRef obc;
+  int r = find_object_context(coids[0], &obc, false, NULL);
+  if (r == -ENOENT || coids[0].snap != obc->obs.oi.soid.snap) {
+    derr << __func__ << "could not find coid " << coids[0] << dendl;
+    assert(0);
+  }
+  assert(r == 0);
+
+  RepGather *repop = simple_repop_create(obc);
+  OpContext *ctx = repop->ctx;
+  ctx->at_version = get_next_version();
+
+  for (vector<hobject_t>::const_iterator p = coids.begin();
+       p != coids.end();
+       ++p) {
+    if (p != coids.begin())
+      ctx->at_version.version++;
+    trim_object(*p, ctx, bytes_released);
+  }
+  return repop;
+}
+
+void ReplicatedPG::trim_object(const hobject_t &coid, OpContext *ctx,
+			       uint64_t *bytes_released)
 {
   // load clone info
   bufferlist bl;
@@ -2069,6 +2166,8 @@ ReplicatedPG::RepGather *ReplicatedPG::trim_object(const hobject_t &coid)
     assert(0);
   }
   assert(r == 0);
+  if (obc != ctx->obc)
+    ctx->batch_obcs.push_back(obc);
 
   object_info_t &coi = obc->obs.oi;
   set<snapid_t> old_snaps(coi.snaps.begin(), coi.snaps.end());
@@ -2090,10 +2189,6 @@ ReplicatedPG::RepGather *ReplicatedPG::trim_object(const hobject_t &coid)
 	   << " old snapset " << snapset << dendl;
   assert(snapset.seq);
 
-  RepGather *repop = simple_repop_create(obc);
-  OpContext *ctx = repop->ctx;
-  ctx->at_version = get_next_version();
-
   ObjectStore::Transaction *t = &ctx->op_t;
   OSDriver::OSTransaction os_t(osdriver.get_transaction(t));
     
@@ -2153,6 +2248,8 @@ ReplicatedPG::RepGather *ReplicatedPG::trim_object(const hobject_t &coid)
     delta.num_object_clones--;
     delta.num_bytes -= snapset.clone_size[last];
     info.stats.stats.add(delta, obc->obs.oi.category);
+    if (bytes_released)
+      *bytes_released += snapset.clone_size[last];
 
     snapset.clones.erase(p);
     snapset.clone_overlap.erase(last);
@@ -2163,7 +2260,7 @@ ReplicatedPG::RepGather *ReplicatedPG::trim_object(const hobject_t &coid)
 	pg_log_entry_t::DELETE,
 	coid,
 	ctx->at_version,
-	ctx->obs->oi.version,
+	coi.version,
 	0,
 	osd_reqid_t(),
 	ctx->mtime)
@@ -2202,7 +2299,11 @@ ReplicatedPG::RepGather *ReplicatedPG::trim_object(const hobject_t &coid)
     coid.oid, coid.get_key(),
     snapset.head_exists ? CEPH_NOSNAP:CEPH_SNAPDIR, coid.hash,
     info.pgid.pool(), coid.get_namespace());
-  ctx->snapset_obc = get_object_context(snapoid, false);
+  ObjectContextRef snapset_obc = get_object_context(snapoid, false);
+  if (!ctx->snapset_obc)
+    ctx->snapset_obc = snapset_obc;
+  else if (snapset_obc != ctx->snapset_obc)
+    ctx->batch_obcs.push_back(snapset_obc);
 
   if (snapset.clones.empty() && !snapset.head_exists) {
     dout(10) << coid << " removing " << snapoid << dendl;
@@ -2211,12 +2312,12 @@ ReplicatedPG::RepGather *ReplicatedPG::trim_object(const hobject_t &coid)
 	pg_log_entry_t::DELETE,
 	snapoid,
 	ctx->at_version,
-	ctx->snapset_obc->obs.oi.version,
+	snapset_obc->obs.oi.version,
 	0,
 	osd_reqid_t(),
 	ctx->mtime)
       );
-    ctx->snapset_obc->obs.exists = false;
+    snapset_obc->obs.exists = false;
 
     t->remove(coll, snapoid);
   } else {
@@ -2226,26 +2327,24 @@ ReplicatedPG::RepGather *ReplicatedPG::trim_object(const hobject_t &coid)
 	pg_log_entry_t::MODIFY,
 	snapoid,
 	ctx->at_version,
-	ctx->snapset_obc->obs.oi.version,
+	snapset_obc->obs.oi.version,
 	0,
 	osd_reqid_t(),
 	ctx->mtime)
       );
 
-    ctx->snapset_obc->obs.oi.prior_version =
-      ctx->snapset_obc->obs.oi.version;
-    ctx->snapset_obc->obs.oi.version = ctx->at_version;
+    snapset_obc->obs.oi.prior_version =
+      snapset_obc->obs.oi.version;
+    snapset_obc->obs.oi.version = ctx->at_version;
 
     bl.clear();
     ::encode(snapset, bl);
     t->setattr(coll, snapoid, SS_ATTR, bl);
 
     bl.clear();
-    ::encode(ctx->snapset_obc->obs.oi, bl);
+    ::encode(snapset_obc->obs.oi, bl);
     t->setattr(coll, snapoid, OI_ATTR, bl);
   }
-
-  return repop;
 }
 
 void ReplicatedPG::snap_trimmer()
@@ -2623,6 +2722,120 @@ static int check_offset_and_length(uint64_t offset, uint64_t length, uint64_t ma
   return 0;
 }
 
+/**
+ * Objects of erasure coded pools are encoded stripe by stripe (see
+ * ECBackend): only the operations which rewrite whole stripes, or do
+ * not touch the data at all, can be applied to the shards.  Watches
+ * and the cache tiering ops are refused as well: they lead to updates
+ * (timeouts, flushes, evictions) issued outside of any client op.
+ */
+int ReplicatedPG::ec_check_op(OpContext *ctx, OSDOp& osd_op)
+{
+  const ceph_osd_op& op = osd_op.op;
+  const object_info_t& oi = ctx->new_obs.oi;
+  uint64_t width = pgbackend->get_stripe_width();
+
+  switch (op.op) {
+  case CEPH_OSD_OP_READ:
+  case CEPH_OSD_OP_STAT:
+  case CEPH_OSD_OP_GETXATTR:
+  case CEPH_OSD_OP_GETXATTRS:
+  case CEPH_OSD_OP_CMPXATTR:
+  case CEPH_OSD_OP_SRC_CMPXATTR:
+  case CEPH_OSD_OP_ASSERT_VER:
+  case CEPH_OSD_OP_ASSERT_SRC_VERSION:
+  case CEPH_OSD_OP_LIST_WATCHERS:
+  case CEPH_OSD_OP_LIST_SNAPS:
+  case CEPH_OSD_OP_NOTIFY:
+  case CEPH_OSD_OP_NOTIFY_ACK:
+  case CEPH_OSD_OP_ISDIRTY:
+  case CEPH_OSD_OP_CREATE:
+  case CEPH_OSD_OP_DELETE:
+  case CEPH_OSD_OP_SETXATTR:
+  case CEPH_OSD_OP_RMXATTR:
+  case CEPH_OSD_OP_APPEND:  // checked as the WRITE it turns into
+    return 0;
+
+  case CEPH_OSD_OP_WRITE:
+    // appends starting on a stripe boundary
+    if (op.extent.offset == oi.size &&
+	oi.size % width == 0 &&
+	op.extent.truncate_seq <= oi.truncate_seq)
+      return 0;
+    break;
+
+  case CEPH_OSD_OP_WRITEFULL:
+    if (op.extent.offset == 0)
+      return 0;
+    break;
+
+  case CEPH_OSD_OP_TRUNCATE:
+    if (op.extent.offset % width == 0)
+      return 0;
+    break;
+
+  default:
+    break;
+  }
+  dout(10) << __func__ << " " << ceph_osd_op_name(op.op) << " "
+	   << op.extent.offset << "~" << op.extent.length
+	   << " not supported on erasure coded pool (size " << oi.size
+	   << ", stripe width " << width << ")" << dendl;
+  return -EOPNOTSUPP;
+}
+
+struct C_OnECRead : public Context {
+  ReplicatedPG::OpContext *ctx;
+  OSDOp *osd_op;
+  C_OnECRead(ReplicatedPG::OpContext *ctx, OSDOp *osd_op)
+    : ctx(ctx), osd_op(osd_op) {}
+  void finish(int r) {
+    ctx->async_read_results[osd_op].first = r;
+    if (!ctx->async_read_waiting)
+      return;  // completed before objects_read_async returned
+    ctx->async_read_waiting = false;
+    if (r == -ECANCELED) {
+      // on cancel just toss it out; client resends
+      if (ctx->pg->is_primary())
+	ctx->pg->requeue_op(ctx->op);
+      ctx->pg->close_op_ctx(ctx);
+      return;
+    }
+    ctx->pg->execute_ctx(ctx);
+  }
+};
+
+/**
+ * Reads of erasure coded objects gather shards from the other osds:
+ * the first pass starts the read and returns -EINPROGRESS, and
+ * execute_ctx() is called again once the data is in.
+ */
+int ReplicatedPG::do_ec_read(OpContext *ctx, OSDOp& osd_op, bufferlist *bl)
+{
+  map<OSDOp*, pair<int, bufferlist> >::iterator p =
+    ctx->async_read_results.find(&osd_op);
+  if (p == ctx->async_read_results.end()) {
+    p = ctx->async_read_results.insert(
+      make_pair(&osd_op, make_pair(-EINPROGRESS, bufferlist()))).first;
+    pgbackend->objects_read_async(
+      ctx->obs->oi.soid,
+      osd_op.op.extent.offset,
+      osd_op.op.extent.length,
+      ctx->obs->oi.size,
+      &p->second.second,
+      new C_OnECRead(ctx, &osd_op));
+  }
+  if (p->second.first == -EINPROGRESS) {
+    dout(10) << __func__ << " " << ctx->obs->oi.soid << " "
+	     << osd_op.op.extent.offset << "~" << osd_op.op.extent.length
+	     << " waiting for shards" << dendl;
+    ctx->async_read_waiting = true;
+    return -EINPROGRESS;
+  }
+  bl->append(p->second.second);
+  return p->second.first;
+}
+
 int ReplicatedPG::do_osd_ops(OpContext *ctx, vector<OSDOp>& ops)
 {
   int result = 0;
@@ -2694,6 +2907,12 @@ int ReplicatedPG::do_osd_ops(OpContext *ctx, vector<OSDOp>& ops)
       op.op = CEPH_OSD_OP_TRUNCATE;
     }
 
+    if (pool.info.is_erasure()) {
+      result = ec_check_op(ctx, osd_op);
+      if (result < 0)
+	goto fail;
+    }
+
     switch (op.op) {
       
       // --- READS ---
@@ -2703,7 +2922,14 @@ int ReplicatedPG::do_osd_ops(OpContext *ctx, vector<OSDOp>& ops)
       {
 	// read into a buffer
 	bufferlist bl;
-	int r = osd->store->read(coll, soid, op.extent.offset, op.extent.length, bl);
+	int r;
+	if (pool.info.is_erasure()) {
+	  r = do_ec_read(ctx, osd_op, &bl);
+	  if (r == -EINPROGRESS)
+	    return r;
+	} else {
+	  r = osd->store->read(coll, soid, op.extent.offset, op.extent.length, bl);
+	}
 	if (first_read) {
 	  first_read = false;
 	  ctx->data_off = op.extent.offset;
@@ -3025,7 +3251,7 @@ int ReplicatedPG::do_osd_ops(OpContext *ctx, vector<OSDOp>& ops)
       ++ctx->num_read;
       {
 	map<string,bufferptr> attrset;
-        result = osd->store->getattrs(coll, soid, attrset, true);
+        result = osd->store->getattrs(coll, get_local_oid(soid), attrset, true);
         map<string, bufferptr>::iterator iter;
         map<string, bufferlist> newattrs;
         for (iter = attrset.begin(); iter != attrset.end(); ++iter) {
@@ -4401,13 +4627,15 @@ void ReplicatedPG::do_osd_op_effects(OpContext *ctx)
 	osd->get_next_id(get_osdmap()->get_epoch()),
 	ctx->obc->obs.oi.user_version,
 	osd));
+    NotifyBatch batch;
     for (map<pair<uint64_t, entity_name_t>, WatchRef>::iterator i =
 	   ctx->obc->watchers.begin();
 	 i != ctx->obc->watchers.end();
 	 ++i) {
       dout(10) << "starting notify on watch " << i->first << dendl;
-      i->second->start_notify(notif);
+      i->second->start_notify(notif, &batch);
     }
+    notif->send_batch(batch);
     notif->init();
   }
 
@@ -4415,6 +4643,16 @@ void ReplicatedPG::do_osd_op_effects(OpContext *ctx)
        p != ctx->notify_acks.end();
        ++p) {
     dout(10) << "notify_ack " << make_pair(p->watch_cookie, p->notify_id) << dendl;
+    if (p->watch_cookie) {
+      // acks name their watch; no need to walk every watcher
+      map<pair<uint64_t, entity_name_t>, WatchRef>::iterator i =
+	ctx->obc->watchers.find(make_pair(p->watch_cookie.get(), entity));
+      if (i != ctx->obc->watchers.end()) {
+	dout(10) << "acking notify on watch " << i->first << dendl;
+	i->second->notify_ack(p->notify_id);
+      }
+      continue;
+    }
     for (map<pair<uint64_t, entity_name_t>, WatchRef>::iterator i =
 	   ctx->obc->watchers.begin();
 	 i != ctx->obc->watchers.end();
@@ -4443,6 +4681,43 @@ hobject_t ReplicatedPG::generate_temp_object()
   return hoid;
 }
 
+/*
+ * can the data changes made by these ops be described by
+ * modified_ranges alone?  only plain writes, zeros, truncates and
+ * xattr updates to an existing object qualify; anything that touches
+ * the omap, replaces the object wholesale or runs a class method does
+ * not, and recovery of such an object falls back to a full copy.
+ */
+static bool ops_have_known_extents(const vector<OSDOp>& ops,
+				   const object_info_t& oi)
+{
+  for (vector<OSDOp>::const_iterator p = ops.begin(); p != ops.end(); ++p) {
+    const ceph_osd_op& op = p->op;
+    if (op.op == CEPH_OSD_OP_CALL)
+      return false;
+    if (!ceph_osd_op_mode_modify(op.op))
+      continue;
+    switch (op.op) {
+    case CEPH_OSD_OP_WRITE:
+      // a newer truncate_seq truncates without updating modified_ranges
+      if (op.extent.truncate_seq > oi.truncate_seq)
+	return false;
+      break;
+    case CEPH_OSD_OP_TRUNCATE:
+    case CEPH_OSD_OP_TRIMTRUNC:
+    case CEPH_OSD_OP_ZERO:
+    case CEPH_OSD_OP_CREATE:
+    case CEPH_OSD_OP_SETXATTR:
+    case CEPH_OSD_OP_RMXATTR:
+    case CEPH_OSD_OP_WATCH:
+      break;
+    default:
+      return false;
+    }
+  }
+  return true;
+}
+
 int ReplicatedPG::prepare_transaction(OpContext *ctx)
 {
   assert(!ctx->ops.empty());
@@ -4460,6 +4735,14 @@ int ReplicatedPG::prepare_transaction(OpContext *ctx)
   if (result < 0)
     return result;
 
+  // the backend may not be able to apply all of it (erasure coding)
+  int r = pgbackend->check_transaction(ctx->op_t);
+  if (r < 0) {
+    dout(10) << " backend cannot apply the transaction: "
+	     << cpp_strerror(r) << dendl;
+    return r;
+  }
+
   // finish side-effects
   if (result == 0)
     do_osd_op_effects(ctx);
@@ -4480,6 +4763,14 @@ int ReplicatedPG::prepare_transaction(OpContext *ctx)
     }
   }
 
+  // note what we touched before make_writeable trims modified_ranges
+  // down to the clone overlap
+  if (ctx->obs->exists && !ctx->obs->oi.is_whiteout() &&
+      ops_have_known_extents(ctx->ops, ctx->obs->oi)) {
+    ctx->extents_known = true;
+    ctx->logged_extents = ctx->modified_ranges;
+  }
+
   // clone, if necessary
   make_writeable(ctx);
 
@@ -4586,6 +4877,10 @@ void ReplicatedPG::finish_ctx(OpContext *ctx)
 				    ctx->obs->oi.version,
 				    ctx->user_at_version, ctx->reqid,
 				    ctx->mtime));
+  if (ctx->extents_known && ctx->new_obs.exists) {
+    ctx->log.back().extents_known = true;
+    ctx->log.back().modified_extents.swap(ctx->logged_extents);
+  }
 
   // apply new object state.
   ctx->obc->obs = ctx->new_obs;
@@ -5101,7 +5396,7 @@ int ReplicatedPG::start_flush(OpContext *ctx, bool blocking)
   map<hobject_t,FlushOpRef>::iterator p = flush_ops.find(soid);
   if (p != flush_ops.end()) {
     FlushOpRef fop = p->second;
-    if (fop->ctx->op == ctx->op) {
+    if (ctx->op && fop->ctx->op == ctx->op) {
       // we couldn't take the write lock on a cache-try-flush before;
       // now we are trying again for the lock.
       close_op_ctx(fop->ctx);  // clean up the previous ctx and use the new one.
@@ -5183,8 +5478,13 @@ void ReplicatedPG::finish_flush(hobject_t oid, tid_t tid, int r)
   fop->objecter_tid = 0;
 
   if (r < 0 && !(r == -ENOENT && fop->removal)) {
-    reply_ctx(fop->ctx, -EBUSY, obc->obs.oi.version,
-	      obc->obs.oi.user_version);
+    if (fop->ctx->op) {
+      reply_ctx(fop->ctx, -EBUSY, obc->obs.oi.version,
+		obc->obs.oi.user_version);
+    } else {
+      osd->agent_finish_op();
+      close_op_ctx(fop->ctx);
+    }
     if (!fop->dup_ops.empty()) {
       dout(20) << __func__ << " requeueing dups" << dendl;
       requeue_ops(fop->dup_ops);
@@ -5195,8 +5495,11 @@ void ReplicatedPG::finish_flush(hobject_t oid, tid_t tid, int r)
 
   r = try_flush_mark_clean(fop);
   if (r == -EBUSY) {
-    reply_ctx(fop->ctx, -EBUSY, obc->obs.oi.version,
-	      obc->obs.oi.user_version);
+    if (fop->ctx->op)
+      reply_ctx(fop->ctx, -EBUSY, obc->obs.oi.version,
+		obc->obs.oi.user_version);
+    else
+      close_op_ctx(fop->ctx);
   }
 }
 
@@ -5217,12 +5520,26 @@ int ReplicatedPG::try_flush_mark_clean(FlushOpRef fop)
       obc->stop_block();
       kick_object_context_blocked(obc);
     }
+    if (!fop->ctx->op)
+      osd->agent_finish_op();
     flush_ops.erase(oid);
     return -EBUSY;
   }
 
   // successfully flushed; can we clear the dirty bit?
-  if (!fop->blocking) {
+  if (!fop->blocking && !fop->ctx->op) {
+    // agent flush: there is no op to retry later, so give up if the
+    // object is busy.  it stays dirty and the agent will come back.
+    dout(20) << __func__ << " taking write lock for agent" << dendl;
+    if (!obc->rwstate.get_write_lock()) {
+      dout(10) << __func__ << " object busy, leaving dirty" << dendl;
+      if (!fop->dup_ops.empty())
+	requeue_ops(fop->dup_ops);
+      osd->agent_finish_op();
+      flush_ops.erase(oid);
+      return -EBUSY;
+    }
+  } else if (!fop->blocking) {
     // non-blocking: try to take the lock manually, since we don't
     // have a ctx yet.
     dout(20) << __func__ << " taking write lock" << dendl;
@@ -5245,6 +5562,7 @@ int ReplicatedPG::try_flush_mark_clean(FlushOpRef fop)
   tid_t rep_tid = osd->get_tid();
   RepGather *repop = new_repop(fop->ctx, obc, rep_tid);
   OpContext *ctx = fop->ctx;
+  bool agent_flush = !ctx->op;
   if (!fop->blocking) {
     ctx->lock_to_release = OpContext::W_LOCK;  // we took it above
   }
@@ -5264,6 +5582,8 @@ int ReplicatedPG::try_flush_mark_clean(FlushOpRef fop)
 
   simple_repop_submit(repop);
 
+  if (agent_flush)
+    osd->agent_finish_op();
   flush_ops.erase(oid);
   return -EINPROGRESS;
 }
@@ -5279,6 +5599,10 @@ void ReplicatedPG::cancel_flush(FlushOpRef fop, bool requeue)
   if (fop->ctx->op && requeue) {
     requeue_op(fop->ctx->op);
     requeue_ops(fop->dup_ops);
+  } else if (!fop->ctx->op) {
+    osd->agent_finish_op();
+    if (requeue)
+      requeue_ops(fop->dup_ops);
   }
   if (fop->blocking) {
     fop->ctx->obc->stop_block();
@@ -5350,12 +5674,18 @@ void ReplicatedPG::apply_repop(RepGather *repop)
     unlock_snapset_obc = true;
   }
 
+  for (list<ObjectContextRef>::iterator p = repop->ctx->batch_obcs.begin();
+       p != repop->ctx->batch_obcs.end();
+       ++p)
+    (*p)->ondisk_write_lock();
+
   Context *oncommit = new C_OSD_OpCommit(this, repop);
   Context *onapplied = new C_OSD_OpApplied(this, repop);
-  Context *onapplied_sync = new C_OSD_OndiskWriteUnlock(
+  C_OSD_OndiskWriteUnlock *onapplied_sync = new C_OSD_OndiskWriteUnlock(
     repop->obc,
     repop->ctx->clone_obc,
     unlock_snapset_obc ? repop->ctx->snapset_obc : ObjectContextRef());
+  onapplied_sync->others = repop->ctx->batch_obcs;
   int r = osd->store->queue_transactions(osr.get(), repop->tls, onapplied, oncommit, onapplied_sync, repop->ctx->op);
   if (r) {
     derr << "apply_repop  queue_transactions returned " << r << " on " << *repop << dendl;
@@ -5368,7 +5698,7 @@ void ReplicatedPG::op_applied(RepGather *repop)
   lock();
   dout(10) << "op_applied " << *repop << dendl;
   if (repop->ctx->op)
-    repop->ctx->op->mark_event("op_applied");
+    repop->ctx->op->mark_event(OpRequest::EVENT_OP_APPLIED);
   
   repop->applying = false;
   repop->applied = true;
@@ -5415,7 +5745,7 @@ void ReplicatedPG::op_commit(RepGather *repop)
 {
   lock();
   if (repop->ctx->op)
-    repop->ctx->op->mark_event("op_commit");
+    repop->ctx->op->mark_event(OpRequest::EVENT_OP_COMMIT);
 
   if (repop->aborted) {
     dout(10) << "op_commit " << *repop << " -- aborted" << dendl;
@@ -5598,6 +5928,10 @@ void ReplicatedPG::issue_repop(RepGather *repop, utime_t now)
 
   repop->v = ctx->at_version;
 
+  // erasure coded pools apply a different transaction on each shard
+  map<int, ObjectStore::Transaction> shard_t;
+  bool sharded = pgbackend->get_shard_transactions(ctx->op_t, &shard_t);
+
   // add myself to gather set
   repop->waitfor_ack.insert(acting[0]);
   repop->waitfor_disk.insert(acting[0]);
@@ -5639,6 +5973,8 @@ void ReplicatedPG::issue_repop(RepGather *repop, utime_t now)
 	       << pinfo.last_backfill << dendl;
       ObjectStore::Transaction t;
       ::encode(t, wr->get_data());
+    } else if (sharded) {
+      ::encode(shard_t[peer], wr->get_data());
     } else {
       ::encode(repop->ctx->op_t, wr->get_data());
     }
@@ -5662,6 +5998,9 @@ void ReplicatedPG::issue_repop(RepGather *repop, utime_t now)
       pinfo.last_update = ctx->at_version;
     pinfo.last_update = ctx->at_version;
   }
+
+  if (sharded)
+    ctx->op_t.swap(shard_t[osd->whoami]);
 }
 
 ReplicatedPG::RepGather *ReplicatedPG::new_repop(OpContext *ctx, ObjectContextRef obc,
@@ -5718,7 +6057,7 @@ void ReplicatedPG::repop_ack(RepGather *repop, int result, int ack_type,
   
   if (ack_type & CEPH_OSD_FLAG_ONDISK) {
     if (repop->ctx->op)
-      repop->ctx->op->mark_event("sub_op_commit_rec");
+      repop->ctx->op->mark_event(OpRequest::EVENT_SUB_OP_COMMIT_REC);
     // disk
     if (repop->waitfor_disk.count(fromosd)) {
       repop->waitfor_disk.erase(fromosd);
@@ -5733,7 +6072,7 @@ void ReplicatedPG::repop_ack(RepGather *repop, int result, int ack_type,
   } else {
     // ack
     if (repop->ctx->op)
-      repop->ctx->op->mark_event("sub_op_applied_rec");
+      repop->ctx->op->mark_event(OpRequest::EVENT_SUB_OP_APPLIED_REC);
     repop->waitfor_ack.erase(fromosd);
   }
 
@@ -6389,7 +6728,7 @@ void ReplicatedPG::sub_op_modify(OpRequestRef op)
 void ReplicatedPG::sub_op_modify_applied(RepModify *rm)
 {
   lock();
-  rm->op->mark_event("sub_op_applied");
+  rm->op->mark_event(OpRequest::EVENT_SUB_OP_APPLIED);
   rm->applied = true;
 
   if (!pg_has_reset_since(rm->epoch_started)) {
@@ -6707,9 +7046,24 @@ void ReplicatedBackend::prepare_pull(
     // FIXME: this may overestimate if we are pulling multiple clones in parallel...
     dout(10) << " pulling " << recovery_info << dendl;
   } else {
-    // pulling head or unversioned object.
-    // always pull the whole thing.
-    recovery_info.copy_subset.insert(0, (uint64_t)-1);
+    // pulling head or unversioned object.  if our stale copy is
+    // covered by the log, pull only what changed since; otherwise
+    // pull the whole thing.
+    eversion_t have = get_parent()->get_local_missing().missing.find(
+      soid)->second.have;
+    interval_set<uint64_t> delta;
+    if (cct->_conf->osd_recovery_delta &&
+	soid.snap == CEPH_NOSNAP &&
+	have != eversion_t() &&
+	peer_supports_delta_recovery(fromosd) &&
+	calc_delta_subset(get_parent()->get_log().get_log(),
+			  soid, have, v, (uint64_t)-1, delta) &&
+	have_delta_base(osd->store, coll, soid, have)) {
+      recovery_info.delta_base = have;
+      recovery_info.copy_subset.swap(delta);
+    }
+    if (recovery_info.delta_base == eversion_t())
+      recovery_info.copy_subset.insert(0, (uint64_t)-1);
     recovery_info.size = ((uint64_t)-1);
   }
 
@@ -6721,7 +7075,9 @@ void ReplicatedBackend::prepare_pull(
   op.recovery_info.soid = soid;
   op.recovery_info.version = v;
   op.recovery_progress.data_complete = false;
-  op.recovery_progress.omap_complete = false;
+  // a delta never touches the omap; the base copy already has it
+  op.recovery_progress.omap_complete =
+    recovery_info.delta_base != eversion_t();
   op.recovery_progress.data_recovered_to = 0;
   op.recovery_progress.first = true;
 
@@ -6870,6 +7226,25 @@ void ReplicatedBackend::prep_push_to_replica(
 		       data_subset, clone_subsets);
   } else if (soid.snap == CEPH_NOSNAP) {
     // pushing head or unversioned object.
+    // does the replica hold an older version we can patch?
+    const pg_missing_t &pmissing =
+      get_parent()->get_peer_missing().find(peer)->second;
+    map<hobject_t, pg_missing_t::item>::const_iterator m =
+      pmissing.missing.find(soid);
+    if (cct->_conf->osd_recovery_delta &&
+	m != pmissing.missing.end() &&
+	m->second.have != eversion_t() &&
+	peer_supports_delta_recovery(peer) &&
+	calc_delta_subset(get_parent()->get_log().get_log(),
+			  soid, m->second.have, oi.version, size,
+			  data_subset)) {
+      dout(15) << "push_to_replica delta from " << m->second.have
+	       << " is " << data_subset << dendl;
+      return prep_push(obc, soid, peer, oi.version, data_subset,
+		       clone_subsets, pop, m->second.have);
+    }
+    data_subset.clear();
+
     // base this on partially on replica's clones?
     SnapSetContext *ssc = obc->ssc;
     assert(ssc);
@@ -6904,7 +7279,8 @@ void ReplicatedBackend::prep_push(
   eversion_t version,
   interval_set<uint64_t> &data_subset,
   map<hobject_t, interval_set<uint64_t> >& clone_subsets,
-  PushOp *pop)
+  PushOp *pop,
+  eversion_t delta_base)
 {
   get_parent()->begin_peer_recover(peer, soid);
   // take note.
@@ -6916,10 +7292,11 @@ void ReplicatedBackend::prep_push(
   pi.recovery_info.soid = soid;
   pi.recovery_info.oi = obc->obs.oi;
   pi.recovery_info.version = version;
+  pi.recovery_info.delta_base = delta_base;
   pi.recovery_progress.first = true;
   pi.recovery_progress.data_recovered_to = 0;
   pi.recovery_progress.data_complete = 0;
-  pi.recovery_progress.omap_complete = 0;
+  pi.recovery_progress.omap_complete = (delta_base != eversion_t());
 
   ObjectRecoveryProgress new_progress;
   int r = build_push_op(pi.recovery_info,
@@ -6931,6 +7308,72 @@ void ReplicatedBackend::prep_push(
   pi.recovery_progress = new_progress;
 }
 
+/*
+ * walk the log back from need to have.  if every step is a MODIFY
+ * that recorded its extents, the union of those extents (clipped to
+ * size) is all a holder of have is missing.
+ */
+bool ReplicatedBackend::calc_delta_subset(
+  const pg_log_t &log,
+  const hobject_t& soid,
+  eversion_t have, eversion_t need,
+  uint64_t size,
+  interval_set<uint64_t>& data_subset)
+{
+  if (have < log.tail)
+    return false;
+
+  interval_set<uint64_t> delta;
+  eversion_t want = need;
+  for (list<pg_log_entry_t>::const_reverse_iterator p = log.log.rbegin();
+       p != log.log.rend() && p->version > have;
+       ++p) {
+    if (p->soid != soid)
+      continue;
+    if (p->version != want ||
+	!p->is_modify() ||
+	!p->extents_known)
+      return false;
+    delta.union_of(p->modified_extents);
+    want = p->prior_version;
+  }
+  if (want != have)
+    return false;
+
+  if (size != (uint64_t)-1) {
+    interval_set<uint64_t> object;
+    if (size)
+      object.insert(0, size);
+    delta.intersection_of(object);
+  }
+  data_subset.swap(delta);
+  return true;
+}
+
+/*
+ * a delta patches the copy at delta_base.  applied to a missing
+ * object, or to one at any other version, it would leave garbage.
+ */
+bool ReplicatedBackend::have_delta_base(
+  ObjectStore *store, coll_t coll,
+  const hobject_t& soid, eversion_t base)
+{
+  bufferlist bv;
+  int r = store->getattr(coll, soid, OI_ATTR, bv);
+  if (r < 0)
+    return false;
+  object_info_t oi(bv);
+  return oi.version == base;
+}
+
+bool ReplicatedBackend::peer_supports_delta_recovery(int peer)
+{
+  ConnectionRef con = osd->get_con_osd_cluster(
+    peer,
+    get_osdmap()->get_epoch());
+  return con && (con->get_features() & CEPH_FEATURE_OSD_DELTA_RECOVERY);
+}
+
 int ReplicatedBackend::send_pull_legacy(int prio, int peer,
 					const ObjectRecoveryInfo &recovery_info,
 					ObjectRecoveryProgress progress)
@@ -6974,8 +7417,9 @@ void ReplicatedBackend::submit_push_data(
   map<string, bufferlist> &omap_entries,
   ObjectStore::Transaction *t)
 {
+  bool delta = recovery_info.delta_base != eversion_t();
   coll_t target_coll;
-  if (first && complete) {
+  if (first && complete && !delta) {
     target_coll = coll;
   } else {
     dout(10) << __func__ << ": Creating oid "
@@ -6984,7 +7428,18 @@ void ReplicatedBackend::submit_push_data(
     target_coll = get_temp_coll(t);
   }
 
-  if (first) {
+  if (first && delta) {
+    // patch our stale copy in place.  park it in the temp collection
+    // while we do so, so that a restart sees it as missing entirely
+    // rather than as a half-updated new version.
+    dout(10) << __func__ << ": applying delta from "
+	     << recovery_info.delta_base << " to "
+	     << recovery_info.soid << dendl;
+    t->remove(target_coll, recovery_info.soid);
+    t->collection_move(target_coll, coll, recovery_info.soid);
+    get_parent()->on_local_recover_start(recovery_info.soid, t);
+    t->rmattrs(target_coll, recovery_info.soid);
+  } else if (first) {
     get_parent()->on_local_recover_start(recovery_info.soid, t);
     t->remove(get_temp_coll(t), recovery_info.soid);
     t->touch(target_coll, recovery_info.soid);
@@ -7007,7 +7462,9 @@ void ReplicatedBackend::submit_push_data(
 	      attrs);
 
   if (complete) {
-    if (!first) {
+    if (delta)
+      t->truncate(target_coll, recovery_info.soid, recovery_info.size);
+    if (!first || delta) {
       assert(temp_contents.count(recovery_info.soid));
       dout(10) << __func__ << ": Removing oid "
 	       << recovery_info.soid << " from the temp collection" << dendl;
@@ -7083,6 +7540,21 @@ bool ReplicatedBackend::handle_pull_response(
   }
 
   PullInfo &pi = pulling[hoid];
+  if (pi.recovery_progress.first &&
+      pi.recovery_info.delta_base != eversion_t() &&
+      !have_delta_base(osd->store, coll, hoid, pi.recovery_info.delta_base)) {
+    dout(0) << "handle_pull_response " << hoid << " is no longer at "
+	    << pi.recovery_info.delta_base << ", pulling all of it" << dendl;
+    pi.recovery_info.delta_base = eversion_t();
+    pi.recovery_info.copy_subset.clear();
+    pi.recovery_info.copy_subset.insert(0, (uint64_t)-1);
+    pi.recovery_info.size = ((uint64_t)-1);
+    pi.recovery_progress = ObjectRecoveryProgress();
+    response->soid = hoid;
+    response->recovery_info = pi.recovery_info;
+    response->recovery_progress = pi.recovery_progress;
+    return true;
+  }
   if (pi.recovery_info.size == (uint64_t(-1))) {
     pi.recovery_info.size = pop.recovery_info.size;
     pi.recovery_info.copy_subset.intersection_of(
@@ -7150,7 +7622,7 @@ struct C_OnPushCommit : public Context {
   OpRequestRef op;
   C_OnPushCommit(ReplicatedPG *pg, OpRequestRef op) : pg(pg), op(op) {}
   void finish(int) {
-    op->mark_event("committed");
+    op->mark_event(OpRequest::EVENT_COMMITTED);
     log_subop_stats(pg->osd, op, l_osd_push_inb, l_osd_sop_push_lat);
   }
 };
@@ -7170,6 +7642,15 @@ void ReplicatedBackend::handle_push(
     pop.after_progress.omap_complete;
 
   response->soid = pop.recovery_info.soid;
+  if (first &&
+      pop.recovery_info.delta_base != eversion_t() &&
+      !have_delta_base(osd->store, coll, pop.recovery_info.soid,
+		       pop.recovery_info.delta_base)) {
+    dout(0) << "handle_push " << pop.recovery_info.soid << " is not at "
+	    << pop.recovery_info.delta_base << ", asking for a full push" << dendl;
+    response->delta_refused = true;
+    return;
+  }
   submit_push_data(pop.recovery_info,
 		   first,
 		   complete,
@@ -7448,6 +7929,15 @@ bool ReplicatedBackend::handle_push_reply(int peer, PushReplyOp &op, PushOp *rep
   } else {
     PushInfo *pi = &pushing[soid][peer];
 
+    if (op.delta_refused && pi->recovery_info.delta_base != eversion_t()) {
+      dout(10) << " osd." << peer << " can't take a delta for " << soid
+	       << ", pushing all of it" << dendl;
+      ObjectContextRef obc = pi->obc;
+      pi->stat = object_stat_sum_t();
+      prep_push(obc, soid, peer, reply);
+      return true;
+    }
+
     if (!pi->recovery_progress.data_complete) {
       dout(10) << " pushing more from, "
 	       << pi->recovery_progress.data_recovered_to
@@ -7555,9 +8045,13 @@ void ReplicatedBackend::handle_pull(int peer, PullOp &op, PushOp *reply)
     if (progress.first && recovery_info.size == ((uint64_t)-1)) {
       // Adjust size and copy_subset
       recovery_info.size = st.st_size;
-      recovery_info.copy_subset.clear();
+      interval_set<uint64_t> object;
       if (st.st_size)
-	recovery_info.copy_subset.insert(0, st.st_size);
+	object.insert(0, st.st_size);
+      if (recovery_info.delta_base != eversion_t())
+	recovery_info.copy_subset.intersection_of(object);
+      else
+	recovery_info.copy_subset.swap(object);
       assert(recovery_info.clone_subset.empty());
     }
 
@@ -7857,7 +8351,7 @@ ObjectContextRef ReplicatedPG::mark_object_lost(ObjectStore::Transaction *t,
 
   bufferlist b2;
   obc->obs.oi.encode(b2);
-  t->setattr(coll, oid, OI_ATTR, b2);
+  t->setattr(coll, get_local_oid(oid), OI_ATTR, b2);
 
   return obc;
 }
@@ -8085,6 +8579,8 @@ void ReplicatedPG::on_shutdown()
   deleting = true;
 
   unreg_next_scrub();
+  agent_clear();
+  hit_set_archive.clear();
   cancel_copy_ops(false);
   cancel_flush_ops(false);
   apply_and_flush_repops(false);
@@ -8110,6 +8606,7 @@ void ReplicatedPG::on_activate()
   }
 
   hit_set_setup();
+  agent_setup();
 }
 
 void ReplicatedPG::on_change(ObjectStore::Transaction *t)
@@ -8121,6 +8618,9 @@ void ReplicatedPG::on_change(ObjectStore::Transaction *t)
     hit_set_clear();
   }
 
+  agent_clear();
+  hit_set_archive.clear();
+
   // requeue everything in the reverse order they should be
   // reexamined.
 
@@ -8187,6 +8687,7 @@ void ReplicatedPG::on_pool_change()
 {
   dout(10) << __func__ << dendl;
   hit_set_setup();
+  agent_setup();
 }
 
 // clear state.  called on recovery completion AND cancellation.
@@ -8505,7 +9006,7 @@ int ReplicatedPG::recover_primary(int max, ThreadPool::TPHandle &handle)
 	      t->register_on_applied(new ObjectStore::C_DeleteTransaction(t));
 	      bufferlist b2;
 	      obc->obs.oi.encode(b2);
-	      t->setattr(coll, soid, OI_ATTR, b2);
+	      t->setattr(coll, get_local_oid(soid), OI_ATTR, b2);
 
 	      recover_got(soid, latest->version);
 
@@ -9136,7 +9637,7 @@ void ReplicatedPG::check_local()
       dout(10) << " checking " << p->soid
 	       << " at " << p->version << dendl;
       struct stat st;
-      int r = osd->store->stat(coll, p->soid, &st);
+      int r = osd->store->stat(coll, get_local_oid(p->soid), &st);
       if (r != -ENOENT) {
 	derr << __func__ << " " << p->soid << " exists, but should have been "
 	     << "deleted" << dendl;
@@ -9180,6 +9681,7 @@ void ReplicatedPG::hit_set_clear()
   dout(20) << __func__ << dendl;
   hit_set.reset(NULL);
   hit_set_start_stamp = utime_t();
+  hit_set_archive.clear();
 }
 
 void ReplicatedPG::hit_set_setup()
@@ -9233,11 +9735,48 @@ void ReplicatedPG::hit_set_create()
 
     dout(10) << __func__ << " target_size " << p->target_size
 	     << " fpp " << p->get_fpp() << dendl;
+  } else if (pool.info.hit_set_params.get_type() == HitSet::TYPE_COUNTING) {
+    CountingHitSet::Params *p =
+      static_cast<CountingHitSet::Params*>(params.impl.get());
+
+    // without a specified width, size the rows so that a period's worth
+    // of unique objects (estimated from the previous set) would only
+    // overcount by ~e/4 on average
+    if (p->width == 0) {
+      uint64_t target = 0;
+      utime_t dur = now - hit_set_start_stamp;
+      if (hit_set && (double)dur > 0) {
+	target = (double)hit_set->approx_unique_insert_count() *
+	  (double)pool.info.hit_set_period / (double)dur;
+      }
+      if (target < static_cast<uint64_t>(g_conf->osd_hit_set_min_size))
+	target = g_conf->osd_hit_set_min_size;
+      p->width = MIN(target * 4, 1 << 20);
+    }
+    p->seed = now.sec();
+
+    dout(10) << __func__ << " width " << p->width
+	     << " depth " << p->depth << dendl;
   }
   hit_set.reset(new HitSet(params));
   hit_set_start_stamp = now;
 }
 
+unsigned ReplicatedPG::hit_set_get_count(const hobject_t& oid,
+					 unsigned max_sets,
+					 unsigned halflife)
+{
+  unsigned count = 0;
+  if (hit_set)
+    count += hit_set->count(oid);
+  if (max_sets) {
+    hit_set_load_archive();
+    count += hit_set_archive.get_count(oid, max_sets, halflife);
+  }
+  dout(20) << __func__ << " " << oid << " " << count << dendl;
+  return count;
+}
+
 /**
  * apply log entries to set
  *
@@ -9320,7 +9859,7 @@ void ReplicatedPG::hit_set_persist()
     ++ctx->at_version.version;
 
     struct stat st;
-    int r = osd->store->stat(coll, old_obj, &st);
+    int r = osd->store->stat(coll, get_local_oid(old_obj), &st);
     assert(r == 0);
     --ctx->delta_stats.num_objects;
     ctx->delta_stats.num_bytes -= st.st_size;
@@ -9330,6 +9869,12 @@ void ReplicatedPG::hit_set_persist()
   info.hit_set.current_info.version = ctx->at_version;
   if (reset) {
     info.hit_set.history.push_back(info.hit_set.current_info);
+    if (agent_state || pool.info.cache_min_promote_hits) {
+      HitSetRef hs(new HitSet);
+      bufferlist::iterator p = bl.begin();
+      ::decode(*hs, p);
+      hit_set_archive.add(info.hit_set.current_info.begin.sec(), hs);
+    }
     hit_set_create();
     info.hit_set.current_info = pg_hit_set_info_t();
     info.hit_set.current_last_stamp = utime_t();
@@ -9390,10 +9935,11 @@ void ReplicatedPG::hit_set_trim(RepGather *repop, unsigned max)
 		       0,
 		       osd_reqid_t(),
 		       repop->ctx->mtime));
+    hit_set_archive.remove(p->begin.sec());
     info.hit_set.history.pop_front();
 
     struct stat st;
-    int r = osd->store->stat(coll, oid, &st);
+    int r = osd->store->stat(coll, get_local_oid(oid), &st);
     assert(r == 0);
     --repop->ctx->delta_stats.num_objects;
     repop->ctx->delta_stats.num_bytes -= st.st_size;
@@ -9401,6 +9947,406 @@ void ReplicatedPG::hit_set_trim(RepGather *repop, unsigned max)
 }
 
 
+// =======================================
+// cache agent
+
+void ReplicatedPG::agent_setup()
+{
+  assert(is_locked());
+  if (!is_active() ||
+      !is_primary() ||
+      pool.info.cache_mode == pg_pool_t::CACHEMODE_NONE ||
+      pool.info.is_erasure() ||  // cannot flush nor evict
+      pool.info.tier_of < 0 ||
+      !get_osdmap()->have_pg_pool(pool.info.tier_of) ||
+      (!pool.info.target_max_bytes && !pool.info.target_max_objects)) {
+    agent_clear();
+    return;
+  }
+  if (!agent_state) {
+    agent_state.reset(new TierAgentState);
+    dout(10) << __func__ << " allocated new state" << dendl;
+  } else {
+    dout(10) << __func__ << " keeping existing state" << dendl;
+  }
+
+  agent_choose_mode();
+}
+
+void ReplicatedPG::agent_clear()
+{
+  if (!agent_state)
+    return;
+  dout(10) << __func__ << dendl;
+  if (!agent_state->is_idle())
+    osd->agent_disable_pg(this, agent_state->evict_effort);
+  agent_state.reset(NULL);
+}
+
+bool ReplicatedPG::agent_work(int start_max)
+{
+  lock();
+  if (!agent_state) {
+    dout(10) << __func__ << " no agent state, stopping" << dendl;
+    unlock();
+    return false;
+  }
+  assert(!deleting);
+
+  if (agent_state->is_idle()) {
+    dout(10) << __func__ << " idle, stopping" << dendl;
+    unlock();
+    return false;
+  }
+
+  dout(10) << __func__
+	   << " max " << start_max
+	   << ", flush " << agent_state->get_flush_mode_name()
+	   << ", evict " << agent_state->get_evict_mode_name()
+	   << ", pos " << agent_state->position
+	   << dendl;
+
+  if (agent_state->evict_mode != TierAgentState::EVICT_MODE_IDLE)
+    hit_set_load_archive();
+
+  // NOTE: the listing is not precise; we do not flush the sequencer
+  // and simply skip objects that are gone by the time we look.
+  vector<hobject_t> ls;
+  hobject_t next;
+  int r = pgbackend->objects_list_partial(agent_state->position, 1, 10, 0,
+					  &ls, &next);
+  assert(r >= 0);
+  dout(20) << __func__ << " got " << ls.size() << " objects" << dendl;
+
+  int started = 0;
+  for (vector<hobject_t>::iterator p = ls.begin(); p != ls.end(); ++p) {
+    if (p->nspace == cct->_conf->osd_hit_set_namespace) {
+      dout(20) << __func__ << " skip (hit set) " << *p << dendl;
+      osd->logger->inc(l_osd_agent_skip);
+      continue;
+    }
+    // clones are left to explicit cache-flush/evict ops
+    if (p->snap != CEPH_NOSNAP) {
+      dout(20) << __func__ << " skip (clone) " << *p << dendl;
+      osd->logger->inc(l_osd_agent_skip);
+      continue;
+    }
+    if (is_degraded_object(*p) || is_missing_object(*p)) {
+      dout(20) << __func__ << " skip (degraded) " << *p << dendl;
+      osd->logger->inc(l_osd_agent_skip);
+      continue;
+    }
+    if (scrubber.write_blocked_by_scrub(*p)) {
+      dout(20) << __func__ << " skip (scrubbing) " << *p << dendl;
+      osd->logger->inc(l_osd_agent_skip);
+      continue;
+    }
+    ObjectContextRef obc = get_object_context(*p, false, NULL);
+    if (!obc || !obc->obs.exists) {
+      dout(20) << __func__ << " skip (no obc) " << *p << dendl;
+      osd->logger->inc(l_osd_agent_skip);
+      continue;
+    }
+    if (obc->is_blocked()) {
+      dout(20) << __func__ << " skip (blocked) " << obc->obs.oi << dendl;
+      osd->logger->inc(l_osd_agent_skip);
+      continue;
+    }
+
+    if (agent_state->evict_mode != TierAgentState::EVICT_MODE_IDLE &&
+	agent_maybe_evict(obc))
+      ++started;
+    else if (agent_state->flush_mode != TierAgentState::FLUSH_MODE_IDLE &&
+	     agent_maybe_flush(obc))
+      ++started;
+    if (started >= start_max) {
+      // finishing early; resume with the next object
+      if (++p != ls.end())
+	next = *p;
+      break;
+    }
+  }
+
+  if (++agent_state->hist_age > cct->_conf->osd_agent_hist_halflife) {
+    dout(20) << __func__ << " resetting temp histogram age ("
+	     << agent_state->hist_age << ")" << dendl;
+    agent_state->hist_age = 0;
+    agent_state->temp_hist.decay(1);
+  }
+
+  if (started)
+    agent_state->progress = true;
+  bool progress = true;
+  if (next.is_max()) {
+    // a pass over the whole pg that did nothing means we are waiting
+    // on objects to age; tell the osd so that it backs off.
+    dout(20) << __func__ << " wrapped around, "
+	     << (agent_state->progress ? "" : "no ") << "progress" << dendl;
+    progress = agent_state->progress;
+    agent_state->progress = false;
+    next = hobject_t();
+  }
+  agent_state->position = next;
+  agent_choose_mode();
+  unlock();
+  return progress;
+}
+
+void ReplicatedPG::hit_set_load_archive()
+{
+  if (hit_set_archive.size() >= info.hit_set.history.size())
+    return;
+
+  dout(10) << __func__ << dendl;
+  for (list<pg_hit_set_info_t>::reverse_iterator p =
+	 info.hit_set.history.rbegin();
+       p != info.hit_set.history.rend();
+       ++p) {
+    if (hit_set_archive.have(p->begin.sec()))
+      continue;
+    hobject_t oid = get_hit_set_archive_object(p->begin, p->end);
+    if (is_degraded_object(oid) || is_missing_object(oid)) {
+      dout(10) << __func__ << " " << oid << " is degraded, skipping" << dendl;
+      continue;
+    }
+    ObjectContextRef obc = get_object_context(oid, false);
+    if (!obc) {
+      derr << __func__ << ": could not load hitset " << oid << dendl;
+      continue;
+    }
+
+    bufferlist bl;
+    obc->ondisk_read_lock();
+    int r = osd->store->read(coll, get_local_oid(oid), 0, 0, bl);
+    obc->ondisk_read_unlock();
+    if (r < 0) {
+      derr << __func__ << ": could not read hitset " << oid << ": "
+	   << cpp_strerror(r) << dendl;
+      continue;
+    }
+    HitSetRef hs(new HitSet);
+    bufferlist::iterator pbl = bl.begin();
+    ::decode(*hs, pbl);
+    hit_set_archive.add(p->begin.sec(), hs);
+  }
+}
+
+bool ReplicatedPG::agent_maybe_flush(ObjectContextRef& obc)
+{
+  if (!obc->obs.oi.is_dirty()) {
+    dout(20) << __func__ << " skip (clean) " << obc->obs.oi << dendl;
+    return false;
+  }
+
+  utime_t now = ceph_clock_now(cct);
+  if (obc->obs.oi.mtime + utime_t(pool.info.cache_min_flush_age, 0) > now) {
+    dout(20) << __func__ << " skip (too young) " << obc->obs.oi << dendl;
+    osd->logger->inc(l_osd_agent_skip);
+    return false;
+  }
+
+  if (flush_ops.count(obc->obs.oi.soid)) {
+    dout(20) << __func__ << " skip (flushing) " << obc->obs.oi << dendl;
+    osd->logger->inc(l_osd_agent_skip);
+    return false;
+  }
+
+  dout(10) << __func__ << " flushing " << obc->obs.oi << dendl;
+
+  // flush anything old enough; how hot it is does not matter, it has
+  // to reach the base pool before it can ever be evicted.
+  vector<OSDOp> ops;
+  tid_t rep_tid = osd->get_tid();
+  osd_reqid_t reqid(osd->get_cluster_msgr_name(), 0, rep_tid);
+  OpContext *ctx = new OpContext(OpRequestRef(), reqid, ops,
+				 &obc->obs, obc->ssc, this);
+  ctx->obc = obc;
+  int result = start_flush(ctx, false);
+  if (result != -EINPROGRESS) {
+    dout(10) << __func__ << " start_flush() failed " << obc->obs.oi
+	     << " with " << result << dendl;
+    close_op_ctx(ctx);
+    osd->logger->inc(l_osd_agent_skip);
+    return false;
+  }
+
+  osd->agent_start_op();
+  osd->logger->inc(l_osd_agent_flush);
+  return true;
+}
+
+bool ReplicatedPG::agent_maybe_evict(ObjectContextRef& obc)
+{
+  const hobject_t& soid = obc->obs.oi.soid;
+  if (obc->obs.oi.is_dirty()) {
+    dout(20) << __func__ << " skip (dirty) " << obc->obs.oi << dendl;
+    return false;
+  }
+  if (!obc->obs.oi.watchers.empty()) {
+    dout(20) << __func__ << " skip (watchers) " << obc->obs.oi << dendl;
+    osd->logger->inc(l_osd_agent_skip);
+    return false;
+  }
+
+  if (agent_state->evict_mode != TierAgentState::EVICT_MODE_FULL) {
+    utime_t now = ceph_clock_now(cct);
+    if (obc->obs.oi.mtime + utime_t(pool.info.cache_min_evict_age, 0) > now) {
+      dout(20) << __func__ << " skip (too young) " << obc->obs.oi << dendl;
+      osd->logger->inc(l_osd_agent_skip);
+      return false;
+    }
+
+    // is this object cold enough?  evict it if it is among the coldest
+    // evict_effort fraction of what we have seen.
+    int32_t temp = hit_set_archive.get_temp(soid);
+    agent_state->temp_hist.add(temp);
+    uint64_t temp_lower = 0, temp_upper = 0;
+    agent_state->temp_hist.get_position_micro(temp, &temp_lower, &temp_upper);
+
+    dout(20) << __func__
+	     << " temp " << temp
+	     << " pos " << temp_lower << "-" << temp_upper
+	     << ", evict_effort " << agent_state->evict_effort
+	     << dendl;
+    if (temp_lower >= agent_state->evict_effort) {
+      osd->logger->inc(l_osd_agent_skip);
+      return false;
+    }
+  }
+
+  if (!obc->rwstate.get_write_lock()) {
+    dout(20) << __func__ << " skip (busy) " << obc->obs.oi << dendl;
+    osd->logger->inc(l_osd_agent_skip);
+    return false;
+  }
+
+  dout(10) << __func__ << " evicting " << obc->obs.oi << dendl;
+  RepGather *repop = simple_repop_create(obc);
+  OpContext *ctx = repop->ctx;
+  ctx->lock_to_release = OpContext::W_LOCK;
+  ctx->at_version = get_next_version();
+  assert(ctx->new_obs.exists);
+  int r = _delete_head(ctx, true);
+  assert(r == 0);
+  finish_ctx(ctx);
+  simple_repop_submit(repop);
+  osd->logger->inc(l_osd_agent_evict);
+  return true;
+}
+
+void ReplicatedPG::agent_choose_mode()
+{
+  uint64_t divisor = MAX(pool.info.get_pg_num(), 1);
+
+  // hit set objects can be neither flushed nor evicted; do not count
+  // them against the targets.
+  uint64_t num_user_objects = info.stats.stats.sum.num_objects;
+  uint64_t unflushable = info.hit_set.history.size();
+  if (num_user_objects > unflushable)
+    num_user_objects -= unflushable;
+  else
+    num_user_objects = 0;
+  int64_t num_dirty = info.stats.stats.sum.num_objects_dirty;
+  if (num_dirty < 0)
+    num_dirty = 0;
+
+  // how dirty and how full are we, in millionths of this pg's share
+  // of the targets
+  uint64_t dirty_micro = 0;
+  uint64_t full_micro = 0;
+  if (pool.info.target_max_bytes && num_user_objects > 0) {
+    uint64_t avg_size = info.stats.stats.sum.num_bytes / num_user_objects;
+    uint64_t target = MAX(pool.info.target_max_bytes / divisor, 1);
+    dirty_micro = num_dirty * avg_size * 1000000 / target;
+    full_micro = num_user_objects * avg_size * 1000000 / target;
+  }
+  if (pool.info.target_max_objects) {
+    uint64_t target = MAX(pool.info.target_max_objects / divisor, 1);
+    uint64_t dirty_objects_micro = num_dirty * 1000000 / target;
+    if (dirty_objects_micro > dirty_micro)
+      dirty_micro = dirty_objects_micro;
+    uint64_t full_objects_micro = num_user_objects * 1000000 / target;
+    if (full_objects_micro > full_micro)
+      full_micro = full_objects_micro;
+  }
+  dout(20) << __func__ << " dirty " << ((float)dirty_micro / 1000000.0)
+	   << " full " << ((float)full_micro / 1000000.0)
+	   << dendl;
+
+  // flush mode
+  TierAgentState::flush_mode_t flush_mode = TierAgentState::FLUSH_MODE_IDLE;
+  if (dirty_micro > pool.info.cache_target_dirty_ratio_micro)
+    flush_mode = TierAgentState::FLUSH_MODE_ACTIVE;
+
+  // evict mode
+  TierAgentState::evict_mode_t evict_mode = TierAgentState::EVICT_MODE_IDLE;
+  unsigned evict_effort = 0;
+  if (full_micro > 1000000) {
+    // evict anything clean
+    evict_mode = TierAgentState::EVICT_MODE_FULL;
+    evict_effort = 1000000;
+  } else if (full_micro > pool.info.cache_target_full_ratio_micro) {
+    // effort in (0..1] based on where we are between the target and
+    // completely full
+    evict_mode = TierAgentState::EVICT_MODE_SOME;
+    uint64_t over = full_micro - pool.info.cache_target_full_ratio_micro;
+    uint64_t span = 1000000 - pool.info.cache_target_full_ratio_micro;
+    evict_effort = MAX(over * 1000000 / span,
+		       (unsigned)(1000000.0 *
+				  cct->_conf->osd_agent_min_evict_effort));
+
+    // quantize effort to avoid too much reordering in the agent queue
+    uint64_t inc = cct->_conf->osd_agent_quantize_effort * 1000000;
+    if (inc > 0) {
+      evict_effort -= evict_effort % inc;
+      if (evict_effort < inc)
+	evict_effort = inc;
+    }
+    if (evict_effort > 1000000)
+      evict_effort = 1000000;
+  }
+
+  bool old_idle = agent_state->is_idle();
+  if (flush_mode != agent_state->flush_mode) {
+    dout(5) << __func__ << " flush_mode "
+	    << TierAgentState::get_flush_mode_name(agent_state->flush_mode)
+	    << " -> "
+	    << TierAgentState::get_flush_mode_name(flush_mode)
+	    << dendl;
+    agent_state->flush_mode = flush_mode;
+  }
+  if (evict_mode != agent_state->evict_mode) {
+    dout(5) << __func__ << " evict_mode "
+	    << TierAgentState::get_evict_mode_name(agent_state->evict_mode)
+	    << " -> "
+	    << TierAgentState::get_evict_mode_name(evict_mode)
+	    << dendl;
+    agent_state->evict_mode = evict_mode;
+  }
+  uint64_t old_effort = agent_state->evict_effort;
+  if (evict_effort != agent_state->evict_effort) {
+    dout(5) << __func__ << " evict_effort "
+	    << ((float)agent_state->evict_effort / 1000000.0)
+	    << " -> "
+	    << ((float)evict_effort / 1000000.0)
+	    << dendl;
+    agent_state->evict_effort = evict_effort;
+  }
+
+  // evict_effort doubles as the priority of all of the pg's agent
+  // work, flushing included.
+  if (agent_state->is_idle()) {
+    if (!old_idle)
+      osd->agent_disable_pg(this, old_effort);
+  } else {
+    if (old_idle)
+      osd->agent_enable_pg(this, agent_state->evict_effort);
+    else if (old_effort != agent_state->evict_effort)
+      osd->agent_adjust_pg(this, old_effort, agent_state->evict_effort);
+  }
+}
+
+
 // ==========================================================================================
 // SCRUB
 
@@ -9487,7 +10433,7 @@ void ReplicatedPG::_scrub(ScrubMap& scrubmap)
     bv.push_back(p->second.attrs[OI_ATTR]);
     object_info_t oi(bv);
 
-    if (oi.size != p->second.size) {
+    if (pgbackend->get_ondisk_size(oi.size) != p->second.size) {
       osd->clog.error() << mode << " " << info.pgid << " " << soid
 			<< " on disk size (" << p->second.size
 			<< ") does not match object info size (" << oi.size << ")";
@@ -9496,7 +10442,11 @@ void ReplicatedPG::_scrub(ScrubMap& scrubmap)
 
     dout(20) << mode << "  " << soid << " " << oi << dendl;
 
-    stat.num_bytes += p->second.size;
+    // stats count logical bytes, which a shard does not hold
+    if (pool.info.is_erasure())
+      stat.num_bytes += oi.size;
+    else
+      stat.num_bytes += p->second.size;
 
     if (oi.is_dirty())
       ++stat.num_objects_dirty;
@@ -9676,6 +10626,8 @@ ReplicatedPG::TrimmingObjects::TrimmingObjects(my_context ctx)
     NamedState(context< SnapTrimmer >().pg->cct, "Trimming/TrimmingObjects")
 {
   context< SnapTrimmer >().log_enter(state_name);
+  // each batch's repop requeues us when it completes
+  context< SnapTrimmer >().requeue = false;
 }
 
 void ReplicatedPG::TrimmingObjects::exit()
@@ -9699,24 +10651,56 @@ boost::statechart::result ReplicatedPG::TrimmingObjects::react(const SnapTrim&)
 
   dout(10) << "TrimmingObjects: trimming snap " << snap_to_trim << dendl;
 
+  // keep one batch in flight
+  for (set<RepGather *>::iterator i = repops.begin();
+       i != repops.end();
+       repops.erase(i++)) {
+    if (!(*i)->applied || !(*i)->waitfor_ack.empty()) {
+      dout(10) << "TrimmingObjects: waiting on " << **i << dendl;
+      return discard_event();
+    } else {
+      (*i)->put();
+    }
+  }
+
+  utime_t retry;
+  unsigned max = pg->osd->get_snap_trim_budget(
+    MAX(1, pg->cct->_conf->osd_snap_trim_batch_objects), &retry);
+  if (!max) {
+    dout(10) << "TrimmingObjects: throttled until " << retry << dendl;
+    pg->osd->logger->inc(l_osd_snap_trim_throttled);
+    pg->osd->queue_for_snap_trim_at(pg, retry);
+    return discard_event();
+  }
+
   // Get next
-  int r = pg->snap_mapper.get_next_object_to_trim(snap_to_trim, &pos);
+  vector<hobject_t> hoids;
+  int r = pg->snap_mapper.get_next_objects_to_trim(snap_to_trim, max, &hoids);
   if (r != 0 && r != -ENOENT) {
     derr << __func__ << ": get_next returned " << cpp_strerror(r) << dendl;
     assert(0);
   } else if (r == -ENOENT) {
     // Done!
     dout(10) << "TrimmingObjects: got ENOENT" << dendl;
+    pg->osd->snap_trim_done(max, 0, 0);
     post_event(SnapTrim());
     return transit< WaitingOnReplicas >();
   }
 
-  dout(10) << "TrimmingObjects react trimming " << pos << dendl;
-  RepGather *repop = pg->trim_object(pos);
+  pos = hoids.back();
+  dout(10) << "TrimmingObjects react trimming " << hoids.size()
+	   << " objects through " << pos << dendl;
+  uint64_t bytes = 0;
+  RepGather *repop = pg->trim_objects(hoids, &bytes);
   assert(repop);
   repop->queue_snap_trimmer = true;
   repops.insert(repop->get());
   pg->simple_repop_submit(repop);
+
+  pg->osd->snap_trim_done(max, hoids.size(), bytes);
+  pg->osd->logger->inc(l_osd_snap_trim, hoids.size());
+  pg->osd->logger->inc(l_osd_snap_trim_bytes, bytes);
+  pg->osd->logger->inc(l_osd_snap_trim_txn);
   return discard_event();
 }
 /* WaitingOnReplicasObjects */
@@ -24,6 +24,7 @@
 #include "common/cmdparse.h"
 
 #include "HitSet.h"
+#include "TierAgentState.h"
 #include "OSD.h"
 #include "PG.h"
 #include "Watch.h"
@@ -185,6 +186,7 @@ public:
 
   friend class CopyFromCallback;
   friend class PromoteCallback;
+  friend struct C_OnECRead;
 
   struct FlushOp {
     OpContext *ctx;             ///< the parent OpContext
@@ -363,10 +365,13 @@ public:
     vector<pg_log_entry_t> log;
 
     interval_set<uint64_t> modified_ranges;
+    bool extents_known;                // log entry can carry logged_extents
+    interval_set<uint64_t> logged_extents;
     ObjectContextRef obc;
     map<hobject_t,ObjectContextRef> src_obc;
     ObjectContextRef clone_obc;    // if we created a clone
     ObjectContextRef snapset_obc;  // if we created/deleted a snapdir
+    list<ObjectContextRef> batch_obcs;  // other objects in a batched snap trim
 
     int data_off;        // FIXME: we may want to kill this msgr hint off at some point!
 
@@ -380,6 +385,10 @@ public:
 
     CopyFromCallback *copy_cb;
 
+    /// erasure coded reads, by op, and whether one is still in flight
+    map<OSDOp*, pair<int, bufferlist> > async_read_results;
+    bool async_read_waiting;
+
     hobject_t new_temp_oid, discard_temp_oid;  ///< temp objects we should start/stop tracking
 
     enum { W_LOCK, R_LOCK, NONE } lock_to_release;
@@ -394,11 +403,12 @@ public:
       new_obs(_obs->oi, _obs->exists),
       modify(false), user_modify(false), undirty(false),
       bytes_written(0), bytes_read(0), user_at_version(0),
-      current_osd_subop_num(0),
+      current_osd_subop_num(0), extents_known(false),
       data_off(0), reply(NULL), pg(_pg),
       num_read(0),
       num_write(0),
       copy_cb(NULL),
+      async_read_waiting(false),
       lock_to_release(NONE) {
       if (_ssc) {
 	new_snapset = _ssc->snapset;
@@ -573,6 +583,7 @@ protected:
   // hot/cold tracking
   boost::scoped_ptr<HitSet> hit_set;  ///< currently accumulating HitSet
   utime_t hit_set_start_stamp;    ///< time the current HitSet started recording
+  HitSetArchive hit_set_archive;  ///< archived HitSets loaded so far
 
   void hit_set_clear();     ///< discard any HitSet state
   void hit_set_setup();     ///< initialize HitSet state
@@ -580,10 +591,33 @@ protected:
   void hit_set_persist();   ///< persist hit info
   bool hit_set_apply_log(); ///< apply log entries to update in-memory HitSet
   void hit_set_trim(RepGather *repop, unsigned max); ///< discard old HitSets
+  void hit_set_load_archive();  ///< load any archived HitSets we lack
+
+  /**
+   * estimate how often oid was accessed lately
+   *
+   * Sum the hits on oid in the current HitSet and the newest max_sets
+   * archived ones, halving each archived set's hits for every
+   * halflife sets it is older (0 to not decay).  Only counting
+   * HitSets can tell more than whether oid was accessed at all in a
+   * period.
+   */
+  unsigned hit_set_get_count(const hobject_t& oid, unsigned max_sets,
+			     unsigned halflife);
 
   hobject_t get_hit_set_current_object(utime_t stamp);
   hobject_t get_hit_set_archive_object(utime_t start, utime_t end);
 
+  // agent
+  boost::scoped_ptr<TierAgentState> agent_state;
+
+  void agent_setup();       ///< initialize agent state
+  void agent_clear();       ///< discard agent state and leave the queue
+  bool agent_maybe_flush(ObjectContextRef& obc);  ///< maybe flush
+  bool agent_maybe_evict(ObjectContextRef& obc);  ///< maybe evict
+  /// recompute flush/evict modes from the pg stats and requeue
+  void agent_choose_mode();
+
   /// true if we can send an ondisk/commit for v
   bool already_complete(eversion_t v) {
     for (xlist<RepGather*>::iterator i = repop_queue.begin();
@@ -773,7 +807,8 @@ protected:
    * This helper function is called from do_op if the ObjectContext lookup fails.
    * @returns true if the caching code is handling the Op, false otherwise.
    */
-  inline bool maybe_handle_cache(OpRequestRef op, ObjectContextRef obc, int r);
+  inline bool maybe_handle_cache(OpRequestRef op, const hobject_t& oid,
+				 ObjectContextRef obc, int r);
   /**
    * This helper function tells the client to redirect their request elsewhere.
    */
@@ -788,6 +823,12 @@ protected:
    */
   bool can_skip_promote(OpRequestRef op, ObjectContextRef obc);
 
+  /**
+   * Check if a read that missed oid is worth a promote, or should
+   * rather be redirected to the base pool (see cache_min_promote_hits)
+   */
+  bool read_wants_promote(const hobject_t& oid);
+
   int prepare_transaction(OpContext *ctx);
   
   // pg on-disk content
@@ -869,6 +910,7 @@ protected:
   };
   struct C_OSD_OndiskWriteUnlock : public Context {
     ObjectContextRef obc, obc2, obc3;
+    list<ObjectContextRef> others;
     C_OSD_OndiskWriteUnlock(
       ObjectContextRef o,
       ObjectContextRef o2 = ObjectContextRef(),
@@ -879,6 +921,10 @@ protected:
 	obc2->ondisk_write_unlock();
       if (obc3)
 	obc3->ondisk_write_unlock();
+      for (list<ObjectContextRef>::iterator p = others.begin();
+	   p != others.end();
+	   ++p)
+	(*p)->ondisk_write_unlock();
     }
   };
   struct C_OSD_OndiskWriteUnlockList : public Context {
@@ -990,6 +1036,8 @@ protected:
   bool pgls_filter(PGLSFilter *filter, hobject_t& sobj, bufferlist& outdata);
   int get_pgls_filter(bufferlist::iterator& iter, PGLSFilter **pfilter);
 
+  PGBackend *build_pg_backend(OSDService *o, const PGPool &_pool, pg_t p);
+
 public:
   ReplicatedPG(OSDService *o, OSDMapRef curmap,
 	       const PGPool &_pool, pg_t p, const hobject_t& oid,
@@ -1012,9 +1060,15 @@ public:
     ThreadPool::TPHandle &handle);
   void do_backfill(OpRequestRef op);
 
-  RepGather *trim_object(const hobject_t &coid);
+  void trim_object(const hobject_t &coid, OpContext *ctx,
+		   uint64_t *bytes_released);
+  RepGather *trim_objects(const vector<hobject_t> &coids,
+			  uint64_t *bytes_released);
   void snap_trimmer();
+  bool agent_work(int max);
   int do_osd_ops(OpContext *ctx, vector<OSDOp>& ops);
+  int ec_check_op(OpContext *ctx, OSDOp& osd_op);
+  int do_ec_read(OpContext *ctx, OSDOp& osd_op, bufferlist *bl);
 
   int do_tmapup(OpContext *ctx, bufferlist::iterator& bp, OSDOp& osd_op);
   int do_tmapup_slow(OpContext *ctx, bufferlist::iterator& bp, OSDOp& osd_op, bufferlist& bl);
@@ -0,0 +1,104 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * Copyright (C) 2013 Sage Weil <sage@inktank.com>
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#ifndef CEPH_OSD_TIERAGENT_H
+#define CEPH_OSD_TIERAGENT_H
+
+#include "include/histogram.h"
+#include "common/hobject.h"
+#include "common/Formatter.h"
+#include "HitSet.h"
+
+/**
+ * per-PG state of the cache tier agent
+ *
+ * The agent walks the objects of a cache pool PG, flushing dirty
+ * objects to the base pool and evicting clean, cold ones.  How hot an
+ * object is comes from the PG's archived HitSets (see
+ * HitSetArchive::get_temp()).
+ */
+struct TierAgentState {
+  /// current position iterating across pg
+  hobject_t position;
+
+  /// histogram of the temperatures we have come across
+  pow2_hist_t temp_hist;
+  int hist_age;
+
+  enum flush_mode_t {
+    FLUSH_MODE_IDLE,   // nothing to flush
+    FLUSH_MODE_ACTIVE, // flush what we can to bring down dirty count
+  } flush_mode;     ///< current flush behavior
+  static const char *get_flush_mode_name(flush_mode_t m) {
+    switch (m) {
+    case FLUSH_MODE_IDLE: return "idle";
+    case FLUSH_MODE_ACTIVE: return "active";
+    default: assert(0 == "bad flush mode");
+    }
+  }
+  const char *get_flush_mode_name() const {
+    return get_flush_mode_name(flush_mode);
+  }
+
+  enum evict_mode_t {
+    EVICT_MODE_IDLE,      // no need to evict anything
+    EVICT_MODE_SOME,      // evict some things as we are near the target
+    EVICT_MODE_FULL,      // evict anything
+  } evict_mode;     ///< current evict behavior
+  static const char *get_evict_mode_name(evict_mode_t m) {
+    switch (m) {
+    case EVICT_MODE_IDLE: return "idle";
+    case EVICT_MODE_SOME: return "some";
+    case EVICT_MODE_FULL: return "full";
+    default: assert(0 == "bad evict mode");
+    }
+  }
+  const char *get_evict_mode_name() const {
+    return get_evict_mode_name(evict_mode);
+  }
+
+  /// approximate ratio of objects (assuming they are uniformly
+  /// distributed) that i should aim to evict, in millionths
+  unsigned evict_effort;
+
+  /// made progress since the last time we started over
+  bool progress;
+
+  TierAgentState()
+    : hist_age(0),
+      flush_mode(FLUSH_MODE_IDLE),
+      evict_mode(EVICT_MODE_IDLE),
+      evict_effort(0),
+      progress(false)
+  {}
+
+  /// false if we have any work to do
+  bool is_idle() const {
+    return
+      flush_mode == FLUSH_MODE_IDLE &&
+      evict_mode == EVICT_MODE_IDLE;
+  }
+
+  void dump(Formatter *f) const {
+    f->dump_string("flush_mode", get_flush_mode_name());
+    f->dump_string("evict_mode", get_evict_mode_name());
+    f->dump_unsigned("evict_effort", evict_effort);
+    f->dump_stream("position") << position;
+    f->open_object_section("temp_hist");
+    temp_hist.dump(f);
+    f->close_section();
+  }
+};
+
+#endif
@@ -150,6 +150,35 @@ void Notify::start_watcher(WatchRef watch)
   watchers.insert(watch);
 }
 
+void Notify::send_batch(const NotifyBatch &batch)
+{
+  for (NotifyBatch::const_iterator i = batch.begin();
+       i != batch.end();
+       ++i) {
+    const vector<uint64_t> &cookies = i->second;
+    assert(!cookies.empty());
+    if (cookies.size() > 1 &&
+	(i->first->get_features() & CEPH_FEATURE_OSD_NOTIFY_BATCH)) {
+      dout(10) << "send_batch " << cookies.size() << " watches to "
+	       << i->first->get_peer_addr() << dendl;
+      MWatchNotify *notify_msg = new MWatchNotify(
+	cookies[0], version, notify_id,
+	WATCH_NOTIFY, payload);
+      notify_msg->extra_cookies.assign(cookies.begin() + 1, cookies.end());
+      osd->send_message_osd_client(notify_msg, i->first.get());
+      continue;
+    }
+    for (vector<uint64_t>::const_iterator j = cookies.begin();
+	 j != cookies.end();
+	 ++j) {
+      MWatchNotify *notify_msg = new MWatchNotify(
+	*j, version, notify_id,
+	WATCH_NOTIFY, payload);
+      osd->send_message_osd_client(notify_msg, i->first.get());
+    }
+  }
+}
+
 void Notify::complete_watcher(WatchRef watch)
 {
   Mutex::Locker l(lock);
@@ -380,14 +409,18 @@ void Watch::remove()
   discard_state();
 }
 
-void Watch::start_notify(NotifyRef notif)
+void Watch::start_notify(NotifyRef notif, NotifyBatch *batch)
 {
   dout(10) << "start_notify " << notif->notify_id << dendl;
   assert(in_progress_notifies.find(notif->notify_id) ==
 	 in_progress_notifies.end());
   in_progress_notifies[notif->notify_id] = notif;
   notif->start_watcher(self.lock());
-  if (connected())
+  if (!connected())
+    return;
+  if (batch)
+    (*batch)[conn].push_back(cookie);
+  else
     send_notify(notif);
 }
 
@@ -42,6 +42,9 @@ class Notify;
 typedef std::tr1::shared_ptr<Notify> NotifyRef;
 typedef std::tr1::weak_ptr<Notify> WNotifyRef;
 
+/// watch cookies to notify, grouped by client connection
+typedef std::map<ConnectionRef, std::vector<uint64_t> > NotifyBatch;
+
 struct CancelableContext;
 
 /**
@@ -126,6 +129,11 @@ public:
     WatchRef watcher ///< [in] watcher to complete
     );
 
+  /// Sends one message per connection where the client supports it
+  void send_batch(
+    const NotifyBatch &batch ///< [in] cookies collected by start_notify
+    );
+
   /// Called once per NotifyAck
   void complete_watcher(
     WatchRef watcher ///< [in] watcher to complete
@@ -225,9 +233,10 @@ public:
   /// Called on unwatch
   void remove();
 
-  /// Adds notif as in-progress notify
+  /// Adds notif as in-progress notify, deferring the send to batch if set
   void start_notify(
-    NotifyRef notif ///< [in] Reference to new in-progress notify
+    NotifyRef notif,       ///< [in] Reference to new in-progress notify
+    NotifyBatch *batch = 0 ///< [out] per-connection cookies to send to
     );
 
   /// Removes timed out notify
@@ -64,11 +64,17 @@ string ceph_osd_flag_string(unsigned flags)
 // -- osd_reqid_t --
 void osd_reqid_t::encode(bufferlist &bl) const
 {
-  ENCODE_START(2, 2, bl);
-  ::encode(name, bl);
-  ::encode(tid, bl);
-  ::encode(inc, bl);
-  ENCODE_FINISH(bl);
+  encode_bounded(*this, bl);
+}
+
+void osd_reqid_t::encode(bufferlist::contiguous_appender& p,
+			 uint64_t features) const
+{
+  BOUNDED_ENCODE_START(2, 2, p);
+  ::encode(name, p);
+  ::encode(tid, p);
+  ::encode(inc, p);
+  BOUNDED_ENCODE_FINISH(p);
 }
 
 void osd_reqid_t::decode(bufferlist::iterator &bl)
@@ -96,20 +102,26 @@ void osd_reqid_t::generate_test_instances(list<osd_reqid_t*>& o)
 // -- object_locator_t --
 
 void object_locator_t::encode(bufferlist& bl) const
+{
+  encode_bounded(*this, bl);
+}
+
+void object_locator_t::encode(bufferlist::contiguous_appender& p,
+			      uint64_t features) const
 {
   // verify that nobody's corrupted the locator
   assert(hash == -1 || key.empty());
   __u8 encode_compat = 3;
-  ENCODE_START(6, encode_compat, bl);
-  ::encode(pool, bl);
+  BOUNDED_ENCODE_START(6, encode_compat, p);
+  ::encode(pool, p);
   int32_t preferred = -1;  // tell old code there is no preferred osd (-1).
-  ::encode(preferred, bl);
-  ::encode(key, bl);
-  ::encode(nspace, bl);
-  ::encode(hash, bl);
+  ::encode(preferred, p);
+  ::encode(key, p);
+  ::encode(nspace, p);
+  ::encode(hash, p);
   if (hash != -1)
     encode_compat = MAX(encode_compat, 6); // need to interpret the hash
-  ENCODE_FINISH_NEW_COMPAT(bl, encode_compat);
+  BOUNDED_ENCODE_FINISH_NEW_COMPAT(p, encode_compat);
 }
 
 void object_locator_t::decode(bufferlist::iterator& p)
@@ -755,6 +767,16 @@ void pg_pool_t::dump(Formatter *f) const
   f->close_section(); // hit_set_params
   f->dump_unsigned("hit_set_period", hit_set_period);
   f->dump_unsigned("hit_set_count", hit_set_count);
+  f->dump_unsigned("hit_set_halflife", hit_set_halflife);
+  f->dump_unsigned("target_max_bytes", target_max_bytes);
+  f->dump_unsigned("target_max_objects", target_max_objects);
+  f->dump_unsigned("cache_target_dirty_ratio_micro",
+		   cache_target_dirty_ratio_micro);
+  f->dump_unsigned("cache_target_full_ratio_micro",
+		   cache_target_full_ratio_micro);
+  f->dump_unsigned("cache_min_flush_age", cache_min_flush_age);
+  f->dump_unsigned("cache_min_evict_age", cache_min_evict_age);
+  f->dump_unsigned("cache_min_promote_hits", cache_min_promote_hits);
 }
 
 
@@ -978,7 +1000,7 @@ void pg_pool_t::encode(bufferlist& bl, uint64_t features) const
   }
 
   __u8 encode_compat = 5;
-  ENCODE_START(11, encode_compat, bl);
+  ENCODE_START(13, encode_compat, bl);
   ::encode(type, bl);
   ::encode(size, bl);
   ::encode(crush_ruleset, bl);
@@ -1011,12 +1033,20 @@ void pg_pool_t::encode(bufferlist& bl, uint64_t features) const
   ::encode(hit_set_params, bl);
   ::encode(hit_set_period, bl);
   ::encode(hit_set_count, bl);
+  ::encode(target_max_bytes, bl);
+  ::encode(target_max_objects, bl);
+  ::encode(cache_target_dirty_ratio_micro, bl);
+  ::encode(cache_target_full_ratio_micro, bl);
+  ::encode(cache_min_flush_age, bl);
+  ::encode(cache_min_evict_age, bl);
+  ::encode(hit_set_halflife, bl);
+  ::encode(cache_min_promote_hits, bl);
   ENCODE_FINISH_NEW_COMPAT(bl, encode_compat);
 }
 
 void pg_pool_t::decode(bufferlist::iterator& bl)
 {
-  DECODE_START_LEGACY_COMPAT_LEN(11, 5, 5, bl);
+  DECODE_START_LEGACY_COMPAT_LEN(13, 5, 5, bl);
   ::decode(type, bl);
   ::decode(size, bl);
   ::decode(crush_ruleset, bl);
@@ -1090,6 +1120,30 @@ void pg_pool_t::decode(bufferlist::iterator& bl)
     hit_set_period = def.hit_set_period;
     hit_set_count = def.hit_set_count;
   }
+  if (struct_v >= 12) {
+    ::decode(target_max_bytes, bl);
+    ::decode(target_max_objects, bl);
+    ::decode(cache_target_dirty_ratio_micro, bl);
+    ::decode(cache_target_full_ratio_micro, bl);
+    ::decode(cache_min_flush_age, bl);
+    ::decode(cache_min_evict_age, bl);
+  } else {
+    pg_pool_t def;
+    target_max_bytes = def.target_max_bytes;
+    target_max_objects = def.target_max_objects;
+    cache_target_dirty_ratio_micro = def.cache_target_dirty_ratio_micro;
+    cache_target_full_ratio_micro = def.cache_target_full_ratio_micro;
+    cache_min_flush_age = def.cache_min_flush_age;
+    cache_min_evict_age = def.cache_min_evict_age;
+  }
+  if (struct_v >= 13) {
+    ::decode(hit_set_halflife, bl);
+    ::decode(cache_min_promote_hits, bl);
+  } else {
+    pg_pool_t def;
+    hit_set_halflife = def.hit_set_halflife;
+    cache_min_promote_hits = def.cache_min_promote_hits;
+  }
   DECODE_FINISH(bl);
   calc_pg_masks();
 }
@@ -1136,6 +1190,14 @@ void pg_pool_t::generate_test_instances(list<pg_pool_t*>& o)
   a.hit_set_params = HitSet::Params(new BloomHitSet::Params);
   a.hit_set_period = 3600;
   a.hit_set_count = 8;
+  a.hit_set_halflife = 2;
+  a.target_max_bytes = 1238132132;
+  a.target_max_objects = 1232132;
+  a.cache_target_dirty_ratio_micro = 187232;
+  a.cache_target_full_ratio_micro = 987222;
+  a.cache_min_flush_age = 231;
+  a.cache_min_evict_age = 2321;
+  a.cache_min_promote_hits = 3;
   o.push_back(new pg_pool_t(a));
 }
 
@@ -1172,7 +1234,13 @@ ostream& operator<<(ostream& out, const pg_pool_t& p)
     out << " hit_set " << p.hit_set_params
 	<< " " << p.hit_set_period << "s"
 	<< " x" << p.hit_set_count;
+    if (p.hit_set_halflife)
+      out << " halflife " << p.hit_set_halflife;
   }
+  if (p.target_max_bytes)
+    out << " target_bytes " << p.target_max_bytes;
+  if (p.target_max_objects)
+    out << " target_objects " << p.target_max_objects;
   return out;
 }
 
@@ -1762,7 +1830,7 @@ void pg_history_t::generate_test_instances(list<pg_history_t*>& o)
 
 void pg_info_t::encode(bufferlist &bl) const
 {
-  ENCODE_START(29, 26, bl);
+  ENCODE_START(30, 26, bl);
   ::encode(pgid, bl);
   ::encode(last_update, bl);
   ::encode(last_complete, bl);
@@ -1774,12 +1842,13 @@ void pg_info_t::encode(bufferlist &bl) const
   ::encode(last_epoch_started, bl);
   ::encode(last_user_version, bl);
   ::encode(hit_set, bl);
+  ::encode(shard, bl);
   ENCODE_FINISH(bl);
 }
 
 void pg_info_t::decode(bufferlist::iterator &bl)
 {
-  DECODE_START_LEGACY_COMPAT_LEN(29, 26, 26, bl);
+  DECODE_START_LEGACY_COMPAT_LEN(30, 26, 26, bl);
   if (struct_v < 23) {
     old_pg_t opgid;
     ::decode(opgid, bl);
@@ -1815,6 +1884,10 @@ void pg_info_t::decode(bufferlist::iterator &bl)
     last_user_version = last_update.version;
   if (struct_v >= 29)
     ::decode(hit_set, bl);
+  if (struct_v >= 30)
+    ::decode(shard, bl);
+  else
+    shard = ghobject_t::NO_SHARD;
   DECODE_FINISH(bl);
 }
 
@@ -1844,6 +1917,7 @@ void pg_info_t::dump(Formatter *f) const
   f->open_object_section("hit_set_history");
   hit_set.dump(f);
   f->close_section();
+  f->dump_int("shard", shard);
 }
 
 void pg_info_t::generate_test_instances(list<pg_info_t*>& o)
@@ -1869,6 +1943,7 @@ void pg_info_t::generate_test_instances(list<pg_info_t*>& o)
     pg_hit_set_history_t::generate_test_instances(s);
     o.back()->hit_set = *s.back();
   }
+  o.back()->shard = 2;
 }
 
 // -- pg_notify_t --
@@ -2142,7 +2217,13 @@ void pg_log_entry_t::decode_with_checksum(bufferlist::iterator& p)
 
 void pg_log_entry_t::encode(bufferlist &bl) const
 {
-  ENCODE_START(8, 4, bl);
+  encode_bounded(*this, bl);
+}
+
+void pg_log_entry_t::encode(bufferlist::contiguous_appender& bl,
+			    uint64_t features) const
+{
+  BOUNDED_ENCODE_START(9, 4, bl);
   ::encode(op, bl);
   ::encode(soid, bl);
   ::encode(version, bl);
@@ -2165,12 +2246,14 @@ void pg_log_entry_t::encode(bufferlist &bl) const
     ::encode(prior_version, bl);
   ::encode(snaps, bl);
   ::encode(user_version, bl);
-  ENCODE_FINISH(bl);
+  ::encode(extents_known, bl);
+  ::encode(modified_extents, bl);
+  BOUNDED_ENCODE_FINISH(bl);
 }
 
 void pg_log_entry_t::decode(bufferlist::iterator &bl)
 {
-  DECODE_START_LEGACY_COMPAT_LEN(8, 4, 4, bl);
+  DECODE_START_LEGACY_COMPAT_LEN(9, 4, 4, bl);
   ::decode(op, bl);
   if (struct_v < 2) {
     sobject_t old_soid;
@@ -2212,6 +2295,13 @@ void pg_log_entry_t::decode(bufferlist::iterator &bl)
   else
     user_version = version.version;
 
+  if (struct_v >= 9) {
+    ::decode(extents_known, bl);
+    ::decode(modified_extents, bl);
+  } else {
+    extents_known = false;
+  }
+
   DECODE_FINISH(bl);
 }
 
@@ -2237,6 +2327,8 @@ void pg_log_entry_t::dump(Formatter *f) const
       f->dump_unsigned("snap", *p);
     f->close_section();
   }
+  if (extents_known)
+    f->dump_stream("modified_extents") << modified_extents;
 }
 
 void pg_log_entry_t::generate_test_instances(list<pg_log_entry_t*>& o)
@@ -2246,6 +2338,11 @@ void pg_log_entry_t::generate_test_instances(list<pg_log_entry_t*>& o)
   o.push_back(new pg_log_entry_t(MODIFY, oid, eversion_t(1,2), eversion_t(3,4),
 				 1, osd_reqid_t(entity_name_t::CLIENT(777), 8, 999),
 				 utime_t(8,9)));
+  o.push_back(new pg_log_entry_t(MODIFY, oid, eversion_t(1,3), eversion_t(1,2),
+				 2, osd_reqid_t(entity_name_t::CLIENT(777), 8, 1000),
+				 utime_t(8,10)));
+  o.back()->extents_known = true;
+  o.back()->modified_extents.insert(4096, 8192);
 }
 
 ostream& operator<<(ostream& out, const pg_log_entry_t& e)
@@ -2263,6 +2360,8 @@ ostream& operator<<(ostream& out, const pg_log_entry_t& e)
     }
     out << " snaps " << snaps;
   }
+  if (e.extents_known)
+    out << " extents " << e.modified_extents;
   return out;
 }
 
@@ -3373,7 +3472,7 @@ void ObjectRecoveryProgress::dump(Formatter *f) const
 
 void ObjectRecoveryInfo::encode(bufferlist &bl) const
 {
-  ENCODE_START(2, 1, bl);
+  ENCODE_START(3, 1, bl);
   ::encode(soid, bl);
   ::encode(version, bl);
   ::encode(size, bl);
@@ -3381,13 +3480,14 @@ void ObjectRecoveryInfo::encode(bufferlist &bl) const
   ::encode(ss, bl);
   ::encode(copy_subset, bl);
   ::encode(clone_subset, bl);
+  ::encode(delta_base, bl);
   ENCODE_FINISH(bl);
 }
 
 void ObjectRecoveryInfo::decode(bufferlist::iterator &bl,
 				int64_t pool)
 {
-  DECODE_START(2, bl);
+  DECODE_START(3, bl);
   ::decode(soid, bl);
   ::decode(version, bl);
   ::decode(size, bl);
@@ -3395,6 +3495,8 @@ void ObjectRecoveryInfo::decode(bufferlist::iterator &bl,
   ::decode(ss, bl);
   ::decode(copy_subset, bl);
   ::decode(clone_subset, bl);
+  if (struct_v >= 3)
+    ::decode(delta_base, bl);
   DECODE_FINISH(bl);
 
   if (struct_v < 2) {
@@ -3440,6 +3542,7 @@ void ObjectRecoveryInfo::dump(Formatter *f) const
   }
   f->dump_stream("copy_subset") << copy_subset;
   f->dump_stream("clone_subset") << clone_subset;
+  f->dump_stream("delta_base") << delta_base;
 }
 
 ostream& operator<<(ostream& out, const ObjectRecoveryInfo &inf)
@@ -3449,11 +3552,13 @@ ostream& operator<<(ostream& out, const ObjectRecoveryInfo &inf)
 
 ostream &ObjectRecoveryInfo::print(ostream &out) const
 {
-  return out << "ObjectRecoveryInfo("
+  out << "ObjectRecoveryInfo("
 	     << soid << "@" << version
 	     << ", copy_subset: " << copy_subset
-	     << ", clone_subset: " << clone_subset
-	     << ")";
+	     << ", clone_subset: " << clone_subset;
+  if (delta_base != eversion_t())
+    out << ", delta_base: " << delta_base;
+  return out << ")";
 }
 
 // -- PushReplyOp --
@@ -3464,32 +3569,40 @@ void PushReplyOp::generate_test_instances(list<PushReplyOp*> &o)
   o.back()->soid = hobject_t(sobject_t("asdf", 2));
   o.push_back(new PushReplyOp);
   o.back()->soid = hobject_t(sobject_t("asdf", CEPH_NOSNAP));
+  o.back()->delta_refused = true;
 }
 
 void PushReplyOp::encode(bufferlist &bl) const
 {
-  ENCODE_START(1, 1, bl);
+  ENCODE_START(2, 1, bl);
   ::encode(soid, bl);
+  ::encode(delta_refused, bl);
   ENCODE_FINISH(bl);
 }
 
 void PushReplyOp::decode(bufferlist::iterator &bl)
 {
-  DECODE_START(1, bl);
+  DECODE_START(2, bl);
   ::decode(soid, bl);
+  if (struct_v >= 2)
+    ::decode(delta_refused, bl);
+  else
+    delta_refused = false;
   DECODE_FINISH(bl);
 }
 
 void PushReplyOp::dump(Formatter *f) const
 {
   f->dump_stream("soid") << soid;
+  f->dump_bool("delta_refused", delta_refused);
 }
 
 ostream &PushReplyOp::print(ostream &out) const
 {
-  return out
-    << "PushReplyOp(" << soid
-    << ")";
+  out << "PushReplyOp(" << soid;
+  if (delta_refused)
+    out << " delta_refused";
+  return out << ")";
 }
 
 ostream& operator<<(ostream& out, const PushReplyOp &op)
@@ -132,12 +132,22 @@ struct object_locator_t {
     return pool == -1;
   }
 
+  void bound_encode(size_t& p, uint64_t features=0) const {
+    p += BOUNDED_ENCODE_HEADER_LEN;
+    ::bound_encode(pool, p);
+    p += sizeof(int32_t);  // preferred
+    ::bound_encode(key, p);
+    ::bound_encode(nspace, p);
+    ::bound_encode(hash, p);
+  }
+  void encode(bufferlist::contiguous_appender& p, uint64_t features=0) const;
   void encode(bufferlist& bl) const;
   void decode(bufferlist::iterator& p);
   void dump(Formatter *f) const;
   static void generate_test_instances(list<object_locator_t*>& o);
 };
 WRITE_CLASS_ENCODER(object_locator_t)
+WRITE_CLASS_BOUNDED_ENCODER(object_locator_t)
 
 inline bool operator==(const object_locator_t& l, const object_locator_t& r) {
   return l.pool == r.pool && l.key == r.key && l.nspace == r.nspace && l.hash == r.hash;
@@ -303,6 +313,16 @@ struct pg_t {
     ::encode(m_seed, bl);
     ::encode(m_preferred, bl);
   }
+  void bound_encode(size_t& p, uint64_t features=0) const {
+    p += sizeof(__u8) + sizeof(m_pool) + sizeof(m_seed) + sizeof(m_preferred);
+  }
+  void encode(bufferlist::contiguous_appender& p, uint64_t features=0) const {
+    __u8 v = 1;
+    ::encode(v, p);
+    ::encode(m_pool, p);
+    ::encode(m_seed, p);
+    ::encode(m_preferred, p);
+  }
   void decode(bufferlist::iterator& bl) {
     __u8 v;
     ::decode(v, bl);
@@ -319,6 +339,7 @@ struct pg_t {
   static void generate_test_instances(list<pg_t*>& o);
 };
 WRITE_CLASS_ENCODER(pg_t)
+WRITE_CLASS_BOUNDED_ENCODER(pg_t)
 
 inline bool operator<(const pg_t& l, const pg_t& r) {
   return l.pool() < r.pool() ||
@@ -520,8 +541,17 @@ public:
     bufferlist::iterator p = bl.begin();
     decode(p);
   }
+  void bound_encode(size_t& p, uint64_t features=0) const {
+    ::bound_encode(version, p);
+    ::bound_encode(epoch, p);
+  }
+  void encode(bufferlist::contiguous_appender& p, uint64_t features=0) const {
+    ::encode(version, p);
+    ::encode(epoch, p);
+  }
 };
 WRITE_CLASS_ENCODER(eversion_t)
+WRITE_CLASS_BOUNDED_ENCODER(eversion_t)
 
 inline bool operator==(const eversion_t& l, const eversion_t& r) {
   return (l.epoch == r.epoch) && (l.version == r.version);
@@ -824,6 +854,17 @@ public:
   HitSet::Params hit_set_params; ///< The HitSet params to use on this pool
   uint32_t hit_set_period;      ///< periodicity of HitSet segments (seconds)
   uint32_t hit_set_count;       ///< number of periods to retain
+  uint32_t hit_set_halflife;    ///< periods over which hits count half; 0 for never
+
+  uint64_t target_max_bytes;   ///< tiering: target max pool size
+  uint64_t target_max_objects; ///< tiering: target max pool object count
+
+  uint32_t cache_target_dirty_ratio_micro; ///< cache: fraction of target to leave dirty
+  uint32_t cache_target_full_ratio_micro;  ///< cache: fraction of target to fill before we evict in earnest
+
+  uint32_t cache_min_flush_age;  ///< minimum age (seconds) before we can flush
+  uint32_t cache_min_evict_age;  ///< minimum age (seconds) before we can evict
+  uint32_t cache_min_promote_hits; ///< recent hits before a read promotes
 
   pg_pool_t()
     : flags(0), type(0), size(0), min_size(0),
@@ -839,7 +880,15 @@ public:
       cache_mode(CACHEMODE_NONE),
       hit_set_params(),
       hit_set_period(0),
-      hit_set_count(0)
+      hit_set_count(0),
+      hit_set_halflife(0),
+      target_max_bytes(0),
+      target_max_objects(0),
+      cache_target_dirty_ratio_micro(400000),
+      cache_target_full_ratio_micro(800000),
+      cache_min_flush_age(0),
+      cache_min_evict_age(0),
+      cache_min_promote_hits(0)
   { }
 
   void dump(Formatter *f) const;
@@ -1408,14 +1457,18 @@ struct pg_info_t {
   pg_history_t history;
   pg_hit_set_history_t hit_set;
 
+  shard_t shard;             // erasure code shard we hold, NO_SHARD if none
+
   pg_info_t()
     : last_epoch_started(0), last_user_version(0),
-      last_backfill(hobject_t::get_max())
+      last_backfill(hobject_t::get_max()),
+      shard(ghobject_t::NO_SHARD)
   { }
   pg_info_t(pg_t p)
     : pgid(p),
       last_epoch_started(0), last_user_version(0),
-      last_backfill(hobject_t::get_max())
+      last_backfill(hobject_t::get_max()),
+      shard(ghobject_t::NO_SHARD)
   { }
   
   bool is_empty() const { return last_update.version == 0; }
@@ -1432,7 +1485,10 @@ WRITE_CLASS_ENCODER(pg_info_t)
 
 inline ostream& operator<<(ostream& out, const pg_info_t& pgi) 
 {
-  out << pgi.pgid << "(";
+  out << pgi.pgid;
+  if (pgi.shard != ghobject_t::NO_SHARD)
+    out << "s" << (int)pgi.shard;
+  out << "(";
   if (pgi.dne())
     out << " DNE";
   if (pgi.is_empty())
@@ -1621,11 +1677,21 @@ struct pg_log_entry_t {
   bool invalid_hash; // only when decoding sobject_t based entries
   bool invalid_pool; // only when decoding pool-less hobject based entries
 
+  /**
+   * extents_known: this MODIFY changed nothing but the object data in
+   * modified_extents, the object size and xattrs.  Recovery can then
+   * bring a peer holding prior_version up to date by pushing only
+   * those extents (see ReplicatedBackend::calc_delta_subset).
+   */
+  bool extents_known;
+  interval_set<uint64_t> modified_extents;
+
   uint64_t offset;   // [soft state] my offset on disk
       
   pg_log_entry_t()
     : op(0), user_version(0),
-      invalid_hash(false), invalid_pool(false), offset(0) {}
+      invalid_hash(false), invalid_pool(false), extents_known(false),
+      offset(0) {}
   pg_log_entry_t(int _op, const hobject_t& _soid, 
 		 const eversion_t& v, const eversion_t& pv,
 		 version_t uv,
@@ -1633,7 +1699,7 @@ struct pg_log_entry_t {
     : op(_op), soid(_soid), version(v),
       prior_version(pv), user_version(uv),
       reqid(rid), mtime(mt), invalid_hash(false), invalid_pool(false),
-      offset(0) {}
+      extents_known(false), offset(0) {}
       
   bool is_clone() const { return op == CLONE; }
   bool is_modify() const { return op == MODIFY; }
@@ -1657,6 +1723,22 @@ struct pg_log_entry_t {
   void encode_with_checksum(bufferlist& bl) const;
   void decode_with_checksum(bufferlist::iterator& p);
 
+  void bound_encode(size_t& p, uint64_t features=0) const {
+    p += BOUNDED_ENCODE_HEADER_LEN;
+    ::bound_encode(op, p);
+    ::bound_encode(soid, p);
+    ::bound_encode(version, p);
+    ::bound_encode(prior_version, p);
+    ::bound_encode(reqid, p);
+    ::bound_encode(mtime, p);
+    if (op == LOST_REVERT)
+      ::bound_encode(prior_version, p);
+    ::bound_encode(snaps, p);
+    ::bound_encode(user_version, p);
+    ::bound_encode(extents_known, p);
+    ::bound_encode(modified_extents, p);
+  }
+  void encode(bufferlist::contiguous_appender& p, uint64_t features=0) const;
   void encode(bufferlist &bl) const;
   void decode(bufferlist::iterator &bl);
   void dump(Formatter *f) const;
@@ -1664,6 +1746,7 @@ struct pg_log_entry_t {
 
 };
 WRITE_CLASS_ENCODER(pg_log_entry_t)
+WRITE_CLASS_BOUNDED_ENCODER(pg_log_entry_t)
 
 ostream& operator<<(ostream& out, const pg_log_entry_t& e);
 
@@ -2532,6 +2615,9 @@ struct ObjectRecoveryInfo {
   SnapSet ss;
   interval_set<uint64_t> copy_subset;
   map<hobject_t, interval_set<uint64_t> > clone_subset;
+  /// if set, the target already has this version and copy_subset
+  /// only covers what changed since
+  eversion_t delta_base;
 
   ObjectRecoveryInfo() : size(0) { }
 
@@ -2574,6 +2660,9 @@ ostream& operator<<(ostream& out, const ObjectRecoveryProgress &prog);
 
 struct PushReplyOp {
   hobject_t soid;
+  bool delta_refused;  ///< we don't have the delta_base; push it all
+
+  PushReplyOp() : delta_refused(false) {}
 
   static void generate_test_instances(list<PushReplyOp*>& o);
   void encode(bufferlist &bl) const;
@@ -0,0 +1,268 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+/*
+ * Compare encoding a pg_log_entry_t and MOSDOp's payload through the
+ * bounded encoders against the same fields appended to a bufferlist
+ * one at a time, the way they were encoded before.
+ *
+ *  ceph_bench_encoding [iterations]
+ */
+
+#include "include/types.h"
+#include "common/Clock.h"
+#include "common/config.h"
+#include "common/ceph_argparse.h"
+#include "global/global_init.h"
+#include "osd/osd_types.h"
+
+// field-by-field encoders, as before bounded encoding
+
+static void legacy_encode(const hobject_t& o, bufferlist& bl)
+{
+  ENCODE_START(4, 3, bl);
+  ::encode(o.get_key(), bl);
+  ::encode(o.oid, bl);
+  ::encode(o.snap, bl);
+  ::encode(o.hash, bl);
+  ::encode(o.is_max(), bl);
+  ::encode(o.get_namespace(), bl);
+  ::encode(o.pool, bl);
+  ENCODE_FINISH(bl);
+}
+
+static void legacy_encode(const osd_reqid_t& r, bufferlist& bl)
+{
+  ENCODE_START(2, 2, bl);
+  ::encode(r.name, bl);
+  ::encode(r.tid, bl);
+  ::encode(r.inc, bl);
+  ENCODE_FINISH(bl);
+}
+
+static void legacy_encode(const object_locator_t& l, bufferlist& bl)
+{
+  __u8 encode_compat = 3;
+  ENCODE_START(6, encode_compat, bl);
+  ::encode(l.pool, bl);
+  int32_t preferred = -1;
+  ::encode(preferred, bl);
+  ::encode(l.key, bl);
+  ::encode(l.nspace, bl);
+  ::encode(l.hash, bl);
+  if (l.hash != -1)
+    encode_compat = MAX(encode_compat, 6);
+  ENCODE_FINISH_NEW_COMPAT(bl, encode_compat);
+}
+
+static void legacy_encode(const pg_log_entry_t& e, bufferlist& bl)
+{
+  ENCODE_START(9, 4, bl);
+  ::encode(e.op, bl);
+  legacy_encode(e.soid, bl);
+  ::encode(e.version, bl);
+  if (e.op == pg_log_entry_t::LOST_REVERT)
+    ::encode(e.reverting_to, bl);
+  else
+    ::encode(e.prior_version, bl);
+  legacy_encode(e.reqid, bl);
+  ::encode(e.mtime, bl);
+  if (e.op == pg_log_entry_t::LOST_REVERT)
+    ::encode(e.prior_version, bl);
+  ::encode(e.snaps, bl);
+  ::encode(e.user_version, bl);
+  ::encode(e.extents_known, bl);
+  ::encode(e.modified_extents, bl);
+  ENCODE_FINISH(bl);
+}
+
+// the modern MOSDOp payload, minus the data
+static void legacy_encode_osd_op(const object_locator_t& oloc,
+				 const pg_t& pgid, const object_t& oid,
+				 const vector<ceph_osd_op>& ops,
+				 const vector<snapid_t>& snaps,
+				 bufferlist& payload)
+{
+  uint32_t client_inc = 1;
+  __u32 osdmap_epoch = 1234, flags = CEPH_OSD_FLAG_WRITE;
+  utime_t mtime(1, 2);
+  eversion_t reassert_version;
+  snapid_t snapid = CEPH_NOSNAP, snap_seq = 0;
+  int32_t retry_attempt = 0;
+  ::encode(client_inc, payload);
+  ::encode(osdmap_epoch, payload);
+  ::encode(flags, payload);
+  ::encode(mtime, payload);
+  ::encode(reassert_version, payload);
+  legacy_encode(oloc, payload);
+  ::encode(pgid, payload);
+  ::encode(oid, payload);
+  __u16 num_ops = ops.size();
+  ::encode(num_ops, payload);
+  for (unsigned i = 0; i < ops.size(); i++)
+    ::encode(ops[i], payload);
+  ::encode(snapid, payload);
+  ::encode(snap_seq, payload);
+  ::encode(snaps, payload);
+  ::encode(retry_attempt, payload);
+}
+
+static void bounded_encode_osd_op(const object_locator_t& oloc,
+				  const pg_t& pgid, const object_t& oid,
+				  const vector<ceph_osd_op>& ops,
+				  const vector<snapid_t>& snaps,
+				  bufferlist& payload)
+{
+  uint32_t client_inc = 1;
+  __u32 osdmap_epoch = 1234, flags = CEPH_OSD_FLAG_WRITE;
+  utime_t mtime(1, 2);
+  eversion_t reassert_version;
+  snapid_t snapid = CEPH_NOSNAP, snap_seq = 0;
+  int32_t retry_attempt = 0;
+  __u16 num_ops = ops.size();
+  size_t len = 0;
+  ::bound_encode(client_inc, len);
+  ::bound_encode(osdmap_epoch, len);
+  ::bound_encode(flags, len);
+  ::bound_encode(mtime, len);
+  ::bound_encode(reassert_version, len);
+  ::bound_encode(oloc, len);
+  ::bound_encode(pgid, len);
+  ::bound_encode(oid, len);
+  ::bound_encode(num_ops, len);
+  len += sizeof(ceph_osd_op) * num_ops;
+  ::bound_encode(snapid, len);
+  ::bound_encode(snap_seq, len);
+  ::bound_encode(snaps, len);
+  ::bound_encode(retry_attempt, len);
+
+  bufferlist::contiguous_appender p(payload, len);
+  ::encode(client_inc, p);
+  ::encode(osdmap_epoch, p);
+  ::encode(flags, p);
+  ::encode(mtime, p);
+  ::encode(reassert_version, p);
+  ::encode(oloc, p);
+  ::encode(pgid, p);
+  ::encode(oid, p);
+  ::encode(num_ops, p);
+  for (unsigned i = 0; i < ops.size(); i++)
+    ::encode(ops[i], p);
+  ::encode(snapid, p);
+  ::encode(snap_seq, p);
+  ::encode(snaps, p);
+  ::encode(retry_attempt, p);
+}
+
+template <class F>
+static utime_t time_it(int iterations, F f)
+{
+  utime_t start = ceph_clock_now(NULL);
+  for (int i = 0; i < iterations; ++i)
+    f();
+  return ceph_clock_now(NULL) - start;
+}
+
+struct LogEntryLegacy {
+  const pg_log_entry_t &e;
+  LogEntryLegacy(const pg_log_entry_t &e) : e(e) {}
+  void operator()() {
+    bufferlist bl;
+    legacy_encode(e, bl);
+  }
+};
+
+struct LogEntryBounded {
+  const pg_log_entry_t &e;
+  LogEntryBounded(const pg_log_entry_t &e) : e(e) {}
+  void operator()() {
+    bufferlist bl;
+    e.encode(bl);
+  }
+};
+
+struct OSDOpArgs {
+  object_locator_t oloc;
+  pg_t pgid;
+  object_t oid;
+  vector<ceph_osd_op> ops;
+  vector<snapid_t> snaps;
+};
+
+struct OSDOpLegacy {
+  const OSDOpArgs &a;
+  OSDOpLegacy(const OSDOpArgs &a) : a(a) {}
+  void operator()() {
+    bufferlist bl;
+    legacy_encode_osd_op(a.oloc, a.pgid, a.oid, a.ops, a.snaps, bl);
+  }
+};
+
+struct OSDOpBounded {
+  const OSDOpArgs &a;
+  OSDOpBounded(const OSDOpArgs &a) : a(a) {}
+  void operator()() {
+    bufferlist bl;
+    bounded_encode_osd_op(a.oloc, a.pgid, a.oid, a.ops, a.snaps, bl);
+  }
+};
+
+static void report(const char *what, int iterations, utime_t legacy,
+		   utime_t bounded)
+{
+  cout << what << ": "
+       << (double)legacy * 1000000000.0 / iterations << " ns legacy, "
+       << (double)bounded * 1000000000.0 / iterations << " ns bounded ("
+       << (double)legacy / (double)bounded << "x)" << std::endl;
+}
+
+int main(int argc, const char **argv)
+{
+  vector<const char*> args;
+  argv_to_vec(argc, argv, args);
+  env_to_vec(args);
+
+  global_init(NULL, args, CEPH_ENTITY_TYPE_CLIENT, CODE_ENVIRONMENT_UTILITY, 0);
+  common_init_finish(g_ceph_context);
+
+  int iterations = args.size() ? atoi(args[0]) : 1000000;
+
+  pg_log_entry_t e(pg_log_entry_t::MODIFY,
+		   hobject_t(object_t("rbd_data.1234.0000000000000001"), "",
+			     CEPH_NOSNAP, 0x12345678, 3, ""),
+		   eversion_t(12, 3456), eversion_t(12, 3455), 3456,
+		   osd_reqid_t(entity_name_t::CLIENT(4123), 0, 99887766),
+		   utime_t(1400000000, 0));
+  e.extents_known = true;
+  e.modified_extents.insert(0, 4096);
+
+  OSDOpArgs a;
+  a.oloc.pool = 3;
+  a.pgid = pg_t(0x12345678, 3);
+  a.oid = object_t("rbd_data.1234.0000000000000001");
+  ceph_osd_op op;
+  memset(&op, 0, sizeof(op));
+  op.op = CEPH_OSD_OP_WRITE;
+  a.ops.push_back(op);
+
+  // same bytes either way
+  {
+    bufferlist l, b;
+    legacy_encode(e, l);
+    e.encode(b);
+    assert(l.contents_equal(b));
+    bufferlist lo, bo;
+    legacy_encode_osd_op(a.oloc, a.pgid, a.oid, a.ops, a.snaps, lo);
+    bounded_encode_osd_op(a.oloc, a.pgid, a.oid, a.ops, a.snaps, bo);
+    assert(lo.contents_equal(bo));
+  }
+
+  cout << iterations << " iterations" << std::endl;
+  report("pg_log_entry_t", iterations,
+	 time_it(iterations, LogEntryLegacy(e)),
+	 time_it(iterations, LogEntryBounded(e)));
+  report("MOSDOp payload", iterations,
+	 time_it(iterations, OSDOpLegacy(a)),
+	 time_it(iterations, OSDOpBounded(a)));
+  return 0;
+}
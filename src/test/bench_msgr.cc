@@ -0,0 +1,392 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+/*
+ * Benchmark SimpleMessenger on its own.  A server messenger and
+ * --conns client messengers run in this process on 127.0.0.1.  Each
+ * client keeps --inflight messages outstanding for --seconds, once for
+ * every data length in --sizes, and the server answers every message
+ * with an empty ping.  For each size we report messages/sec, data
+ * bytes/sec, round-trip latency and where a message spent its time on
+ * the way to the server.
+ *
+ *  ceph_bench_msgr [--conns N] [--inflight M] [--seconds S]
+ *                  [--sizes 0,4096,65536,4194304]
+ *
+ * Messenger options (--ms_tcp_batch_bytes, --ms_unix_socket_dir, ...)
+ * are taken from the command line as usual.
+ */
+
+#include <errno.h>
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "common/Clock.h"
+#include "common/Cond.h"
+#include "common/Mutex.h"
+#include "common/ceph_argparse.h"
+#include "common/config.h"
+#include "global/global_init.h"
+#include "msg/Messenger.h"
+#include "messages/MPing.h"
+
+using namespace std;
+
+/*
+ * Stages, from the client calling send_message() to the server's
+ * dispatcher.  The messenger does not stamp the payload encode or the
+ * decode separately: "send" includes the crcs and the socket write,
+ * "recv" the payload read and the decode.
+ */
+enum {
+  STAGE_QUEUE,		// submitted -> writer encodes it
+  STAGE_ENCODE,		// encode_payload()
+  STAGE_SEND,		// encoded -> reader has the header
+  STAGE_THROTTLE,	// waiting for the policy and dispatch throttlers
+  STAGE_RECV,		// front/middle/data read and decoded
+  STAGE_DISPATCH_QUEUE,	// waiting in the DispatchQueue
+  STAGE_DISPATCH,	// dispatch stamped -> dispatcher entered
+  STAGE_MAX
+};
+static const char *stage_names[STAGE_MAX] = {
+  "queue", "encode", "send", "throttle", "recv", "dispatch_queue", "dispatch"
+};
+
+/*
+ * What the client sends.  It goes out as a CEPH_MSG_PING, so the
+ * server decodes an MPing and reads the stamps from the front.
+ */
+class MBenchPing : public Message {
+public:
+  utime_t submitted;
+
+  MBenchPing() : Message(CEPH_MSG_PING) {}
+private:
+  ~MBenchPing() {}
+
+public:
+  void decode_payload() {}
+  void encode_payload(uint64_t features) {
+    utime_t start = ceph_clock_now(NULL);
+    ::encode(submitted, payload);
+    ::encode(start, payload);
+    ::encode(ceph_clock_now(NULL), payload);
+  }
+  const char *get_type_name() const { return "bench_ping"; }
+};
+
+struct Stats {
+  Mutex lock;
+  uint64_t replies;
+  vector<double> rtt;  // usec
+  double stage_sum[STAGE_MAX];
+  uint64_t stage_count;
+
+  Stats() : lock("Stats::lock") {
+    reset();
+  }
+  void reset() {
+    Mutex::Locker l(lock);
+    replies = 0;
+    rtt.clear();
+    memset(stage_sum, 0, sizeof(stage_sum));
+    stage_count = 0;
+  }
+} stats;
+
+Mutex run_lock("run_lock");
+Cond run_cond;
+bool running = false;
+int outstanding = 0;
+unsigned msg_size = 0;
+bufferptr msg_data;
+
+static Message *new_request()
+{
+  MBenchPing *m = new MBenchPing;
+  if (msg_size) {
+    bufferlist bl;
+    bl.append(msg_data);
+    m->set_data(bl);
+  }
+  m->submitted = ceph_clock_now(NULL);
+  return m;
+}
+
+class ServerDispatcher : public Dispatcher {
+  Messenger *msgr;
+public:
+  ServerDispatcher(Messenger *msgr)
+    : Dispatcher(g_ceph_context), msgr(msgr) {}
+
+  bool ms_dispatch(Message *m) {
+    utime_t now = ceph_clock_now(NULL);
+    bufferlist::iterator p = m->get_payload().begin();
+    utime_t submitted, encode_start, encode_end;
+    ::decode(submitted, p);
+    ::decode(encode_start, p);
+    ::decode(encode_end, p);
+
+    double t[STAGE_MAX];
+    t[STAGE_QUEUE] = encode_start - submitted;
+    t[STAGE_ENCODE] = encode_end - encode_start;
+    t[STAGE_SEND] = m->get_recv_stamp() - encode_end;
+    t[STAGE_THROTTLE] = m->get_throttle_stamp() - m->get_recv_stamp();
+    t[STAGE_RECV] = m->get_recv_complete_stamp() - m->get_throttle_stamp();
+    t[STAGE_DISPATCH_QUEUE] = m->get_dispatch_stamp() - m->get_recv_complete_stamp();
+    t[STAGE_DISPATCH] = now - m->get_dispatch_stamp();
+    {
+      Mutex::Locker l(stats.lock);
+      for (int i = 0; i < STAGE_MAX; ++i)
+	stats.stage_sum[i] += t[i];
+      stats.stage_count++;
+    }
+
+    // echo the submit stamp back for the round trip
+    MPing *reply = new MPing;
+    bufferlist bl;
+    ::encode(submitted, bl);
+    reply->set_payload(bl);
+    msgr->send_message(reply, m->get_connection());
+    m->put();
+    return true;
+  }
+
+  bool ms_handle_reset(Connection *con) { return false; }
+  void ms_handle_remote_reset(Connection *con) {}
+  bool ms_verify_authorizer(Connection *con, int peer_type, int protocol,
+			    bufferlist& authorizer, bufferlist& authorizer_reply,
+			    bool& isvalid, CryptoKey& session_key) {
+    isvalid = true;
+    return true;
+  }
+};
+
+class ClientDispatcher : public Dispatcher {
+  Messenger *msgr;
+public:
+  ConnectionRef con;
+
+  ClientDispatcher(Messenger *msgr)
+    : Dispatcher(g_ceph_context), msgr(msgr) {}
+
+  bool ms_dispatch(Message *m) {
+    utime_t now = ceph_clock_now(NULL);
+    bufferlist::iterator p = m->get_payload().begin();
+    utime_t submitted;
+    ::decode(submitted, p);
+    m->put();
+    {
+      Mutex::Locker l(stats.lock);
+      stats.replies++;
+      stats.rtt.push_back((double)(now - submitted) * 1000000.0);
+    }
+
+    Mutex::Locker l(run_lock);
+    if (running) {
+      msgr->send_message(new_request(), con);
+    } else if (--outstanding == 0) {
+      run_cond.Signal();
+    }
+    return true;
+  }
+
+  bool ms_handle_reset(Connection *con) { return false; }
+  void ms_handle_remote_reset(Connection *con) {}
+};
+
+static string pretty_bytes(double b)
+{
+  const char *units[] = { "B", "KB", "MB", "GB" };
+  int u = 0;
+  while (b >= 1024 && u < 3) {
+    b /= 1024;
+    ++u;
+  }
+  ostringstream ss;
+  ss << fixed << setprecision(1) << b << " " << units[u];
+  return ss.str();
+}
+
+static void report(unsigned size, utime_t elapsed)
+{
+  Mutex::Locker l(stats.lock);
+  double secs = (double)elapsed;
+  ostringstream out;
+  out << fixed << setprecision(1);
+  out << "size " << size << ": "
+      << stats.replies << " msgs in " << secs << " s, "
+      << stats.replies / secs << " msgs/s, "
+      << pretty_bytes(stats.replies * (double)size / secs) << "/s\n";
+
+  if (!stats.rtt.empty()) {
+    sort(stats.rtt.begin(), stats.rtt.end());
+    size_t n = stats.rtt.size();
+    out << "  rtt usec: min " << stats.rtt[0]
+	<< " p50 " << stats.rtt[n / 2]
+	<< " p90 " << stats.rtt[n * 9 / 10]
+	<< " p99 " << stats.rtt[n * 99 / 100]
+	<< " p99.9 " << stats.rtt[n * 999 / 1000]
+	<< " max " << stats.rtt[n - 1] << "\n";
+
+    // log2 buckets, in usec
+    vector<uint64_t> hist;
+    for (size_t i = 0; i < n; ++i) {
+      unsigned b = 0;
+      while ((double)(1ull << b) <= stats.rtt[i])
+	++b;
+      if (hist.size() <= b)
+	hist.resize(b + 1);
+      hist[b]++;
+    }
+    for (unsigned b = 0; b < hist.size(); ++b) {
+      if (!hist[b])
+	continue;
+      out << "    < " << setw(8) << (1ull << b) << " usec " << setw(10) << hist[b]
+	  << " " << string(hist[b] * 50 / n, '#') << "\n";
+    }
+  }
+
+  if (stats.stage_count) {
+    out << "  stage usec (mean):";
+    for (int i = 0; i < STAGE_MAX; ++i)
+      out << " " << stage_names[i] << " "
+	  << stats.stage_sum[i] * 1000000.0 / stats.stage_count;
+    out << "\n";
+  }
+  cout << out.str() << std::flush;
+}
+
+static void usage()
+{
+  cout << "usage: ceph_bench_msgr [--conns N] [--inflight M] [--seconds S]\n"
+       << "                       [--sizes 0,4096,65536,4194304]" << std::endl;
+}
+
+int main(int argc, const char **argv)
+{
+  vector<const char*> args;
+  argv_to_vec(argc, argv, args);
+  env_to_vec(args);
+
+  global_init(NULL, args, CEPH_ENTITY_TYPE_CLIENT, CODE_ENVIRONMENT_UTILITY, 0);
+  common_init_finish(g_ceph_context);
+  g_ceph_context->_conf->set_val("auth_supported", "none");
+  g_ceph_context->_conf->apply_changes(NULL);
+
+  int conns = 1, inflight = 16, seconds = 5;
+  string sizes_str = "0,4096,65536,4194304";
+  string val;
+  ostringstream err;
+  for (vector<const char*>::iterator i = args.begin(); i != args.end(); ) {
+    if (ceph_argparse_double_dash(args, i)) {
+      break;
+    } else if (ceph_argparse_flag(args, i, "-h", "--help", (char*)NULL)) {
+      usage();
+      return 0;
+    } else if (ceph_argparse_withint(args, i, &conns, &err, "--conns", (char*)NULL)) {
+    } else if (ceph_argparse_withint(args, i, &inflight, &err, "--inflight", (char*)NULL)) {
+    } else if (ceph_argparse_withint(args, i, &seconds, &err, "--seconds", (char*)NULL)) {
+    } else if (ceph_argparse_witharg(args, i, &val, "--sizes", (char*)NULL)) {
+      sizes_str = val;
+    } else {
+      cerr << "unrecognized argument " << *i << std::endl;
+      usage();
+      return 1;
+    }
+    if (!err.str().empty()) {
+      cerr << err.str() << std::endl;
+      return 1;
+    }
+  }
+  vector<unsigned> sizes;
+  {
+    istringstream ss(sizes_str);
+    string s;
+    while (getline(ss, s, ','))
+      sizes.push_back(atoi(s.c_str()));
+  }
+  if (conns < 1 || inflight < 1 || seconds < 1 || sizes.empty()) {
+    usage();
+    return 1;
+  }
+
+  entity_addr_t bind_addr;
+  bind_addr.parse("127.0.0.1:0");
+
+  Messenger *server = Messenger::create(g_ceph_context, entity_name_t::OSD(0),
+					"server", getpid());
+  server->set_default_policy(Messenger::Policy::stateless_server(0, 0));
+  if (server->bind(bind_addr) < 0) {
+    cerr << "server failed to bind" << std::endl;
+    return 1;
+  }
+  ServerDispatcher server_dispatcher(server);
+  server->add_dispatcher_head(&server_dispatcher);
+  server->start();
+
+  vector<Messenger*> clients;
+  vector<ClientDispatcher*> client_dispatchers;
+  for (int i = 0; i < conns; ++i) {
+    Messenger *c = Messenger::create(g_ceph_context, entity_name_t::CLIENT(i),
+				     "client", getpid() + i + 1);
+    c->set_default_policy(Messenger::Policy::lossy_client(0, 0));
+    // bound, so that it knows its address (see ms_unix_socket_dir)
+    if (c->bind(bind_addr) < 0) {
+      cerr << "client failed to bind" << std::endl;
+      return 1;
+    }
+    ClientDispatcher *d = new ClientDispatcher(c);
+    c->add_dispatcher_head(d);
+    c->start();
+    d->con = c->get_connection(server->get_myinst());
+    clients.push_back(c);
+    client_dispatchers.push_back(d);
+  }
+
+  cout << conns << " connections, " << inflight << " in flight each, "
+       << seconds << " s per size" << std::endl;
+
+  for (vector<unsigned>::iterator s = sizes.begin(); s != sizes.end(); ++s) {
+    msg_size = *s;
+    if (msg_size) {
+      msg_data = buffer::create_page_aligned(msg_size);
+      msg_data.zero();
+    }
+    stats.reset();
+
+    utime_t start = ceph_clock_now(NULL);
+    run_lock.Lock();
+    running = true;
+    outstanding = conns * inflight;
+    run_lock.Unlock();
+    for (int i = 0; i < conns; ++i)
+      for (int j = 0; j < inflight; ++j)
+	clients[i]->send_message(new_request(), client_dispatchers[i]->con);
+
+    sleep(seconds);
+
+    run_lock.Lock();
+    running = false;
+    while (outstanding > 0)
+      run_cond.Wait(run_lock);
+    run_lock.Unlock();
+
+    report(msg_size, ceph_clock_now(NULL) - start);
+  }
+
+  for (int i = 0; i < conns; ++i) {
+    clients[i]->shutdown();
+    clients[i]->wait();
+    delete clients[i];
+    delete client_dispatchers[i];
+  }
+  server->shutdown();
+  server->wait();
+  delete server;
+  return 0;
+}
@@ -30,6 +30,7 @@
 #include "common/environment.h"
 #include "common/Clock.h"
 #include "common/safe_io.h"
+#include "include/atomic.h"
 
 #include "gtest/gtest.h"
 #include "stdlib.h"
@@ -173,6 +174,115 @@ TEST(BufferRaw, ostream) {
   EXPECT_GT(stream.str().size(), stream.str().find("len 1 nref 1)"));
 }
 
+TEST(BufferPool, reuse) {
+  buffer::pool_stat_t before, after;
+  buffer::get_pool_stat(1, &before);
+  EXPECT_EQ((unsigned)CEPH_PAGE_SIZE * 2, before.size);
+  char *data;
+  {
+    bufferptr ptr(buffer::create_page_aligned(CEPH_PAGE_SIZE + 1));
+    EXPECT_TRUE(ptr.is_page_aligned());
+    EXPECT_EQ(CEPH_PAGE_SIZE + 1, ptr.length());
+    data = ptr.c_str();
+    buffer::get_pool_stat(1, &after);
+    EXPECT_EQ(before.in_use + 1, after.in_use);
+  }
+  buffer::get_pool_stat(1, &after);
+  EXPECT_EQ(before.in_use, after.in_use);
+  EXPECT_EQ(before.cached + 1, after.cached);
+  {
+    // freed on this thread, so it comes straight back
+    bufferptr ptr(buffer::create_page_aligned(CEPH_PAGE_SIZE * 2));
+    EXPECT_EQ(data, ptr.c_str());
+    buffer::pool_stat_t hit;
+    buffer::get_pool_stat(1, &hit);
+    EXPECT_EQ(after.hits + 1, hit.hits);
+  }
+  // too big for the pool
+  unsigned max = buffer::get_pool_max_size();
+  buffer::pool_stat_t last_before, last_after;
+  buffer::get_pool_stat(buffer::get_pool_classes() - 1, &last_before);
+  {
+    bufferptr ptr(buffer::create_page_aligned(max + 1));
+    EXPECT_TRUE(ptr.is_page_aligned());
+  }
+  buffer::get_pool_stat(buffer::get_pool_classes() - 1, &last_after);
+  EXPECT_EQ(last_before.misses, last_after.misses);
+  EXPECT_EQ(last_before.hits, last_after.hits);
+
+  // disabled
+  buffer::set_pool_limits(0, 0);
+  buffer::get_pool_stat(0, &before);
+  {
+    bufferptr ptr(buffer::create_page_aligned(CEPH_PAGE_SIZE));
+  }
+  buffer::get_pool_stat(0, &after);
+  EXPECT_EQ(before.hits, after.hits);
+  EXPECT_EQ(before.misses, after.misses);
+  buffer::set_pool_limits(64 << 20, 1 << 20);
+}
+
+static uint64_t pool_cached_bytes() {
+  uint64_t bytes = 0;
+  for (unsigned cls = 0; cls < buffer::get_pool_classes(); ++cls) {
+    buffer::pool_stat_t s;
+    buffer::get_pool_stat(cls, &s);
+    bytes += s.cached * s.size;
+  }
+  return bytes;
+}
+
+TEST(BufferPool, thread_cache_counts) {
+  bufferptr a(buffer::create_page_aligned(CEPH_PAGE_SIZE));
+  bufferptr b(buffer::create_page_aligned(CEPH_PAGE_SIZE));
+  // room for one more page, thread caches included
+  uint64_t limit = pool_cached_bytes() + CEPH_PAGE_SIZE;
+  buffer::set_pool_limits(limit, 1 << 20);
+  buffer::pool_stat_t before, after;
+  buffer::get_pool_stat(0, &before);
+  a = bufferptr();
+  b = bufferptr();
+  buffer::get_pool_stat(0, &after);
+  EXPECT_EQ(before.cached + 1, after.cached);
+  EXPECT_GE(limit, pool_cached_bytes());
+  buffer::set_pool_limits(64 << 20, 1 << 20);
+}
+
+struct free_only_thread_t {
+  bufferptr ptr;
+  pthread_mutex_t hold;
+  atomic_t freed;
+  static void *entry(void *arg) {
+    free_only_thread_t *t = static_cast<free_only_thread_t*>(arg);
+    t->ptr = bufferptr();
+    t->freed.set(1);
+    // stay alive, with whatever we cached, until told to go
+    pthread_mutex_lock(&t->hold);
+    pthread_mutex_unlock(&t->hold);
+    return NULL;
+  }
+};
+
+TEST(BufferPool, free_only_thread) {
+  free_only_thread_t t;
+  t.ptr = buffer::create_page_aligned(CEPH_PAGE_SIZE * 4);
+  char *data = t.ptr.c_str();
+  pthread_mutex_init(&t.hold, NULL);
+  pthread_mutex_lock(&t.hold);
+  pthread_t tid;
+  ASSERT_EQ(0, pthread_create(&tid, NULL, free_only_thread_t::entry, &t));
+  while (!t.freed.read())
+    usleep(1000);
+  {
+    // the thread never allocates: it handed the buffer to the shared list
+    bufferptr ptr(buffer::create_page_aligned(CEPH_PAGE_SIZE * 4));
+    EXPECT_EQ(data, ptr.c_str());
+  }
+  pthread_mutex_unlock(&t.hold);
+  pthread_join(tid, NULL);
+  pthread_mutex_destroy(&t.hold);
+}
+
 #ifdef CEPH_HAVE_SPLICE
 class TestRawPipe : public ::testing::Test {
 protected:
@@ -51,6 +51,28 @@ protected:
     }
   };
 
+  class Thread_get_shared : public Thread {
+  public:
+    Throttle &throttle;
+    int64_t count;
+    const void *who;
+    atomic_t done;
+
+    Thread_get_shared(Throttle& _throttle, int64_t _count, const void *_who) :
+      throttle(_throttle),
+      count(_count),
+      who(_who),
+      done(0)
+    {
+    }
+
+    virtual void *entry() {
+      throttle.get(count, who, "consumer");
+      done.set(1);
+      return NULL;
+    }
+  };
+
 };
 
 TEST_F(ThrottleTest, Throttle) {
@@ -133,6 +155,37 @@ TEST_F(ThrottleTest, get) {
 	  
 }
 
+TEST_F(ThrottleTest, fair_share) {
+  int64_t throttle_max = 10;
+  Throttle throttle(g_ceph_context, "throttle_fair_share", throttle_max);
+  throttle.set_fair_share(true);
+  int a, b;
+
+  // a fills the throttle and wants more
+  ASSERT_FALSE(throttle.get(throttle_max, &a, "a"));
+  Thread_get_shared ta(throttle, 2, &a);
+  ta.create();
+  usleep(100000);
+
+  // b comes later, but holds nothing and goes first
+  Thread_get_shared tb(throttle, 2, &b);
+  tb.create();
+  usleep(100000);
+  ASSERT_EQ(0u, ta.done.read());
+  ASSERT_EQ(0u, tb.done.read());
+
+  throttle.put(2, &a);
+  tb.join();
+  ASSERT_EQ(0u, ta.done.read());
+  ASSERT_EQ(throttle_max, throttle.get_current());
+
+  // with b gone, a may have it all again
+  throttle.put(2, &b);
+  ta.join();
+  ASSERT_EQ(throttle_max, throttle.get_current());
+  ASSERT_EQ(0, throttle.put(throttle_max, &a));
+}
+
 TEST_F(ThrottleTest, get_or_fail) {
   {
     Throttle throttle(g_ceph_context, "throttle");
@@ -0,0 +1,90 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * Copyright (C) 2014 Inktank <info@inktank.com>
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include "common/Formatter.h"
+#include "include/types.h"
+#include "include/histogram.h"
+#include "gtest/gtest.h"
+
+TEST(Histogram, Basic) {
+  pow2_hist_t h;
+
+  h.add(0);
+  h.add(0);
+  h.add(0);
+  ASSERT_EQ(1u, h.h.size());
+  ASSERT_EQ(3, h.h[0]);
+
+  h.add(1);
+  ASSERT_EQ(2u, h.h.size());
+  ASSERT_EQ(3, h.h[0]);
+  ASSERT_EQ(1, h.h[1]);
+
+  h.add(2);
+  h.add(2);
+  ASSERT_EQ(3u, h.h.size());
+  ASSERT_EQ(3, h.h[0]);
+  ASSERT_EQ(1, h.h[1]);
+  ASSERT_EQ(2, h.h[2]);
+}
+
+TEST(Histogram, Set) {
+  pow2_hist_t h;
+  h.set(0, 12);
+  h.set(2, 12);
+  ASSERT_EQ(3u, h.h.size());
+  ASSERT_EQ(12, h.h[0]);
+  ASSERT_EQ(0, h.h[1]);
+  ASSERT_EQ(12, h.h[2]);
+}
+
+TEST(Histogram, Position) {
+  pow2_hist_t h;
+  uint64_t lb, ub;
+
+  h.get_position_micro(5, &lb, &ub);
+  ASSERT_EQ(0u, lb);
+  ASSERT_EQ(0u, ub);
+
+  h.add(0);
+  h.add(2);
+  h.add(3);
+  h.add(12);
+  h.get_position_micro(0, &lb, &ub);
+  ASSERT_EQ(0u, lb);
+  ASSERT_EQ(250000u, ub);
+  h.get_position_micro(1, &lb, &ub);
+  ASSERT_EQ(250000u, lb);
+  ASSERT_EQ(250000u, ub);
+  h.get_position_micro(2, &lb, &ub);
+  ASSERT_EQ(250000u, lb);
+  ASSERT_EQ(750000u, ub);
+  h.get_position_micro(4, &lb, &ub);
+  ASSERT_EQ(750000u, lb);
+  ASSERT_EQ(750000u, ub);
+  h.get_position_micro(1000, &lb, &ub);
+  ASSERT_EQ(1000000u, lb);
+  ASSERT_EQ(1000000u, ub);
+}
+
+TEST(Histogram, Decay) {
+  pow2_hist_t h;
+  h.set(0, 123);
+  h.set(3, 12);
+  h.set(5, 1);
+  h.decay(1);
+  ASSERT_EQ(61, h.h[0]);
+  ASSERT_EQ(6, h.h[3]);
+  ASSERT_EQ(4u, h.h.size());
+}
@@ -253,3 +253,25 @@ TEST(Crc32c, RangeNull) {
     ASSERT_EQ(crc, *check);
   }
 }
+
+TEST(Crc32c, Zeros) {
+  for (unsigned len = 0; len < 5000; len += (len < 100 ? 1 : 97)) {
+    uint32_t crc = 0x12345678 + len;
+    ASSERT_EQ(ceph_crc32c_func(crc, NULL, len), ceph_crc32c_zeros(crc, len));
+  }
+  ASSERT_EQ(ceph_crc32c_func(1, NULL, 4 << 20), ceph_crc32c_zeros(1, 4 << 20));
+}
+
+TEST(Crc32c, Combine) {
+  int len = 100000;
+  unsigned char *a = (unsigned char *)malloc(len);
+  for (int i = 0; i < len; i++)
+    a[i] = i * 7 + (i >> 8);
+  uint32_t whole = ceph_crc32c(1234, a, len);
+  for (int split = 0; split <= len; split += 9973) {
+    uint32_t crc_a = ceph_crc32c(1234, a, split);
+    uint32_t crc_b = ceph_crc32c(0, a + split, len - split);
+    ASSERT_EQ(whole, ceph_crc32c_combine(crc_a, crc_b, len - split));
+  }
+  free(a);
+}
@@ -0,0 +1,141 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include "common/mClockQueue.h"
+#include <gtest/gtest.h>
+
+enum {
+  CLIENT = 0,
+  RECOVERY = 1,
+};
+
+struct IsEven {
+  bool operator()(int i) const { return i % 2 == 0; }
+};
+
+TEST(mClockQueue, strict) {
+  mClockQueue<int, int> q(1);
+  utime_t now(100, 0);
+  q.enqueue(0, CLIENT, 1, 1, now);
+  q.enqueue_strict(0, 10, 2);
+  q.enqueue_strict(0, 20, 3);
+  ASSERT_EQ(3u, q.length());
+  ASSERT_EQ(3, q.dequeue(now));
+  ASSERT_EQ(2, q.dequeue(now));
+  ASSERT_EQ(1, q.dequeue(now));
+  ASSERT_TRUE(q.empty());
+}
+
+TEST(mClockQueue, weight) {
+  mClockQueue<int, int> q(1);
+  q.set_class(CLIENT, 0, 3, 0);
+  q.set_class(RECOVERY, 0, 1, 0);
+  utime_t now(100, 0);
+  for (int i = 0; i < 400; ++i) {
+    q.enqueue(0, CLIENT, 1, CLIENT, now);
+    q.enqueue(0, RECOVERY, 1, RECOVERY, now);
+  }
+  int served[2] = {0, 0};
+  for (int i = 0; i < 400; ++i)
+    served[q.dequeue(now)]++;
+  // 3:1 split of the capacity
+  ASSERT_NEAR(300, served[CLIENT], 2);
+  ASSERT_NEAR(100, served[RECOVERY], 2);
+}
+
+TEST(mClockQueue, reservation) {
+  mClockQueue<int, int> q(1);
+  q.set_class(CLIENT, 0, 100, 0);
+  q.set_class(RECOVERY, 10, 1, 0);
+  utime_t start(100, 0);
+  for (int i = 0; i < 1000; ++i) {
+    q.enqueue(0, CLIENT, 1, CLIENT, start);
+    q.enqueue(0, RECOVERY, 1, RECOVERY, start);
+  }
+  // 1000 dequeues spread over 10 seconds: recovery has a weight of 1%
+  // but is guaranteed 10 ops per second, i.e. ~100 ops
+  int served[2] = {0, 0};
+  for (int i = 0; i < 1000; ++i) {
+    utime_t now = start;
+    now += (double)i / 100.0;
+    served[q.dequeue(now)]++;
+  }
+  ASSERT_GE(served[RECOVERY], 100);
+  ASSERT_LE(served[RECOVERY], 115);
+}
+
+TEST(mClockQueue, limit) {
+  mClockQueue<int, int> q(1);
+  q.set_class(CLIENT, 0, 1, 0);
+  q.set_class(RECOVERY, 0, 100, 10);
+  utime_t start(100, 0);
+  for (int i = 0; i < 1000; ++i) {
+    q.enqueue(0, CLIENT, 1, CLIENT, start);
+    q.enqueue(0, RECOVERY, 1, RECOVERY, start);
+  }
+  // recovery has by far the larger weight but may not exceed 10 ops per
+  // second while clients are waiting
+  int served[2] = {0, 0};
+  for (int i = 0; i < 1000; ++i) {
+    utime_t now = start;
+    now += (double)i / 100.0;
+    served[q.dequeue(now)]++;
+  }
+  ASSERT_LE(served[RECOVERY], 101);
+  ASSERT_GE(served[CLIENT], 899);
+
+  // with nothing else to do the limit does not idle the queue
+  mClockQueue<int, int> r(1);
+  r.set_class(RECOVERY, 0, 1, 1);
+  for (int i = 0; i < 10; ++i)
+    r.enqueue(0, RECOVERY, 1, i, start);
+  for (int i = 0; i < 10; ++i)
+    ASSERT_EQ(i, r.dequeue(start));
+}
+
+TEST(mClockQueue, cost) {
+  mClockQueue<int, int> q(100);
+  q.set_class(CLIENT, 0, 1, 0);
+  q.set_class(RECOVERY, 0, 1, 0);
+  utime_t now(100, 0);
+  for (int i = 0; i < 100; ++i) {
+    q.enqueue(0, CLIENT, 10, CLIENT, now);     // rounded up to min_cost
+    q.enqueue(0, RECOVERY, 400, RECOVERY, now);
+  }
+  int served[2] = {0, 0};
+  for (int i = 0; i < 50; ++i)
+    served[q.dequeue(now)]++;
+  ASSERT_NEAR(40, served[CLIENT], 1);
+  ASSERT_NEAR(10, served[RECOVERY], 1);
+}
+
+TEST(mClockQueue, round_robin_within_class) {
+  mClockQueue<int, int> q(1);
+  utime_t now(100, 0);
+  for (int i = 0; i < 3; ++i)
+    q.enqueue(1, CLIENT, 1, 10 + i, now);
+  q.enqueue(2, CLIENT, 1, 20, now);
+  ASSERT_EQ(10, q.dequeue(now));
+  ASSERT_EQ(20, q.dequeue(now));
+  ASSERT_EQ(11, q.dequeue(now));
+  ASSERT_EQ(12, q.dequeue(now));
+}
+
+TEST(mClockQueue, remove) {
+  mClockQueue<int, int> q(1);
+  utime_t now(100, 0);
+  for (int i = 0; i < 6; ++i)
+    q.enqueue(i % 3, CLIENT, 1, i, now);
+  q.enqueue_strict(1, 10, 7);
+  list<int> out;
+  q.remove_by_class(1, &out);
+  ASSERT_EQ(3u, out.size());
+  ASSERT_EQ(4u, q.length());
+  out.clear();
+  q.remove_by_filter(IsEven(), &out);
+  ASSERT_EQ(2u, out.size());
+  ASSERT_EQ(2u, q.length());
+  ASSERT_EQ(3, q.dequeue(now));
+  ASSERT_EQ(5, q.dequeue(now));
+  ASSERT_TRUE(q.empty());
+}
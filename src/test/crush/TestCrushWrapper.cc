@@ -29,6 +29,7 @@
 #include "include/Context.h"
 
 #include "crush/CrushWrapper.h"
+#include "osd/osd_types.h"
 
 TEST(CrushWrapper, get_immediate_parent) {
   CrushWrapper *c = new CrushWrapper;
@@ -440,6 +441,33 @@ TEST(CrushWrapper, bucket_types) {
   delete c;
 }
 
+TEST(CrushWrapper, ruleset_uses_firstn) {
+  CrushWrapper *c = new CrushWrapper;
+
+  const int ROOT_TYPE = 1;
+  c->set_type_name(ROOT_TYPE, "root");
+  const int OSD_TYPE = 0;
+  c->set_type_name(OSD_TYPE, "osd");
+
+  int root;
+  EXPECT_EQ(0, c->add_bucket(0, CRUSH_BUCKET_STRAW, CRUSH_HASH_RJENKINS1,
+			     ROOT_TYPE, 0, NULL, NULL, &root));
+  EXPECT_EQ(0, c->set_item_name(root, "default"));
+
+  int firstn = c->add_simple_ruleset("firstn", "default", "osd",
+				     "firstn", pg_pool_t::TYPE_REPLICATED);
+  ASSERT_LE(0, firstn);
+  int indep = c->add_simple_ruleset("indep", "default", "osd",
+				    "indep", pg_pool_t::TYPE_ERASURE);
+  ASSERT_LE(0, indep);
+
+  EXPECT_TRUE(c->ruleset_uses_firstn(c->get_rule_mask_ruleset(firstn)));
+  EXPECT_FALSE(c->ruleset_uses_firstn(c->get_rule_mask_ruleset(indep)));
+  // no such ruleset
+  EXPECT_FALSE(c->ruleset_uses_firstn(88));
+  delete c;
+}
+
 TEST(CrushWrapper, is_valid_crush_name) {
   EXPECT_TRUE(CrushWrapper::is_valid_crush_name("abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ012456789-_"));
   EXPECT_FALSE(CrushWrapper::is_valid_crush_name(""));
@@ -196,3 +196,96 @@ TEST(EncodingRoundTrip, MultimapConstructorCounter) {
   EXPECT_EQ(my_val_t::get_copy_ctor(), 10);
   EXPECT_EQ(my_val_t::get_assigns(), 0);
 }
+
+// a struct encoded both ways, to check BOUNDED_ENCODE_* against ENCODE_*
+struct bounded_t {
+  __u8 a;
+  uint64_t b;
+  std::string c;
+  std::vector<int32_t> d;
+  bufferlist e;
+  bool compat_bump;
+
+  bounded_t() : a(0), b(0), compat_bump(false) {}
+
+  void encode(bufferlist& bl) const {
+    ENCODE_START(3, 1, bl);
+    ::encode(a, bl);
+    ::encode(b, bl);
+    ::encode(c, bl);
+    ::encode(d, bl);
+    ::encode(e, bl);
+    ENCODE_FINISH_NEW_COMPAT(bl, compat_bump ? 2 : 0);
+  }
+  void bound_encode(size_t& p, uint64_t features=0) const {
+    p += BOUNDED_ENCODE_HEADER_LEN;
+    ::bound_encode(a, p);
+    ::bound_encode(b, p);
+    ::bound_encode(c, p);
+    ::bound_encode(d, p);
+    ::bound_encode(e, p);
+  }
+  void encode(bufferlist::contiguous_appender& p, uint64_t features=0) const {
+    BOUNDED_ENCODE_START(3, 1, p);
+    ::encode(a, p);
+    ::encode(b, p);
+    ::encode(c, p);
+    ::encode(d, p);
+    ::encode(e, p);
+    BOUNDED_ENCODE_FINISH_NEW_COMPAT(p, compat_bump ? 2 : 0);
+  }
+};
+WRITE_CLASS_BOUNDED_ENCODER(bounded_t)
+
+TEST(EncodingBounded, SameBytes) {
+  bounded_t t;
+  t.a = 7;
+  t.b = 0x0102030405060708ull;
+  t.c = "hello";
+  t.d.push_back(1);
+  t.d.push_back(-2);
+  t.e.append("foo", 3);
+  t.e.append(buffer::create(5000));  // spans more than one ptr
+  t.e.zero(3, 5000);
+
+  for (int bump = 0; bump < 2; ++bump) {
+    t.compat_bump = bump;
+    bufferlist old_bl, new_bl;
+    old_bl.append("prefix", 6);
+    new_bl.append("prefix", 6);
+    t.encode(old_bl);
+    encode_bounded(t, new_bl);
+    ASSERT_EQ(old_bl.length(), new_bl.length());
+    ASSERT_TRUE(old_bl.contents_equal(new_bl));
+  }
+}
+
+TEST(EncodingBounded, Appender) {
+  bufferlist bl;
+  {
+    bufferlist::contiguous_appender p(bl, 100);
+    ::encode((uint32_t)1, p);
+    p.flush();
+    ASSERT_EQ(4u, bl.length());
+    ::encode((uint32_t)2, p);
+  }
+  ASSERT_EQ(8u, bl.length());
+  // both pieces land in the same buffer
+  ASSERT_EQ(1u, bl.buffers().size());
+  {
+    // unused reservation is not added
+    bufferlist::contiguous_appender p(bl, 10000);
+    std::string s("abc");
+    ::encode(s, p);
+  }
+  ASSERT_EQ(15u, bl.length());
+  bufferlist::iterator i = bl.begin();
+  uint32_t x, y;
+  std::string s;
+  ::decode(x, i);
+  ::decode(y, i);
+  ::decode(s, i);
+  ASSERT_EQ(1u, x);
+  ASSERT_EQ(2u, y);
+  ASSERT_EQ("abc", s);
+}
@@ -86,6 +86,7 @@ TYPE(PushReplyOp)
 TYPE(ExplicitHashHitSet)
 TYPE(ExplicitObjectHitSet)
 TYPE(BloomHitSet)
+TYPE(CountingHitSet)
 TYPE(HitSet)
 TYPE(HitSet::Params)
 
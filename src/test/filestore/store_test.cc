@@ -964,6 +964,65 @@ TEST_F(StoreTest, MoveRename) {
   }
 }
 
+TEST_F(StoreTest, StrictCRC) {
+  g_ceph_context->_conf->set_val("filestore_strict_crc", "true");
+  g_ceph_context->_conf->set_val("filestore_sloppy_crc_block_size", "4096");
+  g_ceph_context->_conf->apply_changes(NULL);
+  coll_t cid("crc");
+  hobject_t oid("crc_oid", "", CEPH_NOSNAP, 0, 0, "");
+  int r;
+  {
+    ObjectStore::Transaction t;
+    t.create_collection(cid);
+    t.touch(cid, oid);
+    r = store->apply_transaction(t);
+    ASSERT_EQ(r, 0);
+  }
+  // unaligned writes, zeros and truncates must all leave the object
+  // readable with every block covered
+  bufferlist expected;
+  {
+    bufferlist a, b;
+    a.append(string(10000, 'a'));
+    b.append(string(3000, 'b'));
+    ObjectStore::Transaction t;
+    t.write(cid, oid, 0, a.length(), a);
+    t.write(cid, oid, 5000, b.length(), b);
+    t.zero(cid, oid, 100, 200);
+    t.truncate(cid, oid, 9000);
+    r = store->apply_transaction(t);
+    ASSERT_EQ(r, 0);
+    expected.append(string(100, 'a'));
+    expected.append(string(200, '\0'));
+    expected.append(string(4700, 'a'));
+    expected.append(string(3000, 'b'));
+    expected.append(string(1000, 'a'));
+  }
+  {
+    bufferlist in;
+    r = store->read(cid, oid, 0, 0, in);
+    ASSERT_EQ(9000, r);
+    ASSERT_TRUE(in.contents_equal(expected));
+  }
+  {
+    bufferlist in, sub;
+    r = store->read(cid, oid, 4000, 1234, in);
+    ASSERT_EQ(1234, r);
+    sub.substr_of(expected, 4000, 1234);
+    ASSERT_TRUE(in.contents_equal(sub));
+  }
+  {
+    ObjectStore::Transaction t;
+    t.remove(cid, oid);
+    t.remove_collection(cid);
+    r = store->apply_transaction(t);
+    ASSERT_EQ(r, 0);
+  }
+  g_ceph_context->_conf->set_val("filestore_strict_crc", "false");
+  g_ceph_context->_conf->set_val("filestore_sloppy_crc_block_size", "65536");
+  g_ceph_context->_conf->apply_changes(NULL);
+}
+
 //
 // support tests for qa/workunits/filestore/filestore.sh
 //
@@ -88,6 +88,11 @@ run_mon --osd_pool_default_crush_erasure_ruleset $expected
 ./ceph --format json osd dump | grep '"crush_ruleset":'$expected
 kill_mon
 
+# erasure coded pools cannot use a firstn crush rule
+run_mon --osd_pool_default_crush_erasure_ruleset 0
+./ceph osd pool create pool_erasure 12 12 erasure 2>&1 | grep 'uses firstn'
+kill_mon
+
 expected='"foo":"bar"'
 # osd_pool_default_erasure_code_properties is JSON
 run_mon --osd_pool_default_erasure_code_properties "{$expected}"
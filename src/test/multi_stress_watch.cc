@@ -11,6 +11,8 @@
 #include <string>
 #include <stdlib.h>
 #include <unistd.h>
+#include <sys/time.h>
+#include <vector>
 
 using namespace librados;
 using ceph::buffer;
@@ -29,10 +31,69 @@ public:
     }
 };
 
+class NullWatchCtx : public WatchCtx
+{
+public:
+    void notify(uint8_t opcode, uint64_t ver, bufferlist& bl) {}
+};
+
+static double now_ms()
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec * 1000.0 + tv.tv_usec / 1000.0;
+}
+
+/*
+ * Measure notify round trip time against the number of watchers.  All
+ * watches come from this client, so they share one OSD connection.
+ */
+static int notify_bench(IoCtx &ioctx, const std::string &obj_name,
+			int max_watchers, int iterations)
+{
+  NullWatchCtx ctx;
+  std::vector<uint64_t> handles;
+  std::cout << "# watchers\tnotifies\tavg_ms\tmax_ms" << std::endl;
+  for (int watchers = 1; watchers <= max_watchers; watchers *= 2) {
+    while ((int)handles.size() < watchers) {
+      uint64_t handle;
+      int ret = ioctx.watch(obj_name, 0, &handle, &ctx);
+      if (ret) {
+	std::cerr << "Error " << ret << " in watch" << std::endl;
+	return ret;
+      }
+      handles.push_back(handle);
+    }
+
+    double total = 0, worst = 0;
+    for (int i = 0; i < iterations; ++i) {
+      bufferlist bl;
+      double start = now_ms();
+      int ret = ioctx.notify(obj_name, 0, bl);
+      if (ret) {
+	std::cerr << "Error " << ret << " in notify" << std::endl;
+	return ret;
+      }
+      double lat = now_ms() - start;
+      total += lat;
+      if (lat > worst)
+	worst = lat;
+    }
+    std::cout << watchers << "\t" << iterations << "\t"
+	      << total / iterations << "\t" << worst << std::endl;
+  }
+  for (std::vector<uint64_t>::iterator p = handles.begin();
+       p != handles.end();
+       ++p)
+    ioctx.unwatch(obj_name, *p);
+  return 0;
+}
+
 int main(int args, char **argv)
 {
   if (args < 3) {
-    std::cerr << "Error: " << argv[0] << " pool_name obj_name" << std::endl;
+    std::cerr << "Error: " << argv[0] << " pool_name obj_name "
+	      << "[--bench max_watchers [iterations]]" << std::endl;
     return 1;
   }
 
@@ -69,7 +130,15 @@ int main(int args, char **argv)
 
   ioctx.create(obj_name, false);
 
-  
+  if (args > 4 && std::string(argv[3]) == "--bench") {
+    int max_watchers = atoi(argv[4]);
+    int iterations = args > 5 ? atoi(argv[5]) : 100;
+    ret = notify_bench(ioctx, obj_name, max_watchers, iterations);
+    ioctx.close();
+    return ret;
+  }
+
+  sem_init(&sem, 0, 0);
   for (int i = 0; i < 10000; ++i) {
     std::cerr << "Iteration " << i << std::endl;
     uint64_t handle;
@@ -174,6 +174,14 @@ TEST_F(TestHOBJECT_WITH_POOL, generate_and_parse_name) {
 
     test_generate_and_parse(hoid, "\\dA_KEY_head_ABABABAB_NSPACE_cdcdcdcd_efefefefef_b");
   }
+  {
+    // a shard without a generation must survive the round trip too
+    ghobject_t hoid(hobject_t(object_t("A"), key, CEPH_NOSNAP, hash, pool, ""),
+		    ghobject_t::NO_GEN, shard_id);
+    hoid.hobj.nspace = "NSPACE";
+
+    test_generate_and_parse(hoid, "A_KEY_head_ABABABAB_NSPACE_cdcdcdcd_ffffffffffffffff_b");
+  }
 }
 
 class TestLFNIndex : public TestWrapLFNIndex, public ::testing::Test {
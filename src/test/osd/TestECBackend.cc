@@ -0,0 +1,185 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * Copyright (C) 2013 Inktank Storage, Inc.
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include "global/global_init.h"
+#include "common/ceph_argparse.h"
+#include "global/global_context.h"
+#include "osd/ECBackend.h"
+#include "ErasureCodeExample.h"
+#include "gtest/gtest.h"
+
+static const uint64_t width = 16;
+
+static ghobject_t oid(const char *name)
+{
+  return ghobject_t(hobject_t(object_t(name), "", CEPH_NOSNAP, 0, 0, ""));
+}
+
+TEST(ECBackend, split_transaction)
+{
+  ceph::ErasureCodeInterfaceRef ec_impl(new ErasureCodeExample);
+  ECUtil::stripe_info_t sinfo(width, ec_impl->get_chunk_size(width));
+  coll_t cid("0.0_head");
+  ghobject_t a = oid("a");
+
+  bufferlist data;
+  for (unsigned i = 0; i < 2 * width + 5; ++i)
+    data.append((char)('a' + (i % 26)));
+  bufferlist attr;
+  attr.append("v");
+
+  ObjectStore::Transaction t;
+  t.touch(cid, a);
+  t.write(cid, a, width, data.length(), data);
+  t.setattr(cid, a, "_", attr);
+  t.truncate(cid, a, 2 * width);
+
+  // osd 13 holds no shard
+  map<int, int> shards;
+  for (unsigned i = 0; i < ec_impl->get_chunk_count(); ++i)
+    shards[10 + i] = i;
+  shards[13] = -1;
+  map<int, ObjectStore::Transaction> out;
+  EXPECT_EQ(0, ECBackend::split_transaction(sinfo, ec_impl, t, shards, &out));
+  EXPECT_EQ(shards.size(), out.size());
+
+  set<int> want;
+  for (unsigned i = 0; i < ec_impl->get_chunk_count(); ++i)
+    want.insert(i);
+  map<int, bufferlist> encoded;
+  EXPECT_EQ(0, ECUtil::encode(sinfo, ec_impl, data, want, &encoded));
+
+  for (map<int, int>::iterator s = shards.begin(); s != shards.end(); ++s) {
+    // each osd stores the object under its shard
+    ghobject_t key = a;
+    if (s->second >= 0)
+      key = ghobject_t(a.hobj, ghobject_t::NO_GEN, s->second);
+    ObjectStore::Transaction::iterator i = out[s->first].begin();
+    ASSERT_TRUE(i.have_op());
+    EXPECT_EQ((int)ObjectStore::Transaction::OP_TOUCH, i.get_op());
+    EXPECT_EQ(cid, i.get_cid());
+    EXPECT_EQ(key, i.get_oid());
+
+    // only the shards get the data, at the matching chunk offset
+    if (s->second >= 0) {
+      ASSERT_TRUE(i.have_op());
+      EXPECT_EQ((int)ObjectStore::Transaction::OP_WRITE, i.get_op());
+      EXPECT_EQ(cid, i.get_cid());
+      EXPECT_EQ(key, i.get_oid());
+      EXPECT_EQ(sinfo.get_chunk_size(), i.get_length());
+      EXPECT_EQ(3 * sinfo.get_chunk_size(), i.get_length());
+      bufferlist chunk;
+      i.get_bl(chunk);
+      EXPECT_TRUE(chunk.contents_equal(encoded[s->second]));
+    }
+
+    ASSERT_TRUE(i.have_op());
+    EXPECT_EQ((int)ObjectStore::Transaction::OP_SETATTR, i.get_op());
+    EXPECT_EQ(cid, i.get_cid());
+    EXPECT_EQ(key, i.get_oid());
+    EXPECT_EQ("_", i.get_attrname());
+    bufferlist bl;
+    i.get_bl(bl);
+    EXPECT_TRUE(bl.contents_equal(attr));
+
+    ASSERT_TRUE(i.have_op());
+    EXPECT_EQ((int)ObjectStore::Transaction::OP_TRUNCATE, i.get_op());
+    EXPECT_EQ(cid, i.get_cid());
+    EXPECT_EQ(key, i.get_oid());
+    EXPECT_EQ(2 * sinfo.get_chunk_size(), i.get_length());
+
+    EXPECT_FALSE(i.have_op());
+  }
+}
+
+TEST(ECBackend, split_transaction_clone)
+{
+  ceph::ErasureCodeInterfaceRef ec_impl(new ErasureCodeExample);
+  ECUtil::stripe_info_t sinfo(width, ec_impl->get_chunk_size(width));
+  coll_t cid("0.0_head");
+  ghobject_t a = oid("a"), b = oid("b");
+
+  ObjectStore::Transaction t;
+  t.clone(cid, a, b);
+
+  map<int, int> shards;
+  for (unsigned i = 0; i < ec_impl->get_chunk_count(); ++i)
+    shards[10 + i] = i;
+  map<int, ObjectStore::Transaction> out;
+  EXPECT_EQ(0, ECBackend::split_transaction(sinfo, ec_impl, t, shards, &out));
+
+  // both ends of the clone are the chunks of the same shard
+  for (map<int, int>::iterator s = shards.begin(); s != shards.end(); ++s) {
+    ObjectStore::Transaction::iterator i = out[s->first].begin();
+    ASSERT_TRUE(i.have_op());
+    EXPECT_EQ((int)ObjectStore::Transaction::OP_CLONE, i.get_op());
+    EXPECT_EQ(cid, i.get_cid());
+    EXPECT_EQ(ghobject_t(a.hobj, ghobject_t::NO_GEN, s->second), i.get_oid());
+    EXPECT_EQ(ghobject_t(b.hobj, ghobject_t::NO_GEN, s->second), i.get_oid());
+    EXPECT_FALSE(i.have_op());
+  }
+}
+
+TEST(ECBackend, split_transaction_unsupported)
+{
+  ceph::ErasureCodeInterfaceRef ec_impl(new ErasureCodeExample);
+  ECUtil::stripe_info_t sinfo(width, ec_impl->get_chunk_size(width));
+  coll_t cid("0.0_head");
+  ghobject_t a = oid("a"), b = oid("b");
+  map<int, int> shards;
+  for (unsigned i = 0; i < ec_impl->get_chunk_count(); ++i)
+    shards[10 + i] = i;
+  bufferlist data;
+  data.append("0123456789abcdef");
+
+  vector<ObjectStore::Transaction> bad(4);
+  bad[0].zero(cid, a, 0, width);
+  bad[1].clone_range(cid, a, b, 0, width, 0);
+  bad[2].write(cid, a, width / 2, data.length(), data);
+  bad[3].truncate(cid, a, width + 1);
+  for (unsigned i = 0; i < bad.size(); ++i) {
+    map<int, ObjectStore::Transaction> out;
+    EXPECT_EQ(-EOPNOTSUPP,
+	      ECBackend::split_transaction(sinfo, ec_impl, bad[i], shards, &out));
+    // same answer when only checking
+    EXPECT_EQ(-EOPNOTSUPP,
+	      ECBackend::split_transaction(sinfo, ec_impl, bad[i],
+					   map<int, int>(), &out));
+  }
+
+  // without shards the transaction is only walked through
+  ObjectStore::Transaction t;
+  t.touch(cid, a);
+  t.write(cid, a, 0, data.length(), data);
+  t.truncate(cid, a, width);
+  map<int, ObjectStore::Transaction> out;
+  EXPECT_EQ(0, ECBackend::split_transaction(sinfo, ec_impl, t,
+					    map<int, int>(), &out));
+  EXPECT_TRUE(out.empty());
+}
+
+int main(int argc, char **argv) {
+  vector<const char*> args;
+  argv_to_vec(argc, (const char **)argv, args);
+
+  global_init(NULL, args, CEPH_ENTITY_TYPE_CLIENT, CODE_ENVIRONMENT_UTILITY, 0);
+  common_init_finish(g_ceph_context);
+
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
+
+// Local Variables:
+// compile-command: "cd ../.. ; make -j4 && make unittest_ecbackend && ./unittest_ecbackend"
+// End:
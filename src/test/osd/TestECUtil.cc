@@ -0,0 +1,136 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * Copyright (C) 2013 Inktank Storage, Inc.
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include "global/global_init.h"
+#include "common/ceph_argparse.h"
+#include "global/global_context.h"
+#include "osd/ECUtil.h"
+#include "ErasureCodeExample.h"
+#include "gtest/gtest.h"
+
+TEST(ECUtil, stripe_info)
+{
+  ECUtil::stripe_info_t s(4096, 1024);
+  EXPECT_EQ(4096u, s.get_stripe_width());
+  EXPECT_EQ(1024u, s.get_chunk_size());
+  EXPECT_TRUE(s.logical_offset_is_stripe_aligned(0));
+  EXPECT_TRUE(s.logical_offset_is_stripe_aligned(8192));
+  EXPECT_FALSE(s.logical_offset_is_stripe_aligned(100));
+  EXPECT_EQ(4096u, s.logical_to_prev_stripe_offset(5000));
+  EXPECT_EQ(8192u, s.logical_to_next_stripe_offset(5000));
+  EXPECT_EQ(8192u, s.logical_to_next_stripe_offset(8192));
+  EXPECT_EQ(1024u, s.logical_to_prev_chunk_offset(5000));
+  EXPECT_EQ(2048u, s.logical_to_next_chunk_offset(5000));
+  EXPECT_EQ(2048u, s.aligned_logical_offset_to_chunk_offset(8192));
+  EXPECT_EQ(8192u, s.aligned_chunk_offset_to_logical_offset(2048));
+  pair<uint64_t, uint64_t> b = s.offset_len_to_stripe_bounds(5000, 4000);
+  EXPECT_EQ(4096u, b.first);
+  EXPECT_EQ(8192u, b.second);
+}
+
+TEST(ECUtil, encode_decode)
+{
+  ceph::ErasureCodeInterfaceRef ec_impl(new ErasureCodeExample);
+  const uint64_t width = 16;
+  ECUtil::stripe_info_t sinfo(width, ec_impl->get_chunk_size(width));
+
+  // two full stripes and a partial one
+  bufferlist in;
+  for (unsigned i = 0; i < 2 * width + 5; ++i)
+    in.append((char)('a' + (i % 26)));
+
+  set<int> want;
+  for (unsigned i = 0; i < ec_impl->get_chunk_count(); ++i)
+    want.insert(i);
+  map<int, bufferlist> encoded;
+  EXPECT_EQ(0, ECUtil::encode(sinfo, ec_impl, in, want, &encoded));
+  EXPECT_EQ(3u, encoded.size());
+  for (map<int, bufferlist>::iterator i = encoded.begin();
+       i != encoded.end();
+       ++i)
+    EXPECT_EQ(3 * sinfo.get_chunk_size(), i->second.length());
+
+  // logical content from any two shards
+  for (int missing = 0; missing < 3; ++missing) {
+    map<int, bufferlist> degraded = encoded;
+    degraded.erase(missing);
+    bufferlist out;
+    EXPECT_EQ(0, ECUtil::decode(sinfo, ec_impl, degraded, &out));
+    EXPECT_EQ(3 * width, out.length());
+    bufferlist logical;
+    logical.substr_of(out, 0, in.length());
+    EXPECT_TRUE(logical.contents_equal(in));
+  }
+
+  // rebuild a single shard
+  {
+    map<int, bufferlist> degraded = encoded;
+    degraded.erase(1);
+    bufferlist rebuilt;
+    map<int, bufferlist*> out;
+    out[1] = &rebuilt;
+    EXPECT_EQ(0, ECUtil::decode(sinfo, ec_impl, degraded, out));
+    EXPECT_TRUE(rebuilt.contents_equal(encoded[1]));
+  }
+
+  // shards of different lengths are refused
+  {
+    map<int, bufferlist> degraded = encoded;
+    degraded.erase(2);
+    bufferlist shorter;
+    shorter.substr_of(degraded[0], 0, sinfo.get_chunk_size());
+    degraded[0].swap(shorter);
+    bufferlist out;
+    EXPECT_EQ(-EIO, ECUtil::decode(sinfo, ec_impl, degraded, &out));
+  }
+}
+
+TEST(ECUtil, append)
+{
+  ceph::ErasureCodeInterfaceRef ec_impl(new ErasureCodeExample);
+  const uint64_t width = 8;
+  ECUtil::stripe_info_t sinfo(width, ec_impl->get_chunk_size(width));
+  set<int> want;
+  for (unsigned i = 0; i < ec_impl->get_chunk_count(); ++i)
+    want.insert(i);
+
+  // encoding an append stripe by stripe only appends to each shard
+  bufferlist first, second, both;
+  first.append("0123456789abcdef");
+  second.append("ghijklmn");
+  both.append(first);
+  both.append(second);
+
+  map<int, bufferlist> whole, pieces;
+  EXPECT_EQ(0, ECUtil::encode(sinfo, ec_impl, both, want, &whole));
+  EXPECT_EQ(0, ECUtil::encode(sinfo, ec_impl, first, want, &pieces));
+  EXPECT_EQ(0, ECUtil::encode(sinfo, ec_impl, second, want, &pieces));
+  for (set<int>::iterator i = want.begin(); i != want.end(); ++i)
+    EXPECT_TRUE(whole[*i].contents_equal(pieces[*i]));
+}
+
+int main(int argc, char **argv) {
+  vector<const char*> args;
+  argv_to_vec(argc, (const char **)argv, args);
+
+  global_init(NULL, args, CEPH_ENTITY_TYPE_CLIENT, CODE_ENVIRONMENT_UTILITY, 0);
+  common_init_finish(g_ceph_context);
+
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
+
+// Local Variables:
+// compile-command: "cd ../.. ; make -j4 && make unittest_ecutil && ./unittest_ecutil"
+// End:
@@ -111,6 +111,9 @@ TEST(ErasureCodeExample, encode_decode)
                               in,
                               &encoded));
   EXPECT_EQ(3u, encoded.size());
+  EXPECT_EQ(3u, example.get_chunk_count());
+  EXPECT_EQ(2u, example.get_data_chunk_count());
+  EXPECT_EQ(3u, example.get_chunk_size(in.length()));
   EXPECT_EQ(3u, encoded[0].length());
   EXPECT_EQ('A', encoded[0][0]);
   EXPECT_EQ('B', encoded[0][1]);
@@ -20,6 +20,10 @@
 #include "common/ceph_argparse.h"
 #include "global/global_context.h"
 #include "gtest/gtest.h"
+extern "C" {
+#include "osd/ErasureCodePluginJerasure/galois.h"
+#include "osd/ErasureCodePluginJerasure/galois_simd.h"
+}
 
 template <typename T>
 class ErasureCodeTest : public ::testing::Test {
@@ -67,6 +71,9 @@ TYPED_TEST(ErasureCodeTest, encode_decode)
                               &encoded));
   EXPECT_EQ(4u, encoded.size());
   unsigned length =  encoded[0].length();
+  EXPECT_EQ(4u, jerasure.get_chunk_count());
+  EXPECT_EQ(2u, jerasure.get_data_chunk_count());
+  EXPECT_EQ(length, jerasure.get_chunk_size(in.length()));
   EXPECT_EQ(0, strncmp(encoded[0].c_str(), in.c_str(), length));
   EXPECT_EQ(0, strncmp(encoded[1].c_str(), in.c_str() + length,
 		       in.length() - length));
@@ -287,6 +294,59 @@ TEST(ErasureCodeTest, encode)
   }
 }
 
+TEST(ErasureCodeJerasure, galois_simd)
+{
+  // not a multiple of the vector sizes, to exercise the scalar tail
+  const int length = 4096 + 3 * sizeof(long);
+  unsigned char src[length], dst[length], orig[length], expected[length];
+  for (int i = 0; i < length; i++) {
+    src[i] = rand();
+    orig[i] = rand();
+  }
+
+  int top = galois_simd_level();
+  for (int level = GALOIS_SIMD_NONE; level <= top; level++) {
+    EXPECT_EQ(level, galois_simd_set_level(level));
+    for (int add = 0; add < 2; add++) {
+      int multby = 1 + rand() % 255;
+      memcpy(dst, orig, length);
+      galois_w08_region_multiply((char*)src, multby, length, (char*)dst, add);
+      for (int i = 0; i < length; i++) {
+	expected[i] = galois_single_multiply(src[i], multby, 8);
+	if (add)
+	  expected[i] ^= orig[i];
+      }
+      EXPECT_EQ(0, memcmp(expected, dst, length)) << "w=8 level " << level;
+
+      multby = 1 + rand() % 65535;
+      memcpy(dst, orig, length);
+      galois_w16_region_multiply((char*)src, multby, length, (char*)dst, add);
+      for (int i = 0; i < length; i += 2) {
+	int product = galois_single_multiply(src[i] | (src[i + 1] << 8),
+					     multby, 16);
+	if (add)
+	  product ^= orig[i] | (orig[i + 1] << 8);
+	expected[i] = product & 0xff;
+	expected[i + 1] = product >> 8;
+      }
+      EXPECT_EQ(0, memcmp(expected, dst, length)) << "w=16 level " << level;
+    }
+
+    galois_region_xor((char*)src, (char*)orig, (char*)dst, length);
+    for (int i = 0; i < length; i++)
+      expected[i] = src[i] ^ orig[i];
+    EXPECT_EQ(0, memcmp(expected, dst, length)) << "xor level " << level;
+
+    // in place
+    memcpy(dst, src, length);
+    galois_w08_region_multiply((char*)dst, 3, length, NULL, 0);
+    for (int i = 0; i < length; i++)
+      expected[i] = galois_single_multiply(src[i], 3, 8);
+    EXPECT_EQ(0, memcmp(expected, dst, length)) << "in place level " << level;
+  }
+  galois_simd_set_level(top);
+}
+
 int main(int argc, char **argv)
 {
   vector<const char*> args;
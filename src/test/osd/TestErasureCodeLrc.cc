@@ -0,0 +1,237 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * Copyright (C) 2013 Inktank Storage, Inc.
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include <errno.h>
+#include "global/global_init.h"
+#include "include/stringify.h"
+#include "osd/ErasureCodePluginLrc/ErasureCodeLrc.h"
+#include "common/ceph_argparse.h"
+#include "global/global_context.h"
+#include "gtest/gtest.h"
+
+static void lrc_init(ErasureCodeLrc &lrc, int k, int m, int l)
+{
+  map<std::string,std::string> parameters;
+  parameters["erasure-code-k"] = stringify(k);
+  parameters["erasure-code-m"] = stringify(m);
+  parameters["erasure-code-l"] = stringify(l);
+  EXPECT_EQ(0, lrc.init(parameters));
+}
+
+TEST(ErasureCodeLrc, init)
+{
+  {
+    ErasureCodeLrc lrc;
+    map<std::string,std::string> parameters;
+    parameters["erasure-code-k"] = "4";
+    parameters["erasure-code-m"] = "2";
+    parameters["erasure-code-l"] = "4";
+    EXPECT_EQ(-EINVAL, lrc.init(parameters));
+  }
+  {
+    ErasureCodeLrc lrc;
+    lrc_init(lrc, 4, 2, 3);
+    EXPECT_EQ(8u, lrc.get_chunk_count());
+    EXPECT_EQ(4u, lrc.get_data_chunk_count());
+    EXPECT_EQ(2u, lrc.get_group_count());
+    EXPECT_EQ(1, lrc.get_group(5));
+    EXPECT_EQ(1, lrc.get_group(7));
+    EXPECT_EQ(6, lrc.get_local_parity(0));
+  }
+}
+
+TEST(ErasureCodeLrc, minimum_to_decode)
+{
+  ErasureCodeLrc lrc;
+  lrc_init(lrc, 4, 2, 3);
+  // groups are { 0, 1, 2 } + 6 and { 3, 4, 5 } + 7
+  set<int> all;
+  for (unsigned i = 0; i < lrc.get_chunk_count(); i++)
+    all.insert(i);
+
+  // everything wanted is available
+  {
+    set<int> want, minimum;
+    want.insert(1);
+    EXPECT_EQ(0, lrc.minimum_to_decode(want, all, &minimum));
+    EXPECT_TRUE(want == minimum);
+  }
+  // one lost chunk is rebuilt from the l other chunks of its group
+  {
+    set<int> want, available = all, minimum, expected;
+    want.insert(0);
+    available.erase(0);
+    EXPECT_EQ(0, lrc.minimum_to_decode(want, available, &minimum));
+    expected.insert(1);
+    expected.insert(2);
+    expected.insert(6);
+    EXPECT_TRUE(expected == minimum);
+  }
+  // so is a lost local parity
+  {
+    set<int> want, available = all, minimum, expected;
+    want.insert(7);
+    available.erase(7);
+    EXPECT_EQ(0, lrc.minimum_to_decode(want, available, &minimum));
+    expected.insert(3);
+    expected.insert(4);
+    expected.insert(5);
+    EXPECT_TRUE(expected == minimum);
+  }
+  // two lost chunks in the same group need the global layer
+  {
+    set<int> want, available = all, minimum;
+    want.insert(0);
+    available.erase(0);
+    available.erase(1);
+    EXPECT_EQ(0, lrc.minimum_to_decode(want, available, &minimum));
+    EXPECT_EQ(4u, minimum.size());
+    EXPECT_EQ(0u, minimum.count(0));
+    EXPECT_EQ(0u, minimum.count(1));
+  }
+  // not enough chunks left
+  {
+    set<int> want, available, minimum;
+    want.insert(0);
+    available.insert(3);
+    available.insert(4);
+    available.insert(5);
+    available.insert(7);
+    EXPECT_EQ(-EIO, lrc.minimum_to_decode(want, available, &minimum));
+  }
+}
+
+TEST(ErasureCodeLrc, minimum_to_decode_with_cost)
+{
+  ErasureCodeLrc lrc;
+  lrc_init(lrc, 4, 2, 3);
+  map<int, int> available;
+  for (unsigned i = 0; i < lrc.get_chunk_count(); i++)
+    available[i] = 1;
+  available.erase(0);
+
+  set<int> want;
+  want.insert(0);
+  // the local group is cheaper
+  {
+    set<int> minimum;
+    EXPECT_EQ(0, lrc.minimum_to_decode_with_cost(want, available, &minimum));
+    EXPECT_EQ(3u, minimum.size());
+  }
+  // unless it is in another rack: the global layer reads 3, 4, 5
+  // and only one of the costly chunks
+  {
+    map<int, int> costly = available;
+    costly[1] = 10;
+    costly[2] = 10;
+    set<int> minimum;
+    EXPECT_EQ(0, lrc.minimum_to_decode_with_cost(want, costly, &minimum));
+    EXPECT_EQ(4u, minimum.size());
+    EXPECT_EQ(1u, minimum.count(1) + minimum.count(2));
+  }
+}
+
+TEST(ErasureCodeLrc, encode_decode)
+{
+  ErasureCodeLrc lrc;
+  lrc_init(lrc, 4, 2, 3);
+  unsigned chunk_count = lrc.get_chunk_count();
+
+  bufferlist in;
+  for (int i = 0; i < 1000; i++)
+    in.append((char)(i * 7));
+  set<int> want_to_encode;
+  for (unsigned i = 0; i < chunk_count; i++)
+    want_to_encode.insert(i);
+  map<int, bufferlist> encoded;
+  EXPECT_EQ(0, lrc.encode(want_to_encode, in, &encoded));
+  EXPECT_EQ(chunk_count, encoded.size());
+  unsigned length = encoded[0].length();
+  EXPECT_EQ(length, lrc.get_chunk_size(in.length()));
+  for (int i = 0; i < 4; i++)
+    EXPECT_EQ(0, memcmp(encoded[i].c_str(), in.c_str() + i * length,
+			min(length, in.length() - i * length)));
+
+  // any single chunk, from its group
+  for (unsigned lost = 0; lost < chunk_count; lost++) {
+    map<int, bufferlist> chunks = encoded;
+    chunks.erase(lost);
+    set<int> want_to_read, minimum, available;
+    want_to_read.insert(lost);
+    for (map<int, bufferlist>::iterator i = chunks.begin();
+	 i != chunks.end();
+	 ++i)
+      available.insert(i->first);
+    EXPECT_EQ(0, lrc.minimum_to_decode(want_to_read, available, &minimum));
+    EXPECT_EQ(3u, minimum.size());
+    map<int, bufferlist> reads;
+    for (set<int>::iterator i = minimum.begin(); i != minimum.end(); ++i)
+      reads[*i] = encoded[*i];
+    map<int, bufferlist> decoded;
+    EXPECT_EQ(0, lrc.decode(want_to_read, reads, &decoded));
+    EXPECT_TRUE(decoded[lost].contents_equal(encoded[lost])) << "lost " << lost;
+  }
+
+  // two chunks of the same group, and its local parity
+  {
+    map<int, bufferlist> chunks = encoded;
+    chunks.erase(0);
+    chunks.erase(1);
+    chunks.erase(6);
+    set<int> want_to_read;
+    want_to_read.insert(0);
+    want_to_read.insert(1);
+    want_to_read.insert(6);
+    map<int, bufferlist> decoded;
+    EXPECT_EQ(0, lrc.decode(want_to_read, chunks, &decoded));
+    for (set<int>::iterator i = want_to_read.begin();
+	 i != want_to_read.end();
+	 ++i)
+      EXPECT_TRUE(decoded[*i].contents_equal(encoded[*i])) << "lost " << *i;
+  }
+
+  // three chunks of a group are more than the global layer can decode
+  {
+    map<int, bufferlist> chunks = encoded;
+    chunks.erase(0);
+    chunks.erase(1);
+    chunks.erase(2);
+    set<int> want_to_read;
+    want_to_read.insert(0);
+    map<int, bufferlist> decoded;
+    EXPECT_EQ(-EIO, lrc.decode(want_to_read, chunks, &decoded));
+  }
+}
+
+int main(int argc, char **argv)
+{
+  vector<const char*> args;
+  argv_to_vec(argc, (const char **)argv, args);
+
+  global_init(NULL, args, CEPH_ENTITY_TYPE_CLIENT, CODE_ENVIRONMENT_UTILITY, 0);
+  common_init_finish(g_ceph_context);
+
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
+
+/*
+ * Local Variables:
+ * compile-command: "cd ../.. ; make -j4 &&
+ *   make unittest_erasure_code_lrc &&
+ *   valgrind --tool=memcheck --leak-check=full \
+ *      ./unittest_erasure_code_lrc \
+ *      --gtest_filter=*.* --log-to-stderr=true --debug-osd=20"
+ * End:
+ */
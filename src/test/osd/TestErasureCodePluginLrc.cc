@@ -0,0 +1,61 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * Copyright (C) 2013 Inktank Storage, Inc.
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include <errno.h>
+#include "global/global_init.h"
+#include "osd/ErasureCodePlugin.h"
+#include "common/ceph_argparse.h"
+#include "global/global_context.h"
+#include "gtest/gtest.h"
+
+TEST(ErasureCodePlugin, factory)
+{
+  ErasureCodePluginRegistry &instance = ErasureCodePluginRegistry::instance();
+  map<std::string,std::string> parameters;
+  parameters["erasure-code-directory"] = ".libs";
+  {
+    ErasureCodeInterfaceRef erasure_code;
+    parameters["erasure-code-l"] = "4";
+    EXPECT_EQ(-EINVAL, instance.factory("lrc", parameters, &erasure_code));
+    EXPECT_FALSE(erasure_code);
+  }
+  {
+    ErasureCodeInterfaceRef erasure_code;
+    parameters["erasure-code-l"] = "3";
+    EXPECT_EQ(0, instance.factory("lrc", parameters, &erasure_code));
+    EXPECT_TRUE(erasure_code);
+    EXPECT_EQ(8u, erasure_code->get_chunk_count());
+  }
+}
+
+int main(int argc, char **argv)
+{
+  vector<const char*> args;
+  argv_to_vec(argc, (const char **)argv, args);
+
+  global_init(NULL, args, CEPH_ENTITY_TYPE_CLIENT, CODE_ENVIRONMENT_UTILITY, 0);
+  common_init_finish(g_ceph_context);
+
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
+
+/*
+ * Local Variables:
+ * compile-command: "cd ../.. ; make -j4 &&
+ *   make unittest_erasure_code_plugin_lrc &&
+ *   valgrind --tool=memcheck ./unittest_erasure_code_plugin_lrc \
+ *      --gtest_filter=*.* --log-to-stderr=true --debug-osd=20"
+ * End:
+ */
@@ -0,0 +1,163 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include <sstream>
+#include <pthread.h>
+#include "global/global_init.h"
+#include "common/ceph_argparse.h"
+#include "global/global_context.h"
+#include "include/atomic.h"
+#include "messages/MOSDOp.h"
+#include "messages/MOSDOpReply.h"
+#include "gtest/gtest.h"
+
+static bufferlist encode_op(MOSDOp **orig)
+{
+  object_t oid("foo");
+  object_locator_t oloc(1);
+  MOSDOp *m = new MOSDOp(1, 2, oid, oloc, pg_t(3, 1), 5,
+			 CEPH_OSD_FLAG_WRITE);
+  bufferlist bl;
+  bl.append("hello");
+  m->write(0, bl.length(), bl);
+  m->set_retry_attempt(2);
+  m->set_snapid(CEPH_NOSNAP);
+  m->encode_payload(CEPH_FEATURES_ALL);
+  *orig = m;
+  return m->get_payload();
+}
+
+/// what the messenger hands the OSD: only the routing fields decoded
+static MOSDOp *decode_op(MOSDOp *orig, const bufferlist& payload)
+{
+  MOSDOp *m = new MOSDOp();
+  m->set_header(orig->get_header());
+  bufferlist bl = payload;
+  m->set_payload(bl);
+  m->set_data(orig->get_data());
+  m->decode_payload();
+  return m;
+}
+
+TEST(MOSDOp, lazy_decode)
+{
+  MOSDOp *orig;
+  bufferlist payload = encode_op(&orig);
+  MOSDOp *m = decode_op(orig, payload);
+
+  // routing fields are there before the rest is decoded
+  EXPECT_TRUE(m->is_final_decode_needed());
+  EXPECT_EQ(pg_t(3, 1), m->get_pg());
+  EXPECT_EQ(5u, m->get_map_epoch());
+  EXPECT_TRUE(m->get_flags() & CEPH_OSD_FLAG_WRITE);
+  ostringstream ss;
+  m->print(ss);
+  EXPECT_NE(string::npos, ss.str().find("(undecoded)"));
+
+  EXPECT_EQ(0, m->finish_decode());
+  EXPECT_FALSE(m->is_final_decode_needed());
+  EXPECT_EQ("foo", m->get_oid().name);
+  ASSERT_EQ(1u, m->ops.size());
+  EXPECT_EQ(CEPH_OSD_OP_WRITE, m->ops[0].op.op);
+  EXPECT_EQ(5u, m->ops[0].op.extent.length);
+  EXPECT_EQ(2, m->get_retry_attempt());
+  EXPECT_EQ(0, m->finish_decode());  // once is enough
+  EXPECT_EQ(1u, m->ops.size());
+  m->put();
+  orig->put();
+}
+
+TEST(MOSDOp, malformed)
+{
+  MOSDOp *orig;
+  bufferlist payload = encode_op(&orig);
+  unsigned routed = 0;
+  for (unsigned len = 0; len < payload.length(); ++len) {
+    bufferlist cut;
+    cut.substr_of(payload, 0, len);
+    MOSDOp *m;
+    try {
+      m = decode_op(orig, cut);
+    } catch (const buffer::error& e) {
+      continue;  // the messenger drops it
+    }
+    ++routed;
+    EXPECT_EQ(-EINVAL, m->finish_decode());
+    EXPECT_FALSE(m->is_final_decode_needed());
+    EXPECT_TRUE(m->get_oid().name.empty());
+    EXPECT_TRUE(m->ops.empty());
+
+    // and can still be answered
+    MOSDOpReply *reply = new MOSDOpReply(m, -EINVAL, 5, 0);
+    EXPECT_EQ(-EINVAL, reply->get_result());
+    reply->put();
+    m->put();
+  }
+  EXPECT_LT(0u, routed);
+  orig->put();
+}
+
+struct printer_t {
+  MOSDOp *m;
+  atomic_t stop;
+  atomic_t prints;
+  unsigned torn;  ///< prints that were neither undecoded nor complete
+  printer_t() : m(NULL), torn(0) {}
+  static void *entry(void *arg) {
+    printer_t *t = static_cast<printer_t*>(arg);
+    while (!t->stop.read()) {
+      ostringstream ss;
+      t->m->print(ss);
+      if (ss.str().find("(undecoded)") == string::npos &&
+	  ss.str().find("foo [write 0~5]") == string::npos)
+	++t->torn;
+      t->prints.inc();
+    }
+    return NULL;
+  }
+};
+
+TEST(MOSDOp, print_while_decoding)
+{
+  MOSDOp *orig;
+  bufferlist payload = encode_op(&orig);
+  for (unsigned i = 0; i < 100; ++i) {
+    printer_t t;
+    t.m = decode_op(orig, payload);
+    pthread_t tid;
+    ASSERT_EQ(0, pthread_create(&tid, NULL, printer_t::entry, &t));
+    while (!t.prints.read())
+      ;
+    EXPECT_EQ(0, t.m->finish_decode());
+    t.stop.set(1);
+    pthread_join(tid, NULL);
+    // print() sees the op either undecoded or complete, never half way
+    EXPECT_EQ(0u, t.torn);
+    t.m->put();
+  }
+  orig->put();
+}
+
+int main(int argc, char **argv) {
+  vector<const char*> args;
+  argv_to_vec(argc, (const char **)argv, args);
+
+  global_init(NULL, args, CEPH_ENTITY_TYPE_CLIENT, CODE_ENVIRONMENT_UTILITY, 0);
+  common_init_finish(g_ceph_context);
+
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
+
+// Local Variables:
+// compile-command: "cd ../.. ; make -j4 && make unittest_mosdop && ./unittest_mosdop"
+// End:
@@ -0,0 +1,208 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include <malloc.h>
+#include <iostream>
+
+#include "gtest/gtest.h"
+#include "osd/OSDMap.h"
+#include "global/global_init.h"
+#include "common/ceph_argparse.h"
+#include "global/global_context.h"
+
+static const int num_osds = 200;
+static const int num_epochs = 500;
+
+class OSDMapTest : public testing::Test {
+public:
+  OSDMap osdmap;
+  vector<OSDMap::Incremental> incs;
+
+  OSDMapTest() {}
+
+  void set_up_map() {
+    uuid_d fsid;
+    osdmap.build_simple(g_ceph_context, 0, fsid, num_osds, 6, 6);
+    OSDMap::Incremental pending_inc(osdmap.get_epoch() + 1);
+    pending_inc.fsid = osdmap.get_fsid();
+    entity_addr_t sample_addr;
+    uuid_d sample_uuid;
+    for (int i = 0; i < num_osds; ++i) {
+      sample_uuid.uuid[i % 16] = i;
+      sample_addr.nonce = i;
+      pending_inc.new_state[i] = CEPH_OSD_EXISTS | CEPH_OSD_NEW;
+      pending_inc.new_up_client[i] = sample_addr;
+      pending_inc.new_up_cluster[i] = sample_addr;
+      pending_inc.new_hb_back_up[i] = sample_addr;
+      pending_inc.new_hb_front_up[i] = sample_addr;
+      pending_inc.new_weight[i] = CEPH_OSD_IN;
+      pending_inc.new_uuid[i] = sample_uuid;
+    }
+    osdmap.apply_incremental(pending_inc);
+  }
+
+  /// a stream of typical incrementals: up_thru bumps, pg_temp churn
+  /// and the odd osd restarting
+  void make_incrementals() {
+    for (int i = 0; i < num_epochs; ++i) {
+      OSDMap::Incremental inc(osdmap.get_epoch() + 1 + i);
+      inc.fsid = osdmap.get_fsid();
+      inc.new_up_thru[i % num_osds] = inc.epoch;
+      if (i % 10 == 0) {
+	vector<int32_t> v;
+	v.push_back(i % num_osds);
+	v.push_back((i + 1) % num_osds);
+	inc.new_pg_temp[pg_t(i, 0)] = v;
+      }
+      if (i % 50 == 25) {
+	entity_addr_t a;
+	a.nonce = 1000 + i;
+	inc.new_up_client[i % num_osds] = a;
+	inc.new_up_cluster[i % num_osds] = a;
+      }
+      incs.push_back(inc);
+    }
+  }
+
+  virtual void SetUp() {
+    set_up_map();
+    make_incrementals();
+  }
+};
+
+static size_t heap_in_use()
+{
+  struct mallinfo mi = mallinfo();
+  return mi.uordblks + mi.hblkhd;
+}
+
+TEST_F(OSDMapTest, ApplyIncrementalSharesUnchanged) {
+  OSDMap next;
+  next = osdmap;
+  next.apply_incremental(incs[0]);  // up_thru and a pg_temp
+
+  // the copy must not have disturbed the original
+  bufferlist a, b;
+  OSDMap reference;
+  bufferlist rbl;
+  osdmap.encode(rbl);
+  reference.decode(rbl);
+  reference.apply_incremental(incs[0]);
+  next.encode(a);
+  reference.encode(b);
+  EXPECT_TRUE(a.contents_equal(b));
+
+  // pg_temp changes must not leak into the map we copied
+  OSDMap next2;
+  next2 = next;
+  next2.apply_incremental(incs[1]);  // up_thru only
+  OSDMap next3;
+  next3 = next2;
+  OSDMap::Incremental inc(next3.get_epoch() + 1);
+  inc.fsid = next3.get_fsid();
+  vector<int32_t> v;
+  v.push_back(1);
+  v.push_back(2);
+  inc.new_pg_temp[pg_t(12345, 0)] = v;
+  next3.apply_incremental(inc);
+  vector<int> up, acting;
+  next2.pg_to_up_acting_osds(pg_t(12345, 0), up, acting);
+  EXPECT_TRUE(v != acting);
+  next3.pg_to_up_acting_osds(pg_t(12345, 0), up, acting);
+  EXPECT_TRUE(v == acting);
+
+  // neither must a restarting osd
+  OSDMap::Incremental inc2(next3.get_epoch() + 1);
+  inc2.fsid = next3.get_fsid();
+  entity_addr_t addr;
+  addr.nonce = 4242;
+  inc2.new_up_client[3] = addr;
+  OSDMap next4;
+  next4 = next3;
+  next4.apply_incremental(inc2);
+  EXPECT_TRUE(addr == next4.get_addr(3));
+  EXPECT_TRUE(addr != next3.get_addr(3));
+}
+
+/*
+ * not so much a test as numbers to look at: the heap used by
+ * num_epochs consecutive cached maps, built by decoding a full copy of
+ * the previous epoch vs copying it and applying the incremental
+ */
+TEST_F(OSDMapTest, CachedEpochsFootprint) {
+  size_t full_bytes, cow_bytes;
+  vector<bufferlist> full_encoded;
+  {
+    size_t before = heap_in_use();
+    vector<std::tr1::shared_ptr<OSDMap> > cache;
+    cache.push_back(std::tr1::shared_ptr<OSDMap>(new OSDMap));
+    bufferlist bl;
+    osdmap.encode(bl);
+    cache.back()->decode(bl);
+    for (int i = 0; i < num_epochs; ++i) {
+      OSDMap *o = new OSDMap;
+      bufferlist obl;
+      cache.back()->encode(obl);
+      o->decode(obl);
+      o->apply_incremental(incs[i]);
+      cache.push_back(std::tr1::shared_ptr<OSDMap>(o));
+    }
+    full_bytes = heap_in_use() - before;
+    for (unsigned i = 0; i < cache.size(); ++i) {
+      full_encoded.push_back(bufferlist());
+      cache[i]->encode(full_encoded.back());
+    }
+  }
+  {
+    size_t before = heap_in_use();
+    vector<std::tr1::shared_ptr<OSDMap> > cache;
+    cache.push_back(std::tr1::shared_ptr<OSDMap>(new OSDMap));
+    bufferlist bl;
+    osdmap.encode(bl);
+    cache.back()->decode(bl);
+    for (int i = 0; i < num_epochs; ++i) {
+      OSDMap *o = new OSDMap;
+      *o = *cache.back();
+      o->apply_incremental(incs[i]);
+      cache.push_back(std::tr1::shared_ptr<OSDMap>(o));
+    }
+    cow_bytes = heap_in_use() - before;
+
+    // same maps either way
+    for (unsigned i = 0; i < cache.size(); ++i) {
+      bufferlist cbl;
+      cache[i]->encode(cbl);
+      EXPECT_TRUE(cbl.contents_equal(full_encoded[i]));
+    }
+  }
+  std::cout << num_epochs << " cached epochs of " << num_osds << " osds: "
+	    << full_bytes / 1024 << " KB with full copies, "
+	    << cow_bytes / 1024 << " KB with shared sub-structures"
+	    << std::endl;
+  if (full_bytes && cow_bytes)  // not every allocator reports through mallinfo
+    EXPECT_LT(cow_bytes, full_bytes);
+}
+
+int main(int argc, char **argv) {
+  vector<const char*> args;
+  argv_to_vec(argc, (const char **)argv, args);
+
+  global_init(NULL, args, CEPH_ENTITY_TYPE_CLIENT, CODE_ENVIRONMENT_UTILITY, 0);
+  common_init_finish(g_ceph_context);
+
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
+
+// Local Variables:
+// compile-command: "cd ../.. ; make -j4 && make unittest_osdmap && ./unittest_osdmap"
+// End:
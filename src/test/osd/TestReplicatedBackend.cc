@@ -0,0 +1,149 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include <sys/stat.h>
+#include "global/global_init.h"
+#include "common/ceph_argparse.h"
+#include "global/global_context.h"
+#include "os/MemStore.h"
+#include "osd/ReplicatedBackend.h"
+#include "gtest/gtest.h"
+
+static hobject_t oid(const char *name)
+{
+  return hobject_t(object_t(name), "", CEPH_NOSNAP, 0, 0, "");
+}
+
+static void add_modify(pg_log_t &log, const hobject_t &soid,
+		       eversion_t v, eversion_t pv,
+		       uint64_t off, uint64_t len, bool known = true)
+{
+  pg_log_entry_t e(pg_log_entry_t::MODIFY, soid, v, pv, 0,
+		   osd_reqid_t(), utime_t());
+  e.extents_known = known;
+  if (len)
+    e.modified_extents.insert(off, len);
+  log.log.push_back(e);
+  log.head = v;
+}
+
+TEST(ReplicatedBackend, delta_subset)
+{
+  pg_log_t log;
+  log.tail = eversion_t(1, 1);
+  hobject_t a = oid("a"), b = oid("b");
+  add_modify(log, a, eversion_t(1, 2), eversion_t(1, 1), 0, 4096);
+  add_modify(log, b, eversion_t(1, 3), eversion_t(1, 1), 0, 100);
+  add_modify(log, a, eversion_t(1, 4), eversion_t(1, 2), 8192, 4096);
+  add_modify(log, a, eversion_t(1, 5), eversion_t(1, 4), 1000, 10);
+
+  // everything a changed since 1'1
+  interval_set<uint64_t> d;
+  EXPECT_TRUE(ReplicatedBackend::calc_delta_subset(
+		log, a, eversion_t(1, 1), eversion_t(1, 5), (uint64_t)-1, d));
+  interval_set<uint64_t> want;
+  want.insert(0, 4096);
+  want.insert(8192, 4096);
+  EXPECT_EQ(want, d);
+
+  // only the last change since 1'4
+  d.clear();
+  EXPECT_TRUE(ReplicatedBackend::calc_delta_subset(
+		log, a, eversion_t(1, 4), eversion_t(1, 5), (uint64_t)-1, d));
+  want.clear();
+  want.insert(1000, 10);
+  EXPECT_EQ(want, d);
+
+  // clipped to the final size
+  d.clear();
+  EXPECT_TRUE(ReplicatedBackend::calc_delta_subset(
+		log, a, eversion_t(1, 1), eversion_t(1, 5), 10000, d));
+  want.clear();
+  want.insert(0, 4096);
+  want.insert(8192, 10000 - 8192);
+  EXPECT_EQ(want, d);
+}
+
+TEST(ReplicatedBackend, delta_subset_fallback)
+{
+  pg_log_t log;
+  log.tail = eversion_t(1, 5);
+  hobject_t a = oid("a");
+  add_modify(log, a, eversion_t(1, 6), eversion_t(1, 1), 0, 4096);
+  add_modify(log, a, eversion_t(1, 7), eversion_t(1, 6), 0, 0, false);
+  add_modify(log, a, eversion_t(1, 8), eversion_t(1, 7), 0, 4096);
+
+  interval_set<uint64_t> d;
+  // older than the log
+  EXPECT_FALSE(ReplicatedBackend::calc_delta_subset(
+		 log, a, eversion_t(1, 1), eversion_t(1, 8), (uint64_t)-1, d));
+  // an entry in between didn't record its extents
+  EXPECT_FALSE(ReplicatedBackend::calc_delta_subset(
+		 log, a, eversion_t(1, 6), eversion_t(1, 8), (uint64_t)-1, d));
+  // have isn't a version the log passes through
+  EXPECT_FALSE(ReplicatedBackend::calc_delta_subset(
+		 log, a, eversion_t(1, 5), eversion_t(1, 6), (uint64_t)-1, d));
+  EXPECT_TRUE(ReplicatedBackend::calc_delta_subset(
+		log, a, eversion_t(1, 7), eversion_t(1, 8), (uint64_t)-1, d));
+}
+
+TEST(ReplicatedBackend, have_delta_base)
+{
+  const char *path = "test_replicated_backend.tmp";
+  ::mkdir(path, 0755);
+  MemStore store(g_ceph_context, path);
+  ASSERT_EQ(0, store.mkfs());
+  ASSERT_EQ(0, store.mount());
+
+  coll_t coll("meta");
+  hobject_t a = oid("a");
+  object_info_t oi(a);
+  oi.version = eversion_t(1, 4);
+  bufferlist bv;
+  ::encode(oi, bv);
+  {
+    ObjectStore::Transaction t;
+    t.create_collection(coll);
+    ASSERT_EQ(0u, store.apply_transaction(t));
+  }
+
+  // missing: a delta has nothing to patch
+  EXPECT_FALSE(ReplicatedBackend::have_delta_base(&store, coll, a,
+						   eversion_t(1, 4)));
+  {
+    ObjectStore::Transaction t;
+    t.touch(coll, a);
+    t.setattr(coll, a, OI_ATTR, bv);
+    ASSERT_EQ(0u, store.apply_transaction(t));
+  }
+  EXPECT_TRUE(ReplicatedBackend::have_delta_base(&store, coll, a,
+						  eversion_t(1, 4)));
+  // at another version: it would patch the wrong data
+  EXPECT_FALSE(ReplicatedBackend::have_delta_base(&store, coll, a,
+						   eversion_t(1, 3)));
+  store.umount();
+}
+
+int main(int argc, char **argv) {
+  vector<const char*> args;
+  argv_to_vec(argc, (const char **)argv, args);
+
+  global_init(NULL, args, CEPH_ENTITY_TYPE_CLIENT, CODE_ENVIRONMENT_UTILITY, 0);
+  common_init_finish(g_ceph_context);
+
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
+
+// Local Variables:
+// compile-command: "cd ../.. ; make -j4 && make unittest_replicated_backend && ./unittest_replicated_backend"
+// End:
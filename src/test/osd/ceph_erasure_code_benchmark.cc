@@ -120,6 +120,14 @@ int ErasureCodeBench::run() {
     return decode();
 }
 
+void ErasureCodeBench::report(utime_t elapsed)
+{
+  double seconds = elapsed;
+  double gb = (double)max_iterations * in_size / (1024 * 1024 * 1024);
+  cout << elapsed << "\t" << (max_iterations * (in_size / 1024))
+       << "\t" << (seconds > 0 ? gb / seconds : 0) << endl;
+}
+
 int ErasureCodeBench::encode()
 {
   ErasureCodePluginRegistry &instance = ErasureCodePluginRegistry::instance();
@@ -127,13 +135,12 @@ int ErasureCodeBench::encode()
   int code = instance.factory(plugin, parameters, &erasure_code);
   if (code)
     return code;
-  int k = atoi(parameters["erasure-code-k"].c_str());
-  int m = atoi(parameters["erasure-code-m"].c_str());
+  int chunk_count = erasure_code->get_chunk_count();
 
   bufferlist in;
   in.append(string(in_size, 'X'));
   set<int> want_to_encode;
-  for (int i = 0; i < k + m; i++) {
+  for (int i = 0; i < chunk_count; i++) {
     want_to_encode.insert(i);
   }
   utime_t begin_time = ceph_clock_now(g_ceph_context);
@@ -144,7 +151,7 @@ int ErasureCodeBench::encode()
       return code;
   }
   utime_t end_time = ceph_clock_now(g_ceph_context);
-  cout << (end_time - begin_time) << "\t" << (max_iterations * (in_size / 1024)) << endl;
+  report(end_time - begin_time);
   return 0;
 }
 
@@ -155,14 +162,13 @@ int ErasureCodeBench::decode()
   int code = instance.factory(plugin, parameters, &erasure_code);
   if (code)
     return code;
-  int k = atoi(parameters["erasure-code-k"].c_str());
-  int m = atoi(parameters["erasure-code-m"].c_str());
+  int chunk_count = erasure_code->get_chunk_count();
 
   bufferlist in;
   in.append(string(in_size, 'X'));
 
   set<int> want_to_encode;
-  for (int i = 0; i < k + m; i++) {
+  for (int i = 0; i < chunk_count; i++) {
     want_to_encode.insert(i);
   }
 
@@ -179,7 +185,7 @@ int ErasureCodeBench::decode()
     for (int j = 0; j < erasures; j++) {
       int erasure;
       do {
-	erasure = rand() % ( k + m );
+	erasure = rand() % chunk_count;
       } while(chunks.count(erasure) == 0);
       chunks.erase(erasure);
     }
@@ -189,7 +195,7 @@ int ErasureCodeBench::decode()
       return code;
   }
   utime_t end_time = ceph_clock_now(g_ceph_context);
-  cout << (end_time - begin_time) << "\t" << (max_iterations * (in_size / 1024)) << endl;
+  report(end_time - begin_time);
   return 0;
 }
 
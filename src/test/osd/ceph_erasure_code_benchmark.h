@@ -18,6 +18,7 @@
 #define CEPH_ERASURE_CODE_BENCHMARK_H
 
 #include <string>
+#include "include/utime.h"
 
 using namespace std;
 
@@ -33,6 +34,8 @@ public:
   int run();
   int decode();
   int encode();
+  /// prints seconds, KB processed and GB/s
+  void report(utime_t elapsed);
 };
 
 #endif
@@ -195,3 +195,241 @@ TEST_F(ExplicitObjectHitSetTest, RejectsNoMatch) {
   }
   EXPECT_EQ(matches, 0);
 }
+
+class CountingHitSetTest : public testing::Test, public HitSetTestStrap {
+public:
+
+  CountingHitSetTest()
+    : HitSetTestStrap(new HitSet(new CountingHitSet(1024, 4, 1, 0))) {}
+
+  void rebuild(unsigned width, unsigned depth, unsigned halflife) {
+    CountingHitSet::Params *cparams =
+      new CountingHitSet::Params(width, depth, 1, halflife);
+    HitSet::Params param(cparams);
+    HitSet new_set(param);
+    *hitset = new_set;
+  }
+
+  CountingHitSet *get_hitset() { return static_cast<CountingHitSet*>(hitset->impl.get()); }
+};
+
+TEST_F(CountingHitSetTest, Params) {
+  CountingHitSet::Params params(1024, 3, 5, 100);
+  bufferlist bl;
+  params.encode(bl);
+  CountingHitSet::Params p2;
+  bufferlist::iterator iter = bl.begin();
+  p2.decode(iter);
+  EXPECT_EQ(1024u, p2.width);
+  EXPECT_EQ(3u, p2.depth);
+  EXPECT_EQ(5u, p2.seed);
+  EXPECT_EQ(100u, p2.halflife);
+}
+
+TEST_F(CountingHitSetTest, Construct) {
+  ASSERT_EQ(hitset->impl->get_type(), HitSet::TYPE_COUNTING);
+  rebuild(100, 2, 0);
+  ASSERT_EQ(hitset->impl->get_type(), HitSet::TYPE_COUNTING);
+}
+
+TEST_F(CountingHitSetTest, InsertsMatch) {
+  fill(50);
+  verify_fill(50);
+  unsigned unique = hitset->approx_unique_insert_count();
+  EXPECT_TRUE(unique >= 45 && unique <= 55);
+  EXPECT_FALSE(hitset->is_full());
+}
+
+TEST_F(CountingHitSetTest, Counts) {
+  hobject_t hot(object_t("hot"), "", 0, 1234, 0, "");
+  hobject_t warm(object_t("warm"), "", 0, 5678, 0, "");
+  fill(200);
+  for (unsigned i = 0; i < 50; ++i)
+    hitset->insert(hot);
+  for (unsigned i = 0; i < 5; ++i)
+    hitset->insert(warm);
+  // a count-min sketch never undercounts
+  EXPECT_LE(50u, hitset->count(hot));
+  EXPECT_LE(5u, hitset->count(warm));
+  EXPECT_GT(10u, hitset->count(warm));
+  EXPECT_EQ(255u, hitset->insert_count());
+
+  // and survives an encode/decode round trip
+  bufferlist bl;
+  ::encode(*hitset, bl);
+  HitSet h2;
+  bufferlist::iterator p = bl.begin();
+  ::decode(h2, p);
+  EXPECT_EQ(hitset->count(hot), h2.count(hot));
+  EXPECT_EQ(hitset->count(warm), h2.count(warm));
+}
+
+TEST_F(CountingHitSetTest, Decay) {
+  rebuild(1024, 4, 100);
+  hobject_t hot(object_t("hot"), "", 0, 1234, 0, "");
+  for (unsigned i = 0; i < 99; ++i)
+    hitset->insert(hot);
+  EXPECT_EQ(99u, hitset->count(hot));
+  hitset->insert(hot);   // 100th insert halves everything
+  EXPECT_EQ(50u, hitset->count(hot));
+  get_hitset()->decay();
+  EXPECT_EQ(25u, hitset->count(hot));
+}
+
+TEST_F(CountingHitSetTest, Saturates) {
+  rebuild(16, 1, 0);
+  hobject_t hot(object_t("hot"), "", 0, 1234, 0, "");
+  for (unsigned i = 0; i < 70000; ++i)
+    hitset->insert(hot);
+  EXPECT_EQ(0xffffu, hitset->count(hot));
+}
+
+TEST_F(CountingHitSetTest, RejectsNoMatch) {
+  rebuild(4096, 4, 0);
+  fill(100);
+  verify_fill(100);
+
+  char buf[50];
+  int matches = 0;
+  for (int i = 100; i < 200; ++i) {
+    sprintf(buf, "hitsettest_%d", i);
+    hobject_t obj(object_t(buf), "", 0, i, 0, "");
+    if (hitset->contains(obj))
+      ++matches;
+  }
+  EXPECT_LT(matches, 2);
+}
+
+static HitSetRef make_counting_set(const hobject_t& oid, unsigned hits)
+{
+  HitSetRef hs(new HitSet(new CountingHitSet(1024, 4, 1, 0)));
+  for (unsigned i = 0; i < hits; ++i)
+    hs->insert(oid);
+  return hs;
+}
+
+TEST(HitSetArchive, Count) {
+  hobject_t hot(object_t("hot"), "", 0, 1234, 0, "");
+  hobject_t cold(object_t("cold"), "", 0, 5678, 0, "");
+  HitSetArchive archive;
+  // oldest first: 40 hits, then 20, 16 and 8 in the newest
+  archive.add(100, make_counting_set(hot, 40));
+  archive.add(200, make_counting_set(hot, 20));
+  archive.add(300, make_counting_set(hot, 16));
+  archive.add(400, make_counting_set(hot, 8));
+  EXPECT_EQ(4u, archive.size());
+
+  EXPECT_EQ(84u, archive.get_count(hot, 4, 0));
+  // only the newest max_sets sets count
+  EXPECT_EQ(24u, archive.get_count(hot, 2, 0));
+  EXPECT_EQ(8u, archive.get_count(hot, 1, 0));
+  EXPECT_EQ(0u, archive.get_count(hot, 0, 0));
+  // halve every set: 8 + 16/2 + 20/4 + 40/8
+  EXPECT_EQ(26u, archive.get_count(hot, 4, 1));
+  // halve every other set: 8 + 16 + 20/2 + 40/2
+  EXPECT_EQ(54u, archive.get_count(hot, 4, 2));
+  EXPECT_EQ(0u, archive.get_count(cold, 4, 1));
+
+  archive.remove(400);
+  EXPECT_FALSE(archive.have(400));
+  EXPECT_EQ(16u, archive.get_count(hot, 1, 1));
+  archive.clear();
+  EXPECT_EQ(0u, archive.get_count(hot, 4, 0));
+}
+
+TEST(HitSetArchive, CountDecaysAway) {
+  hobject_t hot(object_t("hot"), "", 0, 1234, 0, "");
+  HitSetArchive archive;
+  for (time_t t = 1; t <= 20; ++t)
+    archive.add(t, make_counting_set(hot, 1000));
+  // sets 16 or more halflifes old no longer count at all
+  unsigned expect = 0;
+  for (unsigned age = 0; age < 16; ++age)
+    expect += 1000 >> age;
+  EXPECT_EQ(expect, archive.get_count(hot, 20, 1));
+}
+
+TEST(HitSetArchive, Temp) {
+  hobject_t hot(object_t("hot"), "", 0, 1234, 0, "");
+  HitSetArchive archive;
+  HitSetRef a(new HitSet(new ExplicitHashHitSet));
+  HitSetRef b(new HitSet(new ExplicitHashHitSet));
+  a->insert(hot);
+  archive.add(1, a);
+  archive.add(2, b);
+  // only in the set before the newest
+  EXPECT_EQ(500000, archive.get_temp(hot));
+  // a set that does not count hits contributes one
+  EXPECT_EQ(1u, archive.get_count(hot, 2, 0));
+}
+
+/*
+ * not so much tests as numbers to look at when tuning: how big each
+ * kind of set gets and how often it is wrong, for the same workload
+ */
+static void bench_hitset(const char *name, HitSet *hs, unsigned inserts)
+{
+  char buf[50];
+  // a skewed workload: object i is hit (inserts / 10) / (i + 1) times
+  unsigned objects = inserts / 10;
+  map<unsigned, unsigned> truth;
+  unsigned n = 0;
+  for (unsigned i = 0; n < inserts && i < objects; ++i) {
+    unsigned hits = MAX(1u, (inserts / 10) / (i + 1));
+    sprintf(buf, "bench_%u", i);
+    hobject_t obj(object_t(buf), "", 0, i * 2654435761u, 0, "");
+    for (unsigned j = 0; j < hits && n < inserts; ++j, ++n)
+      hs->insert(obj);
+    truth[i] = hits;
+  }
+
+  unsigned false_positives = 0;
+  for (unsigned i = 0; i < objects; ++i) {
+    sprintf(buf, "bench_miss_%u", i);
+    hobject_t obj(object_t(buf), "", 0, i * 2654435761u + 1, 0, "");
+    if (hs->contains(obj))
+      ++false_positives;
+  }
+
+  uint64_t overcount = 0;
+  for (map<unsigned, unsigned>::iterator p = truth.begin();
+       p != truth.end();
+       ++p) {
+    sprintf(buf, "bench_%u", p->first);
+    hobject_t obj(object_t(buf), "", 0, p->first * 2654435761u, 0, "");
+    unsigned c = hs->count(obj);
+    if (c > p->second)
+      overcount += c - p->second;
+  }
+
+  hs->seal();
+  bufferlist bl;
+  ::encode(*hs, bl);
+  std::cout << name << ": " << truth.size() << " objects, " << n
+	    << " inserts, encoded " << bl.length() << " bytes, "
+	    << false_positives << "/" << objects << " false positives, "
+	    << "avg overcount "
+	    << (truth.empty() ? 0.0 : (double)overcount / truth.size())
+	    << std::endl;
+  EXPECT_LT(false_positives, objects);
+}
+
+TEST(HitSetBench, MemoryAndFalsePositives) {
+  unsigned inserts = 100000;
+  {
+    HitSet hs(new ExplicitHashHitSet);
+    bench_hitset("explicit_hash", &hs, inserts);
+  }
+  {
+    HitSet hs(new BloomHitSet(inserts / 10, .01, 1));
+    bench_hitset("bloom(.01)", &hs, inserts);
+  }
+  {
+    HitSet hs(new CountingHitSet(inserts / 10, 4, 1, 0));
+    bench_hitset("counting(w=n)", &hs, inserts);
+  }
+  {
+    HitSet hs(new CountingHitSet(inserts / 10 * 4, 4, 1, 0));
+    bench_hitset("counting(w=4n)", &hs, inserts);
+  }
+}
@@ -0,0 +1,172 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+/*
+ * Several clients send fragmented messages (MSG_FRAG) at once to a
+ * server whose dispatch throttle holds only a few fragments.  Each
+ * message must still get through: a connection holding part of a
+ * message must never wait on the throttler for the rest of it.
+ */
+
+#include <unistd.h>
+#include <vector>
+
+#include "common/Clock.h"
+#include "common/Cond.h"
+#include "common/Mutex.h"
+#include "common/ceph_argparse.h"
+#include "common/config.h"
+#include "global/global_init.h"
+#include "global/global_context.h"
+#include "msg/Messenger.h"
+#include "gtest/gtest.h"
+
+static const unsigned frag_bytes = 64 << 10;
+static const unsigned data_len = 3 * frag_bytes + 4096;
+
+class MFragTest : public Message {
+public:
+  MFragTest() : Message(CEPH_MSG_PING) {}
+private:
+  ~MFragTest() {}
+public:
+  void decode_payload() {}
+  void encode_payload(uint64_t features) {}
+  const char *get_type_name() const { return "frag_test"; }
+};
+
+class Server : public Dispatcher {
+public:
+  Mutex lock;
+  Cond cond;
+  unsigned received;
+  unsigned bad;
+
+  Server()
+    : Dispatcher(g_ceph_context), lock("Server::lock"),
+      received(0), bad(0) {}
+
+  bool ms_dispatch(Message *m) {
+    bufferlist& bl = m->get_data();
+    bool ok = bl.length() == data_len;
+    for (unsigned i = 0; ok && i < data_len; i += 4096)
+      ok = bl[i] == (char)(i / 4096);
+    Mutex::Locker l(lock);
+    ++received;
+    if (!ok)
+      ++bad;
+    cond.Signal();
+    m->put();
+    return true;
+  }
+  bool ms_handle_reset(Connection *con) { return false; }
+  void ms_handle_remote_reset(Connection *con) {}
+  bool ms_verify_authorizer(Connection *con, int peer_type, int protocol,
+			    bufferlist& authorizer, bufferlist& authorizer_reply,
+			    bool& isvalid, CryptoKey& session_key) {
+    isvalid = true;
+    return true;
+  }
+};
+
+class Client : public Dispatcher {
+public:
+  Client() : Dispatcher(g_ceph_context) {}
+  bool ms_dispatch(Message *m) {
+    m->put();
+    return true;
+  }
+  bool ms_handle_reset(Connection *con) { return false; }
+  void ms_handle_remote_reset(Connection *con) {}
+};
+
+TEST(MsgrFrag, concurrent_senders)
+{
+  const unsigned num_clients = 4;
+  const unsigned per_client = 8;
+
+  // room for four fragments, shared by all the connections
+  g_ceph_context->_conf->set_val("ms_dispatch_throttle_bytes", "262144");
+  g_ceph_context->_conf->set_val("ms_tcp_frag_bytes", "65536");
+  g_ceph_context->_conf->apply_changes(NULL);
+
+  entity_addr_t bind_addr;
+  bind_addr.parse("127.0.0.1:0");
+
+  Server server;
+  Messenger *smsgr = Messenger::create(g_ceph_context, entity_name_t::OSD(0),
+				       "server", getpid());
+  smsgr->set_default_policy(Messenger::Policy::stateless_server(0, 0));
+  ASSERT_EQ(0, smsgr->bind(bind_addr));
+  smsgr->add_dispatcher_head(&server);
+  smsgr->start();
+
+  bufferptr bp = buffer::create_page_aligned(data_len);
+  for (unsigned i = 0; i < data_len; i += 4096)
+    bp.c_str()[i] = (char)(i / 4096);
+
+  Client client;
+  std::vector<Messenger*> cmsgrs;
+  for (unsigned i = 0; i < num_clients; ++i) {
+    Messenger *c = Messenger::create(g_ceph_context, entity_name_t::CLIENT(i),
+				     "client", getpid() + 1 + i);
+    c->set_default_policy(Messenger::Policy::lossless_client(0, 0));
+    c->add_dispatcher_head(&client);
+    c->start();
+    cmsgrs.push_back(c);
+  }
+  for (unsigned j = 0; j < per_client; ++j) {
+    for (unsigned i = 0; i < num_clients; ++i) {
+      Message *m = new MFragTest;
+      bufferlist bl;
+      bl.append(bp);
+      m->set_data(bl);
+      cmsgrs[i]->send_message(m, smsgr->get_myinst());
+    }
+  }
+
+  {
+    Mutex::Locker l(server.lock);
+    utime_t until = ceph_clock_now(g_ceph_context);
+    until += 60;
+    while (server.received < num_clients * per_client &&
+	   ceph_clock_now(g_ceph_context) < until)
+      server.cond.WaitUntil(server.lock, until);
+    // stuck connections would leave us short
+    ASSERT_EQ(num_clients * per_client, server.received);
+    EXPECT_EQ(0u, server.bad);
+  }
+
+  for (unsigned i = 0; i < num_clients; ++i) {
+    cmsgrs[i]->shutdown();
+    cmsgrs[i]->wait();
+    delete cmsgrs[i];
+  }
+  smsgr->shutdown();
+  smsgr->wait();
+  delete smsgr;
+}
+
+int main(int argc, char **argv) {
+  vector<const char*> args;
+  argv_to_vec(argc, (const char **)argv, args);
+
+  global_init(NULL, args, CEPH_ENTITY_TYPE_CLIENT, CODE_ENVIRONMENT_UTILITY, 0);
+  common_init_finish(g_ceph_context);
+
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
+
+// Local Variables:
+// compile-command: "cd .. ; make -j4 && make unittest_msgr_frag && ./unittest_msgr_frag"
+// End:
@@ -969,6 +969,52 @@ TEST(pg_missing_t, split_into)
   EXPECT_TRUE(missing.is_missing(oid2));
 }
 
+TEST(pg_log_entry_t, modified_extents)
+{
+  hobject_t oid(object_t("objname"), "key", 123, 456, 0, "");
+  pg_log_entry_t e(pg_log_entry_t::MODIFY, oid, eversion_t(1, 3),
+		   eversion_t(1, 2), 2, osd_reqid_t(), utime_t());
+  e.extents_known = true;
+  e.modified_extents.insert(0, 10);
+  e.modified_extents.insert(4096, 100);
+
+  bufferlist bl;
+  ::encode(e, bl);
+  pg_log_entry_t d;
+  bufferlist::iterator p = bl.begin();
+  ::decode(d, p);
+  EXPECT_TRUE(d.extents_known);
+  EXPECT_EQ(e.modified_extents, d.modified_extents);
+  EXPECT_EQ(e.prior_version, d.prior_version);
+
+  // entries written without extents decode as unknown
+  pg_log_entry_t u(pg_log_entry_t::MODIFY, oid, eversion_t(1, 4),
+		   eversion_t(1, 3), 3, osd_reqid_t(), utime_t());
+  bl.clear();
+  ::encode(u, bl);
+  p = bl.begin();
+  ::decode(d, p);
+  EXPECT_FALSE(d.extents_known);
+  EXPECT_TRUE(d.modified_extents.empty());
+}
+
+TEST(ObjectRecoveryInfo, delta_base)
+{
+  ObjectRecoveryInfo info;
+  info.soid = hobject_t(object_t("objname"), "key", CEPH_NOSNAP, 456, 0, "");
+  info.version = eversion_t(1, 3);
+  info.delta_base = eversion_t(1, 2);
+  info.copy_subset.insert(4096, 4096);
+
+  bufferlist bl;
+  ::encode(info, bl);
+  ObjectRecoveryInfo d;
+  bufferlist::iterator p = bl.begin();
+  ::decode(d, p);
+  EXPECT_EQ(info.delta_base, d.delta_base);
+  EXPECT_EQ(info.copy_subset, d.copy_subset);
+}
+
 class ObjectContextTest : public ::testing::Test {
 protected:
 
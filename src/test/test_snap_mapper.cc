@@ -542,6 +542,48 @@ public:
     snap_to_hobject.erase(snap);
   }
 
+  void trim_snap_batch() {
+    Mutex::Locker l(lock);
+    if (snap_to_hobject.empty())
+      return;
+    map<snapid_t, set<hobject_t> >::iterator snap =
+      rand_choose(snap_to_hobject);
+    set<hobject_t> hobjects = snap->second;
+    unsigned max = 1 + (rand() % 8);
+
+    vector<hobject_t> hoids;
+    while (mapper->get_next_objects_to_trim(snap->first, max, &hoids) == 0) {
+      assert(!hoids.empty());
+      assert(hoids.size() <= max);
+      PausyAsyncMap::Transaction t;
+      for (vector<hobject_t>::iterator i = hoids.begin();
+	   i != hoids.end();
+	   ++i) {
+	assert(hobjects.count(*i));
+	hobjects.erase(*i);
+
+	map<hobject_t, set<snapid_t> >::iterator j =
+	  hobject_to_snap.find(*i);
+	assert(j->second.count(snap->first));
+	set<snapid_t> old_snaps(j->second);
+	j->second.erase(snap->first);
+	mapper->update_snaps(
+	  *i,
+	  j->second,
+	  &old_snaps,
+	  &t);
+	if (j->second.empty()) {
+	  hobject_to_snap.erase(j);
+	}
+      }
+      driver->submit(&t);
+      hoids.clear();
+    }
+    assert(hobjects.empty());
+
+    snap_to_hobject.erase(snap);
+  }
+
   void remove_oid() {
     Mutex::Locker l(lock);
     if (hobject_to_snap.empty())
@@ -619,7 +661,7 @@ protected:
     for (int i = 0; i < 5000; ++i) {
       if (!(i % 50))
 	std::cout << i << std::endl;
-      switch (rand() % 5) {
+      switch (rand() % 6) {
       case 0:
 	get_tester().create_snap();
 	break;
@@ -635,6 +677,9 @@ protected:
       case 4:
 	get_tester().remove_oid();
 	break;
+      case 5:
+	get_tester().trim_snap_batch();
+	break;
       }
     }
   }
@@ -647,6 +692,14 @@ TEST_F(SnapMapperTest, Simple) {
   get_tester().trim_snap();
 }
 
+TEST_F(SnapMapperTest, Batch) {
+  init(1);
+  get_tester().create_snap();
+  for (int i = 0; i < 50; ++i)
+    get_tester().create_object();
+  get_tester().trim_snap_batch();
+}
+
 TEST_F(SnapMapperTest, More) {
   init(1);
   run();